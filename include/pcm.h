@@ -1087,6 +1087,33 @@ int snd_pcm_hw_params_dump(snd_pcm_hw_params_t *params, snd_output_t *out);
 int snd_pcm_sw_params_dump(snd_pcm_sw_params_t *params, snd_output_t *out);
 int snd_pcm_status_dump(snd_pcm_status_t *status, snd_output_t *out);
 
+/** PCM operations with profiling counters */
+typedef enum _snd_pcm_prof_op {
+	/** snd_pcm_mmap_commit() */
+	SND_PCM_PROF_MMAP_COMMIT = 0,
+	/** snd_pcm_avail_update() */
+	SND_PCM_PROF_AVAIL_UPDATE,
+	/** snd_pcm_writei() */
+	SND_PCM_PROF_WRITEI,
+	/** snd_pcm_readi() */
+	SND_PCM_PROF_READI,
+	SND_PCM_PROF_LAST = SND_PCM_PROF_READI
+} snd_pcm_prof_op_t;
+
+/** Profiling counters of one PCM operation */
+typedef struct _snd_pcm_prof_counters {
+	unsigned long long calls;	/**< number of calls */
+	unsigned long long frames;	/**< frames transferred */
+	unsigned long long nsecs;	/**< time spent including the slave PCMs (ns) */
+	unsigned long long self_nsecs;	/**< time spent in this PCM only (ns) */
+} snd_pcm_prof_counters_t;
+
+int snd_pcm_prof_enable(snd_pcm_t *pcm, int enable);
+int snd_pcm_prof_reset(snd_pcm_t *pcm);
+int snd_pcm_prof_get(snd_pcm_t *pcm, snd_pcm_prof_op_t op,
+		     snd_pcm_prof_counters_t *counters);
+const char *snd_pcm_prof_op_name(snd_pcm_prof_op_t op);
+
 /** \} */
 
 /**
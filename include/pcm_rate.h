@@ -38,7 +38,7 @@ extern "C" {
 /**
  * Protocol version
  */
-#define SND_PCM_RATE_PLUGIN_VERSION	0x010002
+#define SND_PCM_RATE_PLUGIN_VERSION	0x010003
 
 /** hw_params information for a single side */
 typedef struct snd_pcm_rate_side_info {
@@ -114,6 +114,21 @@ typedef struct snd_pcm_rate_ops {
 	 * new ops since version 0x010002
 	 */
 	void (*dump)(void *obj, snd_output_t *out);
+	/**
+	 * convert an s32 interleaved-data array; optional,
+	 * used in preference to convert and convert_s16 for
+	 * formats wider than 16 bits;
+	 * new ops since version 0x010003
+	 */
+	void (*convert_s32)(void *obj, int32_t *dst, unsigned int dst_frames,
+			    const int32_t *src, unsigned int src_frames);
+	/**
+	 * convert a float interleaved-data array; optional,
+	 * the rate plugin accepts the FLOAT format only when it is set;
+	 * new ops since version 0x010003
+	 */
+	void (*convert_float)(void *obj, float *dst, unsigned int dst_frames,
+			      const float *src, unsigned int src_frames);
 } snd_pcm_rate_ops_t;
 
 /** open function type */
@@ -515,6 +515,50 @@ LIBASOUND_THREAD_SAFE=0 aplay foo.wav
 \endcode
 for making the debugging easier.
 
+\section pcm_profiling Profiling
+
+Each PCM handle can count the calls, transferred frames and the spent time
+of its #snd_pcm_mmap_commit(), #snd_pcm_avail_update(), #snd_pcm_writei()
+and #snd_pcm_readi() operations.  The counters are enabled per handle with
+#snd_pcm_prof_enable() and read with #snd_pcm_prof_get().  The time is
+reported both including the slave PCMs and for the PCM itself (self time),
+so the layer which burns the CPU in a plugin chain can be identified.
+
+Passing 1 to the environment variable LIBASOUND_PCM_PROFILE enables the
+counters for all PCMs opened by the process, including the slaves of the
+plugins.  The counters of each layer are then shown in the #snd_pcm_dump()
+output, e.g.
+\code
+LIBASOUND_PCM_PROFILE=1 aplay -v foo.wav
+\endcode
+When profiling is disabled, the cost is a single pointer check per call.
+
+\section pcm_refine_cache Refine cache
+
+The results of #snd_pcm_hw_refine() can be memoized per PCM handle, keyed
+by the complete input configuration space, so that repeated refines of the
+same space (as done by #snd_pcm_set_params() and the plugin chains) do not
+walk the whole plugin chain and call into the driver again.  The cache is
+dropped whenever the handle is configured, its software parameters are set
+or it is freed.
+
+Some drivers constrain a stream depending on the state of the other
+streams of the card, so a cached result may be stale.  The cache is hence
+off by default and enabled with the environment variable
+LIBASOUND_HW_REFINE_CACHE: 1 keeps the results of the plugin handles in
+memory, and 2 additionally stores the driver results of the hw plugin in
+$XDG_CACHE_HOME/alsa (~/.cache/alsa by default), so they are reused by
+later processes.  These files are tagged with the card id, driver name and
+protocol version and are discarded when any of them changes.  Use them
+only for devices whose constraints do not depend on other streams.
+
+Only handles opened from the configuration whose whole chain is known to
+refine the same way every time are cached.  With 1, a chain ending in a hw
+handle is therefore not cached at all (the driver is always asked); with
+2, the hw handle counts as stable and the plugins above it are cached in
+memory.  Chains containing plugins with several slaves, external plugins
+or the direct plugins (dmix, dsnoop, dshare) are never cached.
+
 \section pcm_dev_names PCM naming conventions
 
 The ALSA library uses a generic string representation for names of devices.
@@ -668,6 +712,7 @@ playback devices.
 #include <sys/mman.h>
 #include <limits.h>
 #include "pcm_local.h"
+#include "pcm_simd.h"
 
 #ifndef DOC_HIDDEN
 /* return specific error codes for known bad PCM states */
@@ -967,6 +1012,8 @@ int snd_pcm_hw_free(snd_pcm_t *pcm)
 	else
 		err = -ENOSYS;
 	pcm->setup = 0;
+	snd_pcm_resolve_fast_ops(pcm);
+	snd_pcm_refine_cache_flush(pcm->refine_cache);
 	if (err < 0)
 		return err;
 	return 0;
@@ -1024,6 +1071,10 @@ int snd_pcm_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
 	pcm->silence_threshold = params->silence_threshold;
 	pcm->silence_size = params->silence_size;
 	pcm->boundary = params->boundary;
+	/* the slave may have switched its fast ops (e.g. period event) */
+	snd_pcm_resolve_fast_ops(pcm);
+	/* sw_params of a slave (e.g. the tstamp type) may change its refine */
+	snd_pcm_refine_cache_flush(pcm->refine_cache);
 	__snd_pcm_unlock(pcm->op_arg);
 	return 0;
 }
@@ -1699,7 +1750,7 @@ int snd_pcm_link(snd_pcm_t *pcm1, snd_pcm_t *pcm2)
 	assert(pcm1);
 	assert(pcm2);
 	if (pcm1->fast_ops->link)
-		err = pcm1->fast_ops->link(pcm1, pcm2);
+		err = pcm1->fast_ops->link(pcm1->fast_op_arg, pcm2);
 	else
 		err = -ENOSYS;
 	return err;
@@ -1716,7 +1767,7 @@ int snd_pcm_unlink(snd_pcm_t *pcm)
 
 	assert(pcm);
 	if (pcm->fast_ops->unlink)
-		err = pcm->fast_ops->unlink(pcm);
+		err = pcm->fast_ops->unlink(pcm->fast_op_arg);
 	else
 		err = -ENOSYS;
 	return err;
@@ -2358,6 +2409,74 @@ int snd_pcm_status_dump(snd_pcm_status_t *status, snd_output_t *out)
 	return 0;
 }
 
+#ifndef DOC_HIDDEN
+#ifdef HAVE___THREAD
+#define PROF_TLS_PFX	__thread
+#else
+#define PROF_TLS_PFX	/* NOP */
+#endif
+
+/* time spent in nested profiled calls of the current thread */
+static PROF_TLS_PFX unsigned long long prof_child_nsecs;
+
+static const char *const snd_pcm_prof_op_names[] = {
+	[SND_PCM_PROF_MMAP_COMMIT] = "mmap_commit",
+	[SND_PCM_PROF_AVAIL_UPDATE] = "avail_update",
+	[SND_PCM_PROF_WRITEI] = "writei",
+	[SND_PCM_PROF_READI] = "readi",
+};
+
+void snd_pcm_prof_begin(snd_pcm_prof_mark_t *mark)
+{
+	mark->child_nsecs = prof_child_nsecs;
+	prof_child_nsecs = 0;
+	clock_gettime(CLOCK_MONOTONIC, &mark->start);
+}
+
+void snd_pcm_prof_end(snd_pcm_t *pcm, snd_pcm_prof_op_t op,
+		      snd_pcm_prof_mark_t *mark, snd_pcm_sframes_t frames)
+{
+	snd_pcm_prof_counters_t *cnt = &pcm->prof->op[op];
+	struct timespec now;
+	unsigned long long nsecs;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nsecs = (now.tv_sec - mark->start.tv_sec) * 1000000000ULL +
+		now.tv_nsec - mark->start.tv_nsec;
+	cnt->calls++;
+	if (frames > 0)
+		cnt->frames += frames;
+	cnt->nsecs += nsecs;
+	if (nsecs > prof_child_nsecs)
+		cnt->self_nsecs += nsecs - prof_child_nsecs;
+	/* the whole call counts as child time for the caller */
+	prof_child_nsecs = mark->child_nsecs + nsecs;
+}
+
+static void snd_pcm_prof_dump(snd_pcm_t *pcm, snd_output_t *out)
+{
+	unsigned int op;
+
+	snd_output_printf(out, "Profile of %s PCM %s:\n",
+			  snd_pcm_type_name(snd_pcm_type(pcm)),
+			  pcm->name ? pcm->name : "(unnamed)");
+	for (op = 0; op <= SND_PCM_PROF_LAST; op++) {
+		const snd_pcm_prof_counters_t *cnt = &pcm->prof->op[op];
+
+		if (!cnt->calls)
+			continue;
+		snd_output_printf(out, "  %-12s: calls %llu, frames %llu, "
+				  "time %llu ns, self %llu ns",
+				  snd_pcm_prof_op_names[op], cnt->calls,
+				  cnt->frames, cnt->nsecs, cnt->self_nsecs);
+		if (cnt->frames)
+			snd_output_printf(out, " (%.1f ns/frame)",
+					  (double)cnt->self_nsecs / cnt->frames);
+		snd_output_printf(out, "\n");
+	}
+}
+#endif /* DOC_HIDDEN */
+
 /**
  * \brief Dump PCM info
  * \param pcm PCM handle
@@ -2374,9 +2493,88 @@ int snd_pcm_dump(snd_pcm_t *pcm, snd_output_t *out)
 		pcm->ops->dump(pcm->op_arg, out);
 	else
 		err = -ENOSYS;
+	if (pcm->prof)
+		snd_pcm_prof_dump(pcm, out);
 	return err;
 }
 
+/**
+ * \brief Enable or disable the profiling counters of a PCM
+ * \param pcm PCM handle
+ * \param enable 0 = disable and free the counters, 1 = enable
+ * \return 0 on success otherwise a negative error code
+ *
+ * The counters collect the number of calls, transferred frames and
+ * the time spent in #snd_pcm_mmap_commit(), #snd_pcm_avail_update(),
+ * #snd_pcm_writei() and #snd_pcm_readi() of the given PCM handle.
+ * Enabled counters are also shown in the #snd_pcm_dump() output.
+ *
+ * Only the given handle is affected.  For profiling whole plugin
+ * chains, set the environment variable LIBASOUND_PCM_PROFILE=1 so that
+ * the counters are enabled for all PCMs (including slaves) at open time.
+ */
+int snd_pcm_prof_enable(snd_pcm_t *pcm, int enable)
+{
+	assert(pcm);
+	if (!enable) {
+		free(pcm->prof);
+		pcm->prof = NULL;
+		return 0;
+	}
+	if (pcm->prof)
+		return 0;
+	pcm->prof = calloc(1, sizeof(*pcm->prof));
+	if (!pcm->prof)
+		return -ENOMEM;
+	return 0;
+}
+
+/**
+ * \brief Reset the profiling counters of a PCM
+ * \param pcm PCM handle
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_prof_reset(snd_pcm_t *pcm)
+{
+	assert(pcm);
+	if (!pcm->prof)
+		return -EBADFD;
+	memset(pcm->prof, 0, sizeof(*pcm->prof));
+	return 0;
+}
+
+/**
+ * \brief Get the profiling counters of a PCM operation
+ * \param pcm PCM handle
+ * \param op Profiled operation
+ * \param counters Returned counters
+ * \return 0 on success otherwise a negative error code
+ * \retval -EBADFD profiling is not enabled on the PCM
+ */
+int snd_pcm_prof_get(snd_pcm_t *pcm, snd_pcm_prof_op_t op,
+		     snd_pcm_prof_counters_t *counters)
+{
+	assert(pcm && counters);
+	if ((unsigned int)op > SND_PCM_PROF_LAST)
+		return -EINVAL;
+	if (!pcm->prof)
+		return -EBADFD;
+	*counters = pcm->prof->op[op];
+	return 0;
+}
+
+/**
+ * \brief get name of a profiled PCM operation
+ * \param op Profiled operation
+ * \return ascii name of the operation
+ */
+const char *snd_pcm_prof_op_name(snd_pcm_prof_op_t op)
+{
+	if ((unsigned int)op > SND_PCM_PROF_LAST)
+		return NULL;
+	return snd_pcm_prof_op_names[op];
+}
+
 /**
  * \brief Convert bytes in frames for a PCM
  * \param pcm PCM handle
@@ -2637,6 +2835,8 @@ static int snd_pcm_open_conf(snd_pcm_t **pcmp, const char *name,
 		err = snd_config_search(pcm_root, "defaults.pcm.minperiodtime", &tmp);
 		if (err >= 0)
 			snd_config_get_integer(tmp, &(*pcmp)->minperiodtime);
+		/* the slaves are complete and were checked already */
+		(*pcmp)->refine_cacheable = snd_pcm_refine_cacheable(*pcmp);
 		err = 0;
 	}
        _err:
@@ -2757,6 +2957,17 @@ int snd_pcm_new(snd_pcm_t **pcmp, snd_pcm_type_t type, const char *name,
 	pcm->op_arg = pcm;
 	pcm->fast_op_arg = pcm;
 	INIT_LIST_HEAD(&pcm->async_handlers);
+	{
+		/* enable profiling depending on $LIBASOUND_PCM_PROFILE */
+		static int do_prof_enable = -1; /* uninitialized */
+
+		if (do_prof_enable == -1) {
+			char *p = getenv("LIBASOUND_PCM_PROFILE");
+			do_prof_enable = p && *p && *p != '0';
+		}
+		if (do_prof_enable)
+			pcm->prof = calloc(1, sizeof(*pcm->prof));
+	}
 #ifdef THREAD_SAFE_API
 	pthread_mutexattr_init(&attr);
 #ifdef HAVE_PTHREAD_MUTEX_RECURSIVE
@@ -2797,10 +3008,39 @@ int snd_pcm_free(snd_pcm_t *pcm)
 #ifdef THREAD_SAFE_API
 	pthread_mutex_destroy(&pcm->lock);
 #endif
+	free(pcm->prof);
+	snd_pcm_refine_cache_free(pcm->refine_cache);
 	free(pcm);
 	return 0;
 }
 
+/*
+ * Pass-through layers (hooks) forward every fast op to their slave
+ * unchanged.  Once the PCM is set up, their fast ops are replaced with
+ * the ones of the slave, which are already resolved the same way, so
+ * the hot path (avail_update, mmap_commit, delay, ...) goes straight to
+ * the deepest layer doing real work.  The other ops (close, dump,
+ * hw_params, ...) are still handled by the layer itself.
+ */
+void snd_pcm_set_fast_slave(snd_pcm_t *pcm, snd_pcm_t *slave)
+{
+	pcm->fast_slave = slave;
+	pcm->own_fast_ops = pcm->fast_ops;
+}
+
+void snd_pcm_resolve_fast_ops(snd_pcm_t *pcm)
+{
+	if (!pcm->fast_slave)
+		return;
+	if (pcm->setup && pcm->fast_slave->setup) {
+		pcm->fast_ops = pcm->fast_slave->fast_ops;
+		pcm->fast_op_arg = pcm->fast_slave->fast_op_arg;
+	} else {
+		pcm->fast_ops = pcm->own_fast_ops;
+		pcm->fast_op_arg = pcm;
+	}
+}
+
 int snd_pcm_open_named_slave(snd_pcm_t **pcmp, const char *name,
 			     snd_config_t *root,
 			     snd_config_t *conf, snd_pcm_stream_t stream,
@@ -3056,13 +3296,11 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
             width != 24 &&
             ((intptr_t)dst & 7) == 0) {
 		unsigned int dwords = samples * width / 64;
-		uint64_t *dstp = (uint64_t *)dst;
+		snd_pcm_simd_fill64(dst, silence, (size_t)dwords * 8);
 		samples -= dwords * 64 / width;
-		while (dwords-- > 0)
-			*dstp++ = silence;
 		if (samples == 0)
 			return 0;
-		dst = (char *)dstp;
+		dst += (size_t)dwords * 8;
 	}
 	dst_step = dst_area->step / 8;
 	switch (width) {
@@ -3225,7 +3463,7 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 		samples -= bytes * 8 / width;
 		assert(src < dst || src >= dst + bytes);
 		assert(dst < src || dst >= src + bytes);
-		memcpy(dst, src, bytes);
+		snd_pcm_simd_copy(dst, src, bytes);
 		if (samples == 0)
 			return 0;
 	}
@@ -3311,6 +3549,71 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 	return 0;
 }
 
+#ifndef DOC_HIDDEN
+/* check whether areas describe one interleaved buffer */
+static int areas_interleaved(const snd_pcm_channel_area_t *areas,
+			     unsigned int channels, int width)
+{
+	unsigned int c;
+	if (!areas->addr || areas->first % 8 ||
+	    areas->step != channels * width)
+		return 0;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].step != areas->step ||
+		    areas[c].first != areas->first + c * width)
+			return 0;
+	}
+	return 1;
+}
+
+/* check whether areas describe separate non-interleaved buffers */
+static int areas_noninterleaved(const snd_pcm_channel_area_t *areas,
+				unsigned int channels, int width)
+{
+	unsigned int c;
+	for (c = 0; c < channels; c++) {
+		if (!areas[c].addr || areas[c].first % 8 ||
+		    areas[c].step != (unsigned int)width)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * interleave or deinterleave with the vectorized kernels,
+ * returns -EINVAL when the layout is not handled
+ */
+static int areas_copy_simd(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			   unsigned int channels, snd_pcm_uframes_t frames, int width)
+{
+	void *ptrs[8];
+	unsigned int c;
+
+	if (channels < 2 || channels > 8 || (channels & 1) ||
+	    (width != 16 && width != 24 && width != 32))
+		return -EINVAL;
+	if (areas_interleaved(dst_areas, channels, width) &&
+	    areas_noninterleaved(src_areas, channels, width)) {
+		for (c = 0; c < channels; c++)
+			ptrs[c] = snd_pcm_channel_area_addr(&src_areas[c], src_offset);
+		return snd_pcm_simd_interleave(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+					       (const void *const *)ptrs,
+					       channels, width / 8, frames);
+	}
+	if (areas_interleaved(src_areas, channels, width) &&
+	    areas_noninterleaved(dst_areas, channels, width)) {
+		for (c = 0; c < channels; c++)
+			ptrs[c] = snd_pcm_channel_area_addr(&dst_areas[c], dst_offset);
+		return snd_pcm_simd_deinterleave((void *const *)ptrs,
+						 snd_pcm_channel_area_addr(src_areas, src_offset),
+						 channels, width / 8, frames);
+	}
+	return -EINVAL;
+}
+#endif
+
 /**
  * \brief Copy one or more areas
  * \param dst_areas destination areas specification (one for each channel)
@@ -3337,6 +3640,9 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_
 		SNDMSG("invalid frames %ld", frames);
 		return -EINVAL;
 	}
+	if (areas_copy_simd(dst_areas, dst_offset, src_areas, src_offset,
+			    channels, frames, width) == 0)
+		return 0;
 	while (channels > 0) {
 		unsigned int step = src_areas->step;
 		void *src_addr = src_areas->addr;
@@ -7339,10 +7645,18 @@ snd_pcm_sframes_t __snd_pcm_mmap_commit(snd_pcm_t *pcm,
 		       snd_pcm_mmap_avail(pcm));
 		return -EPIPE;
 	}
-	if (pcm->fast_ops->mmap_commit)
-		return pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
-	else
+	if (!pcm->fast_ops->mmap_commit)
 		return -ENOSYS;
+	if (pcm->prof) {
+		snd_pcm_prof_mark_t mark;
+		snd_pcm_sframes_t result;
+
+		snd_pcm_prof_begin(&mark);
+		result = pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
+		snd_pcm_prof_end(pcm, SND_PCM_PROF_MMAP_COMMIT, &mark, result);
+		return result;
+	}
+	return pcm->fast_ops->mmap_commit(pcm->fast_op_arg, offset, frames);
 }
 
 int _snd_pcm_poll_descriptor(snd_pcm_t *pcm)
@@ -40,17 +40,6 @@
 #include <sys/mman.h>
 #include "pcm_direct.h"
 
-/*
- *
- */
- 
-union semun {
-	int              val;    /* Value for SETVAL */
-	struct semid_ds *buf;    /* Buffer for IPC_STAT, IPC_SET */
-	unsigned short  *array;  /* Array for GETALL, SETALL */
-	struct seminfo  *__buf;  /* Buffer for IPC_INFO (Linux specific) */
-};
- 
 /*
  * FIXME:
  *  add possibility to use futexes here
@@ -82,12 +71,94 @@ int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix)
 	return 0;
 }
 
+/*
+ * The first client sets up the mixing lock, the others check that they
+ * can share it: pthread_mutex_t differs between 32-bit and 64-bit
+ * processes, so the mutex is only set up when asked for and when the
+ * mixing mode takes the lock at all.
+ */
+int snd_pcm_direct_mix_lock_init(snd_pcm_direct_t *dmix, int first_instance,
+				 int lock_type)
+{
+#ifdef DIRECT_MUTEX
+	pthread_mutexattr_t attr;
+	int err;
+#endif
+
+	if (!first_instance) {
+		if (dmix->shmptr->lock_type != DIRECT_LOCK_MUTEX)
+			return 0;
+#ifdef DIRECT_MUTEX
+		if (dmix->shmptr->lock_size == sizeof(pthread_mutex_t))
+			return 0;
+#endif
+		SNDERR("the mixing lock cannot be shared with this process, use ipc_lock sysv");
+		return -EINVAL;
+	}
+	dmix->shmptr->lock_type = DIRECT_LOCK_SYSV;
+	dmix->shmptr->lock_size = 0;
+	if (lock_type != DIRECT_LOCK_MUTEX)
+		return 0;
+#ifdef DIRECT_MUTEX
+	err = pthread_mutexattr_init(&attr);
+	if (err)
+		return -err;
+	err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (!err)
+		err = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (!err)
+		err = pthread_mutex_init(&dmix->shmptr->hot.mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (err) {
+		SNDERR("unable to initialize the mixing lock, using the semaphore");
+		return 0;
+	}
+	dmix->shmptr->lock_type = DIRECT_LOCK_MUTEX;
+	dmix->shmptr->lock_size = sizeof(pthread_mutex_t);
+#endif
+	return 0;
+}
+
+/*
+ * A client killed while mixing leaves the mutex to the next one, as
+ * SEM_UNDO does for the semaphore; the kernel marks it through the
+ * robust list of the dead owner, whichever pid namespace it was in.
+ */
+int snd_pcm_direct_mutex_lock(snd_pcm_direct_t *dmix)
+{
+#ifdef DIRECT_MUTEX
+	int err = pthread_mutex_lock(&dmix->shmptr->hot.mutex);
+
+	if (err == EOWNERDEAD)
+		err = pthread_mutex_consistent(&dmix->shmptr->hot.mutex);
+	return -err;
+#else
+	return snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+#endif
+}
+
+int snd_pcm_direct_mutex_unlock(snd_pcm_direct_t *dmix)
+{
+#ifdef DIRECT_MUTEX
+	return -pthread_mutex_unlock(&dmix->shmptr->hot.mutex);
+#else
+	return snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
+#endif
+}
+
 static unsigned int snd_pcm_direct_magic(snd_pcm_direct_t *dmix)
 {
+	/*
+	 * The size alone does not catch a new field in the union, so the
+	 * version is part of the magic: clients of another layout never
+	 * attach to the segment.
+	 */
+	unsigned int magic = (DIRECT_SHM_VERSION << 16) + sizeof(snd_pcm_direct_share_t);
+
 	if (!dmix->direct_memory_access)
-		return 0xa15ad300 + sizeof(snd_pcm_direct_share_t);
+		return 0xa15ad300 + magic;
 	else
-		return 0xb15ad300 + sizeof(snd_pcm_direct_share_t);
+		return 0xb15ad300 + magic;
 }
 
 /*
@@ -139,9 +210,13 @@ retryget:
 			shmctl(dmix->shmid, IPC_SET, &buf);
 		}
 		dmix->shmptr->magic = snd_pcm_direct_magic(dmix);
+		dmix->shmptr->version = DIRECT_SHM_VERSION;
 		return 1;
 	} else {
-		if (dmix->shmptr->magic != snd_pcm_direct_magic(dmix)) {
+		if (dmix->shmptr->magic != snd_pcm_direct_magic(dmix) ||
+		    dmix->shmptr->version != DIRECT_SHM_VERSION) {
+			SNDERR("the shared memory of ipc_key 0x%x has a different layout (version %u, expected %u), used by another alsa-lib version?",
+			       dmix->ipc_key, dmix->shmptr->version, DIRECT_SHM_VERSION);
 			snd_pcm_direct_shm_discard(dmix);
 			return -EINVAL;
 		}
@@ -578,9 +653,11 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 		SNDERR("SEMDOWN FAILED with err %d", semerr);
 		return semerr;
 	}
+	snd_pcm_direct_mix_lock_nested(direct);
 
 	if (snd_pcm_state(direct->spcm) != SND_PCM_STATE_XRUN) {
 		/* ignore... someone else already did recovery */
+		snd_pcm_direct_mix_unlock_nested(direct);
 		semerr = snd_pcm_direct_semaphore_up(direct,
 						     DIRECT_IPC_SEM_CLIENT);
 		if (semerr < 0) {
@@ -593,6 +670,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	ret = snd_pcm_prepare(direct->spcm);
 	if (ret < 0) {
 		SNDERR("recover: unable to prepare slave");
+		snd_pcm_direct_mix_unlock_nested(direct);
 		semerr = snd_pcm_direct_semaphore_up(direct,
 						     DIRECT_IPC_SEM_CLIENT);
 		if (semerr < 0) {
@@ -613,6 +691,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	ret = snd_pcm_start(direct->spcm);
 	if (ret < 0) {
 		SNDERR("recover: unable to start slave");
+		snd_pcm_direct_mix_unlock_nested(direct);
 		semerr = snd_pcm_direct_semaphore_up(direct,
 						     DIRECT_IPC_SEM_CLIENT);
 		if (semerr < 0) {
@@ -622,6 +701,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 		return ret;
 	}
 	direct->shmptr->s.recoveries++;
+	snd_pcm_direct_mix_unlock_nested(direct);
 	semerr = snd_pcm_direct_semaphore_up(direct,
 						 DIRECT_IPC_SEM_CLIENT);
 	if (semerr < 0) {
@@ -1076,6 +1156,7 @@ int snd_pcm_direct_resume(snd_pcm_t *pcm)
 	snd_pcm_t *spcm = dmix->spcm;
 
 	snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+	snd_pcm_direct_mix_lock_nested(dmix);
 	/* some buggy drivers require the device resumed before prepared;
 	 * when a device has RESUME flag and is in SUSPENDED state, resume
 	 * here but immediately drop to bring it to a sane active state.
@@ -1092,6 +1173,7 @@ int snd_pcm_direct_resume(snd_pcm_t *pcm)
 		snd_pcm_prepare(spcm);
 		snd_pcm_start(spcm);
 	}
+	snd_pcm_direct_mix_unlock_nested(dmix);
 	snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
 	return -ENOSYS;
 }
@@ -1905,6 +1987,12 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 #endif
 	rec->hw_ptr_alignment = SND_PCM_HW_PTR_ALIGNMENT_AUTO;
 	rec->tstamp_type = -1;
+	rec->ipc_lock = DIRECT_LOCK_SYSV;
+	rec->mix_thread = 0;
+	rec->mix_thread_clients = 32;
+	rec->client_gain = 1.0;
+	rec->sum_float = 0;
+	rec->mix_simd = 0;
 
 	/* read defaults */
 	if (snd_config_search(root, "defaults.pcm.dmix_max_periods", &n) >= 0) {
@@ -1968,6 +2056,25 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 
 			continue;
 		}
+		if (strcmp(id, "ipc_lock") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(str, "sysv") == 0)
+				rec->ipc_lock = DIRECT_LOCK_SYSV;
+#ifdef DIRECT_MUTEX
+			else if (strcmp(str, "mutex") == 0)
+				rec->ipc_lock = DIRECT_LOCK_MUTEX;
+#endif
+			else {
+				SNDERR("The field ipc_lock is invalid : %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "tstamp_type") == 0) {
 			const char *str;
 			err = snd_config_get_string(n, &str);
@@ -2068,6 +2175,47 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->direct_memory_access = err;
 			continue;
 		}
+		if (strcmp(id, "mix_thread") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->mix_thread = err;
+			continue;
+		}
+		if (strcmp(id, "mix_thread_clients") == 0) {
+			long val;
+			err = snd_config_get_integer(n, &val);
+			if (err < 0)
+				return err;
+			if (val < 1 || val > 1024) {
+				SNDERR("Invalid mix_thread_clients value %ld", val);
+				return -EINVAL;
+			}
+			rec->mix_thread_clients = val;
+			continue;
+		}
+		if (strcmp(id, "sum_float") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->sum_float = err;
+			continue;
+		}
+		if (strcmp(id, "mix_simd") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->mix_simd = err;
+			continue;
+		}
+		if (strcmp(id, "client_gain") == 0) {
+			err = snd_config_get_ireal(n, &rec->client_gain);
+			if (err < 0 || rec->client_gain < 0 || rec->client_gain > 16) {
+				SNDERR("Invalid client_gain value");
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
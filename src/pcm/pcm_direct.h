@@ -21,15 +21,34 @@
 
 #include "pcm_local.h"  
 #include "../timer/timer_local.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #define DIRECT_IPC_SEMS         1
 #define DIRECT_IPC_SEM_CLIENT   0
+/* layout and meaning of snd_pcm_direct_share_t, bump on any change */
+#define DIRECT_SHM_VERSION	7
+/* lock of the mixing (snd_pcm_direct_share_t lock_type) */
+#define DIRECT_LOCK_SYSV	0	/* DIRECT_IPC_SEM_CLIENT */
+#define DIRECT_LOCK_MUTEX	1	/* robust mutex in the shared memory */
+#ifdef HAVE_LIBPTHREAD
+#define DIRECT_MUTEX
+#endif
+#define DIRECT_CACHE_LINE	64
 /* Seconds representing in Milli seconds */
 #define SEC_TO_MS               1000
 /* slave_period time for low latency requirements in ms */
 #define LOW_LATENCY_PERIOD_TIME 10
 
 
+union semun {
+	int              val;    /* Value for SETVAL */
+	struct semid_ds *buf;    /* Buffer for IPC_STAT, IPC_SET */
+	unsigned short  *array;  /* Array for GETALL, SETALL */
+	struct seminfo  *__buf;  /* Buffer for IPC_INFO (Linux specific) */
+};
+
 typedef void (mix_areas_t)(unsigned int size,
 			   volatile void *dst, void *src,
 			   volatile signed int *sum, size_t dst_step,
@@ -76,9 +95,12 @@ struct slave_params {
 /* shared among direct plugin clients - be careful to be 32/64bit compatible! */
 typedef struct {
 	unsigned int magic;			/* magic number */
+	unsigned int version;			/* DIRECT_SHM_VERSION */
 	char socket_name[256];			/* name of communication socket */
 	snd_pcm_type_t type;			/* PCM type (currently only hw) */
 	int use_server;
+	unsigned int lock_type;			/* DIRECT_LOCK_* */
+	unsigned int lock_size;			/* sizeof(pthread_mutex_t) of the creator */
 	struct {
 		unsigned int format;
 		snd_interval_t rate;
@@ -124,7 +146,25 @@ typedef struct {
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
+		struct {
+			unsigned int use_sem;	/* mixing under the mixing lock */
+			unsigned int mix_simd;	/* with the vector kernels */
+			unsigned int mix_thread; /* clients write rings, a thread mixes */
+			unsigned int sum_float;	/* the mixer thread sums in floats */
+		} dmix;
 	} u;
+	/*
+	 * Everything above is set up by the first client and only read
+	 * while streaming.  The fields written by every client while
+	 * mixing live on their own cache line, so the lock traffic does
+	 * not invalidate the setup data in the other clients' caches.
+	 */
+	union {
+#ifdef DIRECT_MUTEX
+		pthread_mutex_t mutex;		/* DIRECT_LOCK_MUTEX */
+#endif
+		char pad[DIRECT_CACHE_LINE];
+	} hot __attribute__((aligned(DIRECT_CACHE_LINE)));
 } snd_pcm_direct_share_t;
 
 typedef struct snd_pcm_direct snd_pcm_direct_t;
@@ -187,6 +227,13 @@ struct snd_pcm_direct {
 			mix_areas_24_t *remix_areas_24;
 			mix_areas_u8_t *remix_areas_u8;
 			unsigned int use_sem;
+			int shmid_ring;			/* IPC per-client rings (mix_thread mode) */
+			int semid_ring;			/* IPC owners of the rings */
+			struct snd_pcm_dmix_ring *ring;	/* attached rings, NULL = mixing in place */
+			unsigned int ring_slot;		/* our ring */
+			snd_pcm_uframes_t ring_lag;	/* frames queued behind the mixer */
+			snd_pcm_channel_area_t *ring_areas; /* our ring, slave layout */
+			struct snd_pcm_dmix_mixer *mixer; /* mixer thread run by this handle */
 		} dmix;
 		struct {
 			unsigned long long chn_mask;
@@ -198,6 +245,12 @@ struct snd_pcm_direct {
 /* make local functions really local */
 #define snd_pcm_direct_semaphore_create_or_connect \
 	snd1_pcm_direct_semaphore_create_or_connect
+#define snd_pcm_direct_mix_lock_init \
+	snd1_pcm_direct_mix_lock_init
+#define snd_pcm_direct_mutex_lock \
+	snd1_pcm_direct_mutex_lock
+#define snd_pcm_direct_mutex_unlock \
+	snd1_pcm_direct_mutex_unlock
 #define snd_pcm_direct_shm_create_or_connect \
 	snd1_pcm_direct_shm_create_or_connect
 #define snd_pcm_direct_shm_discard \
@@ -308,6 +361,47 @@ static inline int snd_pcm_direct_semaphore_final(snd_pcm_direct_t *dmix, int sem
 	return snd_pcm_direct_semaphore_up(dmix, sem_num);
 }
 
+int snd_pcm_direct_mix_lock_init(snd_pcm_direct_t *dmix, int first_instance,
+				 int lock_type);
+int snd_pcm_direct_mutex_lock(snd_pcm_direct_t *dmix);
+int snd_pcm_direct_mutex_unlock(snd_pcm_direct_t *dmix);
+
+/*
+ * The lock of the mixing: with DIRECT_LOCK_MUTEX a robust process-shared
+ * mutex, which needs no system call when uncontended and is released by
+ * the kernel when its owner dies.
+ */
+static inline int snd_pcm_direct_mix_lock(snd_pcm_direct_t *dmix)
+{
+	if (dmix->shmptr->lock_type != DIRECT_LOCK_MUTEX)
+		return snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+	return snd_pcm_direct_mutex_lock(dmix);
+}
+
+static inline int snd_pcm_direct_mix_unlock(snd_pcm_direct_t *dmix)
+{
+	if (dmix->shmptr->lock_type != DIRECT_LOCK_MUTEX)
+		return snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
+	return snd_pcm_direct_mutex_unlock(dmix);
+}
+
+/*
+ * The same for the paths which already hold DIRECT_IPC_SEM_CLIENT (open,
+ * close, slave recovery, resume): they take the mixing lock as well when
+ * it is a separate one, so they never run while a client mixes.
+ */
+static inline void snd_pcm_direct_mix_lock_nested(snd_pcm_direct_t *dmix)
+{
+	if (dmix->shmptr->lock_type == DIRECT_LOCK_MUTEX)
+		snd_pcm_direct_mutex_lock(dmix);
+}
+
+static inline void snd_pcm_direct_mix_unlock_nested(snd_pcm_direct_t *dmix)
+{
+	if (dmix->shmptr->lock_type == DIRECT_LOCK_MUTEX)
+		snd_pcm_direct_mutex_unlock(dmix);
+}
+
 int snd_pcm_direct_shm_create_or_connect(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_shm_discard(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_server_create(snd_pcm_direct_t *dmix);
@@ -360,6 +454,12 @@ struct snd_pcm_direct_open_conf {
 	int direct_memory_access;
 	snd_pcm_direct_hw_ptr_alignment_t hw_ptr_alignment;
 	int tstamp_type;
+	int ipc_lock;
+	int mix_thread;
+	unsigned int mix_thread_clients;
+	double client_gain;
+	int sum_float;
+	int mix_simd;
 	snd_config_t *slave;
 	snd_config_t *bindings;
 };
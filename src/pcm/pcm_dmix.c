@@ -34,6 +34,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <math.h>
 #include <grp.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
@@ -44,6 +45,13 @@
 #include <sys/un.h>
 #include <sys/mman.h>
 #include "pcm_direct.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -150,6 +158,9 @@ static void dmix_server_free(snd_pcm_direct_t *dmix)
 #define dmix_supported_format generic_dmix_supported_format
 #endif
 #endif
+#include "pcm_dmix_simd.c"
+#include "pcm_dmix_float.c"
+#include "pcm_dmix_ring.c"
 
 static void mix_areas(snd_pcm_direct_t *dmix,
 		      const snd_pcm_channel_area_t *src_areas,
@@ -289,19 +300,19 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 
 /*
  * if no concurrent access is allowed in the mixing routines, we need to protect
- * the area via semaphore
+ * the area via the mixing lock (a mutex in the shared memory by default)
  */
 #ifndef DOC_HIDDEN
 static void dmix_down_sem(snd_pcm_direct_t *dmix)
 {
 	if (dmix->u.dmix.use_sem)
-		snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+		snd_pcm_direct_mix_lock(dmix);
 }
 
 static void dmix_up_sem(snd_pcm_direct_t *dmix)
 {
 	if (dmix->u.dmix.use_sem)
-		snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
+		snd_pcm_direct_mix_unlock(dmix);
 }
 #endif
 
@@ -354,6 +365,12 @@ static void snd_pcm_dmix_sync_area(snd_pcm_t *pcm)
 	if (! size)
 		return;
 
+	/* the mixer thread does the rest */
+	if (dmix->u.dmix.ring) {
+		dmix_ring_write(pcm, size);
+		return;
+	}
+
 	/* add sample areas here */
 	src_areas = snd_pcm_mmap_areas(pcm);
 	dst_areas = snd_pcm_mmap_areas(dmix->spcm);
@@ -404,6 +421,14 @@ static int snd_pcm_dmix_sync_ptr0(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_ptr
 		slave_hw_ptr += dmix->slave_boundary;
 		diff = slave_hw_ptr - old_slave_hw_ptr;
 	}
+	if (dmix->u.dmix.ring_lag) {
+		/* a new run was queued behind the mixer, it starts later */
+		snd_pcm_uframes_t lag = dmix->u.dmix.ring_lag;
+		if (lag > (snd_pcm_uframes_t)diff)
+			lag = diff;
+		dmix->u.dmix.ring_lag -= lag;
+		diff -= lag;
+	}
 	dmix->hw_ptr += diff;
 	dmix->hw_ptr %= pcm->boundary;
 	if (pcm->stop_threshold >= pcm->boundary)	/* don't care */
@@ -445,6 +470,9 @@ static int snd_pcm_dmix_sync_ptr(snd_pcm_t *pcm)
 		return -EPIPE;
 	if (dmix->slowptr)
 		snd_pcm_hwsync(dmix->spcm);
+	/* take over the mixing when its thread is gone */
+	if (dmix->u.dmix.ring)
+		dmix_ring_check_mixer(dmix);
 
 	return snd_pcm_dmix_sync_ptr0(pcm, *dmix->spcm->hw.ptr);
 }
@@ -604,6 +632,7 @@ static int snd_pcm_dmix_drop(snd_pcm_t *pcm)
 		return -EBADFD;
 	dmix->state = SND_PCM_STATE_SETUP;
 	snd_pcm_direct_timer_stop(dmix);
+	dmix_ring_drop(dmix);
 	return 0;
 }
 
@@ -735,6 +764,13 @@ static snd_pcm_sframes_t snd_pcm_dmix_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t f
 	if (slave_size < size)
 		size = slave_size;
 
+	/* only the frames not mixed by the thread yet can be taken back */
+	if (dmix->u.dmix.ring) {
+		size = dmix_ring_rewind(pcm, size);
+		snd_pcm_mmap_appl_backward(pcm, size);
+		return result + size;
+	}
+
 	/* frames which should be remixed will be saved
 	 * to also backward the appl pointer on success
 	 */
@@ -809,7 +845,10 @@ static int snd_pcm_dmix_close(snd_pcm_t *pcm)
 	if (dmix->timer)
 		snd_timer_close(dmix->timer);
 	snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
+	snd_pcm_direct_mix_lock_nested(dmix);
+	dmix_ring_close(dmix);
 	snd_pcm_close(dmix->spcm);
+	snd_pcm_direct_mix_unlock_nested(dmix);
  	if (dmix->server)
  		snd_pcm_direct_server_discard(dmix);
  	if (dmix->client)
@@ -1026,6 +1065,8 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	dmix->tstamp_type = opts->tstamp_type;
 	dmix->semid = -1;
 	dmix->shmid = -1;
+	dmix->u.dmix.shmid_ring = -1;
+	dmix->u.dmix.semid_ring = -1;
 
 	ret = snd_pcm_new(&pcm, dmix->type = SND_PCM_TYPE_DMIX, name, stream, mode);
 	if (ret < 0)
@@ -1160,7 +1201,57 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		goto _err;
 	}
 
-	mix_select_callbacks(dmix);
+	/* the clients must agree on whether and how the mixing is locked;
+	 * the first one records whether it mixes under the lock, which is
+	 * also the case for the architectures and formats without the
+	 * lock-free code
+	 */
+	if (first_instance) {
+		dmix->shmptr->u.dmix.mix_simd =
+			opts->mix_simd && simd_mix_select_callbacks(dmix);
+		if (!dmix->shmptr->u.dmix.mix_simd)
+			mix_select_callbacks(dmix);
+		dmix->shmptr->u.dmix.use_sem = dmix->u.dmix.use_sem;
+	} else if (!dmix->shmptr->u.dmix.use_sem) {
+		mix_select_callbacks(dmix);
+	} else if (!dmix->shmptr->u.dmix.mix_simd ||
+		   !simd_mix_select_callbacks(dmix)) {
+		generic_mix_select_callbacks(dmix);
+	}
+	/* the lock-free mixing needs no mixing lock, so the mutex, which
+	 * 32-bit and 64-bit clients cannot share, is only set up when the
+	 * clients mix under the lock
+	 */
+	ret = snd_pcm_direct_mix_lock_init(dmix, first_instance,
+					   dmix->shmptr->u.dmix.use_sem ?
+					   opts->ipc_lock : DIRECT_LOCK_SYSV);
+	if (ret < 0)
+		goto _err;
+
+	/* so must they about the mixer thread and its sums */
+	if (first_instance) {
+		dmix->shmptr->u.dmix.mix_thread = 0;
+		dmix->shmptr->u.dmix.sum_float = 0;
+		if ((opts->mix_thread || opts->sum_float) &&
+		    !dmix_ring_supported(dmix)) {
+			SNDERR("%s is not supported for %s, mixing in place",
+			       opts->mix_thread ? "mix_thread" : "sum_float",
+			       snd_pcm_format_name(dmix->shmptr->s.format));
+		} else if (opts->mix_thread || opts->sum_float) {
+			/* the float sums are converted by the mixer thread */
+			dmix->shmptr->u.dmix.mix_thread = opts->mix_thread_clients;
+			dmix->shmptr->u.dmix.sum_float = opts->sum_float;
+		}
+	}
+	if (dmix->shmptr->u.dmix.mix_thread) {
+		snd_pcm_direct_mix_lock_nested(dmix);
+		ret = dmix_ring_open(dmix, opts);
+		snd_pcm_direct_mix_unlock_nested(dmix);
+		if (ret < 0) {
+			SNDERR("unable to initialize the client rings");
+			goto _err;
+		}
+	}
 		
 	pcm->poll_fd = dmix->poll_fd;
 	pcm->poll_events = POLLIN;	/* it's different than other plugins */
@@ -1184,6 +1275,7 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_direct_server_discard(dmix);
 	if (dmix->client)
 		snd_pcm_direct_client_discard(dmix);
+	dmix_ring_close(dmix);
 	if (spcm)
 		snd_pcm_close(spcm);
 	if (dmix->u.dmix.shmid_sum >= 0)
@@ -1211,12 +1303,47 @@ This plugin provides direct mixing of multiple streams. The resolution
 for 32-bit mixing is only 24-bit. The low significant byte is filled with
 zeros. The extra 8 bits are used for the saturation.
 
+With <code>mix_simd</code> set, S16_LE and S32_LE streams are mixed with
+SSE2 or AVX2 code on x86 CPUs, one client at a time under the mixing
+lock, instead of concurrently with the per-sample atomic operations.
+This pays off with many clients.  The first client selects the method
+for all clients of the device; LIBASOUND_SIMD=0 disables the vector code
+of a client, which then mixes with the generic code under the lock.
+
+The clients mixing under a lock take the IPC semaphore by default:
+those with <code>mix_simd</code>, and all clients on architectures or
+with formats for which no lock-free mixing code exists.
+<code>ipc_lock mutex</code> selects a robust process-shared mutex in the
+shared memory instead, which needs no system call when it is not
+contended; when its owner dies, the next client waiting for it takes it
+over.  The mutex cannot be shared between 32-bit and 64-bit processes,
+such clients are refused.  The lock-free mixing of the default mode on
+x86 takes no mixing lock and ignores the option.
+
+With <code>mix_thread</code> set, each client copies its S16 or S32
+(native endian) samples to its own ring in shared memory and a thread,
+run by one of the clients, mixes the rings into the hardware buffer two
+periods ahead of the hardware pointer.  The clients never wait for each
+other, at the cost of up to two periods of additional latency when a
+stream starts.  <code>mix_thread_clients</code> limits the number of
+simultaneous clients and <code>client_gain</code> scales the samples of
+the clients using this definition.  The first client decides the mode
+for all clients of the device.
+
+With <code>sum_float</code> set, which implies <code>mix_thread</code>,
+the mixer thread sums the rings in floats and converts each period to
+the slave format once, when it writes it to the hardware buffer.  The
+sum is not limited to the sample range, only the written samples are
+saturated.  The float adds serve both formats and use SSE2 or AVX2 on
+x86 CPUs.  S32 samples keep 24 bits of resolution in the float sums.
+
 \code
 pcm.name {
 	type dmix		# Direct mix
 	ipc_key INT		# unique IPC key
 	ipc_key_add_uid BOOL	# add current uid to unique IPC key
 	ipc_perm INT		# IPC permissions (octal, default 0600)
+	ipc_lock STR		# mixing lock: sysv (default) or mutex
 	hw_ptr_alignment STR	# Slave application and hw pointer alignment type
 				# STR can be one of the below strings :
 				# no
@@ -1247,6 +1374,11 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	sum_float BOOL		# float sums in the mixer thread (default no)
+	mix_simd BOOL		# x86 vector mixing under the lock (default no)
+	mix_thread BOOL		# mix in a thread (default no)
+	mix_thread_clients INT	# client rings for mix_thread (default 32)
+	client_gain REAL	# gain of the clients for mix_thread (default 1.0)
 }
 \endcode
 
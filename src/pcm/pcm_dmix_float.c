@@ -0,0 +1,214 @@
+/*
+ * Float sums of the mixer thread (sum_float)
+ *
+ * The mixer thread adds the samples of all client rings, scaled by the
+ * client gain, to one period of floats, and converts that to the slave
+ * format once, when the period is written to the hardware buffer.  The
+ * sum itself is never clipped, only the converted samples are saturated.
+ * The same adds serve S16 and S32, and they are done with SSE2 or AVX2
+ * when the CPU has them.  S16 sums stay exact up to 2^24, S32 samples
+ * keep the 24 bits of the float mantissa.
+ */
+
+/* the largest float below 2^31 */
+#define FLOAT_S32_MAX	2147483520.0f
+#define FLOAT_S32_MIN	-2147483648.0f
+
+#ifndef DOC_HIDDEN
+struct snd_pcm_dmix_float_ops {
+	void (*acc_16)(float *acc, const short *src, float gain, unsigned int size);
+	void (*acc_32)(float *acc, const int *src, float gain, unsigned int size);
+	void (*out_16)(short *dst, const float *acc, unsigned int size);
+	void (*out_32)(int *dst, const float *acc, unsigned int size);
+};
+#endif
+
+static void float_acc_16(float *acc, const short *src, float gain,
+			 unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		acc[i] += (float)src[i] * gain;
+}
+
+static void float_acc_32(float *acc, const int *src, float gain,
+			 unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		acc[i] += (float)src[i] * gain;
+}
+
+/* saturate and round size sums, dst_step bytes and acc_inc floats apart */
+static void float_out_16_step(char *dst, size_t dst_step, const float *acc,
+			      size_t acc_inc, unsigned int size)
+{
+	float s;
+
+	for (; size; size--, dst += dst_step, acc += acc_inc) {
+		s = *acc;
+		if (s > 32767.0f)
+			s = 32767.0f;
+		else if (s < -32768.0f)
+			s = -32768.0f;
+		*(short *)dst = lrintf(s);
+	}
+}
+
+static void float_out_32_step(char *dst, size_t dst_step, const float *acc,
+			      size_t acc_inc, unsigned int size)
+{
+	float s;
+
+	for (; size; size--, dst += dst_step, acc += acc_inc) {
+		s = *acc;
+		if (s > FLOAT_S32_MAX)
+			s = FLOAT_S32_MAX;
+		else if (s < FLOAT_S32_MIN)
+			s = FLOAT_S32_MIN;
+		*(int *)dst = lrintf(s);
+	}
+}
+
+static void float_out_16(short *dst, const float *acc, unsigned int size)
+{
+	float_out_16_step((char *)dst, sizeof(*dst), acc, 1, size);
+}
+
+static void float_out_32(int *dst, const float *acc, unsigned int size)
+{
+	float_out_32_step((char *)dst, sizeof(*dst), acc, 1, size);
+}
+
+#ifdef SND_PCM_SIMD_X86
+
+/* the vector code rounds like lrintf(), to nearest in the default mode */
+
+SND_PCM_SIMD_TARGET("sse2")
+static void float_acc_16_sse2(float *acc, const short *src, float gain,
+			      unsigned int size)
+{
+	const __m128 g = _mm_set1_ps(gain);
+	unsigned int i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i),
+						  _mm_mul_ps(lo, g)));
+		_mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4),
+						      _mm_mul_ps(hi, g)));
+	}
+	float_acc_16(acc + i, src + i, gain, size - i);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void float_acc_32_sse2(float *acc, const int *src, float gain,
+			      unsigned int size)
+{
+	const __m128 g = _mm_set1_ps(gain);
+	unsigned int i;
+
+	for (i = 0; i + 4 <= size; i += 4) {
+		__m128 x = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i)));
+
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i),
+						  _mm_mul_ps(x, g)));
+	}
+	float_acc_32(acc + i, src + i, gain, size - i);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void float_out_16_sse2(short *dst, const float *acc, unsigned int size)
+{
+	const __m128 max = _mm_set1_ps(32767.0f);
+	const __m128 min = _mm_set1_ps(-32768.0f);
+	unsigned int i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		__m128 lo = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(acc + i), max), min);
+		__m128 hi = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(acc + i + 4), max), min);
+
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+	}
+	float_out_16(dst + i, acc + i, size - i);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void float_out_32_sse2(int *dst, const float *acc, unsigned int size)
+{
+	const __m128 max = _mm_set1_ps(FLOAT_S32_MAX);
+	const __m128 min = _mm_set1_ps(FLOAT_S32_MIN);
+	unsigned int i;
+
+	for (i = 0; i + 4 <= size; i += 4) {
+		__m128 s = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(acc + i), max), min);
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(s));
+	}
+	float_out_32(dst + i, acc + i, size - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void float_acc_16_avx2(float *acc, const short *src, float gain,
+			      unsigned int size)
+{
+	const __m256 g = _mm256_set1_ps(gain);
+	unsigned int i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x));
+
+		_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i),
+							_mm256_mul_ps(s, g)));
+	}
+	float_acc_16(acc + i, src + i, gain, size - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void float_acc_32_avx2(float *acc, const int *src, float gain,
+			      unsigned int size)
+{
+	const __m256 g = _mm256_set1_ps(gain);
+	unsigned int i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(src + i)));
+
+		_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i),
+							_mm256_mul_ps(x, g)));
+	}
+	float_acc_32(acc + i, src + i, gain, size - i);
+}
+
+#endif /* SND_PCM_SIMD_X86 */
+
+static void float_mix_select_ops(struct snd_pcm_dmix_float_ops *ops)
+{
+#ifdef SND_PCM_SIMD_X86
+	unsigned int caps = snd_pcm_simd_caps();
+#endif
+
+	ops->acc_16 = float_acc_16;
+	ops->acc_32 = float_acc_32;
+	ops->out_16 = float_out_16;
+	ops->out_32 = float_out_32;
+#ifdef SND_PCM_SIMD_X86
+	if (caps & SND_PCM_SIMD_SSE2) {
+		ops->acc_16 = float_acc_16_sse2;
+		ops->acc_32 = float_acc_32_sse2;
+		ops->out_16 = float_out_16_sse2;
+		ops->out_32 = float_out_32_sse2;
+	}
+	if (caps & SND_PCM_SIMD_AVX2) {
+		ops->acc_16 = float_acc_16_avx2;
+		ops->acc_32 = float_acc_32_avx2;
+	}
+#endif
+}
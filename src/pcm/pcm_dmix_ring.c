@@ -0,0 +1,909 @@
+/*
+ * Per-client rings and the mixing thread (mix_thread mode)
+ *
+ * Instead of adding its samples to the hardware buffer, each client
+ * copies them to its own single-producer ring in a shared memory segment
+ * (ipc_key + 2).  One thread, run by one of the clients, sums the rings
+ * into the hardware buffer a couple of periods ahead of the hardware
+ * pointer.  The clients neither take the semaphore nor do atomic
+ * operations per sample, and a per-client gain is applied while mixing.
+ *
+ * A slot holds the frames [start, appl) in the slave boundary space, the
+ * frame at position p is stored at index p % buffer_size.  Only the owner
+ * moves start and appl; the mixer publishes how far it has mixed in
+ * mix_ptr and never looks at the frames before it again.  The client
+ * which finds no running mixer (or a dead one) starts the thread, so the
+ * mixing survives the exit of any single client.
+ *
+ * The mixer thread never uses the slave handle of the application: it
+ * asks the driver for the hardware pointer with its own SYNC_PTR on the
+ * slave file descriptor, as the pointer of the handle would only move
+ * with the syncs of its client when the status is not mmapped.
+ *
+ * The kernel tracks who owns what, no pid is ever checked: a slot is
+ * owned through its semaphore in the set ipc_key + 2, taken with
+ * SEM_UNDO and thus given back when the owning process exits, whichever
+ * thread closes the stream.  The mixer thread holds the robust mutex of
+ * the ring, which the next client takes over when that thread is gone.
+ */
+
+#if defined(HAVE_LIBPTHREAD) && defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && \
+    __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+#define DMIX_RING
+#endif
+
+#ifndef DOC_HIDDEN
+
+#define DMIX_RING_MAGIC		0x52584d44	/* "DMXR" */
+
+/* keep the layout 32/64bit compatible */
+struct snd_pcm_dmix_ring_slot {
+	volatile int used;			/* mixed; the semaphore tells the owner */
+	unsigned int gain;			/* 16.16 fixed point */
+	volatile unsigned long long start;	/* first valid frame */
+	volatile unsigned long long appl;	/* end of the valid frames */
+	char pad[40];
+};
+
+struct snd_pcm_dmix_ring {
+	unsigned int magic;
+	unsigned int slots;
+	unsigned int frame_bytes;
+	unsigned int buffer_size;
+	unsigned int lock_size;			/* sizeof(pthread_mutex_t) of the creator */
+	unsigned int pad0;
+	volatile unsigned long long mix_ptr;	/* mixed up to here */
+	char pad[32];
+	union {
+#ifdef DMIX_RING
+		pthread_mutex_t mutex;		/* robust, held by the mixer thread */
+#endif
+		char pad[64];
+	} mixer;
+	struct snd_pcm_dmix_ring_slot slot[0];
+};
+
+#endif /* DOC_HIDDEN */
+
+static size_t dmix_ring_size(unsigned int slots, unsigned int frame_bytes,
+			     unsigned int buffer_size)
+{
+	return sizeof(struct snd_pcm_dmix_ring) +
+	       slots * (sizeof(struct snd_pcm_dmix_ring_slot) +
+			(size_t)buffer_size * frame_bytes);
+}
+
+static void *dmix_ring_data(struct snd_pcm_dmix_ring *ring, unsigned int slot)
+{
+	return (char *)&ring->slot[ring->slots] +
+	       (size_t)slot * ring->buffer_size * ring->frame_bytes;
+}
+
+/* signed distance a - b in the slave boundary space */
+static snd_pcm_sframes_t dmix_ring_diff(snd_pcm_direct_t *dmix,
+					unsigned long long a,
+					unsigned long long b)
+{
+	snd_pcm_sframes_t diff = (snd_pcm_sframes_t)(a - b);
+	snd_pcm_sframes_t half = dmix->slave_boundary / 2;
+
+	diff %= (snd_pcm_sframes_t)dmix->slave_boundary;
+	if (diff > half)
+		diff -= dmix->slave_boundary;
+	else if (diff < -half)
+		diff += dmix->slave_boundary;
+	return diff;
+}
+
+#ifdef DMIX_RING
+/*
+ * read the hardware pointer of the slave from the driver; the sync_ptr
+ * belongs to the caller, nothing of the slave handle is touched
+ */
+static int dmix_ring_hw_ptr(snd_pcm_direct_t *dmix,
+			    struct snd_pcm_sync_ptr *sync_ptr,
+			    unsigned int flags, snd_pcm_uframes_t *hw)
+{
+	*hw = 0;
+	memset(sync_ptr, 0, sizeof(*sync_ptr));
+	/* never write appl_ptr and avail_min of the slave */
+	sync_ptr->flags = flags | SNDRV_PCM_SYNC_PTR_APPL |
+			  SNDRV_PCM_SYNC_PTR_AVAIL_MIN;
+	if (ioctl(dmix->spcm->poll_fd, SNDRV_PCM_IOCTL_SYNC_PTR, sync_ptr) < 0)
+		return -errno;
+	*hw = sync_ptr->s.status.hw_ptr;
+	return 0;
+}
+#endif
+
+static int dmix_ring_supported(snd_pcm_direct_t *dmix)
+{
+#ifdef DMIX_RING
+	struct snd_pcm_sync_ptr sync_ptr;
+	snd_pcm_uframes_t hw;
+
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16:
+	case SND_PCM_FORMAT_S32:
+		/* the mixer thread must be able to read the pointer itself */
+		return dmix_ring_hw_ptr(dmix, &sync_ptr, 0, &hw) == 0;
+	default:
+		break;
+	}
+#endif
+	return 0;
+}
+
+#ifdef DMIX_RING
+
+static int shm_ring_discard(snd_pcm_direct_t *dmix);
+
+static int dmix_ring_mutex_init(pthread_mutex_t *mutex)
+{
+	pthread_mutexattr_t attr;
+	int err;
+
+	err = pthread_mutexattr_init(&attr);
+	if (err)
+		return -err;
+	err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (!err)
+		err = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (!err)
+		err = pthread_mutex_init(mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return -err;
+}
+
+/* one semaphore per slot, 1 while a client owns it */
+static int sem_ring_create_or_connect(snd_pcm_direct_t *dmix,
+				      unsigned int slots, int fresh)
+{
+	union semun s;
+	struct semid_ds buf;
+	int tmpid;
+
+retrysem:
+	dmix->u.dmix.semid_ring = semget(dmix->ipc_key + 2, slots,
+					 IPC_CREAT | dmix->ipc_perm);
+	if (dmix->u.dmix.semid_ring < 0) {
+		/* a set of another size left over, nobody can own it */
+		if (errno == EINVAL && fresh &&
+		    (tmpid = semget(dmix->ipc_key + 2, 0, dmix->ipc_perm)) != -1 &&
+		    !semctl(tmpid, 0, IPC_RMID, NULL)) {
+			fresh = 0;
+			goto retrysem;
+		}
+		return -errno;
+	}
+	if (dmix->ipc_gid >= 0) {
+		s.buf = &buf;
+		if (semctl(dmix->u.dmix.semid_ring, 0, IPC_STAT, s) == 0) {
+			buf.sem_perm.gid = dmix->ipc_gid;
+			semctl(dmix->u.dmix.semid_ring, 0, IPC_SET, s);
+		}
+	}
+	return 0;
+}
+
+static int shm_ring_create_or_connect(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_ring *ring;
+	struct shmid_ds buf;
+	unsigned int slots, frame_bytes, buffer_size;
+	int tmpid, err;
+	size_t size;
+
+	slots = dmix->shmptr->u.dmix.mix_thread;
+	frame_bytes = snd_pcm_format_physical_width(dmix->shmptr->s.format) / 8 *
+		      dmix->shmptr->s.channels;
+	buffer_size = dmix->shmptr->s.buffer_size;
+	size = dmix_ring_size(slots, frame_bytes, buffer_size);
+retryshm:
+	dmix->u.dmix.shmid_ring = shmget(dmix->ipc_key + 2, size,
+					 IPC_CREAT | dmix->ipc_perm);
+	err = -errno;
+	if (dmix->u.dmix.shmid_ring < 0) {
+		if (errno == EINVAL)
+		if ((tmpid = shmget(dmix->ipc_key + 2, 0, dmix->ipc_perm)) != -1)
+		if (!shmctl(tmpid, IPC_STAT, &buf))
+		if (!buf.shm_nattch)
+		/* no users so destroy the segment */
+		if (!shmctl(tmpid, IPC_RMID, NULL))
+			goto retryshm;
+		return err;
+	}
+	ring = shmat(dmix->u.dmix.shmid_ring, 0, 0);
+	if (ring == (void *) -1) {
+		err = -errno;
+		shm_ring_discard(dmix);
+		return err;
+	}
+	dmix->u.dmix.ring = ring;
+	if (shmctl(dmix->u.dmix.shmid_ring, IPC_STAT, &buf) < 0) {
+		err = -errno;
+		shm_ring_discard(dmix);
+		return err;
+	}
+	if (dmix->ipc_gid >= 0) {
+		buf.shm_perm.gid = dmix->ipc_gid;
+		shmctl(dmix->u.dmix.shmid_ring, IPC_SET, &buf);
+	}
+	/* we are called under the client semaphore */
+	if (buf.shm_nattch == 1 || ring->magic != DMIX_RING_MAGIC) {
+		/* new or left over by dead clients */
+		memset(ring, 0, size);
+		ring->slots = slots;
+		ring->frame_bytes = frame_bytes;
+		ring->buffer_size = buffer_size;
+		ring->lock_size = sizeof(pthread_mutex_t);
+		err = dmix_ring_mutex_init(&ring->mixer.mutex);
+		if (err < 0) {
+			shm_ring_discard(dmix);
+			return err;
+		}
+		ring->magic = DMIX_RING_MAGIC;
+	} else if (ring->slots != slots || ring->frame_bytes != frame_bytes ||
+		   ring->buffer_size != buffer_size ||
+		   ring->lock_size != sizeof(pthread_mutex_t)) {
+		SNDERR("dmix client rings do not match the configuration");
+		shm_ring_discard(dmix);
+		return -EINVAL;
+	}
+	err = sem_ring_create_or_connect(dmix, slots, buf.shm_nattch == 1);
+	if (err < 0) {
+		shm_ring_discard(dmix);
+		return err;
+	}
+	mlock(ring, size);
+	return 0;
+}
+
+static int shm_ring_discard(snd_pcm_direct_t *dmix)
+{
+	struct shmid_ds buf;
+	int ret = 0;
+
+	if (dmix->u.dmix.shmid_ring < 0)
+		return -EINVAL;
+	if (dmix->u.dmix.ring && shmdt(dmix->u.dmix.ring) < 0)
+		return -errno;
+	dmix->u.dmix.ring = NULL;
+	if (shmctl(dmix->u.dmix.shmid_ring, IPC_STAT, &buf) < 0)
+		return -errno;
+	if (buf.shm_nattch == 0) {	/* we're the last user, destroy the segment */
+		if (shmctl(dmix->u.dmix.shmid_ring, IPC_RMID, NULL) < 0)
+			return -errno;
+		if (dmix->u.dmix.semid_ring >= 0)
+			semctl(dmix->u.dmix.semid_ring, 0, IPC_RMID, NULL);
+		ret = 1;
+	}
+	dmix->u.dmix.shmid_ring = -1;
+	dmix->u.dmix.semid_ring = -1;
+	return ret;
+}
+
+/* take the semaphore of a slot, it fails when the slot has an owner */
+static int dmix_ring_own_slot(snd_pcm_direct_t *dmix, unsigned int idx)
+{
+	struct sembuf op[2] = {
+		{ idx, 0, IPC_NOWAIT },
+		{ idx, 1, SEM_UNDO | IPC_NOWAIT },
+	};
+
+	return semop(dmix->u.dmix.semid_ring, op, 2);
+}
+
+static void dmix_ring_disown_slot(snd_pcm_direct_t *dmix, unsigned int idx)
+{
+	struct sembuf op = { idx, -1, SEM_UNDO | IPC_NOWAIT };
+
+	semop(dmix->u.dmix.semid_ring, &op, 1);
+}
+
+static void dmix_ring_release_slot(struct snd_pcm_dmix_ring_slot *slot)
+{
+	/* leave the slot empty for the next owner */
+	__atomic_store_n(&slot->start, slot->appl, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&slot->used, 0, __ATOMIC_SEQ_CST);
+}
+
+/* stop mixing the slots of the clients which died without closing */
+static void dmix_ring_reap(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	unsigned int idx;
+
+	for (idx = 0; idx < ring->slots; idx++) {
+		if (!ring->slot[idx].used)
+			continue;
+		/* only an ownerless slot can be taken */
+		if (dmix_ring_own_slot(dmix, idx) < 0)
+			continue;
+		dmix_ring_release_slot(&ring->slot[idx]);
+		dmix_ring_disown_slot(dmix, idx);
+	}
+}
+
+static int dmix_ring_claim(snd_pcm_direct_t *dmix, double gain)
+{
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	snd_pcm_channel_area_t *areas;
+	unsigned int idx, chn, bits, channels;
+
+	channels = dmix->shmptr->s.channels;
+	areas = calloc(channels, sizeof(*areas));
+	if (!areas)
+		return -ENOMEM;
+	/* the slot of a dead client is free again */
+	for (idx = 0; idx < ring->slots; idx++) {
+		if (dmix_ring_own_slot(dmix, idx) == 0)
+			goto _found;
+	}
+	free(areas);
+	SNDERR("no free dmix client ring (mix_thread_clients = %u)",
+	       ring->slots);
+	return -EBUSY;
+
+ _found:
+	dmix_ring_release_slot(&ring->slot[idx]);
+	ring->slot[idx].gain = (unsigned int)(gain * 0x10000 + 0.5);
+	memset(dmix_ring_data(ring, idx), 0,
+	       (size_t)ring->buffer_size * ring->frame_bytes);
+	__atomic_store_n(&ring->slot[idx].used, 1, __ATOMIC_SEQ_CST);
+	bits = ring->frame_bytes * 8 / channels;
+	for (chn = 0; chn < channels; chn++) {
+		areas[chn].addr = dmix_ring_data(ring, idx);
+		areas[chn].first = chn * bits;
+		areas[chn].step = ring->frame_bytes * 8;
+	}
+	dmix->u.dmix.ring_slot = idx;
+	dmix->u.dmix.ring_areas = areas;
+	return 0;
+}
+
+/*
+ *  the mixer thread
+ */
+
+#ifndef DOC_HIDDEN
+struct snd_pcm_dmix_mixer {
+	pthread_t thread;
+	volatile int quit;
+	volatile int done;		/* the thread has returned */
+	snd_pcm_direct_t *dmix;
+	const snd_pcm_channel_area_t *dst_areas;
+	int dst_interleaved;
+	int sum_float;			/* see pcm_dmix_float.c */
+	struct snd_pcm_dmix_float_ops fops;
+	void *acc;			/* one period of int (S16) or long long (S32), or floats */
+};
+#endif
+
+/* add the frames [pos, pos + frames) of all clients to the accumulator */
+static void dmix_ring_sum(struct snd_pcm_dmix_mixer *mixer,
+			  unsigned long long pos, unsigned int frames)
+{
+	snd_pcm_direct_t *dmix = mixer->dmix;
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	unsigned int channels = dmix->shmptr->s.channels;
+	unsigned int ofs = pos % ring->buffer_size;
+	int s16 = ring->frame_bytes == channels * 2;
+	unsigned int idx, i, lo, hi, gain;
+	unsigned long long start, appl;
+	snd_pcm_sframes_t from, to, d;
+
+	memset(mixer->acc, 0, (size_t)frames * channels *
+	       (mixer->sum_float ? sizeof(float) :
+		s16 ? sizeof(int) : sizeof(long long)));
+	for (idx = 0; idx < ring->slots; idx++) {
+		struct snd_pcm_dmix_ring_slot *slot = &ring->slot[idx];
+		int retry = 3;
+
+		if (!slot->used)
+			continue;
+		/* start only changes when the owner (re)starts a run */
+		do {
+			start = __atomic_load_n(&slot->start, __ATOMIC_ACQUIRE);
+			/* ordered after mix_ptr, see dmix_ring_rewind() */
+			appl = __atomic_load_n(&slot->appl, __ATOMIC_SEQ_CST);
+		} while (start != __atomic_load_n(&slot->start, __ATOMIC_ACQUIRE) &&
+			 --retry);
+		if (!retry)
+			continue;
+		to = dmix_ring_diff(dmix, appl, pos);
+		if (to > (snd_pcm_sframes_t)frames)
+			to = frames;
+		from = dmix_ring_diff(dmix, start, pos);
+		if (from < 0)
+			from = 0;
+		/* older frames are already overwritten */
+		d = dmix_ring_diff(dmix, appl, pos) - ring->buffer_size;
+		if (d > from)
+			from = d;
+		if (from >= to)
+			continue;
+		gain = slot->gain;
+		lo = from * channels;
+		hi = to * channels;
+		if (mixer->sum_float) {
+			float *acc = (float *)mixer->acc + lo;
+			const char *src = (const char *)dmix_ring_data(ring, idx) +
+					  ((size_t)ofs * channels + lo) *
+					  (s16 ? 2 : 4);
+			if (s16)
+				mixer->fops.acc_16(acc, (const short *)src,
+						   gain / 65536.0f, hi - lo);
+			else
+				mixer->fops.acc_32(acc, (const int *)src,
+						   gain / 65536.0f, hi - lo);
+		} else if (s16) {
+			const short *src = (const short *)dmix_ring_data(ring, idx) +
+					   (size_t)ofs * channels;
+			int *acc = mixer->acc;
+			if (gain == 0x10000) {
+				for (i = lo; i < hi; i++)
+					acc[i] += src[i];
+			} else {
+				for (i = lo; i < hi; i++)
+					acc[i] += ((long long)src[i] * gain) >> 16;
+			}
+		} else {
+			const int *src = (const int *)dmix_ring_data(ring, idx) +
+					 (size_t)ofs * channels;
+			long long *acc = mixer->acc;
+			if (gain == 0x10000) {
+				for (i = lo; i < hi; i++)
+					acc[i] += src[i];
+			} else {
+				for (i = lo; i < hi; i++)
+					acc[i] += ((long long)src[i] * gain) >> 16;
+			}
+		}
+	}
+}
+
+/* saturate the accumulator into the slave buffer, the only conversion of the sums */
+static void dmix_ring_output(struct snd_pcm_dmix_mixer *mixer,
+			     unsigned long long pos, unsigned int frames)
+{
+	snd_pcm_direct_t *dmix = mixer->dmix;
+	unsigned int channels = dmix->shmptr->s.channels;
+	unsigned int ofs = pos % dmix->slave_buffer_size;
+	int s16 = dmix->u.dmix.ring->frame_bytes == channels * 2;
+	unsigned int chn, i, n, step;
+	char *dst;
+
+	/* an interleaved buffer is written as a single channel */
+	n = mixer->dst_interleaved ? 1 : channels;
+	for (chn = 0; chn < n; chn++) {
+		const snd_pcm_channel_area_t *area = &mixer->dst_areas[chn];
+		unsigned int count = mixer->dst_interleaved ? frames * channels : frames;
+
+		step = mixer->dst_interleaved ? (s16 ? 2 : 4) : area->step / 8;
+		dst = (char *)area->addr + area->first / 8 + (size_t)ofs * (area->step / 8);
+		if (mixer->sum_float) {
+			const float *acc = (const float *)mixer->acc + chn;
+			if (mixer->dst_interleaved && s16)
+				mixer->fops.out_16((short *)dst, acc, count);
+			else if (mixer->dst_interleaved)
+				mixer->fops.out_32((int *)dst, acc, count);
+			else if (s16)
+				float_out_16_step(dst, step, acc, channels, count);
+			else
+				float_out_32_step(dst, step, acc, channels, count);
+		} else if (s16) {
+			const int *acc = (const int *)mixer->acc + chn;
+			unsigned int inc = mixer->dst_interleaved ? 1 : channels;
+			for (i = 0; i < count; i++, acc += inc, dst += step) {
+				int s = *acc;
+				if (s > 0x7fff)
+					s = 0x7fff;
+				else if (s < -0x8000)
+					s = -0x8000;
+				*(short *)dst = s;
+			}
+		} else {
+			const long long *acc = (const long long *)mixer->acc + chn;
+			unsigned int inc = mixer->dst_interleaved ? 1 : channels;
+			for (i = 0; i < count; i++, acc += inc, dst += step) {
+				long long s = *acc;
+				if (s > 0x7fffffffLL)
+					s = 0x7fffffffLL;
+				else if (s < -0x80000000LL)
+					s = -0x80000000LL;
+				*(int *)dst = s;
+			}
+		}
+	}
+}
+
+static void *dmix_ring_mixer_thread(void *arg)
+{
+	struct snd_pcm_dmix_mixer *mixer = arg;
+	snd_pcm_direct_t *dmix = mixer->dmix;
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	snd_pcm_uframes_t period = dmix->slave_period_size;
+	snd_pcm_uframes_t buffer = dmix->slave_buffer_size;
+	snd_pcm_uframes_t ahead, hw, target, pos, n;
+	struct snd_pcm_sync_ptr sync_ptr;
+	unsigned int loops = 0, reap_loops;
+	unsigned long long ns;
+	struct timespec ts;
+	snd_pcm_sframes_t diff;
+	int err;
+
+	/* keep two periods mixed, at least one of the buffer is left to the clients */
+	ahead = 2 * period;
+	if (ahead > buffer - period)
+		ahead = buffer - period;
+	if (!ahead)
+		ahead = buffer / 2;
+	/* wake up twice a period, look for dead clients about once a second */
+	ns = (unsigned long long)period * 500000000ULL / dmix->shmptr->s.rate;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	reap_loops = 2 * dmix->shmptr->s.rate / period + 1;
+
+	/* another client may have started a mixer meanwhile */
+	err = pthread_mutex_trylock(&ring->mixer.mutex);
+	if (err == EOWNERDEAD)
+		err = pthread_mutex_consistent(&ring->mixer.mutex);
+	if (err) {
+		mixer->done = 1;
+		return NULL;
+	}
+
+	pos = __atomic_load_n(&ring->mix_ptr, __ATOMIC_SEQ_CST);
+	while (!mixer->quit) {
+		/* the slave is not running (xrun, suspend), its client recovers */
+		if (dmix_ring_hw_ptr(dmix, &sync_ptr, SNDRV_PCM_SYNC_PTR_HWSYNC,
+				     &hw) < 0)
+			goto _sleep;
+		diff = dmix_ring_diff(dmix, pos, hw);
+		if (diff < 0 || diff > (snd_pcm_sframes_t)buffer)
+			pos = hw;
+		target = (hw - hw % period + ahead) % dmix->slave_boundary;
+		if (dmix_ring_diff(dmix, target, pos) > 0) {
+			/* the clients must not move these frames any more */
+			__atomic_store_n(&ring->mix_ptr, target, __ATOMIC_SEQ_CST);
+			while (pos != target) {
+				n = dmix_ring_diff(dmix, target, pos);
+				if (n > period)
+					n = period;
+				if (n > buffer - pos % buffer)
+					n = buffer - pos % buffer;
+				dmix_ring_sum(mixer, pos, n);
+				dmix_ring_output(mixer, pos, n);
+				pos = (pos + n) % dmix->slave_boundary;
+			}
+		}
+	_sleep:
+		if (++loops >= reap_loops) {
+			loops = 0;
+			dmix_ring_reap(dmix);
+		}
+		nanosleep(&ts, NULL);
+	}
+	pthread_mutex_unlock(&ring->mixer.mutex);
+	mixer->done = 1;
+	return NULL;
+}
+
+static int dmix_ring_mixer_start(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_mixer *mixer;
+	unsigned int chn, channels, bits;
+	sigset_t set, oset;
+	int err;
+
+	mixer = calloc(1, sizeof(*mixer));
+	if (!mixer)
+		return -ENOMEM;
+	channels = dmix->shmptr->s.channels;
+	mixer->acc = malloc((size_t)dmix->slave_period_size * channels *
+			    sizeof(long long));
+	if (!mixer->acc) {
+		free(mixer);
+		return -ENOMEM;
+	}
+	mixer->dmix = dmix;
+	mixer->sum_float = dmix->shmptr->u.dmix.sum_float;
+	if (mixer->sum_float)
+		float_mix_select_ops(&mixer->fops);
+	mixer->dst_areas = snd_pcm_mmap_areas(dmix->spcm);
+	bits = dmix->u.dmix.ring->frame_bytes * 8 / channels;
+	mixer->dst_interleaved = 1;
+	for (chn = 0; chn < channels; chn++) {
+		if (mixer->dst_areas[chn].addr != mixer->dst_areas[0].addr ||
+		    mixer->dst_areas[chn].first != chn * bits ||
+		    mixer->dst_areas[chn].step != channels * bits) {
+			mixer->dst_interleaved = 0;
+			break;
+		}
+	}
+	/* signals are left to the application threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	err = -pthread_create(&mixer->thread, NULL, dmix_ring_mixer_thread, mixer);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	if (err < 0) {
+		free(mixer->acc);
+		free(mixer);
+		return err;
+	}
+	dmix->u.dmix.mixer = mixer;
+	return 0;
+}
+
+static void dmix_ring_mixer_stop(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_mixer *mixer = dmix->u.dmix.mixer;
+
+	if (!mixer)
+		return;
+	mixer->quit = 1;
+	pthread_join(mixer->thread, NULL);
+	free(mixer->acc);
+	free(mixer);
+	dmix->u.dmix.mixer = NULL;
+}
+
+/* start the mixer here when nobody runs it */
+static int dmix_ring_check_mixer(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	struct snd_pcm_dmix_mixer *mixer = dmix->u.dmix.mixer;
+	int err;
+
+	if (mixer) {
+		if (!mixer->done)
+			return 0;
+		/* it found the mixer of another client */
+		dmix_ring_mixer_stop(dmix);
+	}
+	/*
+	 * the mixer thread holds the mutex as long as it runs; ask it, not
+	 * mix_ptr: after the mixer of a closed client, mix_ptr stays ahead of
+	 * the hardware until the frames mixed in advance are played, and a
+	 * mixer started only then is already late
+	 */
+	err = pthread_mutex_trylock(&ring->mixer.mutex);
+	if (err == EBUSY)
+		return 0;
+	if (err == EOWNERDEAD)
+		err = pthread_mutex_consistent(&ring->mixer.mutex);
+	if (err)
+		return -err;
+	pthread_mutex_unlock(&ring->mixer.mutex);
+	err = dmix_ring_mixer_start(dmix);
+	if (err < 0)
+		SNDERR("unable to start the dmix mixer thread");
+	return err;
+}
+
+/*
+ *  client side
+ */
+
+/* make the slot hold the (empty) run starting at ptr */
+static void dmix_ring_restart(snd_pcm_direct_t *dmix,
+			      struct snd_pcm_dmix_ring_slot *slot,
+			      unsigned long long ptr)
+{
+	unsigned long long appl = slot->appl;
+
+	__atomic_store_n(&slot->start, appl, __ATOMIC_SEQ_CST);
+	/* never expose the old frames between the two stores */
+	if (dmix_ring_diff(dmix, ptr, appl) < 0) {
+		__atomic_store_n(&slot->appl, ptr, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&slot->start, ptr, __ATOMIC_SEQ_CST);
+	} else {
+		__atomic_store_n(&slot->start, ptr, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&slot->appl, ptr, __ATOMIC_SEQ_CST);
+	}
+}
+
+/* copy size frames from the local buffer to our ring */
+static void dmix_ring_write(snd_pcm_t *pcm, snd_pcm_uframes_t size)
+{
+	snd_pcm_direct_t *dmix = pcm->private_data;
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	struct snd_pcm_dmix_ring_slot *slot = &ring->slot[dmix->u.dmix.ring_slot];
+	const snd_pcm_channel_area_t *src_areas;
+	snd_pcm_uframes_t appl_ptr, slave_appl_ptr, transfer, limit;
+	unsigned int chn, dchn;
+	snd_pcm_sframes_t late, avail;
+	int restart;
+
+	late = dmix_ring_diff(dmix, __atomic_load_n(&ring->mix_ptr, __ATOMIC_SEQ_CST),
+			      dmix->slave_appl_ptr);
+	restart = slot->appl != dmix->slave_appl_ptr;
+	if (late > 0) {
+		if (restart) {
+			/* a new run starts where the mixer is */
+			dmix->slave_appl_ptr += late;
+			dmix->slave_appl_ptr %= dmix->slave_boundary;
+			dmix->u.dmix.ring_lag += late;
+		} else {
+			/* skip the frames which were not mixed in time */
+			transfer = (snd_pcm_uframes_t)late < size ? (snd_pcm_uframes_t)late : size;
+			dmix->last_appl_ptr += transfer;
+			dmix->last_appl_ptr %= pcm->boundary;
+			dmix->slave_appl_ptr += transfer;
+			dmix->slave_appl_ptr %= dmix->slave_boundary;
+			size -= transfer;
+			restart = 1;
+		}
+	}
+	/* the ring holds one slave buffer */
+	limit = dmix->slave_hw_ptr - dmix->slave_hw_ptr % dmix->slave_period_size;
+	limit = (limit + dmix->slave_buffer_size) % dmix->slave_boundary;
+	avail = dmix_ring_diff(dmix, limit, dmix->slave_appl_ptr);
+	if (avail < (snd_pcm_sframes_t)size)
+		size = avail > 0 ? avail : 0;
+	if (!size)
+		return;
+	if (restart)
+		dmix_ring_restart(dmix, slot, dmix->slave_appl_ptr);
+
+	src_areas = snd_pcm_mmap_areas(pcm);
+	appl_ptr = dmix->last_appl_ptr % pcm->buffer_size;
+	dmix->last_appl_ptr += size;
+	dmix->last_appl_ptr %= pcm->boundary;
+	slave_appl_ptr = dmix->slave_appl_ptr % dmix->slave_buffer_size;
+	dmix->slave_appl_ptr += size;
+	dmix->slave_appl_ptr %= dmix->slave_boundary;
+	for (;;) {
+		transfer = size;
+		if (appl_ptr + transfer > pcm->buffer_size)
+			transfer = pcm->buffer_size - appl_ptr;
+		if (slave_appl_ptr + transfer > dmix->slave_buffer_size)
+			transfer = dmix->slave_buffer_size - slave_appl_ptr;
+		if (dmix->interleaved) {
+			memcpy((char *)dmix->u.dmix.ring_areas[0].addr +
+			       slave_appl_ptr * ring->frame_bytes,
+			       (char *)src_areas[0].addr +
+			       appl_ptr * ring->frame_bytes,
+			       transfer * ring->frame_bytes);
+		} else {
+			for (chn = 0; chn < dmix->channels; chn++) {
+				dchn = dmix->bindings ? dmix->bindings[chn] : chn;
+				if (dchn >= dmix->shmptr->s.channels)
+					continue;
+				snd_pcm_area_copy(&dmix->u.dmix.ring_areas[dchn],
+						  slave_appl_ptr, &src_areas[chn],
+						  appl_ptr, transfer,
+						  dmix->shmptr->s.format);
+			}
+		}
+		size -= transfer;
+		if (! size)
+			break;
+		slave_appl_ptr += transfer;
+		slave_appl_ptr %= dmix->slave_buffer_size;
+		appl_ptr += transfer;
+		appl_ptr %= pcm->buffer_size;
+	}
+	/* publish the frames */
+	__atomic_store_n(&slot->appl, dmix->slave_appl_ptr, __ATOMIC_RELEASE);
+}
+
+/*
+ * take back up to size written frames the mixer has not reached yet
+ *
+ * The mixer publishes mix_ptr before it reads appl, and we store appl
+ * before we read mix_ptr again, both sequentially consistent.  So a round
+ * which read the old appl has published its mix_ptr by then: when it is
+ * past the new appl, the frames before it may be mixed already and the
+ * rewind is cut back to it.  The frames from there on stay in the ring,
+ * and the mixer never reads before mix_ptr again.
+ */
+static snd_pcm_uframes_t dmix_ring_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t size)
+{
+	snd_pcm_direct_t *dmix = pcm->private_data;
+	struct snd_pcm_dmix_ring *ring = dmix->u.dmix.ring;
+	struct snd_pcm_dmix_ring_slot *slot = &ring->slot[dmix->u.dmix.ring_slot];
+	unsigned long long appl, mix;
+	snd_pcm_sframes_t avail;
+
+	mix = __atomic_load_n(&ring->mix_ptr, __ATOMIC_SEQ_CST);
+	avail = dmix_ring_diff(dmix, dmix->slave_appl_ptr, mix);
+	if (avail <= 0)
+		return 0;
+	if (size > (snd_pcm_uframes_t)avail)
+		size = avail;
+	appl = (dmix->slave_appl_ptr - size) % dmix->slave_boundary;
+	for (;;) {
+		__atomic_store_n(&slot->appl, appl, __ATOMIC_SEQ_CST);
+		if (appl == dmix->slave_appl_ptr)
+			break;
+		mix = __atomic_load_n(&ring->mix_ptr, __ATOMIC_SEQ_CST);
+		if (dmix_ring_diff(dmix, appl, mix) >= 0)
+			break;
+		/* the mixer moved meanwhile, undo what it may have mixed */
+		if (dmix_ring_diff(dmix, dmix->slave_appl_ptr, mix) <= 0)
+			appl = dmix->slave_appl_ptr;
+		else
+			appl = mix;
+	}
+	size = dmix_ring_diff(dmix, dmix->slave_appl_ptr, appl);
+	dmix->last_appl_ptr -= size;
+	dmix->last_appl_ptr %= pcm->boundary;
+	dmix->slave_appl_ptr = appl;
+	return size;
+}
+
+static void dmix_ring_drop(snd_pcm_direct_t *dmix)
+{
+	struct snd_pcm_dmix_ring_slot *slot;
+
+	if (!dmix->u.dmix.ring)
+		return;
+	slot = &dmix->u.dmix.ring->slot[dmix->u.dmix.ring_slot];
+	__atomic_store_n(&slot->start, slot->appl, __ATOMIC_SEQ_CST);
+	dmix->u.dmix.ring_lag = 0;
+}
+
+static void dmix_ring_close(snd_pcm_direct_t *dmix)
+{
+	if (dmix->u.dmix.ring) {
+		dmix_ring_mixer_stop(dmix);
+		if (dmix->u.dmix.ring_areas) {
+			dmix_ring_release_slot(&dmix->u.dmix.ring->slot[dmix->u.dmix.ring_slot]);
+			dmix_ring_disown_slot(dmix, dmix->u.dmix.ring_slot);
+		}
+	}
+	free(dmix->u.dmix.ring_areas);
+	dmix->u.dmix.ring_areas = NULL;
+	if (dmix->u.dmix.shmid_ring >= 0)
+		shm_ring_discard(dmix);
+}
+
+static int dmix_ring_open(snd_pcm_direct_t *dmix,
+			  struct snd_pcm_direct_open_conf *opts)
+{
+	int err;
+
+	err = shm_ring_create_or_connect(dmix);
+	if (err < 0)
+		return err;
+	err = dmix_ring_claim(dmix, opts->client_gain);
+	if (err < 0)
+		return err;
+	return dmix_ring_check_mixer(dmix);
+}
+
+#else /* !DMIX_RING */
+
+static void dmix_ring_write(snd_pcm_t *pcm ATTRIBUTE_UNUSED,
+			    snd_pcm_uframes_t size ATTRIBUTE_UNUSED)
+{
+}
+
+static snd_pcm_uframes_t dmix_ring_rewind(snd_pcm_t *pcm ATTRIBUTE_UNUSED,
+					  snd_pcm_uframes_t size ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+
+static int dmix_ring_check_mixer(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+
+static void dmix_ring_drop(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+}
+
+static void dmix_ring_close(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+}
+
+static int dmix_ring_open(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED,
+			  struct snd_pcm_direct_open_conf *opts ATTRIBUTE_UNUSED)
+{
+	return -ENXIO;
+}
+
+#endif /* DMIX_RING */
@@ -0,0 +1,239 @@
+/*
+ * SSE2/AVX2 mixing code
+ *
+ * The per-sample lock cmpxchg/xadd of the x86 routines lets the clients
+ * mix without a lock, but the atomics dominate with many clients.  These
+ * kernels are not concurrent: like the generic ones they run under the
+ * mixing lock and compute exactly the same results, a block of samples
+ * at a time.  They are used only with the mix_simd option of the first
+ * client, which stores the scheme in the shared memory (u.dmix.mix_simd),
+ * so all clients of one dmix device use the same kind of locking.
+ *
+ * Only the contiguous (interleaved) case is vectorized, other layouts
+ * are passed to the generic routines.
+ */
+
+#ifdef SND_PCM_SIMD_X86
+
+SND_PCM_SIMD_TARGET("sse2")
+static inline void mix_16_sse2(unsigned int size, signed short *dst,
+			       const signed short *src, signed int *sum,
+			       int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int i;
+
+	for (i = 0; i < size; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i m = _mm_cmpeq_epi16(_mm_loadu_si128((__m128i *)(dst + i)), zero);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		/* an untouched sample (zero in dst) restarts the sum */
+		__m128i slo = _mm_andnot_si128(_mm_unpacklo_epi16(m, m),
+					       _mm_loadu_si128((__m128i *)(sum + i)));
+		__m128i shi = _mm_andnot_si128(_mm_unpackhi_epi16(m, m),
+					       _mm_loadu_si128((__m128i *)(sum + i + 4)));
+		__m128i out;
+
+		if (remix) {
+			lo = _mm_sub_epi32(slo, lo);
+			hi = _mm_sub_epi32(shi, hi);
+		} else {
+			lo = _mm_add_epi32(slo, lo);
+			hi = _mm_add_epi32(shi, hi);
+		}
+		_mm_storeu_si128((__m128i *)(sum + i), lo);
+		_mm_storeu_si128((__m128i *)(sum + i + 4), hi);
+		out = _mm_packs_epi32(lo, hi);
+		if (remix)	/* -src is not saturated for an untouched sample */
+			out = _mm_or_si128(_mm_and_si128(m, _mm_sub_epi16(zero, x)),
+					   _mm_andnot_si128(m, out));
+		_mm_storeu_si128((__m128i *)(dst + i), out);
+	}
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static inline void mix_32_sse2(unsigned int size, signed int *dst,
+			       const signed int *src, signed int *sum,
+			       int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(0x7fffff);
+	const __m128i min = _mm_set1_epi32(-0x800000);
+	const __m128i smax = _mm_set1_epi32(0x7fffffff);
+	unsigned int i;
+
+	for (i = 0; i < size; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i m = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(dst + i)), zero);
+		__m128i s = _mm_andnot_si128(m, _mm_loadu_si128((__m128i *)(sum + i)));
+		__m128i gt, lt, out;
+
+		if (remix)
+			s = _mm_sub_epi32(s, _mm_srai_epi32(x, 8));
+		else
+			s = _mm_add_epi32(s, _mm_srai_epi32(x, 8));
+		_mm_storeu_si128((__m128i *)(sum + i), s);
+		gt = _mm_cmpgt_epi32(s, max);
+		lt = _mm_cmplt_epi32(s, min);
+		out = _mm_andnot_si128(_mm_or_si128(gt, lt), _mm_slli_epi32(s, 8));
+		/* smax ^ lt gives 0x80000000 for the negative clip */
+		out = _mm_or_si128(out, _mm_and_si128(_mm_or_si128(gt, lt),
+						      _mm_xor_si128(smax, lt)));
+		/* an untouched sample takes src as is */
+		x = remix ? _mm_sub_epi32(zero, x) : x;
+		out = _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, out));
+		_mm_storeu_si128((__m128i *)(dst + i), out);
+	}
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static inline void mix_16_avx2(unsigned int size, signed short *dst,
+			       const signed short *src, signed int *sum,
+			       int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned int i;
+
+	for (i = 0; i < size; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i m = _mm256_cmpeq_epi16(_mm256_loadu_si256((__m256i *)(dst + i)), zero);
+		__m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+		__m256i slo = _mm256_andnot_si256(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(m)),
+						  _mm256_loadu_si256((__m256i *)(sum + i)));
+		__m256i shi = _mm256_andnot_si256(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(m, 1)),
+						  _mm256_loadu_si256((__m256i *)(sum + i + 8)));
+		__m256i out;
+
+		if (remix) {
+			lo = _mm256_sub_epi32(slo, lo);
+			hi = _mm256_sub_epi32(shi, hi);
+		} else {
+			lo = _mm256_add_epi32(slo, lo);
+			hi = _mm256_add_epi32(shi, hi);
+		}
+		_mm256_storeu_si256((__m256i *)(sum + i), lo);
+		_mm256_storeu_si256((__m256i *)(sum + i + 8), hi);
+		/* packs works per 128-bit lane, restore the sample order */
+		out = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+		if (remix)
+			out = _mm256_blendv_epi8(out, _mm256_sub_epi16(zero, x), m);
+		_mm256_storeu_si256((__m256i *)(dst + i), out);
+	}
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static inline void mix_32_avx2(unsigned int size, signed int *dst,
+			       const signed int *src, signed int *sum,
+			       int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(0x7fffff);
+	const __m256i min = _mm256_set1_epi32(-0x800000);
+	unsigned int i;
+
+	for (i = 0; i < size; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i m = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *)(dst + i)), zero);
+		__m256i s = _mm256_andnot_si256(m, _mm256_loadu_si256((__m256i *)(sum + i)));
+		__m256i out;
+
+		if (remix)
+			s = _mm256_sub_epi32(s, _mm256_srai_epi32(x, 8));
+		else
+			s = _mm256_add_epi32(s, _mm256_srai_epi32(x, 8));
+		_mm256_storeu_si256((__m256i *)(sum + i), s);
+		out = _mm256_slli_epi32(_mm256_max_epi32(_mm256_min_epi32(s, max), min), 8);
+		/* the positive clip is 0x7fffffff, not 0x7fffff00 */
+		out = _mm256_or_si256(out, _mm256_and_si256(_mm256_cmpgt_epi32(s, max),
+							    _mm256_set1_epi32(0xff)));
+		x = remix ? _mm256_sub_epi32(zero, x) : x;
+		out = _mm256_blendv_epi8(out, x, m);
+		_mm256_storeu_si256((__m256i *)(dst + i), out);
+	}
+}
+
+/* vector part of the run, the tail and strided runs go to the generic code */
+#define SIMD_MIX_AREAS(name, type, sample_step, kernel, block, remix, generic) \
+static void name(unsigned int size,					\
+		 volatile type *dst, type *src,				\
+		 volatile signed int *sum, size_t dst_step,		\
+		 size_t src_step, size_t sum_step)			\
+{									\
+	unsigned int n = 0;						\
+									\
+	if (dst_step == sample_step && src_step == sample_step &&	\
+	    sum_step == sizeof(signed int)) {				\
+		n = size & ~(block - 1);				\
+		if (n)							\
+			kernel(n, (type *)dst, src, (signed int *)sum, remix); \
+	}								\
+	if (n < size)							\
+		generic(size - n,					\
+			(volatile type *)((char *)dst + n * dst_step),	\
+			(type *)((char *)src + n * src_step),		\
+			(volatile signed int *)((char *)sum + n * sum_step), \
+			dst_step, src_step, sum_step);			\
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+SIMD_MIX_AREAS(mix_areas_16_sse2, signed short, 2, mix_16_sse2, 8, 0,
+	       generic_mix_areas_16_native)
+SND_PCM_SIMD_TARGET("sse2")
+SIMD_MIX_AREAS(remix_areas_16_sse2, signed short, 2, mix_16_sse2, 8, 1,
+	       generic_remix_areas_16_native)
+SND_PCM_SIMD_TARGET("sse2")
+SIMD_MIX_AREAS(mix_areas_32_sse2, signed int, 4, mix_32_sse2, 4, 0,
+	       generic_mix_areas_32_native)
+SND_PCM_SIMD_TARGET("sse2")
+SIMD_MIX_AREAS(remix_areas_32_sse2, signed int, 4, mix_32_sse2, 4, 1,
+	       generic_remix_areas_32_native)
+SND_PCM_SIMD_TARGET("avx2")
+SIMD_MIX_AREAS(mix_areas_16_avx2, signed short, 2, mix_16_avx2, 16, 0,
+	       generic_mix_areas_16_native)
+SND_PCM_SIMD_TARGET("avx2")
+SIMD_MIX_AREAS(remix_areas_16_avx2, signed short, 2, mix_16_avx2, 16, 1,
+	       generic_remix_areas_16_native)
+SND_PCM_SIMD_TARGET("avx2")
+SIMD_MIX_AREAS(mix_areas_32_avx2, signed int, 4, mix_32_avx2, 8, 0,
+	       generic_mix_areas_32_native)
+SND_PCM_SIMD_TARGET("avx2")
+SIMD_MIX_AREAS(remix_areas_32_avx2, signed int, 4, mix_32_avx2, 8, 1,
+	       generic_remix_areas_32_native)
+
+#endif /* SND_PCM_SIMD_X86 */
+
+/* returns 1 when vector kernels were selected, they need the semaphore */
+static int simd_mix_select_callbacks(snd_pcm_direct_t *dmix)
+{
+#ifdef SND_PCM_SIMD_X86
+	unsigned int caps = snd_pcm_simd_caps();
+
+	switch (dmix->shmptr->s.format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S32_LE:
+		break;
+	default:
+		return 0;
+	}
+	if (!(caps & (SND_PCM_SIMD_SSE2 | SND_PCM_SIMD_AVX2)))
+		return 0;
+	generic_mix_select_callbacks(dmix);
+	if (caps & SND_PCM_SIMD_AVX2) {
+		dmix->u.dmix.mix_areas_16 = mix_areas_16_avx2;
+		dmix->u.dmix.remix_areas_16 = remix_areas_16_avx2;
+		dmix->u.dmix.mix_areas_32 = mix_areas_32_avx2;
+		dmix->u.dmix.remix_areas_32 = remix_areas_32_avx2;
+	} else {
+		dmix->u.dmix.mix_areas_16 = mix_areas_16_sse2;
+		dmix->u.dmix.remix_areas_16 = remix_areas_16_sse2;
+		dmix->u.dmix.mix_areas_32 = mix_areas_32_sse2;
+		dmix->u.dmix.remix_areas_32 = remix_areas_32_sse2;
+	}
+	dmix->u.dmix.use_sem = 1;
+	return 1;
+#else
+	return 0;
+#endif
+}
@@ -236,6 +236,7 @@ int snd_pcm_hooks_open(snd_pcm_t **pcmp, const char *name, snd_pcm_t *slave, int
 	}
 	pcm->ops = &snd_pcm_hooks_ops;
 	pcm->fast_ops = &snd_pcm_hooks_fast_ops;
+	snd_pcm_set_fast_slave(pcm, slave);
 	pcm->private_data = h;
 	pcm->poll_fd = slave->poll_fd;
 	pcm->poll_events = slave->poll_events;
@@ -109,6 +109,8 @@ typedef struct {
 	/* for chmap */
 	unsigned int chmap_caps;
 	snd_pcm_chmap_query_t **chmap_override;
+	/* persistent cache of the HW_REFINE ioctl results */
+	struct snd_pcm_refine_cache *refine_cache;
 } snd_pcm_hw_t;
 
 #define SNDRV_FILE_PCM_STREAM_PLAYBACK		ALSA_DEVICE_DIRECTORY "pcmC%iD%ip"
@@ -331,6 +333,35 @@ static inline int hw_refine_call(snd_pcm_hw_t *pcm_hw, snd_pcm_hw_params_t *para
 	return use_old_hw_params_ioctl(pcm_hw->fd, SND_PCM_IOCTL_HW_REFINE_OLD, params);
 }
 
+/*
+ * The file is named after the device and tagged with everything which
+ * changes the driver constraints: card identity, driver and protocol.
+ */
+static void hw_refine_cache_open(snd_pcm_hw_t *hw, snd_pcm_info_t *info)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *card;
+	char name[128], tag[256];
+
+	snd_ctl_card_info_alloca(&card);
+	if (snd_ctl_hw_open(&ctl, NULL, hw->card, 0) < 0)
+		return;
+	if (snd_ctl_card_info(ctl, card) < 0) {
+		snd_ctl_close(ctl);
+		return;
+	}
+	snd_ctl_close(ctl);
+	snprintf(name, sizeof(name), "hw-%s-%i-%i-%c",
+		 snd_ctl_card_info_get_id(card), hw->device, hw->subdevice,
+		 info->stream == SND_PCM_STREAM_PLAYBACK ? 'p' : 'c');
+	snprintf(tag, sizeof(tag), "%s|%s|%s|%s|%x",
+		 snd_ctl_card_info_get_driver(card),
+		 snd_ctl_card_info_get_name(card),
+		 snd_ctl_card_info_get_longname(card),
+		 (const char *)info->id, hw->version);
+	hw->refine_cache = snd_pcm_refine_cache_new(name, tag);
+}
+
 static int snd_pcm_hw_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
 	snd_pcm_hw_t *hw = pcm->private_data;
@@ -354,8 +385,12 @@ static int snd_pcm_hw_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 			return err;
 	}
 
-	if (hw_refine_call(hw, params) < 0) {
-		err = -errno;
+	if (!snd_pcm_refine_cache_lookup(hw->refine_cache, params, &err)) {
+		snd_pcm_hw_params_t in = *params;
+		err = hw_refine_call(hw, params) < 0 ? -errno : 0;
+		snd_pcm_refine_cache_store(hw->refine_cache, &in, params, err);
+	}
+	if (err < 0) {
 		// SYSMSG("SNDRV_PCM_IOCTL_HW_REFINE failed");
 		return err;
 	}
@@ -831,7 +866,7 @@ static int snd_pcm_hw_link(snd_pcm_t *pcm1, snd_pcm_t *pcm2)
 {
 	if (pcm2->type != SND_PCM_TYPE_HW) {
 		if (pcm2->fast_ops->link_slaves)
-			return pcm2->fast_ops->link_slaves(pcm2, pcm1);
+			return pcm2->fast_ops->link_slaves(pcm2->fast_op_arg, pcm1);
 		return -ENOSYS;
 	}
 	return hw_link(pcm1, pcm2);
@@ -1091,6 +1126,7 @@ static int snd_pcm_hw_close(snd_pcm_t *pcm)
 
 	unmap_status_and_control_data(hw);
 
+	snd_pcm_refine_cache_free(hw->refine_cache);
 	free(hw);
 	return err;
 }
@@ -1617,9 +1653,12 @@ int snd_pcm_hw_open_fd(snd_pcm_t **pcmp, const char *name, int fd,
 	hw->format = SND_PCM_FORMAT_UNKNOWN;
 	hw->rate = 0;
 	hw->channels = 0;
+	if (snd_pcm_refine_cache_mode() >= 2)
+		hw_refine_cache_open(hw, &info);
 
 	ret = snd_pcm_new(&pcm, SND_PCM_TYPE_HW, name, info.stream, mode);
 	if (ret < 0) {
+		snd_pcm_refine_cache_free(hw->refine_cache);
 		free(hw);
 		close(fd);
 		return ret;
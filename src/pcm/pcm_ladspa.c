@@ -35,8 +35,13 @@
 #include <dirent.h>
 #include <locale.h>
 #include <math.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "ladspa.h"
 
@@ -54,6 +59,8 @@ typedef enum _snd_pcm_ladspa_policy {
 	SND_PCM_LADSPA_POLICY_DUPLICATE		/* duplicate bindings for all channels */
 } snd_pcm_ladspa_policy_t;
 
+typedef struct snd_pcm_ladspa_pool snd_pcm_ladspa_pool_t;
+
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -63,6 +70,8 @@ typedef struct {
 	unsigned int channels;			/* forced input channels, 0 = auto */
 	unsigned int allocated;			/* count of allocated samples */
 	LADSPA_Data *zero[2];			/* zero input or dummy output */
+	unsigned int threads;			/* threads running duplicated instances */
+	snd_pcm_ladspa_pool_t *pool;		/* workers, NULL = run serially */
 } snd_pcm_ladspa_t;
  
 typedef struct {
@@ -108,8 +117,159 @@ typedef struct {
 	struct list_head instances;		/* one LADSPA plugin might be used multiple times */
 } snd_pcm_ladspa_plugin_t;
 
+/*
+ * The instances of a plugin with the duplicate policy process one channel
+ * each and do not depend on each other, so they may run concurrently.
+ * The caller runs share 0 of the instances, worker N runs share N.
+ * The plugins of the chain are still run one after another.
+ */
+
+#ifdef HAVE_LIBPTHREAD
+struct snd_pcm_ladspa_worker {
+	snd_pcm_ladspa_pool_t *pool;
+	unsigned int share;
+	pthread_t thread;
+};
+
+struct snd_pcm_ladspa_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;		/* bumped for each job */
+	unsigned int pending;			/* workers busy with the job */
+	int quit;
+	snd_pcm_ladspa_plugin_t *plugin;	/* job: run its instances */
+	unsigned long frames;
+	unsigned int workers;
+	struct snd_pcm_ladspa_worker worker[];
+};
+#endif
+
 #endif /* DOC_HIDDEN */
 
+static void snd_pcm_ladspa_run_share(snd_pcm_ladspa_plugin_t *plugin,
+				     unsigned int share, unsigned int shares,
+				     unsigned long frames)
+{
+	struct list_head *pos;
+	unsigned int idx = 0;
+
+	list_for_each(pos, &plugin->instances) {
+		snd_pcm_ladspa_instance_t *instance = list_entry(pos, snd_pcm_ladspa_instance_t, list);
+		if (idx++ % shares == share)
+			instance->desc->run(instance->handle, frames);
+	}
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *snd_pcm_ladspa_worker(void *arg)
+{
+	struct snd_pcm_ladspa_worker *worker = arg;
+	snd_pcm_ladspa_pool_t *pool = worker->pool;
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (pool->generation == generation && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->mutex);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+		snd_pcm_ladspa_run_share(pool->plugin, worker->share,
+					 pool->workers + 1, pool->frames);
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+#endif
+
+static void snd_pcm_ladspa_pool_stop(snd_pcm_ladspa_t *ladspa)
+{
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_ladspa_pool_t *pool = ladspa->pool;
+	unsigned int idx;
+
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->mutex);
+	for (idx = 0; idx < pool->workers; idx++)
+		pthread_join(pool->worker[idx].thread, NULL);
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+	ladspa->pool = NULL;
+#endif
+}
+
+/* failures are not fatal, the instances are run serially then */
+static void snd_pcm_ladspa_pool_start(snd_pcm_ladspa_t *ladspa,
+				      unsigned int workers)
+{
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_ladspa_pool_t *pool;
+	sigset_t set, oset;
+	unsigned int idx;
+
+	if (ladspa->pool || workers == 0)
+		return;
+	pool = calloc(1, sizeof(*pool) + workers * sizeof(pool->worker[0]));
+	if (pool == NULL)
+		return;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	/* signals are left to the application threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	for (idx = 0; idx < workers; idx++) {
+		pool->worker[idx].pool = pool;
+		pool->worker[idx].share = idx + 1;
+		if (pthread_create(&pool->worker[idx].thread, NULL,
+				   snd_pcm_ladspa_worker, &pool->worker[idx]))
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	pool->workers = idx;
+	ladspa->pool = pool;
+	if (idx == 0)
+		snd_pcm_ladspa_pool_stop(ladspa);
+#endif
+}
+
+static void snd_pcm_ladspa_run(snd_pcm_ladspa_t *ladspa,
+			       snd_pcm_ladspa_plugin_t *plugin,
+			       unsigned long frames)
+{
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_ladspa_pool_t *pool = ladspa->pool;
+
+	if (pool && plugin->policy == SND_PCM_LADSPA_POLICY_DUPLICATE) {
+		pthread_mutex_lock(&pool->mutex);
+		pool->plugin = plugin;
+		pool->frames = frames;
+		pool->pending = pool->workers;
+		pool->generation++;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->mutex);
+		snd_pcm_ladspa_run_share(plugin, 0, pool->workers + 1, frames);
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->pending > 0)
+			pthread_cond_wait(&pool->done, &pool->mutex);
+		pthread_mutex_unlock(&pool->mutex);
+		return;
+	}
+#endif
+	snd_pcm_ladspa_run_share(plugin, 0, 1, frames);
+}
+
 static unsigned int snd_pcm_ladspa_count_ports(snd_pcm_ladspa_plugin_t *lplug,
                                                LADSPA_PortDescriptor pdesc)
 {
@@ -196,6 +356,7 @@ static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
 {
         unsigned int idx;
 
+	snd_pcm_ladspa_pool_stop(ladspa);
 	snd_pcm_ladspa_free_plugins(&ladspa->pplugins);
 	snd_pcm_ladspa_free_plugins(&ladspa->cplugins);
 	for (idx = 0; idx < 2; idx++) {
@@ -732,6 +893,7 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                                 for (idx = channels; idx < nchannels; idx++)
                                         npchannels[idx] = NULL;
                                 pchannels = npchannels;
+                                channels = nchannels;
                         }
                         assert(instance->input.data == NULL);
                         assert(instance->input.m_data == NULL);
@@ -765,8 +927,15 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                         }
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
 			        chn = instance->output.channels.array[idx];
-                                /* FIXME/OPTIMIZE: check if we can remove double alloc */
-                                /* if LADSPA plugin has no broken inplace */
+                                /* a duplicated instance is the only user of its channel, */
+                                /* so it may overwrite the buffer of the previous plugin */
+                                if (plugin->policy == SND_PCM_LADSPA_POLICY_DUPLICATE &&
+                                    !LADSPA_IS_INPLACE_BROKEN(plugin->desc->Properties) &&
+                                    instance->input.data[0] != NULL &&
+                                    instance->input.data[0] == pchannels[chn]) {
+                                        instance->output.data[idx] = pchannels[chn];
+                                        continue;
+                                }
                                 instance->output.data[idx] = malloc(sizeof(LADSPA_Data) * ladspa->allocated);
                                 if (instance->output.data[idx] == NULL) {
                                         free(pchannels);
@@ -780,13 +949,17 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 	/* next loop deallocates the last output LADSPA areas and connects */
 	/* them to ALSA areas (NULL) or dummy area ladpsa->free[1] ; */
 	/* this algorithm might be optimized to not allocate the last LADSPA outputs */
-	list_for_each(pos, list) {
+	/* the list is walked backwards: in-place outputs share the buffer */
+	/* of the channel and only the last one is connected to ALSA */
+	for (pos = list->prev; pos != list; pos = pos->prev) {
 		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-		list_for_each(pos1, &plugin->instances) {
+		for (pos1 = plugin->instances.prev; pos1 != &plugin->instances; pos1 = pos1->prev) {
 			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
         			chn = instance->output.channels.array[idx];
-                                if (instance->output.data[idx] == pchannels[chn]) {
+                                if (pchannels[chn] != NULL &&
+                                    instance->output.data[idx] == pchannels[chn]) {
+					pchannels[chn] = NULL;
 					free(instance->output.m_data[idx]);
 					instance->output.m_data[idx] = NULL;
                                         if (chn < ochannels) {
@@ -823,6 +996,8 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
+	struct list_head *list, *pos, *pos1;
+	unsigned int count, workers = 0;
 	int err;
 	
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
@@ -836,6 +1011,22 @@ static int snd_pcm_ladspa_init(snd_pcm_t *pcm)
 		snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 		return err;
 	}
+	if (ladspa->threads <= 1)
+		return 0;
+	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
+	list_for_each(pos, list) {
+		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
+		if (plugin->policy != SND_PCM_LADSPA_POLICY_DUPLICATE)
+			continue;
+		count = 0;
+		list_for_each(pos1, &plugin->instances)
+			count++;
+		if (count > ladspa->threads)
+			count = ladspa->threads;
+		if (count > workers + 1)
+			workers = count - 1;
+	}
+	snd_pcm_ladspa_pool_start(ladspa, workers);
 	return 0;
 }
 
@@ -843,6 +1034,7 @@ static int snd_pcm_ladspa_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 
+	snd_pcm_ladspa_pool_stop(ladspa);
 	snd_pcm_ladspa_free_instances(pcm, ladspa, 1);
 	return snd_pcm_generic_hw_free(pcm);
 }
@@ -891,13 +1083,13 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
                                         chn = instance->output.channels.array[idx];
                                         data = instance->output.data[idx];
                                         if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
+                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (slave_areas[chn].first / 8));
                                 		data += slave_offset;
                                         }
 					instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
         			}
-        			instance->desc->run(instance->handle, size1);
         		}
+        		snd_pcm_ladspa_run(ladspa, plugin, size1);
         	}
         	offset += size1;
         	slave_offset += size1;
@@ -943,7 +1135,7 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
                                         chn = instance->input.channels.array[idx];
                                         data = instance->input.data[idx];
                                         if (data == NULL) {
-                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (areas[chn].first / 8));
+                                		data = (LADSPA_Data *)((char *)slave_areas[chn].addr + (slave_areas[chn].first / 8));
                                 		data += slave_offset;
                                         }	
                 			instance->desc->connect_port(instance->handle, instance->input.ports.array[idx], data);
@@ -957,8 +1149,8 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
                                         }
         		        	instance->desc->connect_port(instance->handle, instance->output.ports.array[idx], data);
         			}
-        			instance->desc->run(instance->handle, size1);
         		}
+        		snd_pcm_ladspa_run(ladspa, plugin, size1);
         	}
         	offset += size1;
         	slave_offset += size1;
@@ -1053,6 +1245,8 @@ static void snd_pcm_ladspa_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_ladspa_t *ladspa = pcm->private_data;
 
 	snd_output_printf(out, "LADSPA PCM\n");
+	if (ladspa->threads > 1)
+		snd_output_printf(out, "  Threads: %u\n", ladspa->threads);
 	snd_output_printf(out, "  Playback:\n");
 	snd_pcm_ladspa_plugins_dump(&ladspa->pplugins, out);
 	snd_output_printf(out, "  Capture:\n");
@@ -1083,6 +1277,28 @@ static const snd_pcm_ops_t snd_pcm_ladspa_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
+/*
+ * avoid locale problems - see ALSA bug#1553
+ */
+static int snd_pcm_ladspa_match_label(const char *label, const char *dlabel)
+{
+	char *labellocale;
+	struct lconv *lc;
+	int match;
+
+	if (strcmp(label, dlabel) == 0)
+		return 1;
+	lc = localeconv();
+	labellocale = strdup(label);
+	if (labellocale == NULL)
+		return -ENOMEM;
+	if (strrchr(labellocale, '.'))
+		*strrchr(labellocale, '.') = *lc->decimal_point;
+	match = strcmp(labellocale, dlabel) == 0;
+	free(labellocale);
+	return match;
+}
+
 static int snd_pcm_ladspa_check_file(snd_pcm_ladspa_plugin_t * const plugin,
 				     const char *filename,
 				     const char *label,
@@ -1098,32 +1314,15 @@ static int snd_pcm_ladspa_check_file(snd_pcm_ladspa_plugin_t * const plugin,
 			long idx;
 			const LADSPA_Descriptor *d;
 			for (idx = 0; (d = fcn(idx)) != NULL; idx++) {
-/*
- * avoid locale problems - see ALSA bug#1553
- */
-#if 0
-				if (strcmp(label, d->Label))
-					continue;
-#else
-                                char *labellocale;
-                                struct lconv *lc;
-                                if (label != NULL) {
-                                        lc = localeconv ();
-                                        labellocale = malloc (strlen (label) + 1);
-                                        if (labellocale == NULL) {
-                                        	dlclose(handle);
-                                                return -ENOMEM;
+				if (label != NULL) {
+					int err = snd_pcm_ladspa_match_label(label, d->Label);
+					if (err < 0) {
+						dlclose(handle);
+						return err;
 					}
-                                        strcpy (labellocale, label);
-                                        if (strrchr(labellocale, '.'))
-                                                *strrchr (labellocale, '.') = *lc->decimal_point;
-                                        if (strcmp(label, d->Label) && strcmp(labellocale, d->Label)) {
-                                                free(labellocale);
-                                                continue;
-                                        }
-                                        free (labellocale);
-                                }
-#endif
+					if (!err)
+						continue;
+				}
 				if (ladspa_id > 0 && d->UniqueID != ladspa_id)
 					continue;
 				plugin->filename = strdup(filename);
@@ -1141,6 +1340,22 @@ static int snd_pcm_ladspa_check_file(snd_pcm_ladspa_plugin_t * const plugin,
 	return -ENOENT;
 }
 
+static char *snd_pcm_ladspa_join_path(const char *path, const char *name)
+{
+	size_t len = strlen(path);
+	int need_slash = len > 0 && path[len - 1] != '/';
+	char *filename;
+
+	filename = malloc(len + strlen(name) + 1 + need_slash);
+	if (filename == NULL)
+		return NULL;
+	strcpy(filename, path);
+	if (need_slash)
+		strcat(filename, "/");
+	strcat(filename, name);
+	return filename;
+}
+
 static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 				    const char *path,
 				    const char *label,
@@ -1148,17 +1363,16 @@ static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 {
 	DIR *dir;
 	struct dirent * dirent;
-	int len = strlen(path), err;
-	int need_slash;
+	int err;
 	char *filename;
 	
-	if (len < 1)
+	if (strlen(path) < 1)
 		return 0;
-	need_slash = path[len - 1] != '/';
 	
+	/* a missing or unreadable entry of the path is skipped */
 	dir = opendir(path);
 	if (!dir)
-		return -ENOENT;
+		return 0;
 		
 	while (1) {
 		dirent = readdir(dir);
@@ -1167,15 +1381,11 @@ static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 			return 0;
 		}
 		
-		filename = malloc(len + strlen(dirent->d_name) + 1 + need_slash);
+		filename = snd_pcm_ladspa_join_path(path, dirent->d_name);
 		if (filename == NULL) {
 			closedir(dir);
 			return -ENOMEM;
 		}
-		strcpy(filename, path);
-		if (need_slash)
-			strcat(filename, "/");
-		strcat(filename, dirent->d_name);
 		err = snd_pcm_ladspa_check_file(plugin, filename, label, ladspa_id);
 		free(filename);
 		if (err < 0 && err != -ENOENT) {
@@ -1191,36 +1401,532 @@ static int snd_pcm_ladspa_check_dir(snd_pcm_ladspa_plugin_t * const plugin,
 	return 0;
 }
 
-static int snd_pcm_ladspa_look_for_plugin(snd_pcm_ladspa_plugin_t * const plugin,
+/*
+ * plugin index
+ *
+ * Looking up a plugin by label or ID means a dlopen() of every library in
+ * the LADSPA path until it is found.  Instead, the descriptors of each
+ * directory are recorded once in $XDG_CACHE_HOME/alsa/ladspa.idx together
+ * with the mtime of the directory, and only the library holding the plugin
+ * is opened.  A directory is rescanned when its mtime changes, and a hit is
+ * checked against the port layout of the loaded descriptor.  When a plugin
+ * is not found in the index, all directories are rescanned before giving
+ * up, so a library replaced in place is still picked up.
+ */
+
+#ifndef DOC_HIDDEN
+
+#define LADSPA_INDEX_NAME	"ladspa.idx"
+#define LADSPA_INDEX_MAGIC	"# ALSA LADSPA index 1\n"
+
+typedef struct {
+	unsigned long id;
+	char *label;
+	char *file;			/* relative to the directory */
+	char *ports;			/* one hex digit per port descriptor */
+} snd_pcm_ladspa_index_entry_t;
+
+typedef struct {
+	struct list_head list;
+	char *path;
+	long long mtime;		/* in ns */
+	int scanned;			/* rescanned by this lookup */
+	unsigned int count;
+	unsigned int alloc;
+	snd_pcm_ladspa_index_entry_t *entry;
+} snd_pcm_ladspa_index_dir_t;
+
+typedef struct {
+	struct list_head dirs;
+	int dirty;
+} snd_pcm_ladspa_index_t;
+
+#endif /* DOC_HIDDEN */
+
+static int snd_pcm_ladspa_index_enabled(void)
+{
+	static int mode = -1;
+
+	if (mode < 0) {
+		const char *p = getenv("LIBASOUND_LADSPA_CACHE");
+		mode = p && *p ? atoi(p) > 0 : 1;
+	}
+	return mode;
+}
+
+static char *snd_pcm_ladspa_port_layout(const LADSPA_Descriptor *d)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *ports;
+	unsigned long i;
+
+	ports = malloc(d->PortCount + 1);
+	if (ports == NULL)
+		return NULL;
+	for (i = 0; i < d->PortCount; i++)
+		ports[i] = hex[d->PortDescriptors[i] & 0x0f];
+	ports[i] = '\0';
+	return ports;
+}
+
+static void snd_pcm_ladspa_index_dir_clear(snd_pcm_ladspa_index_dir_t *dir)
+{
+	unsigned int i;
+
+	for (i = 0; i < dir->count; i++) {
+		free(dir->entry[i].label);
+		free(dir->entry[i].file);
+		free(dir->entry[i].ports);
+	}
+	dir->count = 0;
+}
+
+static void snd_pcm_ladspa_index_dir_free(snd_pcm_ladspa_index_dir_t *dir)
+{
+	list_del(&dir->list);
+	snd_pcm_ladspa_index_dir_clear(dir);
+	free(dir->entry);
+	free(dir->path);
+	free(dir);
+}
+
+static void snd_pcm_ladspa_index_free(snd_pcm_ladspa_index_t *index)
+{
+	while (!list_empty(&index->dirs))
+		snd_pcm_ladspa_index_dir_free(list_entry(index->dirs.next,
+							 snd_pcm_ladspa_index_dir_t,
+							 list));
+}
+
+static snd_pcm_ladspa_index_dir_t *
+snd_pcm_ladspa_index_dir_new(snd_pcm_ladspa_index_t *index, const char *path,
+			     long long mtime)
+{
+	snd_pcm_ladspa_index_dir_t *dir;
+
+	dir = calloc(1, sizeof(*dir));
+	if (dir == NULL)
+		return NULL;
+	dir->path = strdup(path);
+	if (dir->path == NULL) {
+		free(dir);
+		return NULL;
+	}
+	dir->mtime = mtime;
+	list_add_tail(&dir->list, &index->dirs);
+	return dir;
+}
+
+static snd_pcm_ladspa_index_dir_t *
+snd_pcm_ladspa_index_dir_find(snd_pcm_ladspa_index_t *index, const char *path)
+{
+	struct list_head *pos;
+
+	list_for_each(pos, &index->dirs) {
+		snd_pcm_ladspa_index_dir_t *dir;
+		dir = list_entry(pos, snd_pcm_ladspa_index_dir_t, list);
+		if (strcmp(dir->path, path) == 0)
+			return dir;
+	}
+	return NULL;
+}
+
+/* takes the ownership of label, file and ports */
+static int snd_pcm_ladspa_index_dir_add(snd_pcm_ladspa_index_dir_t *dir,
+					unsigned long id, char *label,
+					char *file, char *ports)
+{
+	snd_pcm_ladspa_index_entry_t *e;
+
+	if (label == NULL || file == NULL || ports == NULL)
+		goto __nomem;
+	if (dir->count == dir->alloc) {
+		unsigned int alloc = dir->alloc ? dir->alloc * 2 : 16;
+		e = realloc(dir->entry, alloc * sizeof(*e));
+		if (e == NULL)
+			goto __nomem;
+		dir->entry = e;
+		dir->alloc = alloc;
+	}
+	e = &dir->entry[dir->count++];
+	e->id = id;
+	e->label = label;
+	e->file = file;
+	e->ports = ports;
+	return 0;
+ __nomem:
+	free(label);
+	free(file);
+	free(ports);
+	return -ENOMEM;
+}
+
+/* fields are separated by tabs, which LADSPA labels must not contain */
+static int snd_pcm_ladspa_index_valid_field(const char *s)
+{
+	return strpbrk(s, "\t\n") == NULL;
+}
+
+static char *snd_pcm_ladspa_index_path(void)
+{
+	char *dir, *path;
+
+	dir = snd_pcm_cache_dir();
+	if (dir == NULL)
+		return NULL;
+	path = snd_pcm_ladspa_join_path(dir, LADSPA_INDEX_NAME);
+	free(dir);
+	return path;
+}
+
+static void snd_pcm_ladspa_index_load(snd_pcm_ladspa_index_t *index)
+{
+	snd_pcm_ladspa_index_dir_t *dir = NULL;
+	char *path, *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	FILE *fp;
+
+	path = snd_pcm_ladspa_index_path();
+	if (path == NULL)
+		return;
+	fp = fopen(path, "r");
+	free(path);
+	if (fp == NULL)
+		return;
+	len = getline(&line, &size, fp);
+	if (len < 0 || strcmp(line, LADSPA_INDEX_MAGIC))
+		goto __stale;
+	while ((len = getline(&line, &size, fp)) > 0) {
+		char *field[5];
+		unsigned int n = 0;
+		char *p = line;
+
+		if (line[len - 1] != '\n')
+			goto __stale;
+		line[len - 1] = '\0';
+		while (n < 5) {
+			field[n++] = p;
+			p = strchr(p, '\t');
+			if (p == NULL)
+				break;
+			*p++ = '\0';
+		}
+		if (n == 3 && strcmp(field[0], "D") == 0) {
+			dir = snd_pcm_ladspa_index_dir_new(index, field[1],
+							   strtoll(field[2], NULL, 10));
+			if (dir == NULL)
+				goto __stale;
+		} else if (n == 5 && strcmp(field[0], "P") == 0 && dir) {
+			if (snd_pcm_ladspa_index_dir_add(dir,
+							 strtoul(field[1], NULL, 10),
+							 strdup(field[2]),
+							 strdup(field[4]),
+							 strdup(field[3])) < 0)
+				goto __stale;
+		} else {
+			goto __stale;
+		}
+	}
+	free(line);
+	fclose(fp);
+	return;
+ __stale:
+	/* rebuilt from scratch */
+	snd_pcm_ladspa_index_free(index);
+	index->dirty = 1;
+	free(line);
+	fclose(fp);
+}
+
+static int snd_pcm_ladspa_index_save(snd_pcm_ladspa_index_t *index)
+{
+	struct list_head *pos;
+	char *path, *tmp;
+	size_t len;
+	FILE *fp;
+	int fd, err = 0;
+
+	path = snd_pcm_ladspa_index_path();
+	if (path == NULL)
+		return -ENOENT;
+	len = strlen(path) + 8;
+	tmp = malloc(len);
+	if (tmp == NULL) {
+		free(path);
+		return -ENOMEM;
+	}
+	snprintf(tmp, len, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		err = -errno;
+		goto __end;
+	}
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		err = -errno;
+		close(fd);
+		unlink(tmp);
+		goto __end;
+	}
+	fputs(LADSPA_INDEX_MAGIC, fp);
+	list_for_each(pos, &index->dirs) {
+		snd_pcm_ladspa_index_dir_t *dir;
+		unsigned int i;
+		dir = list_entry(pos, snd_pcm_ladspa_index_dir_t, list);
+		fprintf(fp, "D\t%s\t%lld\n", dir->path, dir->mtime);
+		for (i = 0; i < dir->count; i++) {
+			snd_pcm_ladspa_index_entry_t *e = &dir->entry[i];
+			fprintf(fp, "P\t%lu\t%s\t%s\t%s\n",
+				e->id, e->label, e->ports, e->file);
+		}
+	}
+	if (fclose(fp) && !err)
+		err = -errno;
+	if (!err && rename(tmp, path) < 0)
+		err = -errno;
+	if (err < 0)
+		unlink(tmp);
+	else
+		index->dirty = 0;
+ __end:
+	free(tmp);
+	free(path);
+	return err;
+}
+
+/*
+ * record all descriptors of a directory; returns 1 when the directory
+ * cannot be indexed (a name with a tab or newline), -ENOENT when it
+ * cannot be read
+ */
+static int snd_pcm_ladspa_index_scan(snd_pcm_ladspa_index_t *index,
+				     const char *path, long long mtime,
+				     snd_pcm_ladspa_index_dir_t **dirp)
+{
+	snd_pcm_ladspa_index_dir_t *dir;
+	struct dirent *dirent;
+	DIR *d;
+	int err = 0;
+
+	dir = snd_pcm_ladspa_index_dir_find(index, path);
+	if (dir)
+		snd_pcm_ladspa_index_dir_clear(dir);
+	else
+		dir = snd_pcm_ladspa_index_dir_new(index, path, mtime);
+	if (dir == NULL)
+		return -ENOMEM;
+	dir->mtime = mtime;
+	dir->scanned = 1;
+	index->dirty = 1;
+	*dirp = dir;
+
+	d = opendir(path);
+	if (d == NULL) {
+		snd_pcm_ladspa_index_dir_free(dir);
+		*dirp = NULL;
+		return -ENOENT;
+	}
+	while ((dirent = readdir(d)) != NULL) {
+		LADSPA_Descriptor_Function fcn;
+		const LADSPA_Descriptor *desc;
+		char *filename;
+		void *handle;
+		long idx;
+
+		if (strcmp(dirent->d_name, ".") == 0 ||
+		    strcmp(dirent->d_name, "..") == 0)
+			continue;
+		filename = snd_pcm_ladspa_join_path(path, dirent->d_name);
+		if (filename == NULL) {
+			err = -ENOMEM;
+			break;
+		}
+		handle = dlopen(filename, RTLD_LAZY);
+		free(filename);
+		if (handle == NULL)
+			continue;
+		fcn = (LADSPA_Descriptor_Function)dlsym(handle, "ladspa_descriptor");
+		for (idx = 0; fcn && (desc = fcn(idx)) != NULL; idx++) {
+			if (!snd_pcm_ladspa_index_valid_field(dirent->d_name) ||
+			    !snd_pcm_ladspa_index_valid_field(desc->Label)) {
+				err = 1;
+				break;
+			}
+			err = snd_pcm_ladspa_index_dir_add(dir, desc->UniqueID,
+							   strdup(desc->Label),
+							   strdup(dirent->d_name),
+							   snd_pcm_ladspa_port_layout(desc));
+			if (err < 0)
+				break;
+		}
+		dlclose(handle);
+		if (err)
+			break;
+	}
+	closedir(d);
+	if (err) {
+		snd_pcm_ladspa_index_dir_free(dir);
+		*dirp = NULL;
+	}
+	return err;
+}
+
+/* load the library of an index entry; -ENOENT if the entry is stale */
+static int snd_pcm_ladspa_index_open(snd_pcm_ladspa_plugin_t * const plugin,
+				     const char *path,
+				     const snd_pcm_ladspa_index_entry_t *e)
+{
+	LADSPA_Descriptor_Function fcn;
+	const LADSPA_Descriptor *d;
+	char *filename, *ports;
+	void *handle;
+	long idx;
+
+	filename = snd_pcm_ladspa_join_path(path, e->file);
+	if (filename == NULL)
+		return -ENOMEM;
+	handle = dlopen(filename, RTLD_LAZY);
+	if (handle == NULL)
+		goto __stale;
+	fcn = (LADSPA_Descriptor_Function)dlsym(handle, "ladspa_descriptor");
+	for (idx = 0; fcn && (d = fcn(idx)) != NULL; idx++) {
+		int match;
+		if (d->UniqueID != e->id || strcmp(d->Label, e->label))
+			continue;
+		ports = snd_pcm_ladspa_port_layout(d);
+		if (ports == NULL) {
+			dlclose(handle);
+			free(filename);
+			return -ENOMEM;
+		}
+		match = strcmp(ports, e->ports) == 0;
+		free(ports);
+		if (!match)
+			break;
+		plugin->filename = filename;
+		plugin->dl_handle = handle;
+		plugin->desc = d;
+		return 1;
+	}
+	dlclose(handle);
+ __stale:
+	free(filename);
+	return -ENOENT;
+}
+
+static int snd_pcm_ladspa_index_check_dir(snd_pcm_ladspa_index_t *index,
+					  snd_pcm_ladspa_plugin_t * const plugin,
 					  const char *path,
 					  const char *label,
-					  const long ladspa_id)
+					  const unsigned long ladspa_id,
+					  int rescan)
 {
-	const char *c;
-	size_t l;
+	snd_pcm_ladspa_index_dir_t *dir;
+	struct stat st;
+	long long mtime;
+	unsigned int i;
 	int err;
-	
-	for (c = path; (l = strcspn(c, ": ")) > 0; ) {
-		char name[l + 1];
-		char *fullpath;
-		memcpy(name, c, l);
-		name[l] = 0;
-		err = snd_user_file(name, &fullpath);
+
+	/* like the plain scan, skip missing or unreadable entries */
+	if (strlen(path) < 1)
+		return 0;
+	if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return 0;
+	mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	dir = snd_pcm_ladspa_index_dir_find(index, path);
+	if (!dir || dir->mtime != mtime || (rescan && !dir->scanned)) {
+		err = snd_pcm_ladspa_index_scan(index, path, mtime, &dir);
+		if (err > 0)
+			return snd_pcm_ladspa_check_dir(plugin, path, label, ladspa_id);
+		if (err == -ENOENT)
+			return 0;
 		if (err < 0)
 			return err;
-		err = snd_pcm_ladspa_check_dir(plugin, fullpath, label, ladspa_id);
-		free(fullpath);
-		if (err < 0)
+	}
+ __again:
+	for (i = 0; i < dir->count; i++) {
+		const snd_pcm_ladspa_index_entry_t *e = &dir->entry[i];
+		if (label != NULL) {
+			err = snd_pcm_ladspa_match_label(label, e->label);
+			if (err < 0)
+				return err;
+			if (!err)
+				continue;
+		}
+		if (ladspa_id > 0 && e->id != ladspa_id)
+			continue;
+		err = snd_pcm_ladspa_index_open(plugin, path, e);
+		if (err != -ENOENT)
 			return err;
-		if (err > 0)
-			return 0;
-		c += l;
-		if (!*c)
+		if (!dir->scanned) {
+			/* changed without touching the directory */
+			err = snd_pcm_ladspa_index_scan(index, path, mtime, &dir);
+			if (err > 0)
+				return snd_pcm_ladspa_check_dir(plugin, path, label, ladspa_id);
+			if (err == -ENOENT)
+				return 0;
+			if (err < 0)
+				return err;
+			goto __again;
+		}
+	}
+	return 0;
+}
+
+static int snd_pcm_ladspa_look_for_plugin(snd_pcm_ladspa_plugin_t * const plugin,
+					  const char *path,
+					  const char *label,
+					  const long ladspa_id)
+{
+	snd_pcm_ladspa_index_t index;
+	const char *c;
+	size_t l;
+	int err = -ENOENT, rescan;
+
+	INIT_LIST_HEAD(&index.dirs);
+	index.dirty = 0;
+	if (snd_pcm_ladspa_index_enabled())
+		snd_pcm_ladspa_index_load(&index);
+	for (rescan = 0; rescan < 2 && err == -ENOENT; rescan++) {
+		for (c = path; (l = strcspn(c, ": ")) > 0; ) {
+			char name[l + 1];
+			char *fullpath;
+			memcpy(name, c, l);
+			name[l] = 0;
+			err = snd_user_file(name, &fullpath);
+			if (err < 0)
+				goto __end;
+			if (snd_pcm_ladspa_index_enabled())
+				err = snd_pcm_ladspa_index_check_dir(&index, plugin,
+								     fullpath, label,
+								     ladspa_id, rescan);
+			else
+				err = snd_pcm_ladspa_check_dir(plugin, fullpath,
+							       label, ladspa_id);
+			free(fullpath);
+			if (err < 0)
+				goto __end;
+			if (err > 0) {
+				err = 0;
+				goto __end;
+			}
+			c += l;
+			if (!*c)
+				break;
+			c++;
+		}
+		err = -ENOENT;
+		/* the plain scan has nothing to retry */
+		if (!snd_pcm_ladspa_index_enabled())
 			break;
-		c++;
 	}
-	return -ENOENT;
-}					  
+ __end:
+	if (index.dirty)
+		snd_pcm_ladspa_index_save(&index);
+	snd_pcm_ladspa_index_free(&index);
+	return err;
+}
 
 static int snd_pcm_ladspa_add_default_controls(snd_pcm_ladspa_plugin_t *lplug,
 					       snd_pcm_ladspa_plugin_io_t *io) 
@@ -1568,33 +2274,23 @@ static int snd_pcm_ladspa_build_plugins(struct list_head *list,
 	return 0;
 }
 
-/**
- * \brief Creates a new LADSPA<->ALSA Plugin
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param ladspa_path The path for LADSPA plugins
- * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
- * \param ladspa_pplugins The playback configuration
- * \param ladspa_cplugins The capture configuration
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
+/*
+ * snd_pcm_ladspa_open() with the number of threads running the duplicated
+ * instances (1 = the caller only); the exported prototype stays unchanged
  */
-int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
-			const char *ladspa_path,
-			unsigned int channels,
-			snd_config_t *ladspa_pplugins,
-			snd_config_t *ladspa_cplugins,
-			snd_pcm_t *slave, int close_slave)
+static int snd_pcm_ladspa_open_threads(snd_pcm_t **pcmp, const char *name,
+				       const char *ladspa_path,
+				       unsigned int channels,
+				       snd_config_t *ladspa_pplugins,
+				       snd_config_t *ladspa_cplugins,
+				       unsigned int threads,
+				       snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_ladspa_t *ladspa;
 	int err, reverse = 0;
 
-	assert(pcmp && (ladspa_pplugins || ladspa_cplugins) && slave);
+	assert(pcmp && (ladspa_pplugins || ladspa_cplugins) && slave && threads >= 1);
 
 	if (!ladspa_path && !(ladspa_path = getenv("LADSPA_PATH")))
 		return -ENOENT;
@@ -1613,6 +2309,7 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	INIT_LIST_HEAD(&ladspa->pplugins);
 	INIT_LIST_HEAD(&ladspa->cplugins);
 	ladspa->channels = channels;
+	ladspa->threads = threads;
 
 	if (slave->stream == SND_PCM_STREAM_PLAYBACK) {
 		err = snd_pcm_ladspa_build_plugins(&ladspa->pplugins, ladspa_path, ladspa_pplugins, reverse);
@@ -1649,6 +2346,33 @@ int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new LADSPA<->ALSA Plugin
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param ladspa_path The path for LADSPA plugins
+ * \param channels Force input channel count to LADSPA plugin chain, 0 = no force (auto)
+ * \param ladspa_pplugins The playback configuration
+ * \param ladspa_cplugins The capture configuration
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
+			const char *ladspa_path,
+			unsigned int channels,
+			snd_config_t *ladspa_pplugins,
+			snd_config_t *ladspa_cplugins,
+			snd_pcm_t *slave, int close_slave)
+{
+	return snd_pcm_ladspa_open_threads(pcmp, name, ladspa_path, channels,
+					   ladspa_pplugins, ladspa_cplugins,
+					   1, slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_ladpsa Plugin: LADSPA <-> ALSA
@@ -1672,6 +2396,21 @@ connected to a dummy sample area.
 
 Instances of LADSPA plugins are created dynamically.
 
+With the policy duplicate, each channel gets its own instance of the plugin.
+These instances are independent and may be run by several threads, set by
+the threads parameter (one by default, the calling thread only).  The
+plugins of the chain are still processed in the configured order.  Unless
+the plugin declares LADSPA_PROPERTY_INPLACE_BROKEN, a duplicated instance
+writes its output over the buffer of the previous plugin, so a long chain
+does not allocate a buffer for each plugin.
+
+Plugins given by label or id are looked up in the directories of the path.
+The labels, ids and port layouts found there are remembered in
+$XDG_CACHE_HOME/alsa/ladspa.idx (~/.cache/alsa by default), so later opens
+load only the library holding the plugin.  A directory is scanned again
+when its modification time changes.  Set the environment variable
+LIBASOUND_LADSPA_CACHE to 0 to always scan the directories.
+
 \code
 pcm.name {
         type ladspa             # ALSA<->LADSPA PCM
@@ -1683,6 +2422,7 @@ pcm.name {
                 pcm { }         # Slave PCM definition
         }
         [channels INT]		# count input channels (input to LADSPA plugin chain)
+	[threads INT]		# threads running duplicated instances (default 1)
 	[path STR]		# Path (directory) with LADSPA plugins
 	plugins |		# Definition for both directions
         playback_plugins |	# Definition for playback direction
@@ -1739,7 +2479,7 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	const char *path = NULL;
-	long channels = 0;
+	long channels = 0, threads = 1;
 	snd_config_t *plugins = NULL, *pplugins = NULL, *cplugins = NULL;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1764,6 +2504,14 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
                                 channels = 0;
 			continue;
 		}
+		if (strcmp(id, "threads") == 0) {
+			err = snd_config_get_integer(n, &threads);
+			if (err < 0 || threads < 1 || threads > 64) {
+				SNDERR("Invalid threads value");
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "plugins") == 0) {
 			plugins = n;
 			continue;
@@ -1798,7 +2546,8 @@ int _snd_pcm_ladspa_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_ladspa_open(pcmp, name, path, channels, pplugins, cplugins, spcm, 1);
+	err = snd_pcm_ladspa_open_threads(pcmp, name, path, channels,
+					  pplugins, cplugins, threads, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
@@ -44,6 +44,7 @@ typedef struct {
 	unsigned int use_getput;
 	unsigned int conv_idx;
 	unsigned int get_idx, put_idx;
+	snd_pcm_linear_conv_t conv_func;
 	snd_pcm_format_t sformat;
 } snd_pcm_linear_t;
 #endif
@@ -214,6 +215,291 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 	}
 }
 
+/*
+ * Specialized conversion loops
+ *
+ * For the common linear formats a dedicated loop is generated for each
+ * (source, destination) pair.  Samples go through a left-justified 32 bit
+ * value, the result is bit-exact with the conv_labels/getput paths.  When
+ * the samples are contiguous (interleaved buffers with the same layout
+ * on both sides), the whole block is converted in one run which the
+ * compiler can vectorize.  Other formats use the label tables.
+ */
+
+enum {
+	CONV_U8,
+	CONV_S16_LE,
+	CONV_S16_BE,
+	CONV_S24_LE,
+	CONV_S24_BE,
+	CONV_S24_3LE,
+	CONV_S24_3BE,
+	CONV_S32_LE,
+	CONV_S32_BE,
+	CONV_FORMATS
+};
+
+#ifdef SND_LITTLE_ENDIAN
+#define conv_le16(x)	(x)
+#define conv_be16(x)	bswap_16(x)
+#define conv_le32(x)	(x)
+#define conv_be32(x)	bswap_32(x)
+#else
+#define conv_le16(x)	bswap_16(x)
+#define conv_be16(x)	(x)
+#define conv_le32(x)	bswap_32(x)
+#define conv_be32(x)	(x)
+#endif
+
+#define conv_get_triple_le(p) \
+	((uint32_t)((const uint8_t *)(p))[0] | \
+	 (uint32_t)((const uint8_t *)(p))[1] << 8 | \
+	 (uint32_t)((const uint8_t *)(p))[2] << 16)
+#define conv_get_triple_be(p) \
+	((uint32_t)((const uint8_t *)(p))[0] << 16 | \
+	 (uint32_t)((const uint8_t *)(p))[1] << 8 | \
+	 (uint32_t)((const uint8_t *)(p))[2])
+#define conv_put_triple_le(p, v) do { \
+	((uint8_t *)(p))[0] = (v); \
+	((uint8_t *)(p))[1] = (v) >> 8; \
+	((uint8_t *)(p))[2] = (v) >> 16; \
+} while (0)
+#define conv_put_triple_be(p, v) do { \
+	((uint8_t *)(p))[0] = (v) >> 16; \
+	((uint8_t *)(p))[1] = (v) >> 8; \
+	((uint8_t *)(p))[2] = (v); \
+} while (0)
+
+static inline __attribute__((always_inline))
+unsigned int conv_bytes(int fmt)
+{
+	switch (fmt) {
+	case CONV_U8:
+		return 1;
+	case CONV_S16_LE:
+	case CONV_S16_BE:
+		return 2;
+	case CONV_S24_3LE:
+	case CONV_S24_3BE:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+static inline __attribute__((always_inline))
+uint32_t conv_get(const char *src, int fmt)
+{
+	switch (fmt) {
+	case CONV_U8:
+		return (uint32_t)(*(const uint8_t *)src ^ 0x80) << 24;
+	case CONV_S16_LE:
+		return (uint32_t)(uint16_t)conv_le16(*(const uint16_t *)src) << 16;
+	case CONV_S16_BE:
+		return (uint32_t)(uint16_t)conv_be16(*(const uint16_t *)src) << 16;
+	case CONV_S24_LE:
+		return conv_le32(*(const uint32_t *)src) << 8;
+	case CONV_S24_BE:
+		return conv_be32(*(const uint32_t *)src) << 8;
+	case CONV_S24_3LE:
+		return conv_get_triple_le(src) << 8;
+	case CONV_S24_3BE:
+		return conv_get_triple_be(src) << 8;
+	case CONV_S32_LE:
+		return conv_le32(*(const uint32_t *)src);
+	default:
+		return conv_be32(*(const uint32_t *)src);
+	}
+}
+
+static inline __attribute__((always_inline))
+void conv_put(char *dst, uint32_t val, int fmt)
+{
+	switch (fmt) {
+	case CONV_U8:
+		*(uint8_t *)dst = (val >> 24) ^ 0x80;
+		break;
+	case CONV_S16_LE:
+		*(uint16_t *)dst = conv_le16((uint16_t)(val >> 16));
+		break;
+	case CONV_S16_BE:
+		*(uint16_t *)dst = conv_be16((uint16_t)(val >> 16));
+		break;
+	case CONV_S24_LE:
+		*(uint32_t *)dst = conv_le32((uint32_t)((int32_t)val >> 8));
+		break;
+	case CONV_S24_BE:
+		*(uint32_t *)dst = conv_be32((uint32_t)((int32_t)val >> 8));
+		break;
+	case CONV_S24_3LE:
+		conv_put_triple_le(dst, val >> 8);
+		break;
+	case CONV_S24_3BE:
+		conv_put_triple_be(dst, val >> 8);
+		break;
+	case CONV_S32_LE:
+		*(uint32_t *)dst = conv_le32(val);
+		break;
+	default:
+		*(uint32_t *)dst = conv_be32(val);
+		break;
+	}
+}
+
+#define CONV_BLOCK	32
+
+static inline __attribute__((always_inline))
+void conv_run(char *__restrict dst, unsigned int dst_step,
+	      const char *__restrict src, unsigned int src_step,
+	      snd_pcm_uframes_t samples, int sfmt, int dfmt)
+{
+	const unsigned int sbytes = conv_bytes(sfmt);
+	const unsigned int dbytes = conv_bytes(dfmt);
+	snd_pcm_uframes_t i;
+
+	if (src_step == sbytes && dst_step == dbytes) {
+		/* fixed size blocks are vectorized even at -O2 */
+		for (; samples >= CONV_BLOCK; samples -= CONV_BLOCK) {
+			for (i = 0; i < CONV_BLOCK; i++)
+				conv_put(dst + i * dbytes,
+					 conv_get(src + i * sbytes, sfmt), dfmt);
+			src += CONV_BLOCK * sbytes;
+			dst += CONV_BLOCK * dbytes;
+		}
+		for (i = 0; i < samples; i++)
+			conv_put(dst + i * dbytes,
+				 conv_get(src + i * sbytes, sfmt), dfmt);
+		return;
+	}
+	while (samples-- > 0) {
+		conv_put(dst, conv_get(src, sfmt), dfmt);
+		src += src_step;
+		dst += dst_step;
+	}
+}
+
+#define CONV_FUNC(sfmt, dfmt) \
+static void conv_##sfmt##_##dfmt(char *dst, unsigned int dst_step, \
+				 const char *src, unsigned int src_step, \
+				 snd_pcm_uframes_t samples) \
+{ \
+	conv_run(dst, dst_step, src, src_step, samples, \
+		 CONV_##sfmt, CONV_##dfmt); \
+}
+
+#define CONV_FUNCS(sfmt) \
+	CONV_FUNC(sfmt, U8) \
+	CONV_FUNC(sfmt, S16_LE) CONV_FUNC(sfmt, S16_BE) \
+	CONV_FUNC(sfmt, S24_LE) CONV_FUNC(sfmt, S24_BE) \
+	CONV_FUNC(sfmt, S24_3LE) CONV_FUNC(sfmt, S24_3BE) \
+	CONV_FUNC(sfmt, S32_LE) CONV_FUNC(sfmt, S32_BE)
+
+CONV_FUNCS(U8)
+CONV_FUNCS(S16_LE)
+CONV_FUNCS(S16_BE)
+CONV_FUNCS(S24_LE)
+CONV_FUNCS(S24_BE)
+CONV_FUNCS(S24_3LE)
+CONV_FUNCS(S24_3BE)
+CONV_FUNCS(S32_LE)
+CONV_FUNCS(S32_BE)
+
+#define CONV_ROW(sfmt) { \
+	conv_##sfmt##_U8, \
+	conv_##sfmt##_S16_LE, conv_##sfmt##_S16_BE, \
+	conv_##sfmt##_S24_LE, conv_##sfmt##_S24_BE, \
+	conv_##sfmt##_S24_3LE, conv_##sfmt##_S24_3BE, \
+	conv_##sfmt##_S32_LE, conv_##sfmt##_S32_BE }
+
+static const snd_pcm_linear_conv_t conv_funcs[CONV_FORMATS][CONV_FORMATS] = {
+	CONV_ROW(U8),
+	CONV_ROW(S16_LE),
+	CONV_ROW(S16_BE),
+	CONV_ROW(S24_LE),
+	CONV_ROW(S24_BE),
+	CONV_ROW(S24_3LE),
+	CONV_ROW(S24_3BE),
+	CONV_ROW(S32_LE),
+	CONV_ROW(S32_BE),
+};
+
+#undef CONV_ROW
+#undef CONV_FUNCS
+#undef CONV_FUNC
+
+static int conv_format_index(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_U8:		return CONV_U8;
+	case SND_PCM_FORMAT_S16_LE:	return CONV_S16_LE;
+	case SND_PCM_FORMAT_S16_BE:	return CONV_S16_BE;
+	case SND_PCM_FORMAT_S24_LE:	return CONV_S24_LE;
+	case SND_PCM_FORMAT_S24_BE:	return CONV_S24_BE;
+	case SND_PCM_FORMAT_S24_3LE:	return CONV_S24_3LE;
+	case SND_PCM_FORMAT_S24_3BE:	return CONV_S24_3BE;
+	case SND_PCM_FORMAT_S32_LE:	return CONV_S32_LE;
+	case SND_PCM_FORMAT_S32_BE:	return CONV_S32_BE;
+	default:			return -EINVAL;
+	}
+}
+
+/* returns NULL when no specialized loop exists for the format pair */
+snd_pcm_linear_conv_t snd_pcm_linear_conv_find(snd_pcm_format_t src_format,
+						snd_pcm_format_t dst_format)
+{
+	int sidx = conv_format_index(src_format);
+	int didx = conv_format_index(dst_format);
+
+	if (sidx < 0 || didx < 0)
+		return NULL;
+	return conv_funcs[sidx][didx];
+}
+
+/* check whether all channels are interleaved in one buffer in order */
+static int conv_areas_contiguous(const snd_pcm_channel_area_t *areas,
+				 unsigned int channels, unsigned int width)
+{
+	unsigned int c;
+
+	if (areas->step != channels * width)
+		return 0;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].step != areas->step ||
+		    areas[c].first != areas->first + c * width)
+			return 0;
+	}
+	return 1;
+}
+
+void snd_pcm_linear_conv_areas(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			       const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			       unsigned int channels, snd_pcm_uframes_t frames,
+			       snd_pcm_format_t dst_format, snd_pcm_format_t src_format,
+			       snd_pcm_linear_conv_t conv)
+{
+	unsigned int swidth = snd_pcm_format_physical_width(src_format);
+	unsigned int dwidth = snd_pcm_format_physical_width(dst_format);
+	unsigned int channel;
+
+	if (conv_areas_contiguous(src_areas, channels, swidth) &&
+	    conv_areas_contiguous(dst_areas, channels, dwidth)) {
+		conv(snd_pcm_channel_area_addr(dst_areas, dst_offset), dwidth / 8,
+		     snd_pcm_channel_area_addr(src_areas, src_offset), swidth / 8,
+		     frames * channels);
+		return;
+	}
+	for (channel = 0; channel < channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		conv(snd_pcm_channel_area_addr(dst_area, dst_offset),
+		     snd_pcm_channel_area_step(dst_area),
+		     snd_pcm_channel_area_addr(src_area, src_offset),
+		     snd_pcm_channel_area_step(src_area),
+		     frames);
+	}
+}
+
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_linear_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
@@ -308,6 +594,10 @@ static int snd_pcm_linear_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	err = INTERNAL(snd_pcm_hw_params_get_format)(params, &format);
 	if (err < 0)
 		return err;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		linear->conv_func = snd_pcm_linear_conv_find(format, linear->sformat);
+	else
+		linear->conv_func = snd_pcm_linear_conv_find(linear->sformat, format);
 	linear->use_getput = (snd_pcm_format_physical_width(format) == 24 ||
 			      snd_pcm_format_physical_width(linear->sformat) == 24 ||
 			      snd_pcm_format_width(format) == 20 ||
@@ -343,7 +633,13 @@ snd_pcm_linear_write_areas(snd_pcm_t *pcm,
 	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
+	if (linear->conv_func)
+		snd_pcm_linear_conv_areas(slave_areas, slave_offset,
+					  areas, offset,
+					  pcm->channels, size,
+					  linear->sformat, pcm->format,
+					  linear->conv_func);
+	else if (linear->use_getput)
 		snd_pcm_linear_getput(slave_areas, slave_offset,
 				      areas, offset, 
 				      pcm->channels, size,
@@ -368,7 +664,13 @@ snd_pcm_linear_read_areas(snd_pcm_t *pcm,
 	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
+	if (linear->conv_func)
+		snd_pcm_linear_conv_areas(areas, offset,
+					  slave_areas, slave_offset,
+					  pcm->channels, size,
+					  pcm->format, linear->sformat,
+					  linear->conv_func);
+	else if (linear->use_getput)
 		snd_pcm_linear_getput(areas, offset, 
 				      slave_areas, slave_offset,
 				      pcm->channels, size,
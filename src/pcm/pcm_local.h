@@ -237,6 +237,9 @@ struct _snd_pcm {
 					 */
 	unsigned int donot_close: 1;	/* don't close this PCM */
 	unsigned int own_state_check:1; /* plugin has own PCM state check */
+	unsigned int refine_cacheable:1; /* refine results of the whole chain
+					  * are stable, see pcm_refine.c
+					  */
 	snd_pcm_channel_info_t *mmap_channels;
 	snd_pcm_channel_area_t *running_areas;
 	snd_pcm_channel_area_t *stopped_areas;
@@ -246,6 +249,12 @@ struct _snd_pcm {
 	snd_pcm_t *fast_op_arg;
 	void *private_data;
 	struct list_head async_handlers;
+	struct snd_pcm_prof *prof;	/* profiling counters, NULL = disabled */
+	struct snd_pcm_refine_cache *refine_cache; /* memoized hw_refine results */
+	snd_pcm_t *fast_slave;	/* pass-through layer: fast ops are resolved
+				 * to this slave while set up
+				 */
+	const snd_pcm_fast_ops_t *own_fast_ops;	/* restored on hw_free */
 #ifdef THREAD_SAFE_API
 	int need_lock;		/* true = this PCM (plugin) is thread-unsafe,
 				 * thus it needs a lock.
@@ -393,6 +402,67 @@ snd_pcm_sframes_t snd_pcm_mmap_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_ufram
 snd_pcm_sframes_t snd_pcm_mmap_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size);
 snd_pcm_sframes_t snd_pcm_mmap_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size);
 
+struct snd_pcm_prof {
+	snd_pcm_prof_counters_t op[SND_PCM_PROF_LAST + 1];
+};
+
+typedef struct {
+	struct timespec start;
+	unsigned long long child_nsecs;
+} snd_pcm_prof_mark_t;
+
+#define snd_pcm_prof_begin \
+	snd1_pcm_prof_begin
+#define snd_pcm_prof_end \
+	snd1_pcm_prof_end
+
+void snd_pcm_prof_begin(snd_pcm_prof_mark_t *mark);
+void snd_pcm_prof_end(snd_pcm_t *pcm, snd_pcm_prof_op_t op,
+		      snd_pcm_prof_mark_t *mark, snd_pcm_sframes_t frames);
+
+#define snd_pcm_set_fast_slave \
+	snd1_pcm_set_fast_slave
+#define snd_pcm_resolve_fast_ops \
+	snd1_pcm_resolve_fast_ops
+
+void snd_pcm_set_fast_slave(snd_pcm_t *pcm, snd_pcm_t *slave);
+void snd_pcm_resolve_fast_ops(snd_pcm_t *pcm);
+
+struct snd_pcm_refine_cache;
+
+#define snd_pcm_refine_cache_mode \
+	snd1_pcm_refine_cache_mode
+#define snd_pcm_refine_cacheable \
+	snd1_pcm_refine_cacheable
+#define snd_pcm_refine_cache_get \
+	snd1_pcm_refine_cache_get
+#define snd_pcm_refine_cache_new \
+	snd1_pcm_refine_cache_new
+#define snd_pcm_refine_cache_lookup \
+	snd1_pcm_refine_cache_lookup
+#define snd_pcm_refine_cache_store \
+	snd1_pcm_refine_cache_store
+#define snd_pcm_refine_cache_flush \
+	snd1_pcm_refine_cache_flush
+#define snd_pcm_refine_cache_free \
+	snd1_pcm_refine_cache_free
+#define snd_pcm_cache_dir \
+	snd1_pcm_cache_dir
+
+int snd_pcm_refine_cache_mode(void);
+int snd_pcm_refine_cacheable(snd_pcm_t *pcm);
+struct snd_pcm_refine_cache *snd_pcm_refine_cache_get(snd_pcm_t *pcm);
+struct snd_pcm_refine_cache *snd_pcm_refine_cache_new(const char *name,
+						      const char *tag);
+int snd_pcm_refine_cache_lookup(struct snd_pcm_refine_cache *cache,
+				snd_pcm_hw_params_t *params, int *result);
+void snd_pcm_refine_cache_store(struct snd_pcm_refine_cache *cache,
+				const snd_pcm_hw_params_t *in,
+				const snd_pcm_hw_params_t *out, int result);
+void snd_pcm_refine_cache_flush(struct snd_pcm_refine_cache *cache);
+void snd_pcm_refine_cache_free(struct snd_pcm_refine_cache *cache);
+char *snd_pcm_cache_dir(void);
+
 typedef snd_pcm_sframes_t (*snd_pcm_xfer_areas_func_t)(snd_pcm_t *pcm, 
 						       const snd_pcm_channel_area_t *areas,
 						       snd_pcm_uframes_t offset, 
@@ -429,9 +499,17 @@ int __snd_pcm_wait_in_lock(snd_pcm_t *pcm, int timeout);
 
 static inline snd_pcm_sframes_t __snd_pcm_avail_update(snd_pcm_t *pcm)
 {
+	snd_pcm_prof_mark_t mark;
+	snd_pcm_sframes_t result;
+
 	if (!pcm->fast_ops->avail_update)
 		return -ENOSYS;
-	return pcm->fast_ops->avail_update(pcm->fast_op_arg);
+	if (!pcm->prof)
+		return pcm->fast_ops->avail_update(pcm->fast_op_arg);
+	snd_pcm_prof_begin(&mark);
+	result = pcm->fast_ops->avail_update(pcm->fast_op_arg);
+	snd_pcm_prof_end(pcm, SND_PCM_PROF_AVAIL_UPDATE, &mark, 0);
+	return result;
 }
 
 static inline int __snd_pcm_start(snd_pcm_t *pcm)
@@ -645,10 +723,18 @@ static inline unsigned int snd_pcm_channel_area_step(const snd_pcm_channel_area_
 
 static inline snd_pcm_sframes_t _snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size)
 {
+	snd_pcm_prof_mark_t mark;
+	snd_pcm_sframes_t result;
+
 	/* lock handled in the callback */
 	if (!pcm->fast_ops->writei)
 		return -ENOSYS;
-	return pcm->fast_ops->writei(pcm->fast_op_arg, buffer, size);
+	if (!pcm->prof)
+		return pcm->fast_ops->writei(pcm->fast_op_arg, buffer, size);
+	snd_pcm_prof_begin(&mark);
+	result = pcm->fast_ops->writei(pcm->fast_op_arg, buffer, size);
+	snd_pcm_prof_end(pcm, SND_PCM_PROF_WRITEI, &mark, result);
+	return result;
 }
 
 static inline snd_pcm_sframes_t _snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size)
@@ -661,10 +747,18 @@ static inline snd_pcm_sframes_t _snd_pcm_writen(snd_pcm_t *pcm, void **bufs, snd
 
 static inline snd_pcm_sframes_t _snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t size)
 {
+	snd_pcm_prof_mark_t mark;
+	snd_pcm_sframes_t result;
+
 	/* lock handled in the callback */
 	if (!pcm->fast_ops->readi)
 		return -ENOSYS;
-	return pcm->fast_ops->readi(pcm->fast_op_arg, buffer, size);
+	if (!pcm->prof)
+		return pcm->fast_ops->readi(pcm->fast_op_arg, buffer, size);
+	snd_pcm_prof_begin(&mark);
+	result = pcm->fast_ops->readi(pcm->fast_op_arg, buffer, size);
+	snd_pcm_prof_end(pcm, SND_PCM_PROF_READI, &mark, result);
+	return result;
 }
 
 static inline snd_pcm_sframes_t _snd_pcm_readn(snd_pcm_t *pcm, void **bufs, snd_pcm_uframes_t size)
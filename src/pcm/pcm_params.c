@@ -2346,6 +2346,8 @@ static int snd_pcm_sw_params_default(snd_pcm_t *pcm, snd_pcm_sw_params_t *params
 
 int snd_pcm_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
+	struct snd_pcm_refine_cache *cache;
+	snd_pcm_hw_params_t in;
 	int res;
 #ifdef REFINE_DEBUG
 	snd_output_t *log;
@@ -2356,10 +2358,18 @@ int snd_pcm_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	snd_output_printf(log, "REFINE called:\n");
 	snd_pcm_hw_params_dump(params, log);
 #endif
+	cache = snd_pcm_refine_cache_get(pcm);
+	if (snd_pcm_refine_cache_lookup(cache, params, &res))
+		goto _done;
+	if (cache)
+		in = *params;
 	if (pcm->ops->hw_refine)
 		res = pcm->ops->hw_refine(pcm->op_arg, params);
 	else
 		res = -ENOSYS;
+	if (cache)
+		snd_pcm_refine_cache_store(cache, &in, params, res);
+ _done:
 #ifdef REFINE_DEBUG
 	snd_output_printf(log, "refine done - result = %i\n", res);
 	snd_pcm_hw_params_dump(params, log);
@@ -2394,6 +2404,8 @@ int _snd_pcm_hw_params_internal(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		if (err < 0)
 			return err;
 	}
+	/* the constraints may depend on the configured state */
+	snd_pcm_refine_cache_flush(pcm->refine_cache);
 	if (pcm->ops->hw_params)
 		err = pcm->ops->hw_params(pcm->op_arg, params);
 	else
@@ -2402,6 +2414,7 @@ int _snd_pcm_hw_params_internal(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		return err;
 
 	pcm->setup = 1;
+	snd_pcm_resolve_fast_ops(pcm);
 	INTERNAL(snd_pcm_hw_params_get_access)(params, &pcm->access);
 	INTERNAL(snd_pcm_hw_params_get_format)(params, &pcm->format);
 	INTERNAL(snd_pcm_hw_params_get_subformat)(params, &pcm->subformat);
@@ -55,6 +55,8 @@ typedef struct {
 	snd_pcm_route_ttable_entry_t *ttable;
 	int ttable_ok;
 	unsigned int tt_ssize, tt_cused, tt_sused;
+	int float_mode;		/* keep the conversion chain in float */
+	snd_pcm_route_volume_t *vol;	/* soft volume applied by route */
 } snd_pcm_plug_t;
 
 #endif
@@ -64,6 +66,8 @@ static int snd_pcm_plug_close(snd_pcm_t *pcm)
 	snd_pcm_plug_t *plug = pcm->private_data;
 	int err, result = 0;
 	free(plug->ttable);
+	if (plug->vol)
+		plug->vol->free(plug->vol);
 	if (plug->rate_converter) {
 		snd_config_delete(plug->rate_converter);
 		plug->rate_converter = NULL;
@@ -367,6 +371,13 @@ typedef struct {
 } snd_pcm_plug_params_t;
 #endif
 
+/* 32 bit float formats handled by the route plugin itself */
+static inline int snd_pcm_plug_route_float(snd_pcm_format_t format)
+{
+	return format == SND_PCM_FORMAT_FLOAT_LE ||
+	       format == SND_PCM_FORMAT_FLOAT_BE;
+}
+
 #ifdef BUILD_PCM_PLUGIN_RATE
 static int snd_pcm_plug_change_rate(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_plug_params_t *clt, snd_pcm_plug_params_t *slv)
 {
@@ -387,6 +398,15 @@ static int snd_pcm_plug_change_rate(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_plu
 }
 #endif
 
+/*
+ * Check whether a route plugin is needed although the channels match:
+ * for a ttable that is not the identity, or to apply the soft volume.
+ */
+static int snd_pcm_plug_route_forced(snd_pcm_plug_t *plug)
+{
+	return (plug->ttable || plug->vol) && !plug->ttable_ok;
+}
+
 #ifdef BUILD_PCM_PLUGIN_ROUTE
 static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_plug_params_t *clt, snd_pcm_plug_params_t *slv)
 {
@@ -394,13 +414,18 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 	unsigned int tt_ssize, tt_cused, tt_sused;
 	snd_pcm_route_ttable_entry_t *ttable;
 	int err;
-	if (clt->channels == slv->channels &&
-	    (!plug->ttable || plug->ttable_ok))
+	if (clt->channels == slv->channels && !snd_pcm_plug_route_forced(plug))
 		return 0;
+	/*
+	 * with resampling, route works on the side with fewer channels, and
+	 * at the lower rate when the channel counts are equal
+	 */
 	if (clt->rate != slv->rate &&
-	    clt->channels > slv->channels)
+	    (clt->channels > slv->channels ||
+	     (clt->channels == slv->channels && clt->rate < slv->rate)))
 		return 0;
-	assert(snd_pcm_format_linear(slv->format));
+	assert(snd_pcm_format_linear(slv->format) ||
+	       snd_pcm_plug_route_float(slv->format));
 	tt_ssize = slv->channels;
 	tt_cused = clt->channels;
 	tt_sused = slv->channels;
@@ -419,7 +444,6 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 				ttable[c * tt_ssize + s] = v;
 			}
 		}
-		plug->ttable_ok = 1;
 	} else {
 		unsigned int k;
 		unsigned int c = 0, s = 0;
@@ -482,9 +506,18 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 	err = snd_pcm_route_open(new, NULL, slv->format, (int) slv->channels, ttable, tt_ssize, tt_cused, tt_sused, plug->gen.slave, plug->gen.slave != plug->req_slave);
 	if (err < 0)
 		return err;
+	if (plug->vol)
+		snd_pcm_route_set_volume(*new, plug->vol);
+	plug->ttable_ok = 1;
 	slv->channels = clt->channels;
 	slv->access = clt->access;
-	if (snd_pcm_format_linear(clt->format))
+	/*
+	 * route converts linear formats and, when no rate plugin has to
+	 * sit on top of it, 32 bit float too, so no extra linear/lfloat
+	 * pass is needed
+	 */
+	if (snd_pcm_format_linear(clt->format) ||
+	    (clt->rate == slv->rate && snd_pcm_plug_route_float(clt->format)))
 		slv->format = clt->format;
 	return 1;
 }
@@ -501,14 +534,14 @@ static int snd_pcm_plug_change_format(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_p
 	if (clt->format == slv->format &&
 	    clt->rate == slv->rate &&
 	    clt->channels == slv->channels &&
-	    (!plug->ttable || plug->ttable_ok))
+	    !snd_pcm_plug_route_forced(plug))
 		return 0;
 
 	if (snd_pcm_format_linear(slv->format)) {
 		/* Conversion is done in another plugin */
 		if (clt->rate != slv->rate ||
 		    clt->channels != slv->channels ||
-		    (plug->ttable && !plug->ttable_ok))
+		    snd_pcm_plug_route_forced(plug))
 			return 0;
 		cfmt = clt->format;
 		switch (clt->format) {
@@ -539,11 +572,27 @@ static int snd_pcm_plug_change_format(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm_p
 		}
 #ifdef BUILD_PCM_PLUGIN_LFLOAT
 	} else if (snd_pcm_format_float(slv->format)) {
+#ifdef BUILD_PCM_PLUGIN_ROUTE
+		/*
+		 * in float mode, a route plugin writes the float slave
+		 * format directly, so the chain converts only once; so does
+		 * the route plugin applying a soft volume, which must not
+		 * cut float data down to 16 bits
+		 */
+		if ((plug->float_mode || plug->vol) &&
+		    snd_pcm_plug_route_float(slv->format) &&
+		    clt->rate == slv->rate &&
+		    (clt->channels != slv->channels ||
+		     snd_pcm_plug_route_forced(plug)) &&
+		    (snd_pcm_format_linear(clt->format) ||
+		     snd_pcm_plug_route_float(clt->format)))
+			return 0;
+#endif
 		if (snd_pcm_format_linear(clt->format)) {
 			cfmt = clt->format;
 			f = snd_pcm_lfloat_open;
 		} else if (clt->rate != slv->rate || clt->channels != slv->channels ||
-			   (plug->ttable && !plug->ttable_ok)) {
+			   snd_pcm_plug_route_forced(plug)) {
 			cfmt = SND_PCM_FORMAT_S16;
 			f = snd_pcm_lfloat_open;
 		} else
@@ -635,6 +684,28 @@ static int snd_pcm_plug_change_mmap(snd_pcm_t *pcm, snd_pcm_t **new,
 }
 #endif
 
+/*
+ * Check whether the user supplied ttable routes each of the given
+ * channels 1:1 at full volume, so no route plugin is needed for it.
+ */
+static int snd_pcm_plug_ttable_identity(snd_pcm_plug_t *plug, unsigned int channels)
+{
+	unsigned int c, s;
+
+	if (!plug->ttable)
+		return 1;
+	if (plug->tt_cused < channels || plug->tt_sused < channels)
+		return 0;
+	for (c = 0; c < channels; c++) {
+		for (s = 0; s < channels; s++) {
+			snd_pcm_route_ttable_entry_t v = plug->ttable[c * plug->tt_ssize + s];
+			if (v != (c == s ? SND_PCM_PLUGIN_ROUTE_FULL : 0))
+				return 0;
+		}
+	}
+	return 1;
+}
+
 static int snd_pcm_plug_insert_plugins(snd_pcm_t *pcm,
 				       snd_pcm_plug_params_t *client,
 				       snd_pcm_plug_params_t *slave)
@@ -659,12 +730,14 @@ static int snd_pcm_plug_insert_plugins(snd_pcm_t *pcm,
 	};
 	snd_pcm_plug_params_t p = *slave;
 	unsigned int k = 0;
-	plug->ttable_ok = 0;
+	plug->ttable_ok = (client->channels == slave->channels &&
+			   snd_pcm_plug_ttable_identity(plug, client->channels) &&
+			   !plug->vol);
 	while (client->format != p.format ||
 	       client->channels != p.channels ||
 	       client->rate != p.rate ||
 	       client->access != p.access ||
-	       (plug->ttable && !plug->ttable_ok)) {
+	       snd_pcm_plug_route_forced(plug)) {
 		snd_pcm_t *new;
 		int err;
 		if (k >= sizeof(funcs)/sizeof(*funcs)) {
@@ -823,6 +896,10 @@ static int snd_pcm_plug_hw_refine_schange(snd_pcm_t *pcm, snd_pcm_hw_params_t *p
 				continue;
 			if (snd_pcm_format_mask_test(sformat_mask, format))
 				f = format;
+			else if (plug->float_mode &&
+				 snd_pcm_format_linear(format) &&
+				 snd_pcm_format_mask_test(sformat_mask, SND_PCM_FORMAT_FLOAT))
+				f = SND_PCM_FORMAT_FLOAT;
 			else {
 				f = snd_pcm_plug_slave_format(format, sformat_mask);
 				if (f == SND_PCM_FORMAT_UNKNOWN)
@@ -1029,10 +1106,16 @@ static int snd_pcm_plug_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 	INTERNAL(snd_pcm_hw_params_get_channels)(&sparams, &slv_params.channels);
 	INTERNAL(snd_pcm_hw_params_get_rate)(&sparams, &slv_params.rate, 0);
 	snd_pcm_plug_clear(pcm);
+	/*
+	 * When the slave takes the client parameters as they are, no plugin
+	 * is inserted and the fast ops below point straight to the slave, so
+	 * the plug layer costs nothing in the transfer path.
+	 */
 	if (!(clt_params.format == slv_params.format &&
 	      clt_params.channels == slv_params.channels &&
 	      clt_params.rate == slv_params.rate &&
-	      !plug->ttable &&
+	      snd_pcm_plug_ttable_identity(plug, clt_params.channels) &&
+	      !plug->vol &&
 	      snd_pcm_hw_params_test_access(slave, &sparams,
 					    clt_params.access) >= 0)) {
 		INTERNAL(snd_pcm_hw_params_set_access_first)(slave, &sparams, &slv_params.access);
@@ -1090,27 +1173,21 @@ static const snd_pcm_ops_t snd_pcm_plug_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
-/**
- * \brief Creates a new Plug PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave (destination) format
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
+/*
+ * snd_pcm_plug_open() with the float mode of the configuration: when set,
+ * prefer a 32 bit float slave format and keep the conversions in float;
+ * the exported prototype stays unchanged
  */
-int snd_pcm_plug_open(snd_pcm_t **pcmp,
-		      const char *name,
-		      snd_pcm_format_t sformat, int schannels, int srate,
-		      const snd_config_t *rate_converter,
-		      enum snd_pcm_plug_route_policy route_policy,
-		      snd_pcm_route_ttable_entry_t *ttable,
-		      unsigned int tt_ssize,
-		      unsigned int tt_cused, unsigned int tt_sused,
-		      snd_pcm_t *slave, int close_slave)
+static int snd_pcm_plug_open_float(snd_pcm_t **pcmp,
+				   const char *name,
+				   snd_pcm_format_t sformat, int schannels, int srate,
+				   const snd_config_t *rate_converter,
+				   enum snd_pcm_plug_route_policy route_policy,
+				   snd_pcm_route_ttable_entry_t *ttable,
+				   unsigned int tt_ssize,
+				   unsigned int tt_cused, unsigned int tt_sused,
+				   int float_mode,
+				   snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_plug_t *plug;
@@ -1130,6 +1207,7 @@ int snd_pcm_plug_open(snd_pcm_t **pcmp,
 	plug->tt_ssize = tt_ssize;
 	plug->tt_cused = tt_cused;
 	plug->tt_sused = tt_sused;
+	plug->float_mode = float_mode;
 	
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_PLUG, name, slave->stream, slave->mode);
 	if (err < 0) {
@@ -1160,6 +1238,55 @@ int snd_pcm_plug_open(snd_pcm_t **pcmp,
 	return 0;
 }
 
+/**
+ * \brief Creates a new Plug PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave (destination) format
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_plug_open(snd_pcm_t **pcmp,
+		      const char *name,
+		      snd_pcm_format_t sformat, int schannels, int srate,
+		      const snd_config_t *rate_converter,
+		      enum snd_pcm_plug_route_policy route_policy,
+		      snd_pcm_route_ttable_entry_t *ttable,
+		      unsigned int tt_ssize,
+		      unsigned int tt_cused, unsigned int tt_sused,
+		      snd_pcm_t *slave, int close_slave)
+{
+	return snd_pcm_plug_open_float(pcmp, name, sformat, schannels, srate,
+				       rate_converter, route_policy, ttable,
+				       tt_ssize, tt_cused, tt_sused, 0,
+				       slave, close_slave);
+}
+
+#ifndef DOC_HIDDEN
+/*
+ * Take over a soft volume: a route plugin is then always inserted and
+ * applies the gains while it converts.  plug frees the volume on close.
+ */
+int snd_pcm_plug_set_volume(snd_pcm_t *pcm, snd_pcm_route_volume_t *vol)
+{
+#ifdef BUILD_PCM_PLUGIN_ROUTE
+	snd_pcm_plug_t *plug = pcm->private_data;
+
+	assert(pcm->type == SND_PCM_TYPE_PLUG);
+	if (plug->vol)
+		return -EBUSY;
+	plug->vol = vol;
+	return 0;
+#else
+	return -ENXIO;
+#endif
+}
+#endif
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_plug Automatic conversion plugin
@@ -1195,9 +1322,23 @@ pcm.name {
 	rate_converter [ STR1 STR2 ... ]
 				# type of rate converter
 				# default value is taken from defaults.pcm.rate_converter
+	float BOOL		# convert to the float slave format once and do
+				# the channel routing in float (default no)
+				# default value is taken from defaults.pcm.plug_float
 }
 \endcode
 
+When \c float is set and the slave accepts #SND_PCM_FORMAT_FLOAT, a client
+format that the slave does not take is converted to float rather than to
+the nearest linear format, and the route plugin mixes in float without
+clipping.  This avoids repeated integer/float round trips when the slave is
+a float chain (e.g. softvol on top of ladspa).
+
+A softvol plugin with \c fold_into_plug set hands its volume over to a
+plug slave: the route plugin then applies the volume in the same pass as
+the format and channel conversion, and the softvol plugin is not inserted
+at all.
+
 \subsection pcm_plugins_plug_funcref Function reference
 
 <UL>
@@ -1236,10 +1377,18 @@ int _snd_pcm_plug_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_format_t sformat = SND_PCM_FORMAT_UNKNOWN;
 	int schannels = -1, srate = -1;
 	const snd_config_t *rate_converter = NULL;
-
+	int float_mode = 0;
+	snd_config_t *n;
+
+	/* look for defaults.pcm.plug_float definition */
+	if (snd_config_search(root, "defaults.pcm.plug_float", &n) >= 0) {
+		err = snd_config_get_bool(n);
+		if (err >= 0)
+			float_mode = err;
+	}
 	snd_config_for_each(i, next, conf) {
-		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
+		n = snd_config_iterator_entry(i);
 		if (snd_config_get_id(n, &id) < 0)
 			continue;
 		if (snd_pcm_conf_generic_id(id))
@@ -1248,6 +1397,13 @@ int _snd_pcm_plug_open(snd_pcm_t **pcmp, const char *name,
 			slave = n;
 			continue;
 		}
+		if (strcmp(id, "float") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			float_mode = err;
+			continue;
+		}
 #ifdef BUILD_PCM_PLUGIN_ROUTE
 		if (strcmp(id, "ttable") == 0) {
 			route_policy = PLUG_ROUTE_POLICY_NONE;
@@ -1325,8 +1481,9 @@ int _snd_pcm_plug_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_plug_open(pcmp, name, sformat, schannels, srate, rate_converter,
-				route_policy, ttable, ssize, cused, sused, spcm, 1);
+	err = snd_pcm_plug_open_float(pcmp, name, sformat, schannels, srate,
+				      rate_converter, route_policy, ttable,
+				      ssize, cused, sused, float_mode, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
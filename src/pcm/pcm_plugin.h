@@ -90,6 +90,8 @@ snd_pcm_sframes_t snd_pcm_plugin_undo_write_generic
 #define snd_pcm_linear_convert_index	snd1_pcm_linear_convert_index
 #define snd_pcm_linear_convert	snd1_pcm_linear_convert
 #define snd_pcm_linear_getput	snd1_pcm_linear_getput
+#define snd_pcm_linear_conv_find	snd1_pcm_linear_conv_find
+#define snd_pcm_linear_conv_areas	snd1_pcm_linear_conv_areas
 #define snd_pcm_alaw_decode	snd1_pcm_alaw_decode
 #define snd_pcm_alaw_encode	snd1_pcm_alaw_encode
 #define snd_pcm_mulaw_decode	snd1_pcm_mulaw_decode
@@ -109,6 +111,18 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 			   unsigned int channels, snd_pcm_uframes_t frames,
 			   unsigned int get_idx, unsigned int put_idx);
+
+typedef void (*snd_pcm_linear_conv_t)(char *dst, unsigned int dst_step,
+				      const char *src, unsigned int src_step,
+				      snd_pcm_uframes_t samples);
+snd_pcm_linear_conv_t snd_pcm_linear_conv_find(snd_pcm_format_t src_format,
+						snd_pcm_format_t dst_format);
+void snd_pcm_linear_conv_areas(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			       const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+			       unsigned int channels, snd_pcm_uframes_t frames,
+			       snd_pcm_format_t dst_format, snd_pcm_format_t src_format,
+			       snd_pcm_linear_conv_t conv);
+
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			 snd_pcm_uframes_t dst_offset,
 			 const snd_pcm_channel_area_t *src_areas,
@@ -153,3 +167,23 @@ void snd_pcm_adpcm_encode(const snd_pcm_channel_area_t *dst_areas,
 			  unsigned int channels, snd_pcm_uframes_t frames,
 			  unsigned int getidx,
 			  snd_pcm_adpcm_state_t *states);
+
+/*
+ * A soft volume folded into the route stage of plug: route asks for the
+ * gains of the client channels on every transfer and applies them in the
+ * same pass as the conversion and the channel matrix.  The gains are
+ * 16.16 fixed point, 0xffff meaning unity.  The volume is owned by plug,
+ * which calls free when it is closed.
+ */
+typedef struct snd_pcm_route_volume snd_pcm_route_volume_t;
+struct snd_pcm_route_volume {
+	void (*get_gains)(snd_pcm_route_volume_t *vol, unsigned int channels,
+			  unsigned int *gain);
+	void (*free)(snd_pcm_route_volume_t *vol);
+};
+
+#define snd_pcm_route_set_volume	snd1_pcm_route_set_volume
+#define snd_pcm_plug_set_volume		snd1_pcm_plug_set_volume
+
+int snd_pcm_route_set_volume(snd_pcm_t *pcm, snd_pcm_route_volume_t *vol);
+int snd_pcm_plug_set_volume(snd_pcm_t *pcm, snd_pcm_route_volume_t *vol);
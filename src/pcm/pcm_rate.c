@@ -28,6 +28,7 @@
  *
  */
 #include <inttypes.h>
+#include <math.h>
 #include "bswap.h"
 #include "pcm_local.h"
 #include "pcm_plugin.h"
@@ -48,10 +49,27 @@ const char *_snd_module_pcm_rate = "";
 
 typedef struct _snd_pcm_rate snd_pcm_rate_t;
 
+/* adaptive mode: the slave frames per period are trimmed by a PI controller */
+typedef struct {
+	int enabled;
+	snd_pcm_uframes_t target;	/* configured fill level, 0 = half buffer */
+	double kp, ki;
+	unsigned int max_ppm;
+	/* runtime state */
+	int trim;			/* the converter accepts trimmed periods */
+	snd_pcm_uframes_t fill;
+	snd_pcm_uframes_t max_delta;
+	int started;
+	double delay;			/* filtered fill level in client frames */
+	double integral;
+	double acc;			/* fraction of a slave frame not trimmed yet */
+} snd_pcm_rate_adapt_t;
+
 struct _snd_pcm_rate {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t appl_ptr, hw_ptr, last_slave_hw_ptr;
 	snd_pcm_uframes_t last_commit_ptr;
+	snd_pcm_uframes_t committed;	/* frames committed since prepare (saturated) */
 	snd_pcm_uframes_t orig_avail_min;
 	snd_pcm_sw_params_t sw_params;
 	snd_pcm_format_t sformat;
@@ -59,13 +77,20 @@ struct _snd_pcm_rate {
 	snd_pcm_channel_area_t *pareas;	/* areas for splitted period (rate pcm) */
 	snd_pcm_channel_area_t *sareas;	/* areas for splitted period (slave pcm) */
 	snd_pcm_rate_info_t info;
+	snd_pcm_uframes_t slave_frames;	/* slave frames per period */
+	snd_pcm_rate_adapt_t adapt;
 	void *open_func;
 	void *obj;
 	snd_pcm_rate_ops_t ops;
+	snd_pcm_format_t cvt_format;	/* interleaved format of src_buf/dst_buf */
 	unsigned int get_idx;
 	unsigned int put_idx;
-	int16_t *src_buf;
-	int16_t *dst_buf;
+	unsigned int s32_get_idx;
+	unsigned int s32_put_idx;
+	snd_pcm_linear_conv_t to_s32;
+	snd_pcm_linear_conv_t from_s32;
+	void *src_buf;
+	void *dst_buf;
 	int start_pending; /* start is triggered but not commited to slave */
 	snd_htimestamp_t trigger_tstamp;
 	unsigned int plugin_version;
@@ -73,6 +98,7 @@ struct _snd_pcm_rate {
 };
 
 #define SND_PCM_RATE_PLUGIN_VERSION_OLD	0x010001	/* old rate plugin */
+#define SND_PCM_RATE_PLUGIN_VERSION_WIDE 0x010003	/* convert_s32, convert_float */
 
 #endif /* DOC_HIDDEN */
 
@@ -86,6 +112,8 @@ static int snd_pcm_rate_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_
 					 &access_mask);
 	if (err < 0)
 		return err;
+	if (rate->ops.convert_float)
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT);
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_FORMAT,
 					 &format_mask);
 	if (err < 0)
@@ -235,12 +263,40 @@ static int snd_pcm_rate_hw_refine(snd_pcm_t *pcm,
 				       snd_pcm_generic_hw_refine);
 }
 
+/*
+ * Pick the interleaved format handed to the converter; UNKNOWN means the
+ * converter works on the areas directly.  Wide and float streams use the
+ * native S32 / FLOAT entries when present to avoid an S16 round-trip.
+ */
+static snd_pcm_format_t choose_cvt_format(snd_pcm_rate_t *rate)
+{
+	snd_pcm_format_t in = rate->info.in.format;
+	snd_pcm_format_t out = rate->info.out.format;
+	int is_float = in == SND_PCM_FORMAT_FLOAT || out == SND_PCM_FORMAT_FLOAT;
+	int wide = snd_pcm_format_width(in) > 16 || snd_pcm_format_width(out) > 16;
+
+	if (is_float && rate->ops.convert_float)
+		return SND_PCM_FORMAT_FLOAT;
+	if (wide && rate->ops.convert_s32)
+		return SND_PCM_FORMAT_S32;
+	if (wide && rate->ops.convert_float)
+		return SND_PCM_FORMAT_FLOAT;
+	if (rate->ops.convert_s16)
+		return SND_PCM_FORMAT_S16;
+	if (rate->ops.convert)
+		return SND_PCM_FORMAT_UNKNOWN;
+	if (rate->ops.convert_s32)
+		return SND_PCM_FORMAT_S32;
+	return SND_PCM_FORMAT_FLOAT;
+}
+
 static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 	snd_pcm_t *slave = rate->gen.slave;
 	snd_pcm_rate_side_info_t *sinfo, *cinfo;
 	unsigned int channels, cwidth, swidth, chn;
+	snd_pcm_uframes_t sframes;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_rate_hw_refine_cchange,
 					  snd_pcm_rate_hw_refine_sprepare,
@@ -286,6 +342,36 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	if (err < 0)
 		return err;
 
+	/* room for the trimmed slave periods */
+	rate->adapt.max_delta = 0;
+	if (rate->adapt.enabled) {
+		rate->adapt.max_delta = (sinfo->period_size * rate->adapt.max_ppm +
+					 999999) / 1000000 + 1;
+		rate->adapt.fill = rate->adapt.target;
+		if (!rate->adapt.fill || rate->adapt.fill >= cinfo->buffer_size)
+			rate->adapt.fill = cinfo->buffer_size / 2;
+	}
+	if (rate->adapt.max_delta && rate->ops.adjust_pitch) {
+		/* let the converter allocate for the longest trimmed period
+		 * here, so that trimming while streaming needs no allocation
+		 */
+		snd_pcm_rate_info_t info = rate->info;
+		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+			info.out.period_size += rate->adapt.max_delta;
+		else
+			info.in.period_size += rate->adapt.max_delta;
+		err = rate->ops.adjust_pitch(rate->obj, &info);
+		if (err >= 0)
+			err = rate->ops.adjust_pitch(rate->obj, &rate->info);
+		if (err < 0) {
+			if (rate->ops.free)
+				rate->ops.free(rate->obj);
+			return err;
+		}
+	}
+	rate->slave_frames = sinfo->period_size;
+	sframes = sinfo->period_size + rate->adapt.max_delta;
+
 	rate->pareas = malloc(2 * channels * sizeof(*rate->pareas));
 	if (rate->pareas == NULL)
 		goto error;
@@ -293,7 +379,7 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	cwidth = snd_pcm_format_physical_width(cinfo->format);
 	swidth = snd_pcm_format_physical_width(sinfo->format);
 	rate->pareas[0].addr = malloc(((cwidth * channels * cinfo->period_size) / 8) +
-				      ((swidth * channels * sinfo->period_size) / 8));
+				      ((swidth * channels * sframes) / 8));
 	if (rate->pareas[0].addr == NULL)
 		goto error;
 
@@ -303,18 +389,39 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		rate->pareas[chn].addr = (char *)rate->pareas[0].addr + (cwidth * chn * cinfo->period_size) / 8;
 		rate->pareas[chn].first = 0;
 		rate->pareas[chn].step = cwidth;
-		rate->sareas[chn].addr = (char *)rate->sareas[0].addr + (swidth * chn * sinfo->period_size) / 8;
+		rate->sareas[chn].addr = (char *)rate->sareas[0].addr + (swidth * chn * sframes) / 8;
 		rate->sareas[chn].first = 0;
 		rate->sareas[chn].step = swidth;
 	}
 
-	if (rate->ops.convert_s16) {
-		rate->get_idx = snd_pcm_linear_get_index(rate->info.in.format, SND_PCM_FORMAT_S16);
-		rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, rate->info.out.format);
+	rate->cvt_format = choose_cvt_format(rate);
+	if (rate->cvt_format != SND_PCM_FORMAT_UNKNOWN) {
+		unsigned int bytes = snd_pcm_format_physical_width(rate->cvt_format) / 8;
+		snd_pcm_format_t in = rate->info.in.format;
+		snd_pcm_format_t out = rate->info.out.format;
+		if (rate->cvt_format == SND_PCM_FORMAT_S16) {
+			rate->get_idx = snd_pcm_linear_get_index(in, SND_PCM_FORMAT_S16);
+			rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, out);
+		} else {
+			/* S32 and the integer side of FLOAT go via getput */
+			rate->to_s32 = rate->from_s32 = NULL;
+			if (in != SND_PCM_FORMAT_FLOAT) {
+				rate->get_idx = snd_pcm_linear_get_index(in, SND_PCM_FORMAT_S32);
+				rate->to_s32 = snd_pcm_linear_conv_find(in, SND_PCM_FORMAT_S32);
+			}
+			if (out != SND_PCM_FORMAT_FLOAT) {
+				rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, out);
+				rate->from_s32 = snd_pcm_linear_conv_find(SND_PCM_FORMAT_S32, out);
+			}
+			rate->s32_get_idx = snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+			rate->s32_put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+		}
 		free(rate->src_buf);
-		rate->src_buf = malloc(channels * rate->info.in.period_size * 2);
+		rate->src_buf = malloc(channels * (rate->info.in.period_size +
+						   rate->adapt.max_delta) * bytes);
 		free(rate->dst_buf);
-		rate->dst_buf = malloc(channels * rate->info.out.period_size * 2);
+		rate->dst_buf = malloc(channels * (rate->info.out.period_size +
+						   rate->adapt.max_delta) * bytes);
 		if (! rate->src_buf || ! rate->dst_buf)
 			goto error;
 	}
@@ -349,6 +456,19 @@ static int snd_pcm_rate_hw_free(snd_pcm_t *pcm)
 	return snd_pcm_hw_free(rate->gen.slave);
 }
 
+static void snd_pcm_rate_adapt_reset(snd_pcm_t *pcm)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_rate_adapt_t *adapt = &rate->adapt;
+
+	rate->slave_frames = rate->gen.slave->period_size;
+	adapt->trim = adapt->enabled && rate->ops.adjust_pitch;
+	adapt->started = 0;
+	adapt->delay = 0;
+	adapt->integral = 0;
+	adapt->acc = 0;
+}
+
 static void recalc(snd_pcm_t *pcm, snd_pcm_uframes_t *val)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -390,6 +510,7 @@ static int snd_pcm_rate_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	params->boundary = boundary1;
 	sparams->boundary = sboundary;
 
+	snd_pcm_rate_adapt_reset(pcm);
 	if (rate->ops.adjust_pitch)
 		rate->ops.adjust_pitch(rate->obj, &rate->info);
 
@@ -419,9 +540,15 @@ static int snd_pcm_rate_init(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 
+	/* back to the nominal ratio */
+	if (rate->slave_frames != rate->gen.slave->period_size &&
+	    rate->ops.adjust_pitch)
+		rate->ops.adjust_pitch(rate->obj, &rate->info);
+	snd_pcm_rate_adapt_reset(pcm);
 	if (rate->ops.reset)
 		rate->ops.reset(rate->obj);
 	rate->last_commit_ptr = 0;
+	rate->committed = 0;
 	rate->start_pending = 0;
 	return 0;
 }
@@ -502,6 +629,135 @@ static void convert_from_s16(snd_pcm_rate_t *rate, const int16_t *buf,
 	}
 }
 
+/* interleaved areas of a work buffer */
+static void cvt_buf_areas(snd_pcm_channel_area_t *areas, void *buf,
+			  unsigned int channels, unsigned int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; c++) {
+		areas[c].addr = buf;
+		areas[c].first = c * width;
+		areas[c].step = channels * width;
+	}
+}
+
+/* the address when the areas are already interleaved in the work format */
+static void *cvt_direct_addr(const snd_pcm_channel_area_t *areas,
+			     snd_pcm_uframes_t offset, unsigned int channels,
+			     snd_pcm_format_t format, snd_pcm_format_t cvt_format)
+{
+	unsigned int width = snd_pcm_format_physical_width(cvt_format);
+	unsigned int c;
+
+	if (format != cvt_format || areas->first % 8 ||
+	    areas->step != channels * width)
+		return NULL;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].first != areas->first + c * width ||
+		    areas[c].step != areas->step)
+			return NULL;
+	}
+	return snd_pcm_channel_area_addr(areas, offset);
+}
+
+typedef union {
+	int32_t i;
+	float f;
+} cvt_sample_t;
+
+static void cvt_s32_to_float(void *buf, unsigned int samples)
+{
+	cvt_sample_t *p = buf;
+
+	for (; samples--; p++)
+		p->f = p->i * (1.0f / 2147483648.0f);
+}
+
+static void cvt_float_to_s32(void *buf, unsigned int samples)
+{
+	cvt_sample_t *p = buf;
+
+	for (; samples--; p++) {
+		float v = p->f * 2147483648.0f;
+		if (v >= 2147483647.0f)
+			p->i = 0x7fffffff;
+		else if (v <= -2147483648.0f)
+			p->i = -0x7fffffff - 1;
+		else
+			p->i = lrintf(v);
+	}
+}
+
+static void convert_to_s32(snd_pcm_rate_t *rate, void *buf,
+			   const snd_pcm_channel_area_t *areas,
+			   snd_pcm_uframes_t offset, unsigned int frames,
+			   unsigned int channels)
+{
+	snd_pcm_channel_area_t bufareas[channels];
+
+	cvt_buf_areas(bufareas, buf, channels, 32);
+	if (rate->to_s32)
+		snd_pcm_linear_conv_areas(bufareas, 0, areas, offset, channels,
+					  frames, SND_PCM_FORMAT_S32,
+					  rate->info.in.format, rate->to_s32);
+	else
+		snd_pcm_linear_getput(bufareas, 0, areas, offset, channels,
+				      frames, rate->get_idx, rate->s32_put_idx);
+}
+
+static void convert_from_s32(snd_pcm_rate_t *rate, void *buf,
+			     const snd_pcm_channel_area_t *areas,
+			     snd_pcm_uframes_t offset, unsigned int frames,
+			     unsigned int channels)
+{
+	snd_pcm_channel_area_t bufareas[channels];
+
+	cvt_buf_areas(bufareas, buf, channels, 32);
+	if (rate->from_s32)
+		snd_pcm_linear_conv_areas(areas, offset, bufareas, 0, channels,
+					  frames, rate->info.out.format,
+					  SND_PCM_FORMAT_S32, rate->from_s32);
+	else
+		snd_pcm_linear_getput(areas, offset, bufareas, 0, channels,
+				      frames, rate->s32_get_idx, rate->put_idx);
+}
+
+static void convert_to_float(snd_pcm_rate_t *rate, void *buf,
+			     const snd_pcm_channel_area_t *areas,
+			     snd_pcm_uframes_t offset, unsigned int frames,
+			     unsigned int channels)
+{
+	snd_pcm_channel_area_t bufareas[channels];
+
+	if (rate->info.in.format == SND_PCM_FORMAT_FLOAT) {
+		cvt_buf_areas(bufareas, buf, channels, 32);
+		snd_pcm_areas_copy(bufareas, 0, areas, offset, channels,
+				   frames, SND_PCM_FORMAT_FLOAT);
+	} else {
+		convert_to_s32(rate, buf, areas, offset, frames, channels);
+		cvt_s32_to_float(buf, frames * channels);
+	}
+}
+
+static void convert_from_float(snd_pcm_rate_t *rate, void *buf,
+			       const snd_pcm_channel_area_t *areas,
+			       snd_pcm_uframes_t offset, unsigned int frames,
+			       unsigned int channels)
+{
+	snd_pcm_channel_area_t bufareas[channels];
+
+	if (rate->info.out.format == SND_PCM_FORMAT_FLOAT) {
+		cvt_buf_areas(bufareas, buf, channels, 32);
+		snd_pcm_areas_copy(areas, offset, bufareas, 0, channels,
+				   frames, SND_PCM_FORMAT_FLOAT);
+	} else {
+		cvt_float_to_s32(buf, frames * channels);
+		convert_from_s32(rate, buf, areas, offset, frames, channels);
+	}
+}
+
 static void do_convert(const snd_pcm_channel_area_t *dst_areas,
 		       snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
 		       const snd_pcm_channel_area_t *src_areas,
@@ -509,28 +765,52 @@ static void do_convert(const snd_pcm_channel_area_t *dst_areas,
 		       unsigned int channels,
 		       snd_pcm_rate_t *rate)
 {
-	if (rate->ops.convert_s16) {
-		const int16_t *src;
-		int16_t *dst;
-		if (! rate->src_buf)
-			src = (int16_t *)src_areas->addr + src_offset * channels;
-		else {
-			convert_to_s16(rate, rate->src_buf, src_areas, src_offset,
-				       src_frames, channels);
-			src = rate->src_buf;
-		}
-		if (! rate->dst_buf)
-			dst = (int16_t *)dst_areas->addr + dst_offset * channels;
-		else
-			dst = rate->dst_buf;
-		rate->ops.convert_s16(rate->obj, dst, dst_frames, src, src_frames);
-		if (dst == rate->dst_buf)
-			convert_from_s16(rate, rate->dst_buf, dst_areas, dst_offset,
-					 dst_frames, channels);
-	} else {
+	snd_pcm_format_t format = rate->cvt_format;
+	void *src, *dst;
+
+	if (format == SND_PCM_FORMAT_UNKNOWN) {
 		rate->ops.convert(rate->obj, dst_areas, dst_offset, dst_frames,
 				   src_areas, src_offset, src_frames);
+		return;
 	}
+
+	src = cvt_direct_addr(src_areas, src_offset, channels,
+			      rate->info.in.format, format);
+	if (! src) {
+		src = rate->src_buf;
+		if (format == SND_PCM_FORMAT_S16)
+			convert_to_s16(rate, src, src_areas, src_offset,
+				       src_frames, channels);
+		else if (format == SND_PCM_FORMAT_S32)
+			convert_to_s32(rate, src, src_areas, src_offset,
+				       src_frames, channels);
+		else
+			convert_to_float(rate, src, src_areas, src_offset,
+					 src_frames, channels);
+	}
+	dst = cvt_direct_addr(dst_areas, dst_offset, channels,
+			      rate->info.out.format, format);
+	if (! dst)
+		dst = rate->dst_buf;
+
+	if (format == SND_PCM_FORMAT_S16)
+		rate->ops.convert_s16(rate->obj, dst, dst_frames, src, src_frames);
+	else if (format == SND_PCM_FORMAT_S32)
+		rate->ops.convert_s32(rate->obj, dst, dst_frames, src, src_frames);
+	else
+		rate->ops.convert_float(rate->obj, dst, dst_frames, src, src_frames);
+
+	if (dst != rate->dst_buf)
+		return;
+	if (format == SND_PCM_FORMAT_S16)
+		convert_from_s16(rate, dst, dst_areas, dst_offset,
+				 dst_frames, channels);
+	else if (format == SND_PCM_FORMAT_S32)
+		convert_from_s32(rate, dst, dst_areas, dst_offset,
+				 dst_frames, channels);
+	else
+		convert_from_float(rate, dst, dst_areas, dst_offset,
+				   dst_frames, channels);
 }
 
 static inline void
@@ -541,7 +821,7 @@ snd_pcm_rate_write_areas1(snd_pcm_t *pcm,
 			 snd_pcm_uframes_t slave_offset)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
-	do_convert(slave_areas, slave_offset, rate->gen.slave->period_size,
+	do_convert(slave_areas, slave_offset, rate->slave_frames,
 		   areas, offset, pcm->period_size,
 		   pcm->channels, rate);
 }
@@ -555,10 +835,39 @@ snd_pcm_rate_read_areas1(snd_pcm_t *pcm,
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 	do_convert(areas, offset, pcm->period_size,
-		   slave_areas, slave_offset, rate->gen.slave->period_size,
+		   slave_areas, slave_offset, rate->slave_frames,
 		   pcm->channels, rate);
 }
 
+/*
+ * With trimmed periods the slave frames do not map to whole client
+ * periods; the client hw_ptr trails the last commit by the frames still
+ * queued in the slave, scaled by the nominal ratio.
+ */
+static void snd_pcm_rate_sync_hwptr_adaptive(snd_pcm_t *pcm,
+					     snd_pcm_uframes_t slave_hw_ptr)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_t *slave = rate->gen.slave;
+	snd_pcm_sframes_t queued, diff;
+	snd_pcm_uframes_t hw_ptr;
+
+	queued = *slave->appl.ptr - slave_hw_ptr;
+	if (queued < 0)
+		queued += slave->boundary;
+	queued = muldiv_near(queued, pcm->period_size, slave->period_size);
+	if ((snd_pcm_uframes_t)queued > pcm->buffer_size)
+		queued = pcm->buffer_size;
+	hw_ptr = (rate->last_commit_ptr + pcm->boundary - queued) % pcm->boundary;
+	diff = hw_ptr - rate->hw_ptr;
+	if (diff < 0)
+		diff += pcm->boundary;
+	/* never backwards */
+	if (diff > 0 && (snd_pcm_uframes_t)diff <= pcm->buffer_size)
+		rate->hw_ptr = hw_ptr;
+	rate->last_slave_hw_ptr = slave_hw_ptr;
+}
+
 static inline void snd_pcm_rate_sync_hwptr0(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_ptr)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -569,6 +878,10 @@ static inline void snd_pcm_rate_sync_hwptr0(snd_pcm_t *pcm, snd_pcm_uframes_t sl
 	if (pcm->stream != SND_PCM_STREAM_PLAYBACK)
 		return;
 
+	if (rate->adapt.enabled) {
+		snd_pcm_rate_sync_hwptr_adaptive(pcm, slave_hw_ptr);
+		return;
+	}
 	if (slave_hw_ptr_diff < 0)
 		slave_hw_ptr_diff += rate->gen.slave->boundary; /* slave boundary wraparound */
 	else if (slave_hw_ptr_diff == 0)
@@ -642,6 +955,83 @@ static int snd_pcm_rate_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 	return 0;
 }
 
+/*
+ * Adaptive mode: called after each converted period.  The fill level
+ * (the delay in client frames) is low-pass filtered and a PI controller
+ * turns its deviation from the target into a ratio correction, which is
+ * applied by trimming the slave side of the next periods by whole frames.
+ * The fraction left over is carried to the following periods.
+ * The caller passes the client frames not converted yet, as appl_ptr may
+ * not be updated at this point.
+ */
+static void snd_pcm_rate_adapt_update(snd_pcm_t *pcm, snd_pcm_uframes_t pending)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_rate_adapt_t *adapt = &rate->adapt;
+	snd_pcm_t *slave = rate->gen.slave;
+	snd_pcm_uframes_t speriod = slave->period_size;
+	snd_pcm_sframes_t slave_delay, delta;
+	snd_pcm_uframes_t frames;
+	snd_pcm_rate_info_t info;
+	double delay, error, ratio, limit;
+
+	if (!adapt->trim)
+		return;
+	if (snd_pcm_state(slave) != SND_PCM_STATE_RUNNING)
+		return;
+	if (snd_pcm_delay(slave, &slave_delay) < 0)
+		return;
+	delay = (double)slave_delay * pcm->period_size / speriod + pending;
+	if (!adapt->started) {
+		adapt->delay = delay;
+		adapt->started = 1;
+	} else {
+		adapt->delay += (delay - adapt->delay) / 32;
+	}
+
+	limit = adapt->max_ppm * 1e-6;
+	error = adapt->delay - (double)adapt->fill;
+	adapt->integral += adapt->ki * error;
+	if (adapt->integral > limit)
+		adapt->integral = limit;
+	else if (adapt->integral < -limit)
+		adapt->integral = -limit;
+	ratio = adapt->kp * error + adapt->integral;
+	if (ratio > limit)
+		ratio = limit;
+	else if (ratio < -limit)
+		ratio = -limit;
+
+	adapt->acc += ratio * speriod;
+	delta = lrint(adapt->acc);
+	if (delta > (snd_pcm_sframes_t)adapt->max_delta)
+		delta = adapt->max_delta;
+	else if (delta < -(snd_pcm_sframes_t)adapt->max_delta)
+		delta = -(snd_pcm_sframes_t)adapt->max_delta;
+	adapt->acc -= delta;
+
+	/* a fuller buffer means the slave runs slow on playback, fast on capture */
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		frames = speriod - delta;
+	else
+		frames = speriod + delta;
+	if (frames == rate->slave_frames)
+		return;
+	info = rate->info;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		info.out.period_size = frames;
+	else
+		info.in.period_size = frames;
+	if (rate->ops.adjust_pitch(rate->obj, &info) < 0) {
+		SNDERR("rate converter cannot trim the ratio, adaptive mode disabled");
+		rate->ops.adjust_pitch(rate->obj, &rate->info);
+		rate->slave_frames = speriod;
+		adapt->trim = 0;
+		return;
+	}
+	rate->slave_frames = frames;
+}
+
 static int snd_pcm_rate_prepare(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -675,28 +1065,6 @@ static int snd_pcm_rate_reset(snd_pcm_t *pcm)
 	return 0;
 }
 
-static snd_pcm_sframes_t snd_pcm_rate_rewindable(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
-{
-	return 0;
-}
-
-static snd_pcm_sframes_t snd_pcm_rate_forwardable(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
-{
-	return 0;
-}
-
-static snd_pcm_sframes_t snd_pcm_rate_rewind(snd_pcm_t *pcm ATTRIBUTE_UNUSED,
-                                             snd_pcm_uframes_t frames ATTRIBUTE_UNUSED)
-{
-        return 0;
-}
-
-static snd_pcm_sframes_t snd_pcm_rate_forward(snd_pcm_t *pcm ATTRIBUTE_UNUSED,
-                                              snd_pcm_uframes_t frames ATTRIBUTE_UNUSED)
-{
-        return 0;
-}
-
 static int snd_pcm_rate_commit_area(snd_pcm_t *pcm, snd_pcm_rate_t *rate,
 				    snd_pcm_uframes_t appl_offset,
 				    snd_pcm_uframes_t size,
@@ -809,7 +1177,7 @@ static int snd_pcm_rate_commit_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t app
 	snd_pcm_rate_t *rate = pcm->private_data;
 
 	return snd_pcm_rate_commit_area(pcm, rate, appl_offset, pcm->period_size,
-					rate->gen.slave->period_size);
+					rate->slave_frames);
 }
 
 static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_offset)
@@ -827,12 +1195,12 @@ static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_of
 		result = snd_pcm_mmap_begin(rate->gen.slave, &slave_areas, &slave_offset, &slave_frames);
 		if (result < 0)
 			return result;
-		if (slave_frames < rate->gen.slave->period_size)
+		if (slave_frames < rate->slave_frames)
 			goto __partial;
 		snd_pcm_rate_read_areas1(pcm, areas, hw_offset,
 					 slave_areas, slave_offset);
-		result = snd_pcm_mmap_commit(rate->gen.slave, slave_offset, rate->gen.slave->period_size);
-		if (result < (snd_pcm_sframes_t)rate->gen.slave->period_size) {
+		result = snd_pcm_mmap_commit(rate->gen.slave, slave_offset, rate->slave_frames);
+		if (result < (snd_pcm_sframes_t)rate->slave_frames) {
 			if (result < 0)
 				return result;
 			result = snd_pcm_rewind(rate->gen.slave, result);
@@ -848,8 +1216,8 @@ static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_of
 	      __partial:
 		xfer = 0;
 		cont = slave_frames;
-		if (cont > rate->gen.slave->period_size)
-			cont = rate->gen.slave->period_size;
+		if (cont > rate->slave_frames)
+			cont = rate->slave_frames;
 		snd_pcm_areas_copy(rate->sareas, 0,
 				   slave_areas, slave_offset,
 				   pcm->channels, cont,
@@ -865,11 +1233,11 @@ static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_of
 		}
 		xfer = cont;
 
-		if (xfer == rate->gen.slave->period_size)
+		if (xfer == rate->slave_frames)
 			goto __transfer;
 
 		/* grab second fragment */
-		cont = rate->gen.slave->period_size - cont;
+		cont = rate->slave_frames - cont;
 		slave_frames = cont;
 		result = snd_pcm_mmap_begin(rate->gen.slave, &slave_areas, &slave_offset, &slave_frames);
 		if (result < 0)
@@ -916,6 +1284,51 @@ static int snd_pcm_rate_grab_next_period(snd_pcm_t *pcm, snd_pcm_uframes_t hw_of
 	return 1;
 }
 
+static void snd_pcm_rate_commit_forward(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+
+	rate->last_commit_ptr += frames;
+	if (rate->last_commit_ptr >= pcm->boundary)
+		rate->last_commit_ptr = 0;
+	if (rate->committed < pcm->boundary)
+		rate->committed += frames;
+}
+
+/*
+ * Playback rewind works on whole committed periods: the slave is rewound
+ * by the matching slave periods and the client frames are converted
+ * again on the next commit.  The converter state at the new commit
+ * position is rebuilt by running the period before it through the
+ * converter once more, with the output discarded.  Converters with
+ * a memory shorter than a period end up in exactly the same state.
+ */
+static void snd_pcm_rate_restore_state(snd_pcm_t *pcm, snd_pcm_uframes_t avail)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	const snd_pcm_channel_area_t *areas = snd_pcm_mmap_areas(pcm);
+	snd_pcm_uframes_t offset, cont;
+
+	if (rate->ops.reset)
+		rate->ops.reset(rate->obj);
+	/* the previous period must be written and not overwritten yet */
+	if (rate->committed < pcm->period_size || avail < pcm->period_size)
+		return;
+	offset = (rate->last_commit_ptr + pcm->boundary - pcm->period_size) %
+		pcm->buffer_size;
+	cont = pcm->buffer_size - offset;
+	if (cont < pcm->period_size) {
+		snd_pcm_areas_copy(rate->pareas, 0, areas, offset,
+				   pcm->channels, cont, pcm->format);
+		snd_pcm_areas_copy(rate->pareas, cont, areas, 0,
+				   pcm->channels, pcm->period_size - cont,
+				   pcm->format);
+		areas = rate->pareas;
+		offset = 0;
+	}
+	snd_pcm_rate_write_areas1(pcm, areas, offset, rate->sareas, 0);
+}
+
 static int snd_pcm_rate_sync_playback_area(snd_pcm_t *pcm, snd_pcm_uframes_t appl_ptr)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -933,21 +1346,129 @@ static int snd_pcm_rate_sync_playback_area(snd_pcm_t *pcm, snd_pcm_uframes_t app
 	else
 		xfer = appl_ptr - rate->last_commit_ptr;
 	while (xfer >= pcm->period_size &&
-	       (snd_pcm_uframes_t)slave_size >= rate->gen.slave->period_size) {
+	       (snd_pcm_uframes_t)slave_size >= rate->slave_frames) {
 		err = snd_pcm_rate_commit_next_period(pcm, rate->last_commit_ptr % pcm->buffer_size);
 		if (err == 0)
 			break;
 		if (err < 0)
 			return err;
 		xfer -= pcm->period_size;
-		slave_size -= rate->gen.slave->period_size;
-		rate->last_commit_ptr += pcm->period_size;
-		if (rate->last_commit_ptr >= pcm->boundary)
-			rate->last_commit_ptr = 0;
+		slave_size -= rate->slave_frames;
+		snd_pcm_rate_commit_forward(pcm, pcm->period_size);
+		snd_pcm_rate_adapt_update(pcm, xfer);
 	}
 	return 0;
 }
 
+static snd_pcm_sframes_t snd_pcm_rate_rewindable(snd_pcm_t *pcm)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_sframes_t slave_frames;
+	snd_pcm_uframes_t frames, hw_avail;
+
+	if (pcm->stream == SND_PCM_STREAM_CAPTURE)
+		return snd_pcm_mmap_capture_hw_avail(pcm);
+
+	snd_pcm_rate_sync_hwptr(pcm);
+	hw_avail = snd_pcm_mmap_hw_rewindable(pcm);
+	frames = snd_pcm_rate_playback_internal_delay(pcm);
+	/* the committed periods do not map to whole slave periods */
+	if (rate->adapt.enabled)
+		return frames < hw_avail ? frames : hw_avail;
+	slave_frames = snd_pcm_rewindable(rate->gen.slave);
+	if (slave_frames < 0)
+		return slave_frames;
+	frames += (slave_frames / rate->gen.slave->period_size) * pcm->period_size;
+	return frames < hw_avail ? frames : hw_avail;
+}
+
+static snd_pcm_sframes_t snd_pcm_rate_forwardable(snd_pcm_t *pcm)
+{
+	if (pcm->stream == SND_PCM_STREAM_CAPTURE)
+		return snd_pcm_mmap_capture_avail(pcm);
+	return snd_pcm_mmap_avail(pcm);
+}
+
+static snd_pcm_sframes_t snd_pcm_rate_rewind(snd_pcm_t *pcm,
+					     snd_pcm_uframes_t frames)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_uframes_t pending, periods, speriod, span;
+	snd_pcm_sframes_t n = snd_pcm_rate_rewindable(pcm);
+	snd_pcm_sframes_t result;
+
+	if (n < 0)
+		return n;
+	if ((snd_pcm_uframes_t)n < frames)
+		frames = n;
+	if (frames == 0)
+		return 0;
+	if (pcm->stream == SND_PCM_STREAM_CAPTURE)
+		goto _done;
+
+	pending = snd_pcm_rate_playback_internal_delay(pcm);
+	if (frames <= pending)
+		goto _done;
+	speriod = rate->gen.slave->period_size;
+	periods = (frames - pending + pcm->period_size - 1) / pcm->period_size;
+	result = snd_pcm_rewind(rate->gen.slave, periods * speriod);
+	if (result < 0)
+		return result;
+	if (result % speriod) {
+		/* keep the slave on a period boundary */
+		snd_pcm_sframes_t err = INTERNAL(snd_pcm_forward)(rate->gen.slave,
+								  result % speriod);
+		if (err < 0)
+			return err;
+	}
+	if ((snd_pcm_uframes_t)result / speriod < periods) {
+		periods = result / speriod;
+		if (frames > pending + periods * pcm->period_size)
+			frames = pending + periods * pcm->period_size;
+		if (frames == 0)
+			return 0;
+	}
+	if (periods) {
+		rate->last_commit_ptr = (rate->last_commit_ptr + pcm->boundary -
+					 periods * pcm->period_size) % pcm->boundary;
+		rate->committed -= periods * pcm->period_size;
+		/* the buffer holds the last buffer_size frames up to appl_ptr */
+		span = pending + periods * pcm->period_size;
+		snd_pcm_rate_restore_state(pcm, span < pcm->buffer_size ?
+					   pcm->buffer_size - span : 0);
+	}
+ _done:
+	snd_pcm_mmap_appl_backward(pcm, frames);
+	return frames;
+}
+
+static snd_pcm_sframes_t snd_pcm_rate_forward(snd_pcm_t *pcm,
+					      snd_pcm_uframes_t frames)
+{
+	snd_pcm_rate_t *rate = pcm->private_data;
+	snd_pcm_sframes_t n = snd_pcm_rate_forwardable(pcm);
+	int err;
+
+	if (n < 0)
+		return n;
+	if ((snd_pcm_uframes_t)n < frames)
+		frames = n;
+	if (frames == 0)
+		return 0;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
+		snd_pcm_uframes_t appl_ptr = rate->appl_ptr + frames;
+
+		if (appl_ptr >= pcm->boundary)
+			appl_ptr -= pcm->boundary;
+		/* the skipped frames are committed like written ones */
+		err = snd_pcm_rate_sync_playback_area(pcm, appl_ptr);
+		if (err < 0)
+			return err;
+	}
+	snd_pcm_mmap_appl_forward(pcm, frames);
+	return frames;
+}
+
 static snd_pcm_sframes_t snd_pcm_rate_mmap_commit(snd_pcm_t *pcm,
 						  snd_pcm_uframes_t offset ATTRIBUTE_UNUSED,
 						  snd_pcm_uframes_t size)
@@ -988,7 +1509,7 @@ static snd_pcm_sframes_t snd_pcm_rate_avail_update(snd_pcm_t *pcm)
 	size = pcm->buffer_size - xfer;
 	hw_offset = snd_pcm_mmap_hw_offset(pcm);
 	while (size >= pcm->period_size &&
-	       (snd_pcm_uframes_t)slave_size >= rate->gen.slave->period_size) {
+	       (snd_pcm_uframes_t)slave_size >= rate->slave_frames) {
 		int err = snd_pcm_rate_grab_next_period(pcm, hw_offset);
 		if (err < 0)
 			return err;
@@ -996,10 +1517,11 @@ static snd_pcm_sframes_t snd_pcm_rate_avail_update(snd_pcm_t *pcm)
 			return (snd_pcm_sframes_t)xfer;
 		xfer += pcm->period_size;
 		size -= pcm->period_size;
-		slave_size -= rate->gen.slave->period_size;
+		slave_size -= rate->slave_frames;
 		hw_offset += pcm->period_size;
 		hw_offset %= pcm->buffer_size;
 		snd_pcm_mmap_hw_forward(pcm, pcm->period_size);
+		snd_pcm_rate_adapt_update(pcm, snd_pcm_mmap_capture_avail(pcm));
 	}
 	return (snd_pcm_sframes_t)xfer;
  }
@@ -1073,7 +1595,7 @@ static int snd_pcm_rate_drain(snd_pcm_t *pcm)
 				break;
 			if (size > pcm->period_size) {
 				psize = pcm->period_size;
-				spsize = rate->gen.slave->period_size;
+				spsize = rate->slave_frames;
 			} else {
 				psize = size;
 				spsize = rate->ops.output_frames(rate->obj, size);
@@ -1083,9 +1605,7 @@ static int snd_pcm_rate_drain(snd_pcm_t *pcm)
 			commit_err = snd_pcm_rate_commit_area(pcm, rate, ofs,
 						 psize, spsize);
 			if (commit_err == 1) {
-				rate->last_commit_ptr += psize;
-				if (rate->last_commit_ptr >= pcm->boundary)
-					rate->last_commit_ptr = 0;
+				snd_pcm_rate_commit_forward(pcm, psize);
 			} else if (commit_err == 0) {
 				if (pcm->mode & SND_PCM_NONBLOCK) {
 					commit_err = -EAGAIN;
@@ -1189,6 +1709,14 @@ static void snd_pcm_rate_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (rate->ops.dump)
 		rate->ops.dump(rate->obj, out);
 	snd_output_printf(out, "Protocol version: %x\n", rate->plugin_version);
+	if (pcm->setup && rate->cvt_format != SND_PCM_FORMAT_UNKNOWN)
+		snd_output_printf(out, "Converter format: %s\n",
+				  snd_pcm_format_name(rate->cvt_format));
+	if (rate->adapt.enabled)
+		snd_output_printf(out, "Adaptive: target %lu, kp %g, ki %g, max %u ppm%s\n",
+				  pcm->setup ? rate->adapt.fill : rate->adapt.target,
+				  rate->adapt.kp, rate->adapt.ki, rate->adapt.max_ppm,
+				  pcm->setup && !rate->adapt.trim ? " (inactive)" : "");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1272,7 +1800,8 @@ const snd_config_t *snd_pcm_rate_get_default_converter(snd_config_t *root)
 #ifdef PIC
 static int is_builtin_plugin(const char *type)
 {
-	return strcmp(type, "linear") == 0;
+	return strcmp(type, "linear") == 0 ||
+	       strncmp(type, "builtin-", 8) == 0;
 }
 
 static const char *const default_rate_plugins[] = {
@@ -1292,6 +1821,15 @@ static int rate_open_func(snd_pcm_rate_t *rate, const char *type, const snd_conf
 		snprintf(lib_name, sizeof(lib_name),
 				 "libasound_module_rate_%s.so", type);
 		lib = lib_name;
+	} else {
+		/* builtin-xxx-yyy is _snd_pcm_rate_builtin_xxx_yyy_open */
+		char *p;
+		for (p = open_name; *p; p++)
+			if (*p == '-')
+				*p = '_';
+		for (p = open_conf_name; *p; p++)
+			if (*p == '-')
+				*p = '_';
 	}
 
 	rate->rate_min = SND_PCM_PLUGIN_RATE_MIN;
@@ -1369,24 +1907,76 @@ static int is_string_array(const snd_config_t *conf)
 	return 1;
 }
 
-/**
- * \brief Creates a new rate PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave format
- * \param srate Slave rate
- * \param converter SRC type string node
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
+static int rate_adapt_conf(const snd_config_t *conf, snd_pcm_rate_adapt_t *adapt)
+{
+	snd_config_iterator_t i, next;
+	long val;
+	int err;
+
+	if (snd_config_get_type(conf) != SND_CONFIG_TYPE_COMPOUND) {
+		err = snd_config_get_bool(conf);
+		if (err < 0) {
+			SNDERR("The field adaptive must be a boolean or a compound");
+			return err;
+		}
+		adapt->enabled = err;
+		return 0;
+	}
+	adapt->enabled = 1;
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id;
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (strcmp(id, "target") == 0) {
+			err = snd_config_get_integer(n, &val);
+			if (err < 0 || val < 0) {
+				SNDERR("Invalid adaptive target");
+				return -EINVAL;
+			}
+			adapt->target = val;
+			continue;
+		}
+		if (strcmp(id, "kp") == 0) {
+			err = snd_config_get_ireal(n, &adapt->kp);
+			if (err < 0 || adapt->kp < 0) {
+				SNDERR("Invalid adaptive kp");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "ki") == 0) {
+			err = snd_config_get_ireal(n, &adapt->ki);
+			if (err < 0 || adapt->ki < 0) {
+				SNDERR("Invalid adaptive ki");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "max_ppm") == 0) {
+			err = snd_config_get_integer(n, &val);
+			if (err < 0 || val <= 0 || val > 100000) {
+				SNDERR("Invalid adaptive max_ppm");
+				return -EINVAL;
+			}
+			adapt->max_ppm = val;
+			continue;
+		}
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * snd_pcm_rate_open() with the adaptive resampling node (bool or compound)
+ * of the configuration, or NULL; the exported prototype stays unchanged
  */
-int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
-		      snd_pcm_format_t sformat, unsigned int srate,
-		      const snd_config_t *converter,
-		      snd_pcm_t *slave, int close_slave)
+static int snd_pcm_rate_open_adaptive(snd_pcm_t **pcmp, const char *name,
+				      snd_pcm_format_t sformat, unsigned int srate,
+				      const snd_config_t *converter,
+				      const snd_config_t *adaptive,
+				      snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_rate_t *rate;
@@ -1399,7 +1989,8 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 
 	assert(pcmp && slave);
 	if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-	    snd_pcm_format_linear(sformat) != 1)
+	    snd_pcm_format_linear(sformat) != 1 &&
+	    sformat != SND_PCM_FORMAT_FLOAT)
 		return -EINVAL;
 	rate = calloc(1, sizeof(snd_pcm_rate_t));
 	if (!rate) {
@@ -1409,6 +2000,16 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	rate->gen.close_slave = close_slave;
 	rate->srate = srate;
 	rate->sformat = sformat;
+	rate->adapt.kp = 2e-6;
+	rate->adapt.ki = 2e-8;
+	rate->adapt.max_ppm = 1000;
+	if (adaptive) {
+		err = rate_adapt_conf(adaptive, &rate->adapt);
+		if (err < 0) {
+			free(rate);
+			return err;
+		}
+	}
 
 	err = snd_pcm_new(&pcm, SND_PCM_TYPE_RATE, name, slave->stream, slave->mode);
 	if (err < 0) {
@@ -1479,15 +2080,30 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 		free(rate);
 		return err;
 	}
+	rate->plugin_version = rate->ops.version;
 #endif
 
-	if (! rate->ops.init || ! (rate->ops.convert || rate->ops.convert_s16) ||
+	/* a converter of an older protocol has no such members */
+	if (rate->plugin_version < SND_PCM_RATE_PLUGIN_VERSION_WIDE) {
+		rate->ops.convert_s32 = NULL;
+		rate->ops.convert_float = NULL;
+	}
+
+	if (! rate->ops.init ||
+	    ! (rate->ops.convert || rate->ops.convert_s16 ||
+	       rate->ops.convert_s32 || rate->ops.convert_float) ||
 	    ! rate->ops.input_frames || ! rate->ops.output_frames) {
 		SNDERR("Inproper rate plugin %s initialization", type);
 		snd_pcm_free(pcm);
 		free(rate);
 		return err;
 	}
+	if (sformat == SND_PCM_FORMAT_FLOAT && ! rate->ops.convert_float) {
+		SNDERR("Rate converter %s does not support float", type);
+		snd_pcm_free(pcm);
+		free(rate);
+		return -EINVAL;
+	}
 
 	pcm->ops = &snd_pcm_rate_ops;
 	pcm->fast_ops = &snd_pcm_rate_fast_ops;
@@ -1503,11 +2119,35 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new rate PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave format
+ * \param srate Slave rate
+ * \param converter SRC type string node
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
+		      snd_pcm_format_t sformat, unsigned int srate,
+		      const snd_config_t *converter,
+		      snd_pcm_t *slave, int close_slave)
+{
+	return snd_pcm_rate_open_adaptive(pcmp, name, sformat, srate,
+					  converter, NULL, slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_rate Plugin: Rate
 
-This plugin converts a stream rate. The input and output formats must be linear.
+This plugin converts a stream rate. The input and output formats must be linear,
+or FLOAT when the converter provides a float entry (the linear one does).
 
 \code
 pcm.name {
@@ -1531,9 +2171,37 @@ pcm.name {
 		name STR	# Convertor type
 		xxx yyy		# optional convertor-specific configuration
 	}
+	adaptive BOOL		# optional, drift compensation
+	# or
+	adaptive {		# optional
+		target INT	# fill level in frames, default half buffer
+		kp REAL		# proportional gain, default 2e-6
+		ki REAL		# integral gain, default 2e-8
+		max_ppm INT	# max. ratio correction, default 1000
+	}
 }
 \endcode
 
+The converters "linear", "builtin-sinc-fast", "builtin-sinc" and
+"builtin-sinc-best" are built into the library.  The builtin-sinc ones are
+windowed-sinc polyphase filters (16, 32 and 64 taps at the input rate)
+with increasing quality and CPU cost; their filter tables are shared by all
+streams using the same parameters.  Other converters, e.g. "speexrate" or
+"samplerate", are loaded from the external plugin libraries.
+
+The stream can be rewound and forwarded.  On playback, the frames already
+passed to the slave are rewound in whole slave periods and converted again
+from the new position, so the rewindable amount is limited by what the slave
+can rewind.
+
+In the adaptive mode, the plugin compensates a drift between the clock
+driving the client and the clock of the slave.  The delay is measured after
+each converted period and a PI controller trims the conversion ratio, so
+that the fill level settles at the target.  The correction is applied as
+whole slave frames per period, thus the converter must accept a changed
+ratio via adjust_pitch (the built-in ones do).  Playback can be rewound
+only by the frames not passed to the slave yet in this mode.
+
 \subsection pcm_plugins_rate_funcref Function reference
 
 <UL>
@@ -1543,6 +2211,7 @@ pcm.name {
 
 */
 
+
 /**
  * \brief Creates a new rate PCM
  * \param pcmp Returns created PCM handle
@@ -1567,6 +2236,7 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_format_t sformat = SND_PCM_FORMAT_UNKNOWN;
 	int srate = -1;
 	const snd_config_t *converter = NULL;
+	const snd_config_t *adaptive = NULL;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1583,6 +2253,10 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 			converter = n;
 			continue;
 		}
+		if (strcmp(id, "adaptive") == 0) {
+			adaptive = n;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1597,17 +2271,18 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	if (err < 0)
 		return err;
 	if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-	    snd_pcm_format_linear(sformat) != 1) {
+	    snd_pcm_format_linear(sformat) != 1 &&
+	    sformat != SND_PCM_FORMAT_FLOAT) {
 	    	snd_config_delete(sconf);
-		SNDERR("slave format is not linear");
+		SNDERR("slave format is not linear or float");
 		return -EINVAL;
 	}
 	err = snd_pcm_open_slave(&spcm, root, sconf, stream, mode, conf);
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_rate_open(pcmp, name, sformat, (unsigned int) srate,
-				converter, spcm, 1);
+	err = snd_pcm_rate_open_adaptive(pcmp, name, sformat, (unsigned int) srate,
+					 converter, adaptive, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
@@ -21,12 +21,13 @@
  */
 
 #include <inttypes.h>
-#include "bswap.h"
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "pcm_rate.h"
-
-#include "plugin_ops.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
 
 
 /* LINEAR_DIV needs to be large enough to handle resampling from 768000 -> 8000 */
@@ -34,17 +35,17 @@
 #define LINEAR_DIV (1<<LINEAR_DIV_SHIFT)
 
 struct rate_linear {
-	unsigned int get_idx;
-	unsigned int put_idx;
 	unsigned int pitch;
 	unsigned int pitch_shift;	/* for expand interpolation */
 	unsigned int channels;
-	int16_t *old_sample;
-	void (*func)(struct rate_linear *rate,
-		     const snd_pcm_channel_area_t *dst_areas,
-		     snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-		     const snd_pcm_channel_area_t *src_areas,
-		     snd_pcm_uframes_t src_offset, unsigned int src_frames);
+	int expand;
+	void *old_frame;		/* last input frame, kept for expand */
+	void (*mix_s16)(int16_t *dst, const int16_t *old, const int16_t *new,
+			unsigned int channels, unsigned int weight);
+	void (*mix_s32)(int32_t *dst, const int32_t *old, const int32_t *new,
+			unsigned int channels, unsigned int weight);
+	void (*mix_float)(float *dst, const float *old, const float *new,
+			  unsigned int channels, float weight);
 };
 
 static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
@@ -65,294 +66,337 @@ static snd_pcm_uframes_t output_frames(void *obj, snd_pcm_uframes_t frames)
 	return muldiv_near(frames, rate->pitch, LINEAR_DIV);
 }
 
-static void linear_expand(struct rate_linear *rate,
-			  const snd_pcm_channel_area_t *dst_areas,
-			  snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-			  const snd_pcm_channel_area_t *src_areas,
-			  snd_pcm_uframes_t src_offset, unsigned int src_frames)
+/*
+ * Frame mixers: dst = old * (1 - weight) + new * weight for all channels
+ * of a frame.  The integer weight is 0..0x10000.
+ */
+static void mix_s16_c(int16_t *dst, const int16_t *old, const int16_t *new,
+		      unsigned int channels, unsigned int weight)
 {
-#define GET16_LABELS
-#define PUT16_LABELS
-#include "plugin_ops.h"
-#undef GET16_LABELS
-#undef PUT16_LABELS
-	void *get = get16_labels[rate->get_idx];
-	void *put = put16_labels[rate->put_idx];
-	unsigned int get_threshold = rate->pitch;
-	unsigned int channel;
-	unsigned int src_frames1;
-	unsigned int dst_frames1;
-	int16_t sample = 0;
-	unsigned int pos;
-	
-	for (channel = 0; channel < rate->channels; ++channel) {
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		const char *src;
-		char *dst;
-		int src_step, dst_step;
-		int16_t old_sample = 0;
-		int16_t new_sample;
-		int old_weight, new_weight;
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area);
-		dst_step = snd_pcm_channel_area_step(dst_area);
-		src_frames1 = 0;
-		dst_frames1 = 0;
-		new_sample = rate->old_sample[channel];
-		pos = get_threshold;
-		while (dst_frames1 < dst_frames) {
-			if (pos >= get_threshold) {
-				pos -= get_threshold;
-				old_sample = new_sample;
-				if (src_frames1 < src_frames) {
-					goto *get;
-#define GET16_END after_get
-#include "plugin_ops.h"
-#undef GET16_END
-				after_get:
-					new_sample = sample;
-				}
-			}
-			new_weight = (pos << (16 - rate->pitch_shift)) / (get_threshold >> rate->pitch_shift);
-			old_weight = 0x10000 - new_weight;
-			sample = (old_sample * old_weight + new_sample * new_weight) >> 16;
-			goto *put;
-#define PUT16_END after_put
-#include "plugin_ops.h"
-#undef PUT16_END
-		after_put:
-			dst += dst_step;
-			dst_frames1++;
-			pos += LINEAR_DIV;
-			if (pos >= get_threshold) {
-				src += src_step;
-				src_frames1++;
-			}
-		} 
-		rate->old_sample[channel] = new_sample;
-	}
+	int new_weight = weight;
+	int old_weight = 0x10000 - weight;
+	unsigned int c;
+
+	for (c = 0; c < channels; c++)
+		dst[c] = (old[c] * old_weight + new[c] * new_weight) >> 16;
 }
 
-/* optimized version for S16 format */
-static void linear_expand_s16(struct rate_linear *rate,
-			      const snd_pcm_channel_area_t *dst_areas,
-			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-			      const snd_pcm_channel_area_t *src_areas,
-			      snd_pcm_uframes_t src_offset, unsigned int src_frames)
+static void mix_s32_c(int32_t *dst, const int32_t *old, const int32_t *new,
+		      unsigned int channels, unsigned int weight)
 {
-	unsigned int channel;
-	unsigned int src_frames1;
-	unsigned int dst_frames1;
-	unsigned int get_threshold = rate->pitch;
-	unsigned int pos;
-	
-	for (channel = 0; channel < rate->channels; ++channel) {
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		const int16_t *src;
-		int16_t *dst;
-		int src_step, dst_step;
-		int16_t old_sample = 0;
-		int16_t new_sample;
-		int old_weight, new_weight;
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area) >> 1;
-		dst_step = snd_pcm_channel_area_step(dst_area) >> 1;
-		src_frames1 = 0;
-		dst_frames1 = 0;
-		new_sample = rate->old_sample[channel];
-		pos = get_threshold;
-		while (dst_frames1 < dst_frames) {
-			if (pos >= get_threshold) {
-				pos -= get_threshold;
-				old_sample = new_sample;
-				if (src_frames1 < src_frames)
-					new_sample = *src;
-			}
-			new_weight = (pos << (16 - rate->pitch_shift)) / (get_threshold >> rate->pitch_shift);
-			old_weight = 0x10000 - new_weight;
-			*dst = (old_sample * old_weight + new_sample * new_weight) >> 16;
-			dst += dst_step;
-			dst_frames1++;
-			pos += LINEAR_DIV;
-			if (pos >= get_threshold) {
-				src += src_step;
-				src_frames1++;
-			}
-		} 
-		rate->old_sample[channel] = new_sample;
-	}
+	int64_t new_weight = weight;
+	int64_t old_weight = 0x10000 - weight;
+	unsigned int c;
+
+	for (c = 0; c < channels; c++)
+		dst[c] = (old[c] * old_weight + new[c] * new_weight) >> 16;
 }
 
-static void linear_shrink(struct rate_linear *rate,
-			  const snd_pcm_channel_area_t *dst_areas,
-			  snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-			  const snd_pcm_channel_area_t *src_areas,
-			  snd_pcm_uframes_t src_offset, unsigned int src_frames)
+static void mix_float_c(float *dst, const float *old, const float *new,
+			unsigned int channels, float weight)
 {
-#define GET16_LABELS
-#define PUT16_LABELS
-#include "plugin_ops.h"
-#undef GET16_LABELS
-#undef PUT16_LABELS
-	void *get = get16_labels[rate->get_idx];
-	void *put = put16_labels[rate->put_idx];
-	unsigned int get_increment = rate->pitch;
-	unsigned int channel;
-	unsigned int src_frames1;
-	unsigned int dst_frames1;
-	int16_t sample = 0;
-	unsigned int pos;
-
-	for (channel = 0; channel < rate->channels; ++channel) {
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		const char *src;
-		char *dst;
-		int src_step, dst_step;
-		int16_t old_sample = 0;
-		int16_t new_sample = 0;
-		int old_weight, new_weight;
-		pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area);
-		dst_step = snd_pcm_channel_area_step(dst_area);
-		src_frames1 = 0;
-		dst_frames1 = 0;
-		while (src_frames1 < src_frames) {
-			
-			goto *get;
-#define GET16_END after_get
-#include "plugin_ops.h"
-#undef GET16_END
-		after_get:
-			new_sample = sample;
-			src += src_step;
-			src_frames1++;
-			pos += get_increment;
-			if (pos >= LINEAR_DIV) {
-				pos -= LINEAR_DIV;
-				old_weight = (pos << (32 - LINEAR_DIV_SHIFT)) / (get_increment >> (LINEAR_DIV_SHIFT - 16));
-				new_weight = 0x10000 - old_weight;
-				sample = (old_sample * old_weight + new_sample * new_weight) >> 16;
-				goto *put;
-#define PUT16_END after_put
-#include "plugin_ops.h"
-#undef PUT16_END
-			after_put:
-				dst += dst_step;
-				dst_frames1++;
-				if (CHECK_SANITY(dst_frames1 > dst_frames)) {
-					SNDERR("dst_frames overflow");
-					break;
-				}
-			}
-			old_sample = new_sample;
+	unsigned int c;
+
+	for (c = 0; c < channels; c++)
+		dst[c] = old[c] + (new[c] - old[c]) * weight;
+}
+
+#ifdef SND_PCM_SIMD_X86
+/*
+ * pmaddwd takes signed 16-bit weights, so a weight w >= 0x8000 is applied
+ * as w - 0x10000 and the missing sample << 16 is added back; the sums are
+ * exact modulo 2^32 and the result is the same as mix_s16_c().
+ */
+SND_PCM_SIMD_TARGET("sse2")
+static void mix_s16_sse2(int16_t *dst, const int16_t *old, const int16_t *new,
+			 unsigned int channels, unsigned int weight)
+{
+	unsigned int old_weight = 0x10000 - weight;
+	__m128i w = _mm_set1_epi32((int)(((weight & 0xffff) << 16) |
+					 (old_weight & 0xffff)));
+	__m128i zero = _mm_setzero_si128();
+	int fix_old = old_weight >= 0x8000;
+	int fix_new = weight >= 0x8000;
+	unsigned int c;
+
+	for (c = 0; c + 8 <= channels; c += 8) {
+		__m128i o = _mm_loadu_si128((const __m128i *)(old + c));
+		__m128i n = _mm_loadu_si128((const __m128i *)(new + c));
+		__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(o, n), w);
+		__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(o, n), w);
+		if (fix_old) {
+			lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(zero, o));
+			hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(zero, o));
+		}
+		if (fix_new) {
+			lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(zero, n));
+			hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(zero, n));
 		}
+		lo = _mm_srai_epi32(lo, 16);
+		hi = _mm_srai_epi32(hi, 16);
+		_mm_storeu_si128((__m128i *)(dst + c), _mm_packs_epi32(lo, hi));
 	}
+	if (c < channels)
+		mix_s16_c(dst + c, old + c, new + c, channels - c, weight);
 }
 
-/* optimized version for S16 format */
-static void linear_shrink_s16(struct rate_linear *rate,
-			      const snd_pcm_channel_area_t *dst_areas,
-			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-			      const snd_pcm_channel_area_t *src_areas,
-			      snd_pcm_uframes_t src_offset, unsigned int src_frames)
+SND_PCM_SIMD_TARGET("avx2")
+static void mix_s16_avx2(int16_t *dst, const int16_t *old, const int16_t *new,
+			 unsigned int channels, unsigned int weight)
 {
-	unsigned int get_increment = rate->pitch;
-	unsigned int channel;
-	unsigned int src_frames1;
-	unsigned int dst_frames1;
-	unsigned int pos = 0;
-
-	for (channel = 0; channel < rate->channels; ++channel) {
-		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
-		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
-		const int16_t *src;
-		int16_t *dst;
-		int src_step, dst_step;
-		int16_t old_sample = 0;
-		int16_t new_sample = 0;
-		int old_weight, new_weight;
-		pos = LINEAR_DIV - get_increment; /* Force first sample to be copied */
-		src = snd_pcm_channel_area_addr(src_area, src_offset);
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-		src_step = snd_pcm_channel_area_step(src_area) >> 1;
-		dst_step = snd_pcm_channel_area_step(dst_area) >> 1 ;
-		src_frames1 = 0;
-		dst_frames1 = 0;
-		while (src_frames1 < src_frames) {
-			
-			new_sample = *src;
-			src += src_step;
-			src_frames1++;
-			pos += get_increment;
-			if (pos >= LINEAR_DIV) {
-				pos -= LINEAR_DIV;
-				old_weight = (pos << (32 - LINEAR_DIV_SHIFT)) / (get_increment >> (LINEAR_DIV_SHIFT - 16));
-				new_weight = 0x10000 - old_weight;
-				*dst = (old_sample * old_weight + new_sample * new_weight) >> 16;
-				dst += dst_step;
-				dst_frames1++;
-				if (CHECK_SANITY(dst_frames1 > dst_frames)) {
-					SNDERR("dst_frames overflow");
-					break;
-				}
-			}
-			old_sample = new_sample;
+	unsigned int old_weight = 0x10000 - weight;
+	__m256i w = _mm256_set1_epi32((int)(((weight & 0xffff) << 16) |
+					    (old_weight & 0xffff)));
+	__m256i zero = _mm256_setzero_si256();
+	int fix_old = old_weight >= 0x8000;
+	int fix_new = weight >= 0x8000;
+	unsigned int c;
+
+	for (c = 0; c + 16 <= channels; c += 16) {
+		__m256i o = _mm256_loadu_si256((const __m256i *)(old + c));
+		__m256i n = _mm256_loadu_si256((const __m256i *)(new + c));
+		__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(o, n), w);
+		__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(o, n), w);
+		if (fix_old) {
+			lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(zero, o));
+			hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(zero, o));
 		}
+		if (fix_new) {
+			lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(zero, n));
+			hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(zero, n));
+		}
+		lo = _mm256_srai_epi32(lo, 16);
+		hi = _mm256_srai_epi32(hi, 16);
+		/* unpack and pack both work per 128-bit lane, so the order holds */
+		_mm256_storeu_si256((__m256i *)(dst + c), _mm256_packs_epi32(lo, hi));
+	}
+	if (c < channels)
+		mix_s16_sse2(dst + c, old + c, new + c, channels - c, weight);
+}
+
+/* 32x32->64 multiplies; bits 16..47 of the sum are the result */
+SND_PCM_SIMD_TARGET("avx2")
+static void mix_s32_avx2(int32_t *dst, const int32_t *old, const int32_t *new,
+			 unsigned int channels, unsigned int weight)
+{
+	__m256i new_weight = _mm256_set1_epi64x(weight);
+	__m256i old_weight = _mm256_set1_epi64x(0x10000 - weight);
+	__m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+	unsigned int c;
+
+	for (c = 0; c + 4 <= channels; c += 4) {
+		__m256i o = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(old + c)));
+		__m256i n = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(new + c)));
+		__m256i sum = _mm256_add_epi64(_mm256_mul_epi32(o, old_weight),
+					       _mm256_mul_epi32(n, new_weight));
+		sum = _mm256_permutevar8x32_epi32(_mm256_srli_epi64(sum, 16), even);
+		_mm_storeu_si128((__m128i *)(dst + c), _mm256_castsi256_si128(sum));
+	}
+	if (c < channels)
+		mix_s32_c(dst + c, old + c, new + c, channels - c, weight);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void mix_float_sse2(float *dst, const float *old, const float *new,
+			   unsigned int channels, float weight)
+{
+	__m128 w = _mm_set1_ps(weight);
+	unsigned int c;
+
+	for (c = 0; c + 4 <= channels; c += 4) {
+		__m128 o = _mm_loadu_ps(old + c);
+		__m128 n = _mm_loadu_ps(new + c);
+		_mm_storeu_ps(dst + c, _mm_add_ps(o, _mm_mul_ps(_mm_sub_ps(n, o), w)));
 	}
+	if (c < channels)
+		mix_float_c(dst + c, old + c, new + c, channels - c, weight);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void mix_float_avx2(float *dst, const float *old, const float *new,
+			   unsigned int channels, float weight)
+{
+	__m256 w = _mm256_set1_ps(weight);
+	unsigned int c;
+
+	/* no FMA, to give the same result as the other versions */
+	for (c = 0; c + 8 <= channels; c += 8) {
+		__m256 o = _mm256_loadu_ps(old + c);
+		__m256 n = _mm256_loadu_ps(new + c);
+		_mm256_storeu_ps(dst + c, _mm256_add_ps(o, _mm256_mul_ps(_mm256_sub_ps(n, o), w)));
+	}
+	if (c < channels)
+		mix_float_sse2(dst + c, old + c, new + c, channels - c, weight);
+}
+#endif /* SND_PCM_SIMD_X86 */
+
+#define LINEAR_EXPAND_WEIGHT(rate, pos) \
+	(((pos) << (16 - (rate)->pitch_shift)) / ((rate)->pitch >> (rate)->pitch_shift))
+#define LINEAR_SHRINK_WEIGHT(rate, pos) \
+	(0x10000 - ((pos) << (32 - LINEAR_DIV_SHIFT)) / ((rate)->pitch >> (LINEAR_DIV_SHIFT - 16)))
+#define LINEAR_EXPAND_WEIGHT_FLOAT(rate, pos)	((float)(pos) / (rate)->pitch)
+#define LINEAR_SHRINK_WEIGHT_FLOAT(rate, pos)	(1.0f - (float)(pos) / (rate)->pitch)
+
+/* the plain C mixer is called directly so it can be inlined */
+#define LINEAR_MIX(name, weight_t, weight)				\
+	do {								\
+		if (rate->mix_##name == mix_##name##_c)			\
+			mix_##name##_c(dst, old_frame, new_frame,	\
+				       channels, (weight_t)(weight));	\
+		else							\
+			rate->mix_##name(dst, old_frame, new_frame,	\
+					 channels, (weight_t)(weight));	\
+	} while (0)
+
+/*
+ * Interleaved converters: the phase is stepped once per frame and all
+ * channels of the frame are interpolated at once by the mixer.
+ */
+#define LINEAR_FRAME_FUNCS(name, type, weight_t, expand_weight, shrink_weight) \
+static void linear_expand_##name(struct rate_linear *rate,		\
+				 type *dst, unsigned int dst_frames,	\
+				 const type *src, unsigned int src_frames) \
+{									\
+	unsigned int channels = rate->channels;				\
+	unsigned int get_threshold = rate->pitch;			\
+	unsigned int src_frames1 = 0;					\
+	unsigned int dst_frames1 = 0;					\
+	unsigned int pos = get_threshold;				\
+	type *last = rate->old_frame;					\
+	const type *old_frame = last;					\
+	const type *new_frame = last;					\
+									\
+	while (dst_frames1 < dst_frames) {				\
+		if (pos >= get_threshold) {				\
+			pos -= get_threshold;				\
+			old_frame = new_frame;				\
+			if (src_frames1 < src_frames)			\
+				new_frame = src;			\
+		}							\
+		LINEAR_MIX(name, weight_t, expand_weight(rate, pos));	\
+		dst += channels;					\
+		dst_frames1++;						\
+		pos += LINEAR_DIV;					\
+		if (pos >= get_threshold) {				\
+			src += channels;				\
+			src_frames1++;					\
+		}							\
+	}								\
+	if (new_frame != last)						\
+		memcpy(last, new_frame, channels * sizeof(type));	\
+}									\
+									\
+static void linear_shrink_##name(struct rate_linear *rate,		\
+				 type *dst, unsigned int dst_frames,	\
+				 const type *src, unsigned int src_frames) \
+{									\
+	unsigned int channels = rate->channels;				\
+	unsigned int get_increment = rate->pitch;			\
+	unsigned int src_frames1 = 0;					\
+	unsigned int dst_frames1 = 0;					\
+	/* force first sample to be copied (old weight is zero) */	\
+	unsigned int pos = LINEAR_DIV - get_increment;			\
+	const type *old_frame = src;					\
+	const type *new_frame;						\
+									\
+	while (src_frames1 < src_frames) {				\
+		new_frame = src;					\
+		src += channels;					\
+		src_frames1++;						\
+		pos += get_increment;					\
+		if (pos >= LINEAR_DIV) {				\
+			pos -= LINEAR_DIV;				\
+			if (CHECK_SANITY(dst_frames1 >= dst_frames)) {	\
+				SNDERR("dst_frames overflow");		\
+				break;					\
+			}						\
+			LINEAR_MIX(name, weight_t, shrink_weight(rate, pos)); \
+			dst += channels;				\
+			dst_frames1++;					\
+		}							\
+		old_frame = new_frame;					\
+	}								\
+}
+
+LINEAR_FRAME_FUNCS(s16, int16_t, unsigned int, LINEAR_EXPAND_WEIGHT, LINEAR_SHRINK_WEIGHT)
+LINEAR_FRAME_FUNCS(s32, int32_t, unsigned int, LINEAR_EXPAND_WEIGHT, LINEAR_SHRINK_WEIGHT)
+LINEAR_FRAME_FUNCS(float, float, float, LINEAR_EXPAND_WEIGHT_FLOAT, LINEAR_SHRINK_WEIGHT_FLOAT)
+
+static void linear_convert_s16(void *obj, int16_t *dst, unsigned int dst_frames,
+			       const int16_t *src, unsigned int src_frames)
+{
+	struct rate_linear *rate = obj;
+
+	if (rate->expand)
+		linear_expand_s16(rate, dst, dst_frames, src, src_frames);
+	else
+		linear_shrink_s16(rate, dst, dst_frames, src, src_frames);
+}
+
+static void linear_convert_s32(void *obj, int32_t *dst, unsigned int dst_frames,
+			       const int32_t *src, unsigned int src_frames)
+{
+	struct rate_linear *rate = obj;
+
+	if (rate->expand)
+		linear_expand_s32(rate, dst, dst_frames, src, src_frames);
+	else
+		linear_shrink_s32(rate, dst, dst_frames, src, src_frames);
 }
 
-static void linear_convert(void *obj, 
-			   const snd_pcm_channel_area_t *dst_areas,
-			   snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
-			   const snd_pcm_channel_area_t *src_areas,
-			   snd_pcm_uframes_t src_offset, unsigned int src_frames)
+static void linear_convert_float(void *obj, float *dst, unsigned int dst_frames,
+				 const float *src, unsigned int src_frames)
 {
 	struct rate_linear *rate = obj;
-	rate->func(rate, dst_areas, dst_offset, dst_frames,
-		   src_areas, src_offset, src_frames);
+
+	if (rate->expand)
+		linear_expand_float(rate, dst, dst_frames, src, src_frames);
+	else
+		linear_shrink_float(rate, dst, dst_frames, src, src_frames);
 }
 
 static void linear_free(void *obj)
 {
 	struct rate_linear *rate = obj;
 
-	free(rate->old_sample);
-	rate->old_sample = NULL;
+	free(rate->old_frame);
+	rate->old_frame = NULL;
 }
 
 static int linear_init(void *obj, snd_pcm_rate_info_t *info)
 {
 	struct rate_linear *rate = obj;
+	unsigned int caps = snd_pcm_simd_caps();
 
-	rate->get_idx = snd_pcm_linear_get_index(info->in.format, SND_PCM_FORMAT_S16);
-	rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S16, info->out.format);
-	if (info->in.rate < info->out.rate) {
-		if (info->in.format == info->out.format && info->in.format == SND_PCM_FORMAT_S16)
-			rate->func = linear_expand_s16;
-		else
-			rate->func = linear_expand;
-		/* pitch is get_threshold */
-	} else {
-		if (info->in.format == info->out.format && info->in.format == SND_PCM_FORMAT_S16)
-			rate->func = linear_shrink_s16;
-		else
-			rate->func = linear_shrink;
-		/* pitch is get_increment */
-	}
+	/* pitch is get_threshold for expand, get_increment for shrink */
+	rate->expand = info->in.rate < info->out.rate;
 	rate->pitch = (((uint64_t)info->out.rate * LINEAR_DIV) +
 		       (info->in.rate / 2)) / info->in.rate;
 	rate->channels = info->channels;
 
-	free(rate->old_sample);
-	rate->old_sample = malloc(sizeof(*rate->old_sample) * rate->channels);
-	if (! rate->old_sample)
+	/* the vector mixers are used only when a frame fills a vector */
+	rate->mix_s16 = mix_s16_c;
+	rate->mix_s32 = mix_s32_c;
+	rate->mix_float = mix_float_c;
+#ifdef SND_PCM_SIMD_X86
+	if ((caps & SND_PCM_SIMD_AVX2) && rate->channels >= 16)
+		rate->mix_s16 = mix_s16_avx2;
+	else if ((caps & SND_PCM_SIMD_SSE2) && rate->channels >= 8)
+		rate->mix_s16 = mix_s16_sse2;
+	if ((caps & SND_PCM_SIMD_AVX2) && rate->channels >= 4)
+		rate->mix_s32 = mix_s32_avx2;
+	if ((caps & SND_PCM_SIMD_AVX2) && rate->channels >= 8)
+		rate->mix_float = mix_float_avx2;
+	else if ((caps & SND_PCM_SIMD_SSE2) && rate->channels >= 4)
+		rate->mix_float = mix_float_sse2;
+#else
+	(void)caps;
+#endif
+
+	free(rate->old_frame);
+	/* room for a frame of the widest sample type */
+	rate->old_frame = calloc(rate->channels, sizeof(int32_t));
+	if (! rate->old_frame)
 		return -ENOMEM;
 
 	return 0;
@@ -396,8 +440,8 @@ static void linear_reset(void *obj)
 	struct rate_linear *rate = obj;
 
 	/* for expand */
-	if (rate->old_sample)
-		memset(rate->old_sample, 0, sizeof(*rate->old_sample) * rate->channels);
+	if (rate->old_frame)
+		memset(rate->old_frame, 0, sizeof(int32_t) * rate->channels);
 }
 
 static void linear_close(void *obj)
@@ -424,12 +468,14 @@ static const snd_pcm_rate_ops_t linear_ops = {
 	.free = linear_free,
 	.reset = linear_reset,
 	.adjust_pitch = linear_adjust_pitch,
-	.convert = linear_convert,
+	.convert_s16 = linear_convert_s16,
 	.input_frames = input_frames,
 	.output_frames = output_frames,
 	.version = SND_PCM_RATE_PLUGIN_VERSION,
 	.get_supported_rates = get_supported_rates,
 	.dump = linear_dump,
+	.convert_s32 = linear_convert_s32,
+	.convert_float = linear_convert_float,
 };
 
 int SND_PCM_RATE_PLUGIN_ENTRY(linear) (ATTRIBUTE_UNUSED unsigned int version,
@@ -0,0 +1,718 @@
+/*
+ *  Windowed-sinc polyphase rate converter plugin
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include "pcm_local.h"
+#include "pcm_plugin.h"
+#include "pcm_rate.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+/*
+ * The rate plugin hands over whole periods, so the conversion ratio is
+ * out.period_size / in.period_size, reduced to L / M.  The position of
+ * the next output frame is kept in units of 1/L input frames.  When L
+ * is small enough, each position has its own filter phase (exact
+ * polyphase); otherwise the two nearest of a fixed number of phases are
+ * interpolated.  The samples are filtered as float.
+ *
+ * A trimmed ratio (adaptive resampling) always takes the interpolated
+ * phases, so one more table covers the whole trimming range.  It is
+ * taken with the buffers for the longest period at the first trim,
+ * which the rate plugin does at hw_params; a trim while streaming then
+ * neither allocates nor locks, and keeps the filter position.
+ */
+
+#define SINC_MAX_TAPS	512
+/* exact polyphase up to this many phases, regardless of the quality */
+#define SINC_MAX_EXACT	1024
+
+struct sinc_quality {
+	const char *name;
+	unsigned int half;		/* filter half length in input frames */
+	unsigned int phases;		/* max. number of filter phases */
+	double beta;			/* Kaiser window parameter */
+	double rolloff;			/* cutoff relative to Nyquist */
+};
+
+static const struct sinc_quality sinc_fast = {
+	.name = "fast", .half = 8, .phases = 128, .beta = 5.0, .rolloff = 0.85,
+};
+static const struct sinc_quality sinc_medium = {
+	.name = "medium", .half = 16, .phases = 256, .beta = 7.0, .rolloff = 0.90,
+};
+static const struct sinc_quality sinc_best = {
+	.name = "best", .half = 32, .phases = 512, .beta = 9.5, .rolloff = 0.94,
+};
+
+/* filter tables, shared among all instances with the same parameters */
+struct sinc_table {
+	struct list_head list;
+	unsigned int refcnt;
+	const struct sinc_quality *q;
+	unsigned int nphases;
+	unsigned int taps;
+	double cutoff;
+	float *coef;			/* nphases + 1 rows of taps */
+};
+
+static LIST_HEAD(sinc_tables);
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t sinc_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define sinc_tables_lock()	pthread_mutex_lock(&sinc_tables_mutex)
+#define sinc_tables_unlock()	pthread_mutex_unlock(&sinc_tables_mutex)
+#else
+#define sinc_tables_lock()	do { } while (0)
+#define sinc_tables_unlock()	do { } while (0)
+#endif
+
+typedef float (*sinc_dot_t)(const float *x, const float *h, unsigned int n);
+
+struct rate_sinc {
+	const struct sinc_quality *q;
+	struct sinc_table *table;	/* current one of the two below */
+	struct sinc_table *nominal;	/* for the ratio given at init */
+	struct sinc_table *trim;	/* interpolated, for a trimmed ratio */
+	unsigned int channels;
+	unsigned int taps;
+	double cutoff;
+	unsigned int L, M;
+	unsigned int nominal_L, nominal_M;
+	unsigned int in_period, out_period;
+	unsigned int in_max, out_max;	/* allocated period sizes */
+	uint64_t pos;			/* in 1/L input frames */
+	float *buf;			/* per channel: taps - 1 history + period */
+	unsigned int buf_stride;
+	int32_t *tmp;
+	unsigned int *idx;		/* per output frame: window start */
+	const float **row;		/* per output frame: filter phase */
+	float *weight;			/* per output frame: next phase weight */
+	snd_pcm_format_t in_format, out_format;
+	unsigned int get_idx, get_put_idx;
+	unsigned int put_get_idx, put_idx;
+	sinc_dot_t dot;
+};
+
+/*
+ * dot product kernels; n is a multiple of 8
+ */
+
+static float sinc_dot_c(const float *x, const float *h, unsigned int n)
+{
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i += 4) {
+		s0 += x[i] * h[i];
+		s1 += x[i + 1] * h[i + 1];
+		s2 += x[i + 2] * h[i + 2];
+		s3 += x[i + 3] * h[i + 3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef SND_PCM_SIMD_X86
+SND_PCM_SIMD_TARGET("sse2")
+static float sinc_dot_sse2(const float *x, const float *h, unsigned int n)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	float r[4];
+	unsigned int i;
+
+	for (i = 0; i < n; i += 8) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i),
+					       _mm_loadu_ps(h + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4),
+					       _mm_loadu_ps(h + i + 4)));
+	}
+	_mm_storeu_ps(r, _mm_add_ps(s0, s1));
+	return (r[0] + r[1]) + (r[2] + r[3]);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static float sinc_dot_avx2(const float *x, const float *h, unsigned int n)
+{
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m128 s;
+	float r[4];
+	unsigned int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(x + i),
+						     _mm256_loadu_ps(h + i)));
+		s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8),
+						     _mm256_loadu_ps(h + i + 8)));
+	}
+	if (i < n)
+		s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(x + i),
+						     _mm256_loadu_ps(h + i)));
+	s0 = _mm256_add_ps(s0, s1);
+	s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	_mm_storeu_ps(r, s);
+	return (r[0] + r[1]) + (r[2] + r[3]);
+}
+#endif
+
+/*
+ * filter design
+ */
+
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1, q = x * x / 4;
+	unsigned int k;
+
+	for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+		term *= q / ((double)k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+static void sinc_design(struct sinc_table *t)
+{
+	unsigned int half = t->taps / 2;
+	double i0_beta = bessel_i0(t->q->beta);
+	unsigned int r, k;
+
+	for (r = 0; r <= t->nphases; r++) {
+		float *h = t->coef + r * t->taps;
+		double f = (double)r / t->nphases;
+		double sum = 0;
+
+		for (k = 0; k < t->taps; k++) {
+			/* the center lies between taps half - 1 and half */
+			double x = k - (half - 1.0) - f;
+			double w = x / half, v;
+
+			if (w <= -1 || w >= 1) {
+				h[k] = 0;
+				continue;
+			}
+			w = bessel_i0(t->q->beta * sqrt(1 - w * w)) / i0_beta;
+			x *= t->cutoff;
+			v = t->cutoff * w;
+			if (fabs(x) > 1e-9)
+				v *= sin(M_PI * x) / (M_PI * x);
+			h[k] = v;
+			sum += v;
+		}
+		/* unity gain at DC for each phase */
+		for (k = 0; k < t->taps; k++)
+			h[k] /= sum;
+	}
+}
+
+static struct sinc_table *sinc_table_get(const struct sinc_quality *q,
+					 unsigned int nphases,
+					 unsigned int taps, double cutoff)
+{
+	struct sinc_table *t;
+	struct list_head *p;
+
+	sinc_tables_lock();
+	list_for_each(p, &sinc_tables) {
+		t = list_entry(p, struct sinc_table, list);
+		if (t->q == q && t->nphases == nphases && t->taps == taps &&
+		    t->cutoff == cutoff) {
+			t->refcnt++;
+			goto __end;
+		}
+	}
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		goto __end;
+	t->coef = malloc((nphases + 1) * taps * sizeof(float));
+	if (!t->coef) {
+		free(t);
+		t = NULL;
+		goto __end;
+	}
+	t->refcnt = 1;
+	t->q = q;
+	t->nphases = nphases;
+	t->taps = taps;
+	t->cutoff = cutoff;
+	sinc_design(t);
+	list_add_tail(&t->list, &sinc_tables);
+ __end:
+	sinc_tables_unlock();
+	return t;
+}
+
+static void sinc_table_put(struct sinc_table *t)
+{
+	if (!t)
+		return;
+	sinc_tables_lock();
+	if (--t->refcnt == 0) {
+		list_del(&t->list);
+		free(t->coef);
+		free(t);
+	}
+	sinc_tables_unlock();
+}
+
+/*
+ * converter
+ */
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_sinc *rate = obj;
+	if (frames == 0)
+		return 0;
+	return ((uint64_t)frames * rate->M + rate->L / 2) / rate->L;
+}
+
+static snd_pcm_uframes_t output_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_sinc *rate = obj;
+	if (frames == 0)
+		return 0;
+	return ((uint64_t)frames * rate->L + rate->M / 2) / rate->M;
+}
+
+/* read one channel as float */
+static void sinc_get(struct rate_sinc *rate, float *dst,
+		     const snd_pcm_channel_area_t *src_area,
+		     snd_pcm_uframes_t src_offset, unsigned int frames)
+{
+	const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+	int src_step = snd_pcm_channel_area_step(src_area);
+	unsigned int n;
+
+	switch (rate->in_format) {
+	case SND_PCM_FORMAT_S16:
+		for (n = 0; n < frames; n++, src += src_step)
+			dst[n] = *(const int16_t *)src * (1.0f / 0x8000);
+		break;
+	case SND_PCM_FORMAT_S32:
+		for (n = 0; n < frames; n++, src += src_step)
+			dst[n] = *(const int32_t *)src * (1.0f / 0x80000000UL);
+		break;
+	default: {
+		snd_pcm_channel_area_t tmp_area = {
+			.addr = rate->tmp,
+			.first = 0,
+			.step = 32,
+		};
+		snd_pcm_linear_getput(&tmp_area, 0, src_area, src_offset,
+				      1, frames, rate->get_idx, rate->get_put_idx);
+		for (n = 0; n < frames; n++)
+			dst[n] = rate->tmp[n] * (1.0f / 0x80000000UL);
+		break;
+	}
+	}
+}
+
+static inline int32_t sinc_to_s32(float y)
+{
+	y *= 2147483648.0f;
+	if (y >= 2147483647.0f)
+		return 0x7fffffff;
+	if (y <= -2147483648.0f)
+		return -0x7fffffff - 1;
+	return (int32_t)y;
+}
+
+/* store one channel from rate->tmp */
+static void sinc_put(struct rate_sinc *rate,
+		     const snd_pcm_channel_area_t *dst_area,
+		     snd_pcm_uframes_t dst_offset, unsigned int frames)
+{
+	char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	int dst_step = snd_pcm_channel_area_step(dst_area);
+	unsigned int n;
+
+	switch (rate->out_format) {
+	case SND_PCM_FORMAT_S16:
+		for (n = 0; n < frames; n++, dst += dst_step)
+			*(int16_t *)dst = rate->tmp[n] >> 16;
+		break;
+	case SND_PCM_FORMAT_S32:
+		for (n = 0; n < frames; n++, dst += dst_step)
+			*(int32_t *)dst = rate->tmp[n];
+		break;
+	default: {
+		snd_pcm_channel_area_t tmp_area = {
+			.addr = rate->tmp,
+			.first = 0,
+			.step = 32,
+		};
+		snd_pcm_linear_getput(dst_area, dst_offset, &tmp_area, 0,
+				      1, frames, rate->put_get_idx, rate->put_idx);
+		break;
+	}
+	}
+}
+
+static void sinc_convert(void *obj,
+			 const snd_pcm_channel_area_t *dst_areas,
+			 snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			 const snd_pcm_channel_area_t *src_areas,
+			 snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	struct rate_sinc *rate = obj;
+	const struct sinc_table *t = rate->table;
+	unsigned int taps = rate->taps;
+	unsigned int channel, n;
+
+	if (dst_frames > rate->out_period)
+		dst_frames = rate->out_period;
+	if (src_frames > rate->in_period)
+		src_frames = rate->in_period;
+	if (!src_frames)
+		return;
+
+	/* the phases are the same for all channels */
+	for (n = 0; n < dst_frames; n++) {
+		uint64_t ipos = rate->pos / rate->L;
+		unsigned int frac = rate->pos % rate->L;
+
+		if (ipos >= src_frames)
+			ipos = src_frames - 1;
+		rate->idx[n] = ipos;
+		if (t->nphases == rate->L) {
+			rate->row[n] = t->coef + frac * taps;
+			rate->weight[n] = 0;
+		} else {
+			double p = (double)frac * t->nphases / rate->L;
+			unsigned int r = p;
+			rate->row[n] = t->coef + r * taps;
+			rate->weight[n] = p - r;
+		}
+		rate->pos += rate->M;
+	}
+	if (rate->pos >= (uint64_t)src_frames * rate->L)
+		rate->pos -= (uint64_t)src_frames * rate->L;
+	else
+		rate->pos = 0;
+
+	for (channel = 0; channel < rate->channels; ++channel) {
+		float *x = rate->buf + channel * rate->buf_stride;
+		float *in = x + taps - 1;
+
+		sinc_get(rate, in, &src_areas[channel], src_offset, src_frames);
+		if (t->nphases == rate->L) {
+			for (n = 0; n < dst_frames; n++)
+				rate->tmp[n] = sinc_to_s32(rate->dot(x + rate->idx[n],
+								     rate->row[n], taps));
+		} else {
+			for (n = 0; n < dst_frames; n++) {
+				const float *xs = x + rate->idx[n];
+				float y = rate->dot(xs, rate->row[n], taps);
+				float y1 = rate->dot(xs, rate->row[n] + taps, taps);
+				rate->tmp[n] = sinc_to_s32(y + (y1 - y) * rate->weight[n]);
+			}
+		}
+		sinc_put(rate, &dst_areas[channel], dst_offset, dst_frames);
+
+		memmove(x, x + src_frames, (taps - 1) * sizeof(float));
+	}
+}
+
+static void sinc_free(void *obj)
+{
+	struct rate_sinc *rate = obj;
+
+	sinc_table_put(rate->nominal);
+	sinc_table_put(rate->trim);
+	rate->nominal = rate->trim = rate->table = NULL;
+	free(rate->buf);
+	rate->buf = NULL;
+	free(rate->tmp);
+	rate->tmp = NULL;
+	free(rate->idx);
+	rate->idx = NULL;
+	free(rate->row);
+	rate->row = NULL;
+	free(rate->weight);
+	rate->weight = NULL;
+}
+
+static void sinc_reset(void *obj)
+{
+	struct rate_sinc *rate = obj;
+
+	rate->pos = 0;
+	if (rate->buf)
+		memset(rate->buf, 0, rate->channels * rate->buf_stride * sizeof(float));
+}
+
+/*
+ * The filter length and cutoff follow the nominal ratio given at init;
+ * a trimmed ratio (adaptive resampling) only changes the phases.
+ */
+static void sinc_design_filter(struct rate_sinc *rate, snd_pcm_rate_info_t *info)
+{
+	const struct sinc_quality *q = rate->q;
+	unsigned int in = info->in.period_size, out = info->out.period_size;
+	unsigned int half, taps;
+	double cutoff;
+
+	cutoff = q->rolloff;
+	half = q->half;
+	if (out < in) {
+		/* anti-aliasing: scale the filter to the output Nyquist */
+		cutoff = cutoff * out / in;
+		half = (half * in + out - 1) / out;
+	}
+	taps = (2 * half + 7) & ~7U;
+	if (taps > SINC_MAX_TAPS)
+		taps = SINC_MAX_TAPS;
+	rate->taps = taps;
+	rate->cutoff = cutoff;
+}
+
+/* grow the work buffers to the given period sizes, keeping the history */
+static int sinc_alloc(struct rate_sinc *rate, unsigned int in_period,
+		      unsigned int out_period)
+{
+	unsigned int frames, channel;
+	int grown = 0;
+
+	if (in_period > rate->in_max || !rate->buf) {
+		unsigned int stride = rate->taps - 1 + in_period;
+		float *buf = calloc(rate->channels * stride, sizeof(float));
+		if (!buf)
+			return -ENOMEM;
+		if (rate->buf) {
+			for (channel = 0; channel < rate->channels; channel++)
+				memcpy(buf + channel * stride,
+				       rate->buf + channel * rate->buf_stride,
+				       (rate->taps - 1) * sizeof(float));
+			free(rate->buf);
+		}
+		rate->buf = buf;
+		rate->buf_stride = stride;
+		rate->in_max = in_period;
+		grown = 1;
+	}
+	if (out_period > rate->out_max || !rate->idx) {
+		free(rate->idx);
+		free(rate->row);
+		free(rate->weight);
+		rate->idx = malloc(out_period * sizeof(*rate->idx));
+		rate->row = malloc(out_period * sizeof(*rate->row));
+		rate->weight = malloc(out_period * sizeof(*rate->weight));
+		if (!rate->idx || !rate->row || !rate->weight)
+			return -ENOMEM;
+		rate->out_max = out_period;
+		grown = 1;
+	}
+	if (!grown)
+		return 0;
+	frames = rate->in_max > rate->out_max ? rate->in_max : rate->out_max;
+	free(rate->tmp);
+	rate->tmp = malloc(frames * sizeof(*rate->tmp));
+	if (!rate->tmp)
+		return -ENOMEM;
+	return 0;
+}
+
+/* select the filter phases for the current period sizes */
+static int sinc_setup(struct rate_sinc *rate, snd_pcm_rate_info_t *info)
+{
+	unsigned int g, L, M;
+
+	g = gcd(info->out.period_size, info->in.period_size);
+	L = info->out.period_size / g;
+	M = info->in.period_size / g;
+	if (L == rate->nominal_L && M == rate->nominal_M) {
+		rate->table = rate->nominal;
+	} else {
+		if (!rate->trim) {
+			rate->trim = sinc_table_get(rate->q, rate->q->phases,
+						    rate->taps, rate->cutoff);
+			if (!rate->trim)
+				return -ENOMEM;
+		}
+		rate->table = rate->trim;
+	}
+	/* the same position between the periods, in units of the new L */
+	rate->pos = rate->pos * L / rate->L;
+	rate->L = L;
+	rate->M = M;
+	return 0;
+}
+
+static int sinc_init(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_sinc *rate = obj;
+	unsigned int caps = snd_pcm_simd_caps();
+	unsigned int g;
+	int err;
+
+	sinc_free(rate);
+	rate->channels = info->channels;
+	rate->in_period = info->in.period_size;
+	rate->out_period = info->out.period_size;
+	rate->in_max = rate->out_max = 0;
+	rate->in_format = info->in.format;
+	rate->out_format = info->out.format;
+	rate->get_idx = snd_pcm_linear_get_index(info->in.format, SND_PCM_FORMAT_S32);
+	rate->get_put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	rate->put_get_idx = snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	rate->put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, info->out.format);
+
+	rate->dot = sinc_dot_c;
+#ifdef SND_PCM_SIMD_X86
+	if (caps & SND_PCM_SIMD_AVX2)
+		rate->dot = sinc_dot_avx2;
+	else if (caps & SND_PCM_SIMD_SSE2)
+		rate->dot = sinc_dot_sse2;
+#else
+	(void)caps;
+#endif
+
+	sinc_design_filter(rate, info);
+	err = sinc_alloc(rate, rate->in_period, rate->out_period);
+	if (err < 0)
+		goto __error;
+	g = gcd(rate->out_period, rate->in_period);
+	rate->L = rate->nominal_L = rate->out_period / g;
+	rate->M = rate->nominal_M = rate->in_period / g;
+	rate->pos = 0;
+	rate->nominal = sinc_table_get(rate->q, rate->L <= SINC_MAX_EXACT ?
+				       rate->L : rate->q->phases,
+				       rate->taps, rate->cutoff);
+	if (!rate->nominal) {
+		err = -ENOMEM;
+		goto __error;
+	}
+	rate->table = rate->nominal;
+	return 0;
+
+ __error:
+	sinc_free(rate);
+	return err;
+}
+
+static int sinc_adjust_pitch(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_sinc *rate = obj;
+	int err;
+
+	if (!info->in.period_size || !info->out.period_size) {
+		SNDERR("invalid pcm period_size %ld -> %ld",
+		       info->in.period_size, info->out.period_size);
+		return -EIO;
+	}
+	/* no-op unless longer than any period before */
+	err = sinc_alloc(rate, info->in.period_size, info->out.period_size);
+	if (err < 0)
+		return err;
+	err = sinc_setup(rate, info);
+	if (err < 0)
+		return err;
+	rate->in_period = info->in.period_size;
+	rate->out_period = info->out.period_size;
+	return 0;
+}
+
+static void sinc_close(void *obj)
+{
+	sinc_free(obj);
+	free(obj);
+}
+
+static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
+			       unsigned int *rate_min, unsigned int *rate_max)
+{
+	*rate_min = SND_PCM_PLUGIN_RATE_MIN;
+	*rate_max = SND_PCM_PLUGIN_RATE_MAX;
+	return 0;
+}
+
+static void sinc_dump(void *obj, snd_output_t *out)
+{
+	struct rate_sinc *rate = obj;
+
+	snd_output_printf(out, "Converter: builtin-sinc (%s)\n", rate->q->name);
+	if (rate->table)
+		snd_output_printf(out, "  taps %u, phases %u%s, cutoff %.3f\n",
+				  rate->taps, rate->table->nphases,
+				  rate->table->nphases == rate->L ? "" : " (interpolated)",
+				  rate->table->cutoff);
+}
+
+static const snd_pcm_rate_ops_t sinc_ops = {
+	.close = sinc_close,
+	.init = sinc_init,
+	.free = sinc_free,
+	.reset = sinc_reset,
+	.adjust_pitch = sinc_adjust_pitch,
+	.convert = sinc_convert,
+	.input_frames = input_frames,
+	.output_frames = output_frames,
+	.version = SND_PCM_RATE_PLUGIN_VERSION,
+	.get_supported_rates = get_supported_rates,
+	.dump = sinc_dump,
+};
+
+static int sinc_open(const struct sinc_quality *q, void **objp,
+		     snd_pcm_rate_ops_t *ops)
+{
+	struct rate_sinc *rate;
+
+	rate = calloc(1, sizeof(*rate));
+	if (! rate)
+		return -ENOMEM;
+	rate->q = q;
+	rate->L = rate->M = 1;
+
+	*objp = rate;
+	*ops = sinc_ops;
+	return 0;
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(builtin_sinc_fast) (ATTRIBUTE_UNUSED unsigned int version,
+						  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(&sinc_fast, objp, ops);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(builtin_sinc) (ATTRIBUTE_UNUSED unsigned int version,
+					     void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(&sinc_medium, objp, ops);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(builtin_sinc_best) (ATTRIBUTE_UNUSED unsigned int version,
+						  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(&sinc_best, objp, ops);
+}
@@ -0,0 +1,351 @@
+/*
+ *  PCM - hw_params refine cache
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pcm_local.h"
+#include "pcm_generic.h"
+
+#ifndef DOC_HIDDEN
+
+/*
+ * Refine results are memoized per PCM handle: the key is the complete
+ * input parameter space, the value the refined space and the return
+ * code.  snd_pcm_set_params() and the plugin chains refine the same
+ * spaces over and over, and each refine of a hw PCM is an ioctl.
+ *
+ * The cache is opt-in (LIBASOUND_HW_REFINE_CACHE=1), as the constraints
+ * of some drivers depend on the state of the other streams.  For the same
+ * reason hw handles are not cached in memory, and neither is any handle
+ * with a hw handle (or any other uncacheable one) down its chain, as its
+ * results are derived from the driver's.  The cache of a handle is also
+ * dropped whenever its hw or sw configuration changes.  The hw plugin
+ * may back its ioctl results with a file (LIBASOUND_HW_REFINE_CACHE=2),
+ * tagged with the card and driver identity so a changed setup discards
+ * it; with that, the user declares the driver constraints static, and the
+ * handles above the hw one are cached too.
+ */
+
+#define REFINE_CACHE_ENTRIES	32
+#define REFINE_CACHE_MAGIC	"ALSARFC1"
+
+typedef struct {
+	unsigned int hash;
+	int result;
+	snd_pcm_hw_params_t in;
+	snd_pcm_hw_params_t out;
+} snd_pcm_refine_entry_t;
+
+struct snd_pcm_refine_cache {
+	unsigned int count;
+	unsigned int next;
+	int dirty;
+	char *path;
+	char tag[256];
+	snd_pcm_refine_entry_t entry[REFINE_CACHE_ENTRIES];
+};
+
+typedef struct {
+	char magic[8];
+	unsigned int params_size;
+	unsigned int count;
+	char tag[256];
+} snd_pcm_refine_file_header_t;
+
+static unsigned int refine_hash(const snd_pcm_hw_params_t *params)
+{
+	const unsigned char *p = (const unsigned char *)params;
+	unsigned int h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < sizeof(*params); i++) {
+		h ^= p[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+int snd_pcm_refine_cache_mode(void)
+{
+	static int mode = -1;
+
+	if (mode < 0) {
+		const char *p = getenv("LIBASOUND_HW_REFINE_CACHE");
+		mode = p && *p ? atoi(p) : 0;
+		if (mode < 0)
+			mode = 0;
+	}
+	return mode;
+}
+
+/*
+ * Whether the refine results of a handle are stable, which needs the same
+ * of every handle down its chain.  It is evaluated when the handle is
+ * opened from the configuration, after its slaves, so one level is looked
+ * at here.  Handles created otherwise (e.g. the converters plug inserts)
+ * are never cached.
+ */
+int snd_pcm_refine_cacheable(snd_pcm_t *pcm)
+{
+	snd_pcm_t *slave;
+
+	if (!snd_pcm_refine_cache_mode())
+		return 0;
+	switch (pcm->type) {
+	case SND_PCM_TYPE_NULL:
+		return 1;
+	/* the driver constraints may change with the other streams */
+	case SND_PCM_TYPE_HW:
+		return snd_pcm_refine_cache_mode() >= 2;
+	/* the private data of these starts with snd_pcm_generic_t */
+	case SND_PCM_TYPE_HOOKS:
+	case SND_PCM_TYPE_FILE:
+	case SND_PCM_TYPE_COPY:
+	case SND_PCM_TYPE_LINEAR:
+	case SND_PCM_TYPE_ALAW:
+	case SND_PCM_TYPE_MULAW:
+	case SND_PCM_TYPE_ADPCM:
+	case SND_PCM_TYPE_RATE:
+	case SND_PCM_TYPE_ROUTE:
+	case SND_PCM_TYPE_PLUG:		/* the slave is still req_slave */
+	case SND_PCM_TYPE_METER:
+	case SND_PCM_TYPE_LINEAR_FLOAT:
+	case SND_PCM_TYPE_LADSPA:
+	case SND_PCM_TYPE_IEC958:
+	case SND_PCM_TYPE_SOFTVOL:
+	case SND_PCM_TYPE_MMAP_EMUL:
+		slave = ((snd_pcm_generic_t *)pcm->private_data)->slave;
+		return slave && slave->refine_cacheable;
+	/*
+	 * several slaves, or the refine depends on external code or on
+	 * shared state (ioplug, extplug, share, dmix, dsnoop, dshare, ...)
+	 */
+	default:
+		return 0;
+	}
+}
+
+struct snd_pcm_refine_cache *snd_pcm_refine_cache_get(snd_pcm_t *pcm)
+{
+	if (pcm->refine_cache)
+		return pcm->refine_cache;
+	/* hw handles are cached by the hw plugin itself, if at all */
+	if (!pcm->refine_cacheable || pcm->type == SND_PCM_TYPE_HW)
+		return NULL;
+	pcm->refine_cache = calloc(1, sizeof(*pcm->refine_cache));
+	return pcm->refine_cache;
+}
+
+int snd_pcm_refine_cache_lookup(struct snd_pcm_refine_cache *cache,
+				snd_pcm_hw_params_t *params, int *result)
+{
+	unsigned int i, hash;
+
+	if (!cache || !cache->count)
+		return 0;
+	hash = refine_hash(params);
+	for (i = 0; i < cache->count; i++) {
+		snd_pcm_refine_entry_t *e = &cache->entry[i];
+		if (e->hash == hash && !memcmp(&e->in, params, sizeof(*params))) {
+			*params = e->out;
+			*result = e->result;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void snd_pcm_refine_cache_store(struct snd_pcm_refine_cache *cache,
+				const snd_pcm_hw_params_t *in,
+				const snd_pcm_hw_params_t *out, int result)
+{
+	snd_pcm_refine_entry_t *e;
+
+	if (!cache)
+		return;
+	e = &cache->entry[cache->next];
+	e->hash = refine_hash(in);
+	e->result = result;
+	e->in = *in;
+	e->out = *out;
+	cache->next = (cache->next + 1) % REFINE_CACHE_ENTRIES;
+	if (cache->count < REFINE_CACHE_ENTRIES)
+		cache->count++;
+	cache->dirty = 1;
+}
+
+static int refine_cache_save(struct snd_pcm_refine_cache *cache)
+{
+	snd_pcm_refine_file_header_t hdr;
+	char *tmp;
+	FILE *fp;
+	size_t len;
+	int fd, err = 0;
+
+	len = strlen(cache->path) + 8;
+	tmp = malloc(len);
+	if (!tmp)
+		return -ENOMEM;
+	snprintf(tmp, len, "%s.XXXXXX", cache->path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		err = -errno;
+		free(tmp);
+		return err;
+	}
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		err = -errno;
+		close(fd);
+		goto _err;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, REFINE_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.params_size = sizeof(snd_pcm_hw_params_t);
+	hdr.count = cache->count;
+	memcpy(hdr.tag, cache->tag, sizeof(hdr.tag));
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(cache->entry, sizeof(cache->entry[0]), cache->count, fp) != cache->count)
+		err = -EIO;
+	if (fclose(fp) && !err)
+		err = -errno;
+	if (!err && rename(tmp, cache->path) < 0)
+		err = -errno;
+ _err:
+	if (err < 0)
+		unlink(tmp);
+	free(tmp);
+	return err;
+}
+
+static void refine_cache_load(struct snd_pcm_refine_cache *cache)
+{
+	snd_pcm_refine_file_header_t hdr;
+	FILE *fp;
+
+	fp = fopen(cache->path, "r");
+	if (!fp)
+		return;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, REFINE_CACHE_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.params_size != sizeof(snd_pcm_hw_params_t) ||
+	    hdr.count > REFINE_CACHE_ENTRIES ||
+	    memcmp(hdr.tag, cache->tag, sizeof(hdr.tag)))
+		goto _stale;
+	if (fread(cache->entry, sizeof(cache->entry[0]), hdr.count, fp) != hdr.count) {
+		memset(cache->entry, 0, sizeof(cache->entry));
+		goto _stale;
+	}
+	cache->count = hdr.count;
+	cache->next = hdr.count % REFINE_CACHE_ENTRIES;
+	fclose(fp);
+	return;
+ _stale:
+	/* rewritten with the current tag at the next save */
+	cache->dirty = 1;
+	fclose(fp);
+}
+
+/* $XDG_CACHE_HOME/alsa, created when missing */
+char *snd_pcm_cache_dir(void)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *sub = "/alsa";
+	char *dir;
+	size_t len;
+
+	if (!base || !*base) {
+		base = getenv("HOME");
+		if (!base || !*base)
+			return NULL;
+		sub = "/.cache/alsa";
+	}
+	len = strlen(base) + strlen(sub) + 1;
+	dir = malloc(len);
+	if (!dir)
+		return NULL;
+	snprintf(dir, len, "%s%s", base, sub);
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+struct snd_pcm_refine_cache *snd_pcm_refine_cache_new(const char *name,
+						      const char *tag)
+{
+	struct snd_pcm_refine_cache *cache;
+	char *dir, *p;
+	size_t len;
+
+	dir = snd_pcm_cache_dir();
+	if (!dir)
+		return NULL;
+	cache = calloc(1, sizeof(*cache));
+	if (!cache)
+		goto _end;
+	len = strlen(dir) + strlen(name) + 2;
+	cache->path = malloc(len);
+	if (!cache->path) {
+		free(cache);
+		cache = NULL;
+		goto _end;
+	}
+	snprintf(cache->path, len, "%s/%s", dir, name);
+	for (p = cache->path + strlen(dir) + 1; *p; p++)
+		if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_')
+			*p = '_';
+	snprintf(cache->tag, sizeof(cache->tag), "%s", tag);
+	refine_cache_load(cache);
+ _end:
+	free(dir);
+	return cache;
+}
+
+void snd_pcm_refine_cache_flush(struct snd_pcm_refine_cache *cache)
+{
+	if (!cache)
+		return;
+	if (cache->path && cache->dirty)
+		refine_cache_save(cache);
+	cache->dirty = 0;
+	cache->count = 0;
+	cache->next = 0;
+}
+
+void snd_pcm_refine_cache_free(struct snd_pcm_refine_cache *cache)
+{
+	if (!cache)
+		return;
+	if (cache->path) {
+		if (cache->dirty)
+			refine_cache_save(cache);
+		free(cache->path);
+	}
+	free(cache);
+}
+
+#endif /* DOC_HIDDEN */
@@ -30,8 +30,10 @@
 #include <math.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
-
-#include "plugin_ops.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -59,44 +61,82 @@ typedef struct {
 
 typedef struct snd_pcm_route_ttable_dst snd_pcm_route_ttable_dst_t;
 
+typedef void (*snd_pcm_route_mix_s32_t)(int32_t *dst, const void *const *srcs,
+					const float *weight, unsigned int nsrcs,
+					unsigned int frames);
+typedef void (*snd_pcm_route_mix_float_t)(float *dst, const void *const *srcs,
+					  const float *weight, unsigned int nsrcs,
+					  unsigned int frames);
+
+enum {
+	ROUTE_DST_ZERO,		/* silence */
+	ROUTE_DST_COPY,		/* one source, not attenuated */
+	ROUTE_DST_MIX,		/* weighted sum of the sources */
+};
+
+typedef struct {
+	unsigned int type;	/* ROUTE_DST_* */
+	int att;
+	unsigned int src;	/* copy: source channel */
+	int slot;		/* copy: source block when not direct, or -1 */
+	unsigned int nsrcs;	/* mix: sources from first on */
+	unsigned int first;
+} snd_pcm_route_plan_dst_t;
+
+enum {
+	ROUTE_PLAN_IDENTITY,	/* every channel copied to itself */
+	ROUTE_PLAN_PERMUTATION,	/* copies and silence only */
+	ROUTE_PLAN_MIX,		/* some destinations mixed from sources */
+};
+
+/* the ttable compiled for the current channels and formats */
+typedef struct {
+	unsigned int kind;	/* ROUTE_PLAN_* */
+	unsigned int dst_channels;
+	snd_pcm_route_plan_dst_t *dsts;
+	unsigned int nused;	/* sources converted to blocks */
+	unsigned int *used;	/* their channels */
+	unsigned int block_frames;
+	const void **src;	/* mix entries: source block */
+	float *weight;
+	int *iweight;
+	unsigned int *perm;	/* permutation: source of each destination */
+	int copy_direct;	/* copies go straight from source to destination */
+	snd_pcm_linear_conv_t copy_conv; /* NULL for a plain copy */
+	snd_pcm_route_mix_s32_t mix_s32;
+	snd_pcm_route_mix_float_t mix_float;
+	/* with a soft volume: */
+	unsigned int *slot;	/* mix entries: source block */
+	float *base;		/* mix entries: weight at unity gain */
+	unsigned char *live;	/* used sources which are not only copied */
+	unsigned int *gain;	/* the gains the weights were made with */
+	unsigned int gain_channels;
+	int gain_dst;		/* gains per destination (capture) */
+} snd_pcm_route_plan_t;
+
 typedef struct {
-	enum {UINT64, FLOAT} sum_idx;
 	unsigned int get_idx;
 	unsigned int put_idx;
-	unsigned int conv_idx;
-	int use_getput;
-	unsigned int src_size;
+	unsigned int s32_get_idx, s32_put_idx;
+	snd_pcm_linear_conv_t get_conv;
+	snd_pcm_linear_conv_t put_conv;
+	snd_pcm_format_t src_sfmt;
 	snd_pcm_format_t dst_sfmt;
 	unsigned int nsrcs;
 	unsigned int ndsts;
 	snd_pcm_route_ttable_dst_t *dsts;
+	int float_mix;		/* mix in float, for float destinations */
+	void *block;		/* nsrcs + 1 blocks of ROUTE_BLOCK samples */
+	snd_pcm_route_volume_t *vol;	/* soft volume handed over by plug */
+	snd_pcm_route_plan_t plan;
 } snd_pcm_route_params_t;
 
-
-typedef void (*route_f)(const snd_pcm_channel_area_t *dst_area,
-			snd_pcm_uframes_t dst_offset,
-			const snd_pcm_channel_area_t *src_areas,
-			snd_pcm_uframes_t src_offset,
-			unsigned int src_channels,
-			snd_pcm_uframes_t frames,
-			const snd_pcm_route_ttable_dst_t *ttable,
-			const snd_pcm_route_params_t *params);
-
 struct snd_pcm_route_ttable_dst {
 	int att;	/* Attenuated */
 	unsigned int nsrcs;
 	snd_pcm_route_ttable_src_t* srcs;
-	route_f func;
 };
 
-typedef union {
-	int32_t as_sint32;
-	int64_t as_sint64;
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-	float as_float;
-#endif
-} sum_t;
-
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -107,295 +147,725 @@ typedef struct {
 	snd_pcm_chmap_query_t **chmap_override;
 } snd_pcm_route_t;
 
+/*
+ * The conversion works on blocks of ROUTE_BLOCK frames: each used source
+ * channel is converted once to S32 into a scratch block, every mixed
+ * destination is summed from those blocks into a mix block, which is then
+ * converted to the slave format.  These are separate passes over small
+ * blocks which stay in the cache; their gain is that a source feeding
+ * several destinations is read and converted only once.
+ *
+ * When the destination is float, the blocks hold floats instead and the
+ * sum is not clipped, so float chains keep their headroom.
+ *
+ * The ttable is compiled at hw_params time into a plan: unattenuated
+ * single-source destinations are copied (or converted) straight from the
+ * source channel, only the sources that are really mixed are converted
+ * to blocks, and each mixed destination is summed in registers over all
+ * its sources, several frames at once.  The block length is reduced for
+ * wide matrices so that the blocks stay in the L1 cache.
+ *
+ * A soft volume handed over by plug costs no pass of its own: the gains
+ * are folded into the weights, and every destination is mixed from the
+ * blocks by the same kernels.  Only an unattenuated single source at
+ * unity gain stays a copy, which keeps 0 dB bit exact.  The weights are
+ * recomputed when the gains change.
+ */
+#define ROUTE_BLOCK	256
+#define ROUTE_BLOCK_MIN	32
+#define ROUTE_CACHE_BYTES	(16 * 1024)
+
 #endif /* DOC_HIDDEN */
 
-static void snd_pcm_route_convert1_zero(const snd_pcm_channel_area_t *dst_area,
-					snd_pcm_uframes_t dst_offset,
-					const snd_pcm_channel_area_t *src_areas ATTRIBUTE_UNUSED,
-					snd_pcm_uframes_t src_offset ATTRIBUTE_UNUSED,
-					unsigned int src_channels ATTRIBUTE_UNUSED,
-					snd_pcm_uframes_t frames,
-					const snd_pcm_route_ttable_dst_t* ttable ATTRIBUTE_UNUSED,
-					const snd_pcm_route_params_t *params)
+#ifndef DOC_HIDDEN
+
+static inline int route_format_float(snd_pcm_format_t format)
 {
-	snd_pcm_area_silence(dst_area, dst_offset, frames, params->dst_sfmt);
+	return format == SND_PCM_FORMAT_FLOAT_LE ||
+	       format == SND_PCM_FORMAT_FLOAT_BE;
 }
 
-#ifndef DOC_HIDDEN
+/* same conversion as the lfloat plugin */
+static void route_get_float(int32_t *dst, const char *src, int src_step,
+			    snd_pcm_uframes_t frames, int swap)
+{
+	union {
+		float f;
+		uint32_t i;
+	} v;
 
-static void snd_pcm_route_convert1_one(const snd_pcm_channel_area_t *dst_area,
-				       snd_pcm_uframes_t dst_offset,
-				       const snd_pcm_channel_area_t *src_areas,
-				       snd_pcm_uframes_t src_offset,
-				       unsigned int src_channels,
-				       snd_pcm_uframes_t frames,
-				       const snd_pcm_route_ttable_dst_t* ttable,
-				       const snd_pcm_route_params_t *params)
+	while (frames-- > 0) {
+		v.i = *(const uint32_t *)src;
+		if (swap)
+			v.i = bswap_32(v.i);
+		if (v.f >= 1.0)
+			*dst = 0x7fffffff;
+		else if (v.f <= -1.0)
+			*dst = 0x80000000;
+		else
+			*dst = (int32_t)(v.f * (float)0x80000000UL);
+		dst++;
+		src += src_step;
+	}
+}
+
+static void route_put_float(char *dst, int dst_step, const int32_t *src,
+			    snd_pcm_uframes_t frames, int swap)
 {
-#define CONV_LABELS
-#include "plugin_ops.h"
-#undef CONV_LABELS
-	void *conv;
-	const snd_pcm_channel_area_t *src_area = 0;
-	unsigned int srcidx;
-	const char *src;
-	char *dst;
-	int src_step, dst_step;
-	for (srcidx = 0; srcidx < ttable->nsrcs && srcidx < src_channels; ++srcidx) {
-		unsigned int channel = ttable->srcs[srcidx].channel;
-		if (channel >= src_channels)
-			continue;
-		src_area = &src_areas[channel];
-		if (src_area->addr != NULL)
-			break;
+	union {
+		float f;
+		uint32_t i;
+	} v;
+
+	while (frames-- > 0) {
+		v.f = (float)*src++ / (float)0x80000000UL;
+		if (swap)
+			v.i = bswap_32(v.i);
+		*(uint32_t *)dst = v.i;
+		dst += dst_step;
 	}
-	if (srcidx == ttable->nsrcs || srcidx == src_channels) {
-		snd_pcm_route_convert1_zero(dst_area, dst_offset,
-					    src_areas, src_offset,
-					    src_channels,
-					    frames, ttable, params);
+}
+
+/* convert one source channel to S32 */
+static void route_get_block(int32_t *dst,
+			    const snd_pcm_channel_area_t *src_area,
+			    snd_pcm_uframes_t src_offset,
+			    snd_pcm_uframes_t frames,
+			    const snd_pcm_route_params_t *params)
+{
+	const char *src;
+	int src_step;
+
+	if (!src_area->addr) {
+		memset(dst, 0, frames * sizeof(*dst));
 		return;
 	}
-	
-	conv = conv_labels[params->conv_idx];
 	src = snd_pcm_channel_area_addr(src_area, src_offset);
-	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
 	src_step = snd_pcm_channel_area_step(src_area);
-	dst_step = snd_pcm_channel_area_step(dst_area);
-	while (frames-- > 0) {
-		goto *conv;
-#define CONV_END after
-#include "plugin_ops.h"
-#undef CONV_END
-	after:
-		src += src_step;
-		dst += dst_step;
+	if (params->get_conv) {
+		params->get_conv((char *)dst, sizeof(*dst), src, src_step, frames);
+	} else if (route_format_float(params->src_sfmt)) {
+		route_get_float(dst, src, src_step, frames,
+				params->src_sfmt != SND_PCM_FORMAT_FLOAT);
+	} else {
+		snd_pcm_channel_area_t area = {
+			.addr = dst,
+			.first = 0,
+			.step = 32,
+		};
+		snd_pcm_linear_getput(&area, 0, src_area, src_offset, 1, frames,
+				      params->get_idx, params->s32_put_idx);
 	}
 }
 
-static void snd_pcm_route_convert1_one_getput(const snd_pcm_channel_area_t *dst_area,
-					      snd_pcm_uframes_t dst_offset,
-					      const snd_pcm_channel_area_t *src_areas,
-					      snd_pcm_uframes_t src_offset,
-					      unsigned int src_channels,
-					      snd_pcm_uframes_t frames,
-					      const snd_pcm_route_ttable_dst_t* ttable,
-					      const snd_pcm_route_params_t *params)
+/* convert S32 to one destination channel */
+static void route_put_block(const snd_pcm_channel_area_t *dst_area,
+			    snd_pcm_uframes_t dst_offset,
+			    const int32_t *src,
+			    snd_pcm_uframes_t frames,
+			    const snd_pcm_route_params_t *params)
 {
-#define CONV24_LABELS
-#include "plugin_ops.h"
-#undef CONV24_LABELS
-	void *get, *put;
-	const snd_pcm_channel_area_t *src_area = 0;
-	unsigned int srcidx;
-	const char *src;
 	char *dst;
-	int src_step, dst_step;
-	uint32_t sample = 0;
-	for (srcidx = 0; srcidx < ttable->nsrcs && srcidx < src_channels; ++srcidx) {
-		unsigned int channel = ttable->srcs[srcidx].channel;
-		if (channel >= src_channels)
-			continue;
-		src_area = &src_areas[channel];
-		if (src_area->addr != NULL)
-			break;
-	}
-	if (srcidx == ttable->nsrcs || srcidx == src_channels) {
-		snd_pcm_route_convert1_zero(dst_area, dst_offset,
-					    src_areas, src_offset,
-					    src_channels,
-					    frames, ttable, params);
+	int dst_step;
+
+	if (!dst_area->addr)
 		return;
-	}
-	
-	get = get32_labels[params->get_idx];
-	put = put32_labels[params->put_idx];
-	src = snd_pcm_channel_area_addr(src_area, src_offset);
 	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-	src_step = snd_pcm_channel_area_step(src_area);
 	dst_step = snd_pcm_channel_area_step(dst_area);
-	while (frames-- > 0) {
-		goto *get;
-#define CONV24_END after
-#include "plugin_ops.h"
-#undef CONV24_END
-	after:
-		src += src_step;
-		dst += dst_step;
+	if (params->put_conv) {
+		params->put_conv(dst, dst_step, (const char *)src, sizeof(*src), frames);
+	} else if (route_format_float(params->dst_sfmt)) {
+		route_put_float(dst, dst_step, src, frames,
+				params->dst_sfmt != SND_PCM_FORMAT_FLOAT);
+	} else {
+		snd_pcm_channel_area_t area = {
+			.addr = (void *)src,
+			.first = 0,
+			.step = 32,
+		};
+		snd_pcm_linear_getput(dst_area, dst_offset, &area, 0, 1, frames,
+				      params->s32_get_idx, params->put_idx);
 	}
 }
 
-static void snd_pcm_route_convert1_many(const snd_pcm_channel_area_t *dst_area,
-					snd_pcm_uframes_t dst_offset,
-					const snd_pcm_channel_area_t *src_areas,
-					snd_pcm_uframes_t src_offset,
-					unsigned int src_channels,
-					snd_pcm_uframes_t frames,
-					const snd_pcm_route_ttable_dst_t* ttable,
-					const snd_pcm_route_params_t *params)
+/*
+ * mix kernels: dst[i] = sum of srcs[k][i] * weight[k], summed in float in
+ * the order of the sources, so all variants give the same result
+ */
+
+static inline int32_t route_float_to_s32(float s)
 {
-#define GET32_LABELS
-#define PUT32_LABELS
-#include "plugin_ops.h"
-#undef GET32_LABELS
-#undef PUT32_LABELS
-	static void *const zero_labels[2] = {
-		&&zero_int64,
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-		&&zero_float
+	/* 0x7fffffff rounds up to 2^31 in float */
+	if (s >= (int64_t)0x7fffffff)
+		return 0x7fffffff;	/* maximum positive value */
+	else if (s < -(int64_t)0x80000000)
+		return 0x80000000;	/* maximum negative value */
+	return s;
+}
+
+static inline void route_mix_s32_range(int32_t *dst, const void *const *srcs,
+				       const float *weight, unsigned int nsrcs,
+				       unsigned int i, unsigned int frames)
+{
+	unsigned int k;
+
+	for (; i < frames; i++) {
+		float sum = 0.0f;
+		for (k = 0; k < nsrcs; k++)
+			sum += ((const int32_t *)srcs[k])[i] * weight[k];
+		dst[i] = route_float_to_s32(rint(sum));
+	}
+}
+
+static inline void route_mix_float_range(float *dst, const void *const *srcs,
+					 const float *weight, unsigned int nsrcs,
+					 unsigned int i, unsigned int frames)
+{
+	unsigned int k;
+
+	for (; i < frames; i++) {
+		float sum = 0.0f;
+		for (k = 0; k < nsrcs; k++)
+			sum += ((const float *)srcs[k])[i] * weight[k];
+		dst[i] = sum;
+	}
+}
+
+static void route_mix_s32_c(int32_t *dst, const void *const *srcs,
+			    const float *weight, unsigned int nsrcs,
+			    unsigned int frames)
+{
+	route_mix_s32_range(dst, srcs, weight, nsrcs, 0, frames);
+}
+
+static void route_mix_float_c(float *dst, const void *const *srcs,
+			      const float *weight, unsigned int nsrcs,
+			      unsigned int frames)
+{
+	route_mix_float_range(dst, srcs, weight, nsrcs, 0, frames);
+}
+
+#ifdef SND_PCM_SIMD_X86
+SND_PCM_SIMD_TARGET("sse2")
+static void route_mix_s32_sse2(int32_t *dst, const void *const *srcs,
+			       const float *weight, unsigned int nsrcs,
+			       unsigned int frames)
+{
+	const __m128 ovf = _mm_set1_ps(2147483648.0f);
+	const __m128i max = _mm_set1_epi32(0x7fffffff);
+	unsigned int i, k;
+
+	for (i = 0; i + 4 <= frames; i += 4) {
+		__m128 sum = _mm_setzero_ps();
+		__m128i r, m;
+		for (k = 0; k < nsrcs; k++) {
+			__m128i x = _mm_loadu_si128((const __m128i *)((const int32_t *)srcs[k] + i));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(x),
+							 _mm_set1_ps(weight[k])));
+		}
+		/* rounds to nearest even; out of range gives 0x80000000 */
+		r = _mm_cvtps_epi32(sum);
+		m = _mm_castps_si128(_mm_cmpge_ps(sum, ovf));
+		r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, max));
+		_mm_storeu_si128((__m128i *)(dst + i), r);
+	}
+	route_mix_s32_range(dst, srcs, weight, nsrcs, i, frames);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void route_mix_s32_avx2(int32_t *dst, const void *const *srcs,
+			       const float *weight, unsigned int nsrcs,
+			       unsigned int frames)
+{
+	const __m256 ovf = _mm256_set1_ps(2147483648.0f);
+	const __m256i max = _mm256_set1_epi32(0x7fffffff);
+	unsigned int i, k;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		__m256i r;
+		for (k = 0; k < nsrcs; k++) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)((const int32_t *)srcs[k] + i));
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(x),
+							       _mm256_set1_ps(weight[k])));
+		}
+		r = _mm256_cvtps_epi32(sum);
+		r = _mm256_blendv_epi8(r, max,
+				       _mm256_castps_si256(_mm256_cmp_ps(sum, ovf, _CMP_GE_OQ)));
+		_mm256_storeu_si256((__m256i *)(dst + i), r);
+	}
+	route_mix_s32_range(dst, srcs, weight, nsrcs, i, frames);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void route_mix_float_sse2(float *dst, const void *const *srcs,
+				 const float *weight, unsigned int nsrcs,
+				 unsigned int frames)
+{
+	unsigned int i, k;
+
+	for (i = 0; i + 4 <= frames; i += 4) {
+		__m128 sum = _mm_setzero_ps();
+		for (k = 0; k < nsrcs; k++)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps((const float *)srcs[k] + i),
+							 _mm_set1_ps(weight[k])));
+		_mm_storeu_ps(dst + i, sum);
+	}
+	route_mix_float_range(dst, srcs, weight, nsrcs, i, frames);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void route_mix_float_avx2(float *dst, const void *const *srcs,
+				 const float *weight, unsigned int nsrcs,
+				 unsigned int frames)
+{
+	unsigned int i, k;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		__m256 sum = _mm256_setzero_ps();
+		for (k = 0; k < nsrcs; k++)
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps((const float *)srcs[k] + i),
+							       _mm256_set1_ps(weight[k])));
+		_mm256_storeu_ps(dst + i, sum);
+	}
+	route_mix_float_range(dst, srcs, weight, nsrcs, i, frames);
+}
 #endif
-	};
-	/* sum_type att */
-	static void *const add_labels[2 * 2] = {
-		&&add_int64_noatt, &&add_int64_att,
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-		&&add_float_noatt, &&add_float_att
+
+#if !SND_PCM_PLUGIN_ROUTE_FLOAT
+/* integer weights, summed in 64 bits */
+static void route_mix_s32_int(int32_t *dst, const void *const *srcs,
+			      const int *weight, unsigned int nsrcs,
+			      unsigned int frames, int att)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < frames; i++) {
+		int64_t sum = 0;
+		for (k = 0; k < nsrcs; k++) {
+			int32_t v = ((const int32_t *)srcs[k])[i];
+			if (att)
+				sum += (int64_t)v * weight[k];
+			else
+				sum += v;
+		}
+		if (att)
+			div(sum);
+		if (sum > (int64_t)0x7fffffff)
+			dst[i] = 0x7fffffff;	/* maximum positive value */
+		else if (sum < -(int64_t)0x80000000)
+			dst[i] = 0x80000000;	/* maximum negative value */
+		else
+			dst[i] = sum;
+	}
+}
 #endif
-	};
-	/* sum_type att */
-	static void *const norm_labels[2 * 2] = {
-		&&norm_int64_noatt,
-		&&norm_int64_att,
+
+static inline float route_weight(const snd_pcm_route_ttable_src_t *tt)
+{
 #if SND_PCM_PLUGIN_ROUTE_FLOAT
-		&&norm_float,
-		&&norm_float,
+	return tt->as_float;
+#else
+	return (float)tt->as_int / SND_PCM_PLUGIN_ROUTE_RESOLUTION;
 #endif
-	};
-	void *zero, *get32, *add, *norm, *put32;
-	int nsrcs = ttable->nsrcs;
+}
+
+/* convert one source channel to float */
+static void route_get_block_float(float *dst,
+				  const snd_pcm_channel_area_t *src_area,
+				  snd_pcm_uframes_t src_offset,
+				  snd_pcm_uframes_t frames,
+				  const snd_pcm_route_params_t *params)
+{
+	snd_pcm_uframes_t i;
+
+	if (route_format_float(params->src_sfmt) && src_area->addr) {
+		const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		union {
+			float f;
+			uint32_t i;
+		} v;
+
+		if (params->src_sfmt != SND_PCM_FORMAT_FLOAT) {
+			for (i = 0; i < frames; i++, src += src_step) {
+				v.i = bswap_32(*(const uint32_t *)src);
+				dst[i] = v.f;
+			}
+		} else {
+			for (i = 0; i < frames; i++, src += src_step)
+				dst[i] = *(const float *)src;
+		}
+	} else {
+		int32_t tmp[ROUTE_BLOCK];
+
+		route_get_block(tmp, src_area, src_offset, frames, params);
+		for (i = 0; i < frames; i++)
+			dst[i] = tmp[i] * (1.0f / 0x80000000UL);
+	}
+}
+
+/* store one float destination channel */
+static void route_put_block_float(const snd_pcm_channel_area_t *dst_area,
+				  snd_pcm_uframes_t dst_offset,
+				  const float *src,
+				  snd_pcm_uframes_t frames,
+				  const snd_pcm_route_params_t *params)
+{
+	snd_pcm_uframes_t i;
 	char *dst;
 	int dst_step;
-	const char *srcs[nsrcs];
-	int src_steps[nsrcs];
-	snd_pcm_route_ttable_src_t src_tt[nsrcs];
-	int32_t sample = 0;
-	int srcidx, srcidx1 = 0;
-	for (srcidx = 0; srcidx < nsrcs && (unsigned)srcidx < src_channels; ++srcidx) {
-		const snd_pcm_channel_area_t *src_area;
-		unsigned int channel = ttable->srcs[srcidx].channel;
-		if (channel >= src_channels)
-			continue;
-		src_area = &src_areas[channel];
-		srcs[srcidx1] = snd_pcm_channel_area_addr(src_area, src_offset);
-		src_steps[srcidx1] = snd_pcm_channel_area_step(src_area);
-		src_tt[srcidx1] = ttable->srcs[srcidx];
-		srcidx1++;
-	}
-	nsrcs = srcidx1;
-	if (nsrcs == 0) {
-		snd_pcm_route_convert1_zero(dst_area, dst_offset,
-					    src_areas, src_offset,
-					    src_channels,
-					    frames, ttable, params);
+	union {
+		float f;
+		uint32_t i;
+	} v;
+
+	if (!dst_area->addr)
 		return;
-	} else if (nsrcs == 1 && src_tt[0].as_int == SND_PCM_PLUGIN_ROUTE_RESOLUTION) {
-		if (params->use_getput)
-			snd_pcm_route_convert1_one_getput(dst_area, dst_offset,
-							  src_areas, src_offset,
-							  src_channels,
-							  frames, ttable, params);
-		else
-			snd_pcm_route_convert1_one(dst_area, dst_offset,
-						   src_areas, src_offset,
-						   src_channels,
-						   frames, ttable, params);
+	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	dst_step = snd_pcm_channel_area_step(dst_area);
+	if (params->dst_sfmt != SND_PCM_FORMAT_FLOAT) {
+		for (i = 0; i < frames; i++, dst += dst_step) {
+			v.f = src[i];
+			*(uint32_t *)dst = bswap_32(v.i);
+		}
+	} else {
+		for (i = 0; i < frames; i++, dst += dst_step)
+			*(float *)dst = src[i];
+	}
+}
+
+#endif /* DOC_HIDDEN */
+
+#ifndef DOC_HIDDEN
+
+static void route_plan_free(snd_pcm_route_plan_t *plan)
+{
+	free(plan->dsts);
+	free(plan->used);
+	free(plan->src);
+	free(plan->weight);
+	free(plan->iweight);
+	free(plan->perm);
+	free(plan->slot);
+	free(plan->base);
+	free(plan->live);
+	free(plan->gain);
+	memset(plan, 0, sizeof(*plan));
+}
+
+/* copy or convert a source channel straight to the destination */
+static void route_copy_direct(const snd_pcm_channel_area_t *dst_area,
+			      snd_pcm_uframes_t dst_offset,
+			      const snd_pcm_channel_area_t *src_area,
+			      snd_pcm_uframes_t src_offset,
+			      snd_pcm_uframes_t frames,
+			      const snd_pcm_route_params_t *params)
+{
+	const snd_pcm_route_plan_t *plan = &params->plan;
+
+	if (!dst_area->addr)
 		return;
+	if (!src_area->addr)
+		snd_pcm_area_silence(dst_area, dst_offset, frames, params->dst_sfmt);
+	else if (plan->copy_conv)
+		plan->copy_conv(snd_pcm_channel_area_addr(dst_area, dst_offset),
+				snd_pcm_channel_area_step(dst_area),
+				snd_pcm_channel_area_addr(src_area, src_offset),
+				snd_pcm_channel_area_step(src_area), frames);
+	else
+		snd_pcm_area_copy(dst_area, dst_offset, src_area, src_offset,
+				  frames, params->dst_sfmt);
+}
+
+/* check whether all channels are interleaved in one buffer in order */
+static int route_areas_interleaved(const snd_pcm_channel_area_t *areas,
+				   unsigned int channels, unsigned int width)
+{
+	unsigned int c;
+
+	if (areas->step != channels * width || areas->first % 8)
+		return 0;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].step != areas->step ||
+		    areas[c].first != areas->first + c * width)
+			return 0;
 	}
+	return 1;
+}
 
-	zero = zero_labels[params->sum_idx];
-	get32 = get32_labels[params->get_idx];
-	add = add_labels[params->sum_idx * 2 + ttable->att];
-	norm = norm_labels[params->sum_idx * 2 + ttable->att];
-	put32 = put32_labels[params->put_idx];
-	dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
-	dst_step = snd_pcm_channel_area_step(dst_area);
+#define ROUTE_PERMUTE(type) do { \
+	const type *src = snd_pcm_channel_area_addr(src_areas, src_offset); \
+	type *dst = snd_pcm_channel_area_addr(dst_areas, dst_offset); \
+	while (frames-- > 0) { \
+		for (c = 0; c < dst_channels; c++) \
+			dst[c] = src[perm[c]]; \
+		src += src_channels; \
+		dst += dst_channels; \
+	} \
+} while (0)
+
+/* permutation of interleaved 16 or 32 bit samples, returns 0 if not done */
+static int route_permute_interleaved(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     const snd_pcm_channel_area_t *src_areas,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int src_channels,
+				     unsigned int dst_channels,
+				     snd_pcm_uframes_t frames,
+				     const snd_pcm_route_params_t *params)
+{
+	const unsigned int *perm = params->plan.perm;
+	unsigned int width = snd_pcm_format_physical_width(params->dst_sfmt);
+	unsigned int c;
 
-	while (frames-- > 0) {
-		snd_pcm_route_ttable_src_t *ttp = src_tt;
-		sum_t sum;
-
-		/* Zero sum */
-		goto *zero;
-	zero_int64: 
-		sum.as_sint64 = 0;
-		goto zero_end;
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-	zero_float:
-		sum.as_float = 0.0;
-		goto zero_end;
-#endif
-	zero_end:
-		for (srcidx = 0; srcidx < nsrcs; ++srcidx) {
-			const char *src = srcs[srcidx];
-			
-			/* Get sample */
-			goto *get32;
-#define GET32_END after_get
-#include "plugin_ops.h"
-#undef GET32_END
-		after_get:
-
-			/* Sum */
-			goto *add;
-		add_int64_att:
-			sum.as_sint64 += (int64_t) sample * ttp->as_int;
-			goto after_sum;
-		add_int64_noatt:
-			if (ttp->as_int)
-				sum.as_sint64 += sample;
-			goto after_sum;
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-		add_float_att:
-			sum.as_float += sample * ttp->as_float;
-			goto after_sum;
-		add_float_noatt:
-			if (ttp->as_int)
-				sum.as_float += sample;
-			goto after_sum;
-#endif
-		after_sum:
-			srcs[srcidx] += src_steps[srcidx];
-			ttp++;
+	if (!perm || (width != 16 && width != 32) ||
+	    !route_areas_interleaved(src_areas, src_channels, width) ||
+	    !route_areas_interleaved(dst_areas, dst_channels, width))
+		return 0;
+	if (width == 16)
+		ROUTE_PERMUTE(uint16_t);
+	else
+		ROUTE_PERMUTE(uint32_t);
+	return 1;
+}
+
+#undef ROUTE_PERMUTE
+
+static int route_plan_use(snd_pcm_route_plan_t *plan, int *slots,
+			  unsigned int channel)
+{
+	if (slots[channel] < 0) {
+		slots[channel] = plan->nused;
+		plan->used[plan->nused++] = channel;
+	}
+	return slots[channel];
+}
+
+/* compile the ttable for the given channels, after the formats are set */
+static int route_plan_build(snd_pcm_route_params_t *params,
+			    unsigned int src_channels,
+			    unsigned int dst_channels)
+{
+	snd_pcm_route_plan_t *plan = &params->plan;
+	unsigned int nsrcs = params->nsrcs < src_channels ? params->nsrcs : src_channels;
+	unsigned int channel, srcidx, entries = 0, mixed = 0, copies = 0;
+	unsigned int caps = snd_pcm_simd_caps();
+	size_t sample_bytes = params->float_mix ? sizeof(float) : sizeof(int32_t);
+	int slots[nsrcs ? nsrcs : 1];
+	unsigned int *slot;
+
+	route_plan_free(plan);
+	for (channel = 0; channel < dst_channels && channel < params->ndsts; ++channel)
+		entries += params->dsts[channel].nsrcs;
+	plan->dst_channels = dst_channels;
+	plan->dsts = calloc(dst_channels ? dst_channels : 1, sizeof(*plan->dsts));
+	plan->used = malloc((nsrcs ? nsrcs : 1) * sizeof(*plan->used));
+	plan->src = malloc((entries ? entries : 1) * sizeof(*plan->src));
+	plan->weight = malloc((entries ? entries : 1) * sizeof(*plan->weight));
+	plan->iweight = malloc((entries ? entries : 1) * sizeof(*plan->iweight));
+	slot = malloc((entries ? entries : 1) * sizeof(*slot));
+	if (!plan->dsts || !plan->used || !plan->src || !plan->weight ||
+	    !plan->iweight || !slot) {
+		free(slot);
+		route_plan_free(plan);
+		return -ENOMEM;
+	}
+
+	/* a plain copy must give the same as the conversion via S32 */
+	plan->copy_conv = snd_pcm_linear_conv_find(params->src_sfmt, params->dst_sfmt);
+	plan->copy_direct = plan->copy_conv != NULL;
+	if (params->src_sfmt == params->dst_sfmt &&
+	    (route_format_float(params->src_sfmt) ||
+	     snd_pcm_format_width(params->src_sfmt) ==
+	     snd_pcm_format_physical_width(params->src_sfmt))) {
+		plan->copy_conv = NULL;
+		plan->copy_direct = 1;
+	}
+
+	for (channel = 0; channel < nsrcs; ++channel)
+		slots[channel] = -1;
+	entries = 0;
+	for (channel = 0; channel < dst_channels; ++channel) {
+		snd_pcm_route_plan_dst_t *pd = &plan->dsts[channel];
+		const snd_pcm_route_ttable_dst_t *d = &params->dsts[channel];
+		unsigned int k = 0;
+
+		pd->type = ROUTE_DST_ZERO;
+		pd->slot = -1;
+		if (channel >= params->ndsts)
+			continue;
+		pd->att = d->att;
+		pd->first = entries;
+		for (srcidx = 0; srcidx < d->nsrcs; ++srcidx) {
+			const snd_pcm_route_ttable_src_t *tt = &d->srcs[srcidx];
+			if (tt->channel >= (int)nsrcs)
+				continue;
+			pd->src = tt->channel;
+			plan->weight[entries + k] = d->att ? route_weight(tt) : 1.0f;
+			plan->iweight[entries + k] = tt->as_int;
+			k++;
 		}
-		
-		/* Normalization */
-		goto *norm;
-	norm_int64_att:
-		div(sum.as_sint64);
-		/* fallthru */
-	norm_int64_noatt:
-		if (sum.as_sint64 > (int64_t)0x7fffffff)
-			sample = 0x7fffffff;	/* maximum positive value */
-		else if (sum.as_sint64 < -(int64_t)0x80000000)
-			sample = 0x80000000;	/* maximum negative value */
-		else
-			sample = sum.as_sint64;
-		goto after_norm;
+		if (k == 0)
+			continue;
+		/* with a volume, the gain may make any destination a mix */
+		if (k == 1 && !d->att && !params->vol) {
+			pd->type = ROUTE_DST_COPY;
+			if (!plan->copy_direct)
+				pd->slot = route_plan_use(plan, slots, pd->src);
+			copies++;
+			continue;
+		}
+		pd->type = ROUTE_DST_MIX;
+		pd->nsrcs = k;
+		k = 0;
+		for (srcidx = 0; srcidx < d->nsrcs; ++srcidx) {
+			unsigned int c = d->srcs[srcidx].channel;
+			if (c >= nsrcs)
+				continue;
+			slot[entries + k++] = route_plan_use(plan, slots, c);
+		}
+		entries += k;
+		mixed++;
+	}
 
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-	norm_float:
-		sum.as_float = rint(sum.as_float);
-		if (sum.as_float > (int64_t)0x7fffffff)
-			sample = 0x7fffffff;	/* maximum positive value */
-		else if (sum.as_float < -(int64_t)0x80000000)
-			sample = 0x80000000;	/* maximum negative value */
-		else
-			sample = sum.as_float;
-		goto after_norm;
+	plan->block_frames = ROUTE_BLOCK;
+	if (plan->nused) {
+		unsigned int frames = ROUTE_CACHE_BYTES / (sample_bytes * (plan->nused + 1));
+		if (frames < ROUTE_BLOCK)
+			plan->block_frames = frames < ROUTE_BLOCK_MIN ?
+				ROUTE_BLOCK_MIN : frames & ~7U;
+	}
+	for (srcidx = 0; srcidx < entries; ++srcidx)
+		plan->src[srcidx] = (const char *)params->block +
+			slot[srcidx] * plan->block_frames * sample_bytes;
+	if (params->vol)
+		plan->slot = slot;
+	else
+		free(slot);
+
+	if (!mixed) {
+		plan->kind = ROUTE_PLAN_PERMUTATION;
+		if (copies == dst_channels && plan->copy_direct) {
+			plan->kind = ROUTE_PLAN_IDENTITY;
+			for (channel = 0; channel < dst_channels; ++channel)
+				if (plan->dsts[channel].src != channel)
+					plan->kind = ROUTE_PLAN_PERMUTATION;
+		}
+		/* plain copies of all channels are gathered frame by frame */
+		if (plan->kind == ROUTE_PLAN_PERMUTATION &&
+		    copies == dst_channels && plan->copy_direct && !plan->copy_conv) {
+			plan->perm = malloc((dst_channels ? dst_channels : 1) *
+					    sizeof(*plan->perm));
+			if (!plan->perm) {
+				route_plan_free(plan);
+				return -ENOMEM;
+			}
+			for (channel = 0; channel < dst_channels; ++channel)
+				plan->perm[channel] = plan->dsts[channel].src;
+		}
+	} else {
+		/* each destination lists only its nonzero sources */
+		plan->kind = ROUTE_PLAN_MIX;
+	}
+
+	plan->mix_s32 = route_mix_s32_c;
+	plan->mix_float = route_mix_float_c;
+#ifdef SND_PCM_SIMD_X86
+	if (caps & SND_PCM_SIMD_AVX2) {
+		plan->mix_s32 = route_mix_s32_avx2;
+		plan->mix_float = route_mix_float_avx2;
+	} else if (caps & SND_PCM_SIMD_SSE2) {
+		plan->mix_s32 = route_mix_s32_sse2;
+		plan->mix_float = route_mix_float_sse2;
+	}
+#else
+	(void)caps;
 #endif
-	after_norm:
-		
-		/* Put sample */
-		goto *put32;
-#define PUT32_END after_put32
-#include "plugin_ops.h"
-#undef PUT32_END
-	after_put32:
-		
-		dst += dst_step;
+	return 0;
+}
+
+/*
+ * fold the gains into the weights; an unattenuated single source at unity
+ * gain is copied, so that it stays bit exact
+ */
+static void route_plan_gains(snd_pcm_route_plan_t *plan)
+{
+	unsigned int channel, k;
+
+	memset(plan->live, 0, plan->nused ? plan->nused : 1);
+	for (channel = 0; channel < plan->dst_channels; ++channel) {
+		snd_pcm_route_plan_dst_t *pd = &plan->dsts[channel];
+		int unity = 1;
+
+		if (!pd->nsrcs)
+			continue;
+		for (k = pd->first; k < pd->first + pd->nsrcs; ++k) {
+			unsigned int g = plan->gain[plan->gain_dst ? channel :
+						    plan->used[plan->slot[k]]];
+			if (g != 0xffff)
+				unity = 0;
+			plan->weight[k] = g == 0xffff ? plan->base[k] :
+				plan->base[k] * (g * (1.0f / 65536));
+		}
+		if (pd->nsrcs == 1 && !pd->att && unity) {
+			pd->type = ROUTE_DST_COPY;
+			pd->slot = plan->copy_direct ? -1 : (int)plan->slot[pd->first];
+			if (pd->slot >= 0)
+				plan->live[pd->slot] = 1;
+			continue;
+		}
+		pd->type = ROUTE_DST_MIX;
+		for (k = pd->first; k < pd->first + pd->nsrcs; ++k)
+			plan->live[plan->slot[k]] = 1;
+	}
+}
+
+/* set up the gains of a plan built with a volume, per client channel */
+static int route_plan_volume(snd_pcm_route_params_t *params,
+			     unsigned int channels, int capture)
+{
+	snd_pcm_route_plan_t *plan = &params->plan;
+	unsigned int channel, entries = 0;
+
+	for (channel = 0; channel < plan->dst_channels; ++channel)
+		entries += plan->dsts[channel].nsrcs;
+	plan->base = malloc((entries ? entries : 1) * sizeof(*plan->base));
+	plan->live = malloc(plan->nused ? plan->nused : 1);
+	plan->gain = malloc((channels ? channels : 1) * sizeof(*plan->gain));
+	if (!plan->base || !plan->live || !plan->gain) {
+		route_plan_free(plan);
+		return -ENOMEM;
 	}
+	memcpy(plan->base, plan->weight, entries * sizeof(*plan->base));
+	plan->gain_channels = channels;
+	plan->gain_dst = capture;
+	for (channel = 0; channel < channels; ++channel)
+		plan->gain[channel] = 0xffff;
+	route_plan_gains(plan);
+	return 0;
 }
 
+/* pick up a changed volume */
+static void route_plan_update_gains(snd_pcm_route_params_t *params)
+{
+	snd_pcm_route_plan_t *plan = &params->plan;
+	unsigned int gain[plan->gain_channels ? plan->gain_channels : 1];
+
+	params->vol->get_gains(params->vol, plan->gain_channels, gain);
+	if (!memcmp(gain, plan->gain, plan->gain_channels * sizeof(*gain)))
+		return;
+	memcpy(plan->gain, gain, plan->gain_channels * sizeof(*gain));
+	route_plan_gains(plan);
+}
+
+static const char *const route_plan_kind_names[] = {
+	[ROUTE_PLAN_IDENTITY] = "identity",
+	[ROUTE_PLAN_PERMUTATION] = "permutation",
+	[ROUTE_PLAN_MIX] = "mix",
+};
+
 #endif /* DOC_HIDDEN */
 
 static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
@@ -407,25 +877,91 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 				  snd_pcm_uframes_t frames,
 				  snd_pcm_route_params_t *params)
 {
-	unsigned int dst_channel;
-	snd_pcm_route_ttable_dst_t *dstp;
-	const snd_pcm_channel_area_t *dst_area;
-
-	dstp = params->dsts;
-	dst_area = dst_areas;
-	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
-		if (dst_channel >= params->ndsts)
-			snd_pcm_route_convert1_zero(dst_area, dst_offset,
-						    src_areas, src_offset,
-						    src_channels,
-						    frames, dstp, params);
+	const snd_pcm_route_plan_t *plan = &params->plan;
+	size_t sample_bytes = params->float_mix ? sizeof(float) : sizeof(int32_t);
+	char *block = params->block;
+	void *mix = block + plan->nused * plan->block_frames * sample_bytes;
+
+	if (plan->gain)
+		route_plan_update_gains(params);
+	if (plan->kind == ROUTE_PLAN_IDENTITY) {
+		/* whole frames at once when interleaved */
+		if (plan->copy_conv)
+			snd_pcm_linear_conv_areas(dst_areas, dst_offset,
+						  src_areas, src_offset,
+						  dst_channels, frames,
+						  params->dst_sfmt, params->src_sfmt,
+						  plan->copy_conv);
 		else
-			dstp->func(dst_area, dst_offset,
-				   src_areas, src_offset,
-				   src_channels,
-				   frames, dstp, params);
-		dstp++;
-		dst_area++;
+			snd_pcm_areas_copy(dst_areas, dst_offset,
+					   src_areas, src_offset,
+					   dst_channels, frames, params->dst_sfmt);
+		return;
+	}
+	if (plan->perm &&
+	    route_permute_interleaved(dst_areas, dst_offset, src_areas, src_offset,
+				      src_channels, dst_channels, frames, params))
+		return;
+	while (frames > 0) {
+		snd_pcm_uframes_t n = frames < plan->block_frames ? frames : plan->block_frames;
+		unsigned int channel;
+
+		for (channel = 0; channel < plan->nused; ++channel) {
+			void *dst = block + channel * plan->block_frames * sample_bytes;
+			const snd_pcm_channel_area_t *src_area = &src_areas[plan->used[channel]];
+			if (plan->live && !plan->live[channel])
+				continue;
+			if (params->float_mix)
+				route_get_block_float(dst, src_area, src_offset, n, params);
+			else
+				route_get_block(dst, src_area, src_offset, n, params);
+		}
+		for (channel = 0; channel < dst_channels; ++channel) {
+			const snd_pcm_route_plan_dst_t *d = &plan->dsts[channel];
+			const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+			const void *src;
+
+			switch (d->type) {
+			case ROUTE_DST_ZERO:
+				snd_pcm_area_silence(dst_area, dst_offset, n,
+						     params->dst_sfmt);
+				continue;
+			case ROUTE_DST_COPY:
+				if (d->slot < 0) {
+					route_copy_direct(dst_area, dst_offset,
+							  &src_areas[d->src], src_offset,
+							  n, params);
+					continue;
+				}
+				src = block + d->slot * plan->block_frames * sample_bytes;
+				break;
+			default:
+				if (params->float_mix)
+					plan->mix_float(mix, plan->src + d->first,
+							plan->weight + d->first,
+							d->nsrcs, n);
+#if !SND_PCM_PLUGIN_ROUTE_FLOAT
+				/* the gains exist as float weights only */
+				else if (!plan->gain)
+					route_mix_s32_int(mix, plan->src + d->first,
+							  plan->iweight + d->first,
+							  d->nsrcs, n, d->att);
+#endif
+				else
+					plan->mix_s32(mix, plan->src + d->first,
+						      plan->weight + d->first,
+						      d->nsrcs, n);
+				src = mix;
+				break;
+			}
+			if (params->float_mix)
+				route_put_block_float(dst_area, dst_offset, src, n, params);
+			else
+				route_put_block(dst_area, dst_offset, src, n, params);
+		}
+		src_offset += n;
+		dst_offset += n;
+		frames -= n;
 	}
 }
 
@@ -441,6 +977,8 @@ static int snd_pcm_route_close(snd_pcm_t *pcm)
 		}
 		free(params->dsts);
 	}
+	route_plan_free(&params->plan);
+	free(params->block);
 	free(route->chmap);
 	snd_pcm_free_chmaps(route->chmap_override);
 	return snd_pcm_generic_close(pcm);
@@ -451,6 +989,8 @@ static int snd_pcm_route_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd
 	int err;
 	snd_pcm_access_mask_t access_mask = { SND_PCM_ACCBIT_SHM };
 	snd_pcm_format_mask_t format_mask = { SND_PCM_FMTBIT_LINEAR };
+	snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT_LE);
+	snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT_BE);
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_ACCESS,
 					 &access_mask);
 	if (err < 0)
@@ -550,6 +1090,7 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	snd_pcm_route_t *route = pcm->private_data;
 	snd_pcm_t *slave = route->plug.gen.slave;
 	snd_pcm_format_t src_format, dst_format;
+	unsigned int channels;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_route_hw_refine_cchange,
 					  snd_pcm_route_hw_refine_sprepare,
@@ -567,23 +1108,36 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	}
 	if (err < 0)
 		return err;
-	/* 3 bytes or 20-bit formats? */
-	route->params.use_getput =
-		(snd_pcm_format_physical_width(src_format) + 7) / 8 == 3 ||
-		(snd_pcm_format_physical_width(dst_format) + 7) / 8 == 3 ||
-		snd_pcm_format_width(src_format) == 20 ||
-		snd_pcm_format_width(dst_format) == 20;
-	route->params.get_idx = snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
-	route->params.put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
-	route->params.conv_idx = snd_pcm_linear_convert_index(src_format, dst_format);
-	route->params.src_size = snd_pcm_format_width(src_format) / 8;
+	route->params.get_conv = snd_pcm_linear_conv_find(src_format, SND_PCM_FORMAT_S32);
+	route->params.put_conv = snd_pcm_linear_conv_find(SND_PCM_FORMAT_S32, dst_format);
+	if (!route_format_float(src_format))
+		route->params.get_idx = snd_pcm_linear_get_index(src_format, SND_PCM_FORMAT_S32);
+	if (!route_format_float(dst_format))
+		route->params.put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, dst_format);
+	route->params.s32_get_idx = snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	route->params.s32_put_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+	route->params.src_sfmt = src_format;
 	route->params.dst_sfmt = dst_format;
-#if SND_PCM_PLUGIN_ROUTE_FLOAT
-	route->params.sum_idx = FLOAT;
-#else
-	route->params.sum_idx = UINT64;
-#endif
-	return 0;
+	route->params.float_mix = route_format_float(dst_format);
+	err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels);
+	if (err < 0)
+		return err;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		err = route_plan_build(&route->params, channels, slave->channels);
+	else
+		err = route_plan_build(&route->params, slave->channels, channels);
+	if (err < 0 || !route->params.vol)
+		return err;
+	return route_plan_volume(&route->params, channels,
+				 pcm->stream == SND_PCM_STREAM_CAPTURE);
+}
+
+static int snd_pcm_route_hw_free(snd_pcm_t *pcm)
+{
+	snd_pcm_route_t *route = pcm->private_data;
+
+	route_plan_free(&route->params.plan);
+	return snd_pcm_generic_hw_free(pcm);
 }
 
 static snd_pcm_uframes_t
@@ -716,6 +1270,12 @@ static void snd_pcm_route_dump(snd_pcm_t *pcm, snd_output_t *out)
 		}
 		snd_output_putc(out, '\n');
 	}
+	if (pcm->setup)
+		snd_output_printf(out, "  Plan: %s, %u source blocks of %u frames%s\n",
+				  route_plan_kind_names[route->params.plan.kind],
+				  route->params.plan.nused,
+				  route->params.plan.block_frames,
+				  route->params.plan.gain ? ", soft volume" : "");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -913,7 +1473,7 @@ static const snd_pcm_ops_t snd_pcm_route_ops = {
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_route_hw_refine,
 	.hw_params = snd_pcm_route_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_route_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_route_dump,
@@ -980,10 +1540,6 @@ static int route_load_ttable(snd_pcm_route_params_t *params, snd_pcm_stream_t st
 #endif
 		dptr->att = att;
 		dptr->nsrcs = nsrcs;
-		if (nsrcs == 0)
-			dptr->func = snd_pcm_route_convert1_zero;
-		else
-			dptr->func = snd_pcm_route_convert1_many;
 		if (nsrcs > 0) {
 			dptr->srcs = calloc((unsigned int) nsrcs, sizeof(*srcs));
 			if (!dptr->srcs)
@@ -1025,7 +1581,8 @@ int snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 	int err;
 	assert(pcmp && slave && ttable);
 	if (sformat != SND_PCM_FORMAT_UNKNOWN && 
-	    snd_pcm_format_linear(sformat) != 1)
+	    snd_pcm_format_linear(sformat) != 1 &&
+	    !route_format_float(sformat))
 		return -EINVAL;
 	route = calloc(1, sizeof(snd_pcm_route_t));
 	if (!route) {
@@ -1060,11 +1617,32 @@ int snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 		snd_pcm_close(pcm);
 		return err;
 	}
+	route->params.block = malloc((route->params.nsrcs + 1) * ROUTE_BLOCK *
+				     sizeof(int32_t));
+	if (!route->params.block) {
+		snd_pcm_close(pcm);
+		return -ENOMEM;
+	}
 	*pcmp = pcm;
 
 	return 0;
 }
 
+#ifndef DOC_HIDDEN
+/*
+ * Apply a soft volume in the conversion; called by plug before hw_params,
+ * the volume stays owned by the caller.
+ */
+int snd_pcm_route_set_volume(snd_pcm_t *pcm, snd_pcm_route_volume_t *vol)
+{
+	snd_pcm_route_t *route = pcm->private_data;
+
+	assert(pcm->type == SND_PCM_TYPE_ROUTE);
+	route->params.vol = vol;
+	return 0;
+}
+#endif
+
 static int _snd_pcm_route_determine_ttable(snd_config_t *tt,
 					   unsigned int *tt_csize,
 					   unsigned int *tt_ssize,
@@ -1240,6 +1818,9 @@ int snd_pcm_route_load_ttable(snd_config_t *tt, snd_pcm_route_ttable_entry_t *tt
 This plugin converts channels and applies volume during the conversion.
 The format and rate must match for both of them.
 
+Linear and 32 bit float formats are accepted on both sides.  When the
+slave format is float, the channels are mixed in float without clipping.
+
 SCHANNEL can be a channel name instead of a number (e g FL, LFE).
 If so, a matching channel map will be selected for the slave.
 
@@ -1351,9 +1932,10 @@ int _snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 		return err;
 	}
 	if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-	    snd_pcm_format_linear(sformat) != 1) {
+	    snd_pcm_format_linear(sformat) != 1 &&
+	    !route_format_float(sformat)) {
 	    	snd_config_delete(sconf);
-		SNDERR("slave format is not linear");
+		SNDERR("slave format is not linear or float");
 		snd_pcm_free_chmaps(chmaps);
 		return -EINVAL;
 	}
@@ -0,0 +1,678 @@
+/*
+ *  PCM - SIMD helpers and runtime CPU dispatch
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pcm_local.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifndef DOC_HIDDEN
+
+/*
+ * CPU feature detection
+ *
+ * Resolved once; LIBASOUND_SIMD=0 in the environment disables all
+ * vector kernels (useful to compare results against the C paths).
+ */
+
+static int simd_caps = -1;
+
+unsigned int snd_pcm_simd_caps(void)
+{
+	int caps = simd_caps;
+	const char *str;
+
+	if (caps >= 0)
+		return caps;
+	caps = 0;
+	str = getenv("LIBASOUND_SIMD");
+	if (str && atoi(str) <= 0)
+		goto __end;
+#ifdef SND_PCM_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		caps |= SND_PCM_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		caps |= SND_PCM_SIMD_AVX2;
+#endif
+ __end:
+	simd_caps = caps;
+	return caps;
+}
+
+/*
+ * contiguous copy / fill
+ */
+
+#ifdef SND_PCM_SIMD_X86
+SND_PCM_SIMD_TARGET("sse2")
+static void copy_stream_sse2(char *dst, const char *src, size_t bytes)
+{
+	size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+		_mm_stream_si128((__m128i *)dst, a);
+		_mm_stream_si128((__m128i *)(dst + 16), b);
+		_mm_stream_si128((__m128i *)(dst + 32), c);
+		_mm_stream_si128((__m128i *)(dst + 48), d);
+	}
+	_mm_sfence();
+	memcpy(dst, src, bytes);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void copy_stream_avx2(char *dst, const char *src, size_t bytes)
+{
+	size_t head = (32 - ((uintptr_t)dst & 31)) & 31;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+	for (; bytes >= 64; bytes -= 64, src += 64, dst += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)src);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+		_mm256_stream_si256((__m256i *)dst, a);
+		_mm256_stream_si256((__m256i *)(dst + 32), b);
+	}
+	_mm_sfence();
+	memcpy(dst, src, bytes);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void fill64_stream_sse2(char *dst, uint64_t pattern, size_t bytes)
+{
+	__m128i v = _mm_set1_epi64x(pattern);
+	uint64_t *p = (uint64_t *)dst;
+
+	/* dst is 8 byte aligned here */
+	if ((uintptr_t)p & 15) {
+		*p++ = pattern;
+		bytes -= 8;
+	}
+	dst = (char *)p;
+	for (; bytes >= 64; bytes -= 64, dst += 64) {
+		_mm_stream_si128((__m128i *)dst, v);
+		_mm_stream_si128((__m128i *)(dst + 16), v);
+		_mm_stream_si128((__m128i *)(dst + 32), v);
+		_mm_stream_si128((__m128i *)(dst + 48), v);
+	}
+	_mm_sfence();
+	for (p = (uint64_t *)dst; bytes >= 8; bytes -= 8)
+		*p++ = pattern;
+}
+#endif
+
+/* copy non-overlapping memory, bypassing the cache for big blocks */
+void snd_pcm_simd_copy(void *dst, const void *src, size_t bytes)
+{
+#ifdef SND_PCM_SIMD_X86
+	if (bytes >= SND_PCM_SIMD_NT_THRESHOLD) {
+		unsigned int caps = snd_pcm_simd_caps();
+		if (caps & SND_PCM_SIMD_AVX2) {
+			copy_stream_avx2(dst, src, bytes);
+			return;
+		}
+		if (caps & SND_PCM_SIMD_SSE2) {
+			copy_stream_sse2(dst, src, bytes);
+			return;
+		}
+	}
+#endif
+	memcpy(dst, src, bytes);
+}
+
+/*
+ * fill memory with a 64 bit pattern; dst must be 8 byte aligned and
+ * bytes a multiple of 8
+ */
+void snd_pcm_simd_fill64(void *dst, uint64_t pattern, size_t bytes)
+{
+	uint64_t *p = dst;
+
+#ifdef SND_PCM_SIMD_X86
+	if (bytes >= SND_PCM_SIMD_NT_THRESHOLD &&
+	    (snd_pcm_simd_caps() & SND_PCM_SIMD_SSE2)) {
+		fill64_stream_sse2(dst, pattern, bytes);
+		return;
+	}
+#endif
+	for (; bytes >= 8; bytes -= 8)
+		*p++ = pattern;
+}
+
+/*
+ * interleave / deinterleave
+ *
+ * The C versions are specialized for the common channel counts and
+ * sample sizes so that the compiler can unroll the inner loop; they
+ * also handle the tails left over by the vector kernels.
+ */
+
+static inline __attribute__((always_inline))
+void copy_sample(char *dst, const char *src, unsigned int bytes)
+{
+	switch (bytes) {
+	case 2:
+		*(uint16_t *)dst = *(const uint16_t *)src;
+		break;
+	case 4:
+		*(uint32_t *)dst = *(const uint32_t *)src;
+		break;
+	default:
+		memcpy(dst, src, bytes);
+		break;
+	}
+}
+
+static inline __attribute__((always_inline))
+void interleave_c(char *dst, const char *const *src, unsigned int channels,
+		  unsigned int bytes, snd_pcm_uframes_t start,
+		  snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f;
+	unsigned int c;
+
+	dst += start * channels * bytes;
+	for (f = start; f < frames; f++) {
+		for (c = 0; c < channels; c++) {
+			copy_sample(dst, src[c] + f * bytes, bytes);
+			dst += bytes;
+		}
+	}
+}
+
+static inline __attribute__((always_inline))
+void deinterleave_c(char *const *dst, const char *src, unsigned int channels,
+		    unsigned int bytes, snd_pcm_uframes_t start,
+		    snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f;
+	unsigned int c;
+
+	src += start * channels * bytes;
+	for (f = start; f < frames; f++) {
+		for (c = 0; c < channels; c++) {
+			copy_sample(dst[c] + f * bytes, src, bytes);
+			src += bytes;
+		}
+	}
+}
+
+#define DEFINE_C_KERNELS(chn, bytes) \
+static void interleave_c_##chn##_##bytes(char *dst, const char *const *src, \
+					 snd_pcm_uframes_t start, \
+					 snd_pcm_uframes_t frames) \
+{ \
+	interleave_c(dst, src, chn, bytes, start, frames); \
+} \
+static void deinterleave_c_##chn##_##bytes(char *const *dst, const char *src, \
+					   snd_pcm_uframes_t start, \
+					   snd_pcm_uframes_t frames) \
+{ \
+	deinterleave_c(dst, src, chn, bytes, start, frames); \
+}
+
+DEFINE_C_KERNELS(2, 2)
+DEFINE_C_KERNELS(2, 3)
+DEFINE_C_KERNELS(2, 4)
+DEFINE_C_KERNELS(4, 2)
+DEFINE_C_KERNELS(4, 3)
+DEFINE_C_KERNELS(4, 4)
+DEFINE_C_KERNELS(6, 2)
+DEFINE_C_KERNELS(6, 3)
+DEFINE_C_KERNELS(6, 4)
+DEFINE_C_KERNELS(8, 2)
+DEFINE_C_KERNELS(8, 3)
+DEFINE_C_KERNELS(8, 4)
+
+typedef void (*interleave_f)(char *dst, const char *const *src,
+			     snd_pcm_uframes_t start, snd_pcm_uframes_t frames);
+typedef void (*deinterleave_f)(char *const *dst, const char *src,
+			       snd_pcm_uframes_t start, snd_pcm_uframes_t frames);
+
+#define C_KERNEL_ROW(chn) \
+	{ interleave_c_##chn##_2, interleave_c_##chn##_3, interleave_c_##chn##_4 }
+static const interleave_f interleave_c_table[4][3] = {
+	C_KERNEL_ROW(2), C_KERNEL_ROW(4), C_KERNEL_ROW(6), C_KERNEL_ROW(8)
+};
+#undef C_KERNEL_ROW
+#define C_KERNEL_ROW(chn) \
+	{ deinterleave_c_##chn##_2, deinterleave_c_##chn##_3, deinterleave_c_##chn##_4 }
+static const deinterleave_f deinterleave_c_table[4][3] = {
+	C_KERNEL_ROW(2), C_KERNEL_ROW(4), C_KERNEL_ROW(6), C_KERNEL_ROW(8)
+};
+#undef C_KERNEL_ROW
+
+#ifdef SND_PCM_SIMD_X86
+
+#define LOAD(p)		_mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v)	_mm_storeu_si128((__m128i *)(p), v)
+
+/* 8x8 transpose of 16 bit words; interleaves and deinterleaves 8 channels */
+#define TRANSPOSE8x16(r0, r1, r2, r3, r4, r5, r6, r7) do { \
+	__m128i t0 = _mm_unpacklo_epi16(r0, r1), t1 = _mm_unpackhi_epi16(r0, r1); \
+	__m128i t2 = _mm_unpacklo_epi16(r2, r3), t3 = _mm_unpackhi_epi16(r2, r3); \
+	__m128i t4 = _mm_unpacklo_epi16(r4, r5), t5 = _mm_unpackhi_epi16(r4, r5); \
+	__m128i t6 = _mm_unpacklo_epi16(r6, r7), t7 = _mm_unpackhi_epi16(r6, r7); \
+	__m128i u0 = _mm_unpacklo_epi32(t0, t2), u1 = _mm_unpackhi_epi32(t0, t2); \
+	__m128i u2 = _mm_unpacklo_epi32(t1, t3), u3 = _mm_unpackhi_epi32(t1, t3); \
+	__m128i u4 = _mm_unpacklo_epi32(t4, t6), u5 = _mm_unpackhi_epi32(t4, t6); \
+	__m128i u6 = _mm_unpacklo_epi32(t5, t7), u7 = _mm_unpackhi_epi32(t5, t7); \
+	r0 = _mm_unpacklo_epi64(u0, u4); r1 = _mm_unpackhi_epi64(u0, u4); \
+	r2 = _mm_unpacklo_epi64(u1, u5); r3 = _mm_unpackhi_epi64(u1, u5); \
+	r4 = _mm_unpacklo_epi64(u2, u6); r5 = _mm_unpackhi_epi64(u2, u6); \
+	r6 = _mm_unpacklo_epi64(u3, u7); r7 = _mm_unpackhi_epi64(u3, u7); \
+} while (0)
+
+/* 4x4 transpose of 32 bit words */
+#define TRANSPOSE4x32(r0, r1, r2, r3) do { \
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1); \
+	__m128i t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3); \
+	r0 = _mm_unpacklo_epi64(t0, t2); r1 = _mm_unpackhi_epi64(t0, t2); \
+	r2 = _mm_unpacklo_epi64(t1, t3); r3 = _mm_unpackhi_epi64(t1, t3); \
+} while (0)
+
+/* L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 L2 L3 R0 R1 R2 R3 */
+#define SPLIT2x16(v) \
+	_mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xd8), 0xd8), 0xd8)
+
+/* returns the number of frames processed */
+SND_PCM_SIMD_TARGET("sse2")
+static snd_pcm_uframes_t interleave_sse2(char *dst, const char *const *src,
+					 unsigned int channels, unsigned int bytes,
+					 snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+
+	if (bytes == 2) {
+		switch (channels) {
+		case 2:
+			for (; f + 8 <= frames; f += 8, dst += 32) {
+				__m128i a = LOAD(src[0] + f * 2);
+				__m128i b = LOAD(src[1] + f * 2);
+				STORE(dst, _mm_unpacklo_epi16(a, b));
+				STORE(dst + 16, _mm_unpackhi_epi16(a, b));
+			}
+			break;
+		case 4:
+			for (; f + 8 <= frames; f += 8, dst += 64) {
+				__m128i a = LOAD(src[0] + f * 2);
+				__m128i b = LOAD(src[1] + f * 2);
+				__m128i c = LOAD(src[2] + f * 2);
+				__m128i d = LOAD(src[3] + f * 2);
+				__m128i t0 = _mm_unpacklo_epi16(a, b);
+				__m128i t1 = _mm_unpackhi_epi16(a, b);
+				__m128i t2 = _mm_unpacklo_epi16(c, d);
+				__m128i t3 = _mm_unpackhi_epi16(c, d);
+				STORE(dst, _mm_unpacklo_epi32(t0, t2));
+				STORE(dst + 16, _mm_unpackhi_epi32(t0, t2));
+				STORE(dst + 32, _mm_unpacklo_epi32(t1, t3));
+				STORE(dst + 48, _mm_unpackhi_epi32(t1, t3));
+			}
+			break;
+		case 8:
+			for (; f + 8 <= frames; f += 8, dst += 128) {
+				__m128i r0 = LOAD(src[0] + f * 2);
+				__m128i r1 = LOAD(src[1] + f * 2);
+				__m128i r2 = LOAD(src[2] + f * 2);
+				__m128i r3 = LOAD(src[3] + f * 2);
+				__m128i r4 = LOAD(src[4] + f * 2);
+				__m128i r5 = LOAD(src[5] + f * 2);
+				__m128i r6 = LOAD(src[6] + f * 2);
+				__m128i r7 = LOAD(src[7] + f * 2);
+				TRANSPOSE8x16(r0, r1, r2, r3, r4, r5, r6, r7);
+				STORE(dst, r0);
+				STORE(dst + 16, r1);
+				STORE(dst + 32, r2);
+				STORE(dst + 48, r3);
+				STORE(dst + 64, r4);
+				STORE(dst + 80, r5);
+				STORE(dst + 96, r6);
+				STORE(dst + 112, r7);
+			}
+			break;
+		}
+	} else if (bytes == 4) {
+		switch (channels) {
+		case 2:
+			for (; f + 4 <= frames; f += 4, dst += 32) {
+				__m128i a = LOAD(src[0] + f * 4);
+				__m128i b = LOAD(src[1] + f * 4);
+				STORE(dst, _mm_unpacklo_epi32(a, b));
+				STORE(dst + 16, _mm_unpackhi_epi32(a, b));
+			}
+			break;
+		case 4:
+			for (; f + 4 <= frames; f += 4, dst += 64) {
+				__m128i r0 = LOAD(src[0] + f * 4);
+				__m128i r1 = LOAD(src[1] + f * 4);
+				__m128i r2 = LOAD(src[2] + f * 4);
+				__m128i r3 = LOAD(src[3] + f * 4);
+				TRANSPOSE4x32(r0, r1, r2, r3);
+				STORE(dst, r0);
+				STORE(dst + 16, r1);
+				STORE(dst + 32, r2);
+				STORE(dst + 48, r3);
+			}
+			break;
+		case 8:
+			for (; f + 4 <= frames; f += 4, dst += 128) {
+				__m128i r0 = LOAD(src[0] + f * 4);
+				__m128i r1 = LOAD(src[1] + f * 4);
+				__m128i r2 = LOAD(src[2] + f * 4);
+				__m128i r3 = LOAD(src[3] + f * 4);
+				__m128i r4 = LOAD(src[4] + f * 4);
+				__m128i r5 = LOAD(src[5] + f * 4);
+				__m128i r6 = LOAD(src[6] + f * 4);
+				__m128i r7 = LOAD(src[7] + f * 4);
+				TRANSPOSE4x32(r0, r1, r2, r3);
+				TRANSPOSE4x32(r4, r5, r6, r7);
+				STORE(dst, r0);
+				STORE(dst + 16, r4);
+				STORE(dst + 32, r1);
+				STORE(dst + 48, r5);
+				STORE(dst + 64, r2);
+				STORE(dst + 80, r6);
+				STORE(dst + 96, r3);
+				STORE(dst + 112, r7);
+			}
+			break;
+		}
+	}
+	return f;
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static snd_pcm_uframes_t deinterleave_sse2(char *const *dst, const char *src,
+					   unsigned int channels, unsigned int bytes,
+					   snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+
+	if (bytes == 2) {
+		switch (channels) {
+		case 2:
+			for (; f + 8 <= frames; f += 8, src += 32) {
+				__m128i a = SPLIT2x16(LOAD(src));
+				__m128i b = SPLIT2x16(LOAD(src + 16));
+				STORE(dst[0] + f * 2, _mm_unpacklo_epi64(a, b));
+				STORE(dst[1] + f * 2, _mm_unpackhi_epi64(a, b));
+			}
+			break;
+		case 4:
+			for (; f + 8 <= frames; f += 8, src += 64) {
+				__m128i v0 = LOAD(src);
+				__m128i v1 = LOAD(src + 16);
+				__m128i v2 = LOAD(src + 32);
+				__m128i v3 = LOAD(src + 48);
+				__m128i t0 = _mm_unpacklo_epi16(v0, v1);
+				__m128i t1 = _mm_unpackhi_epi16(v0, v1);
+				__m128i t2 = _mm_unpacklo_epi16(v2, v3);
+				__m128i t3 = _mm_unpackhi_epi16(v2, v3);
+				/* p0 = ch0|ch1 frames 0-3, p1 = ch2|ch3 frames 0-3 */
+				__m128i p0 = _mm_unpacklo_epi16(t0, t1);
+				__m128i p1 = _mm_unpackhi_epi16(t0, t1);
+				__m128i q0 = _mm_unpacklo_epi16(t2, t3);
+				__m128i q1 = _mm_unpackhi_epi16(t2, t3);
+				STORE(dst[0] + f * 2, _mm_unpacklo_epi64(p0, q0));
+				STORE(dst[1] + f * 2, _mm_unpackhi_epi64(p0, q0));
+				STORE(dst[2] + f * 2, _mm_unpacklo_epi64(p1, q1));
+				STORE(dst[3] + f * 2, _mm_unpackhi_epi64(p1, q1));
+			}
+			break;
+		case 8:
+			for (; f + 8 <= frames; f += 8, src += 128) {
+				__m128i r0 = LOAD(src);
+				__m128i r1 = LOAD(src + 16);
+				__m128i r2 = LOAD(src + 32);
+				__m128i r3 = LOAD(src + 48);
+				__m128i r4 = LOAD(src + 64);
+				__m128i r5 = LOAD(src + 80);
+				__m128i r6 = LOAD(src + 96);
+				__m128i r7 = LOAD(src + 112);
+				TRANSPOSE8x16(r0, r1, r2, r3, r4, r5, r6, r7);
+				STORE(dst[0] + f * 2, r0);
+				STORE(dst[1] + f * 2, r1);
+				STORE(dst[2] + f * 2, r2);
+				STORE(dst[3] + f * 2, r3);
+				STORE(dst[4] + f * 2, r4);
+				STORE(dst[5] + f * 2, r5);
+				STORE(dst[6] + f * 2, r6);
+				STORE(dst[7] + f * 2, r7);
+			}
+			break;
+		}
+	} else if (bytes == 4) {
+		switch (channels) {
+		case 2:
+			for (; f + 4 <= frames; f += 4, src += 32) {
+				__m128 a = _mm_castsi128_ps(LOAD(src));
+				__m128 b = _mm_castsi128_ps(LOAD(src + 16));
+				STORE(dst[0] + f * 4,
+				      _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+				STORE(dst[1] + f * 4,
+				      _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+			break;
+		case 4:
+			for (; f + 4 <= frames; f += 4, src += 64) {
+				__m128i r0 = LOAD(src);
+				__m128i r1 = LOAD(src + 16);
+				__m128i r2 = LOAD(src + 32);
+				__m128i r3 = LOAD(src + 48);
+				TRANSPOSE4x32(r0, r1, r2, r3);
+				STORE(dst[0] + f * 4, r0);
+				STORE(dst[1] + f * 4, r1);
+				STORE(dst[2] + f * 4, r2);
+				STORE(dst[3] + f * 4, r3);
+			}
+			break;
+		case 8:
+			for (; f + 4 <= frames; f += 4, src += 128) {
+				__m128i r0 = LOAD(src);
+				__m128i r4 = LOAD(src + 16);
+				__m128i r1 = LOAD(src + 32);
+				__m128i r5 = LOAD(src + 48);
+				__m128i r2 = LOAD(src + 64);
+				__m128i r6 = LOAD(src + 80);
+				__m128i r3 = LOAD(src + 96);
+				__m128i r7 = LOAD(src + 112);
+				TRANSPOSE4x32(r0, r1, r2, r3);
+				TRANSPOSE4x32(r4, r5, r6, r7);
+				STORE(dst[0] + f * 4, r0);
+				STORE(dst[1] + f * 4, r1);
+				STORE(dst[2] + f * 4, r2);
+				STORE(dst[3] + f * 4, r3);
+				STORE(dst[4] + f * 4, r4);
+				STORE(dst[5] + f * 4, r5);
+				STORE(dst[6] + f * 4, r6);
+				STORE(dst[7] + f * 4, r7);
+			}
+			break;
+		}
+	}
+	return f;
+}
+
+#undef LOAD
+#undef STORE
+
+#define LOAD(p)		_mm256_loadu_si256((const __m256i *)(p))
+#define STORE(p, v)	_mm256_storeu_si256((__m256i *)(p), v)
+
+/* AVX2 only pays off for stereo, the other layouts use the SSE2 kernels */
+SND_PCM_SIMD_TARGET("avx2")
+static snd_pcm_uframes_t interleave_avx2(char *dst, const char *const *src,
+					 unsigned int channels, unsigned int bytes,
+					 snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+
+	if (channels != 2)
+		return 0;
+	if (bytes == 2) {
+		for (; f + 16 <= frames; f += 16, dst += 64) {
+			__m256i a = LOAD(src[0] + f * 2);
+			__m256i b = LOAD(src[1] + f * 2);
+			__m256i lo = _mm256_unpacklo_epi16(a, b);
+			__m256i hi = _mm256_unpackhi_epi16(a, b);
+			STORE(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+			STORE(dst + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+	} else if (bytes == 4) {
+		for (; f + 8 <= frames; f += 8, dst += 64) {
+			__m256i a = LOAD(src[0] + f * 4);
+			__m256i b = LOAD(src[1] + f * 4);
+			__m256i lo = _mm256_unpacklo_epi32(a, b);
+			__m256i hi = _mm256_unpackhi_epi32(a, b);
+			STORE(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+			STORE(dst + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+	}
+	return f;
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static snd_pcm_uframes_t deinterleave_avx2(char *const *dst, const char *src,
+					   unsigned int channels, unsigned int bytes,
+					   snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t f = 0;
+
+	if (channels != 2)
+		return 0;
+	if (bytes == 2) {
+		/* even words to the low, odd words to the high qword of each lane */
+		const __m256i split = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13,
+						       2, 3, 6, 7, 10, 11, 14, 15,
+						       0, 1, 4, 5, 8, 9, 12, 13,
+						       2, 3, 6, 7, 10, 11, 14, 15);
+		for (; f + 16 <= frames; f += 16, src += 64) {
+			__m256i a = _mm256_shuffle_epi8(LOAD(src), split);
+			__m256i b = _mm256_shuffle_epi8(LOAD(src + 32), split);
+			a = _mm256_permute4x64_epi64(a, 0xd8);
+			b = _mm256_permute4x64_epi64(b, 0xd8);
+			STORE(dst[0] + f * 2, _mm256_permute2x128_si256(a, b, 0x20));
+			STORE(dst[1] + f * 2, _mm256_permute2x128_si256(a, b, 0x31));
+		}
+	} else if (bytes == 4) {
+		const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		for (; f + 8 <= frames; f += 8, src += 64) {
+			__m256i a = _mm256_permutevar8x32_epi32(LOAD(src), split);
+			__m256i b = _mm256_permutevar8x32_epi32(LOAD(src + 32), split);
+			STORE(dst[0] + f * 4, _mm256_permute2x128_si256(a, b, 0x20));
+			STORE(dst[1] + f * 4, _mm256_permute2x128_si256(a, b, 0x31));
+		}
+	}
+	return f;
+}
+
+#undef LOAD
+#undef STORE
+
+#endif /* SND_PCM_SIMD_X86 */
+
+static int kernel_index(unsigned int channels, unsigned int bytes,
+			unsigned int *ci, unsigned int *bi)
+{
+	if (bytes < 2 || bytes > 4)
+		return -EINVAL;
+	switch (channels) {
+	case 2: *ci = 0; break;
+	case 4: *ci = 1; break;
+	case 6: *ci = 2; break;
+	case 8: *ci = 3; break;
+	default:
+		return -EINVAL;
+	}
+	*bi = bytes - 2;
+	return 0;
+}
+
+/*
+ * Interleave frames from channels separate buffers (src[c]) to dst.
+ * Returns -EINVAL if the layout is not handled here; the caller must
+ * fall back to the generic area copy then.
+ */
+int snd_pcm_simd_interleave(void *dst, const void *const *src,
+			    unsigned int channels, unsigned int bytes,
+			    snd_pcm_uframes_t frames)
+{
+	const char *const *s = (const char *const *)src;
+	snd_pcm_uframes_t done = 0;
+	unsigned int ci, bi;
+
+	if (kernel_index(channels, bytes, &ci, &bi) < 0)
+		return -EINVAL;
+#ifdef SND_PCM_SIMD_X86
+	{
+		unsigned int caps = snd_pcm_simd_caps();
+		if (caps & SND_PCM_SIMD_AVX2)
+			done = interleave_avx2(dst, s, channels, bytes, frames);
+		if (!done && (caps & SND_PCM_SIMD_SSE2))
+			done = interleave_sse2(dst, s, channels, bytes, frames);
+	}
+#endif
+	if (done < frames)
+		interleave_c_table[ci][bi](dst, s, done, frames);
+	return 0;
+}
+
+/*
+ * Deinterleave frames from src to channels separate buffers (dst[c]).
+ * Returns -EINVAL if the layout is not handled here.
+ */
+int snd_pcm_simd_deinterleave(void *const *dst, const void *src,
+			      unsigned int channels, unsigned int bytes,
+			      snd_pcm_uframes_t frames)
+{
+	char *const *d = (char *const *)dst;
+	snd_pcm_uframes_t done = 0;
+	unsigned int ci, bi;
+
+	if (kernel_index(channels, bytes, &ci, &bi) < 0)
+		return -EINVAL;
+#ifdef SND_PCM_SIMD_X86
+	{
+		unsigned int caps = snd_pcm_simd_caps();
+		if (caps & SND_PCM_SIMD_AVX2)
+			done = deinterleave_avx2(d, src, channels, bytes, frames);
+		if (!done && (caps & SND_PCM_SIMD_SSE2))
+			done = deinterleave_sse2(d, src, channels, bytes, frames);
+	}
+#endif
+	if (done < frames)
+		deinterleave_c_table[ci][bi](d, src, done, frames);
+	return 0;
+}
+
+#endif /* DOC_HIDDEN */
@@ -0,0 +1,62 @@
+/*
+ *  PCM - SIMD helpers and runtime CPU dispatch
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * x86 kernels are built with per-function target attributes, so the
+ * library itself is still compiled for the baseline CPU and the kernels
+ * are picked at runtime according to snd_pcm_simd_caps().
+ */
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SND_PCM_SIMD_X86	1
+#define SND_PCM_SIMD_TARGET(x)	__attribute__((target(x)))
+#else
+#define SND_PCM_SIMD_TARGET(x)
+#endif
+
+#define SND_PCM_SIMD_SSE2	(1U << 0)
+#define SND_PCM_SIMD_AVX2	(1U << 1)
+
+/* use non-temporal stores above this size (in bytes) */
+#define SND_PCM_SIMD_NT_THRESHOLD	(256 * 1024)
+
+/* make local functions really local */
+#define snd_pcm_simd_caps \
+	snd1_pcm_simd_caps
+#define snd_pcm_simd_copy \
+	snd1_pcm_simd_copy
+#define snd_pcm_simd_fill64 \
+	snd1_pcm_simd_fill64
+#define snd_pcm_simd_interleave \
+	snd1_pcm_simd_interleave
+#define snd_pcm_simd_deinterleave \
+	snd1_pcm_simd_deinterleave
+
+unsigned int snd_pcm_simd_caps(void);
+
+void snd_pcm_simd_copy(void *dst, const void *src, size_t bytes);
+void snd_pcm_simd_fill64(void *dst, uint64_t pattern, size_t bytes);
+
+int snd_pcm_simd_interleave(void *dst, const void *const *src,
+			    unsigned int channels, unsigned int bytes,
+			    snd_pcm_uframes_t frames);
+int snd_pcm_simd_deinterleave(void *const *dst, const void *src,
+			      unsigned int channels, unsigned int bytes,
+			      snd_pcm_uframes_t frames);
@@ -28,10 +28,18 @@
 
 #include "bswap.h"
 #include <math.h>
+#include <sys/mman.h>
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_simd.h"
+#ifdef SND_PCM_SIMD_X86
+#include <immintrin.h>
+#endif
 
 #include <sound/tlv.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -40,6 +48,24 @@ const char *_snd_module_pcm_softvol = "";
 
 #ifndef DOC_HIDDEN
 
+typedef void (*softvol_kernel_t)(char *dst, unsigned int dst_step,
+				 const char *src, unsigned int src_step,
+				 const unsigned int *gain, unsigned int gain_step,
+				 unsigned int samples);
+
+/* gain slots */
+enum {
+	SOFTVOL_LEFT,
+	SOFTVOL_RIGHT,
+	SOFTVOL_CENTER,
+	SOFTVOL_SLOTS
+};
+
+/* frames per gain block */
+#define SOFTVOL_BLOCK		256
+
+struct softvol_dB_table;
+
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -52,7 +78,22 @@ typedef struct {
 	unsigned int zero_dB_val; /* index at 0 dB */
 	double min_dB;
 	double max_dB;
-	unsigned int *dB_value;
+	const unsigned int *dB_value;
+	struct softvol_dB_table *dB_table;
+	softvol_kernel_t kernel;
+	unsigned char *slot;		/* gain slot of each channel */
+	unsigned int *pattern;		/* per-sample gains, interleaved */
+	unsigned int pattern_frames;	/* frames of valid constant pattern */
+	int primed;
+	unsigned int target[SOFTVOL_SLOTS];
+	unsigned int gain[SOFTVOL_SLOTS];	/* gains applied outside ramps */
+	unsigned int ramp_frames;
+	int ramp_exp;
+	snd_pcm_uframes_t ramp_left;
+	double ramp_pos[SOFTVOL_SLOTS];
+	double ramp_inc[SOFTVOL_SLOTS];
+	unsigned int ramp_gain[SOFTVOL_SLOTS][SOFTVOL_BLOCK];
+	snd_pcm_route_volume_t vol;	/* when folded into plug */
 } snd_pcm_softvol_t;
 
 #define VOL_SCALE_SHIFT		16
@@ -102,6 +143,99 @@ static const unsigned int preset_dB_value[PRESET_RESOLUTION] = {
 	0xd9e3, 0xdef6, 0xe428, 0xe978, 0xeee8, 0xf479, 0xfa2b, 0xffff,
 };
 
+/*
+ * dB tables for the other ranges, shared among all instances in the
+ * process with the same parameters; the values are mapped read-only
+ * once computed
+ */
+struct softvol_dB_table {
+	struct list_head list;
+	unsigned int refcnt;
+	double min_dB;
+	double max_dB;
+	unsigned int resolution;
+	size_t size;
+	unsigned int *value;
+};
+
+static LIST_HEAD(softvol_dB_tables);
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t softvol_dB_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define softvol_dB_tables_lock()	pthread_mutex_lock(&softvol_dB_tables_mutex)
+#define softvol_dB_tables_unlock()	pthread_mutex_unlock(&softvol_dB_tables_mutex)
+#else
+#define softvol_dB_tables_lock()	do { } while (0)
+#define softvol_dB_tables_unlock()	do { } while (0)
+#endif
+
+static struct softvol_dB_table *softvol_dB_table_get(double min_dB,
+						     double max_dB,
+						     unsigned int resolution,
+						     unsigned int zero_dB_val)
+{
+	struct softvol_dB_table *t;
+	struct list_head *p;
+	unsigned int i, max_val = resolution - 1;
+	long page = sysconf(_SC_PAGESIZE);
+
+	softvol_dB_tables_lock();
+	list_for_each(p, &softvol_dB_tables) {
+		t = list_entry(p, struct softvol_dB_table, list);
+		if (t->min_dB == min_dB && t->max_dB == max_dB &&
+		    t->resolution == resolution) {
+			t->refcnt++;
+			goto __end;
+		}
+	}
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		goto __end;
+	if (page <= 0)
+		page = 4096;
+	t->size = (resolution * sizeof(*t->value) + page - 1) & ~(page - 1);
+	t->value = mmap(NULL, t->size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t->value == MAP_FAILED) {
+		free(t);
+		t = NULL;
+		goto __end;
+	}
+	t->refcnt = 1;
+	t->min_dB = min_dB;
+	t->max_dB = max_dB;
+	t->resolution = resolution;
+	for (i = 0; i <= max_val; i++) {
+		double db = min_dB + (i * (max_dB - min_dB)) / max_val;
+		double v = (pow(10.0, db / 20.0) *
+			    (double)(1 << VOL_SCALE_SHIFT));
+		t->value[i] = (unsigned int)v;
+	}
+	if (zero_dB_val)
+		t->value[zero_dB_val] = 65535;
+	/* only a read-only table is shared, a writable one stays private */
+	INIT_LIST_HEAD(&t->list);
+	if (mprotect(t->value, t->size, PROT_READ) < 0)
+		SYSMSG("mprotect failed, the dB table is not shared");
+	else
+		list_add_tail(&t->list, &softvol_dB_tables);
+ __end:
+	softvol_dB_tables_unlock();
+	return t;
+}
+
+static void softvol_dB_table_put(struct softvol_dB_table *t)
+{
+	if (!t)
+		return;
+	softvol_dB_tables_lock();
+	if (--t->refcnt == 0) {
+		list_del(&t->list);
+		munmap(t->value, t->size);
+		free(t);
+	}
+	softvol_dB_tables_unlock();
+}
+
 /* (32bit x 16bit) >> 16 */
 typedef union {
 	int i;
@@ -174,256 +308,732 @@ static inline short MULTI_DIV_short(short a, unsigned int b, int swap)
 	return swap ? (short)bswap_16((short)fraction) : (short)fraction;
 }
 
+/* 32bit float, kept as raw bits so that CONVERT_AREA() can swap them */
+typedef unsigned int float_raw;
+static inline float_raw MULTI_DIV_float_raw(float_raw a, unsigned int b, int swap)
+{
+	union {
+		float f;
+		unsigned int i;
+	} v;
+	v.i = swap ? bswap_32(a) : a;
+	v.f *= (float)b * (1.0f / (1 << VOL_SCALE_SHIFT));
+	return swap ? bswap_32(v.i) : v.i;
+}
+
+/* 24bit in the lower bits of a 32bit word */
+static inline int S24_SIGN_EXTEND(int a)
+{
+	return (int)((unsigned int)a << 8) >> 8;
+}
+
 #endif /* DOC_HIDDEN */
 
 /*
- * apply volumue attenuation
+ * apply volume attenuation
  *
- * TODO: use SIMD operations
+ * The kernels work on a run of samples with byte steps, and take one
+ * 16.16 gain per sample (gain_step 1) or one gain for the whole run
+ * (gain_step 0).  A gain of 0 gives silence and 0xffff a plain copy,
+ * everything else goes through MULTI_DIV_*(), so the vector kernels
+ * produce exactly the same output as the scalar ones.  The integer
+ * vector kernels handle attenuation only; a block with a gain above
+ * unity falls back to the scalar code for the clipping.
  */
 
 #ifndef DOC_HIDDEN
-#define CONVERT_AREA(TYPE, swap) do {	\
-	unsigned int ch, fr; \
-	TYPE *src, *dst; \
-	for (ch = 0; ch < channels; ch++) { \
-		src_area = &src_areas[ch]; \
-		dst_area = &dst_areas[ch]; \
-		src = snd_pcm_channel_area_addr(src_area, src_offset); \
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset); \
-		src_step = snd_pcm_channel_area_step(src_area) / sizeof(TYPE); \
-		dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(TYPE); \
-		GET_VOL_SCALE; \
-		fr = frames; \
-		if (! vol_scale) { \
-			while (fr--) { \
-				*dst = 0; \
-				dst += dst_step; \
-			} \
-		} else if (vol_scale == 0xffff) { \
-			while (fr--) { \
-				*dst = *src; \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} else { \
-			while (fr--) { \
-				*dst = (TYPE) MULTI_DIV_##TYPE(*src, vol_scale, swap); \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} \
-	} \
-} while (0)
-
-#define CONVERT_AREA_S24_3LE() do {					\
-	unsigned int ch, fr;						\
-	unsigned char *src, *dst;					\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area);		\
-		dst_step = snd_pcm_channel_area_step(dst_area);		\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				dst[0] = dst[1] = dst[2] = 0;		\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				dst[0] = src[0];			\
-				dst[1] = src[1];			\
-				dst[2] = src[2];			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = src[0] |				\
-				      (src[1] << 8) |			\
-				      (((signed char *) src)[2] << 16);	\
-				tmp = MULTI_DIV_24(tmp, vol_scale);	\
-				dst[0] = tmp;				\
-				dst[1] = tmp >> 8;			\
-				dst[2] = tmp >> 16;			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
+#define SOFTVOL_KERNEL(name, TYPE, swap)				\
+static void name(char *dst, unsigned int dst_step,			\
+		 const char *src, unsigned int src_step,		\
+		 const unsigned int *gain, unsigned int gain_step,	\
+		 unsigned int samples)					\
+{									\
+	while (samples--) {						\
+		unsigned int vol_scale = *gain;				\
+		TYPE v = *(const TYPE *)src;				\
+		if (! vol_scale)					\
+			v = 0;						\
+		else if (vol_scale != 0xffff)				\
+			v = (TYPE) MULTI_DIV_##TYPE(v, vol_scale, swap); \
+		*(TYPE *)dst = v;					\
+		src += src_step;					\
+		dst += dst_step;					\
+		gain += gain_step;					\
 	}								\
-} while (0)
-
-#define CONVERT_AREA_S24_LE() do {					\
-	unsigned int ch, fr;						\
-	int *src, *dst;							\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area)		\
-				/ sizeof(int);				\
-		dst_step = snd_pcm_channel_area_step(dst_area)		\
-				/ sizeof(int);				\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				*dst = 0;				\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				*dst = *src;				\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = *src << 8;			\
-				tmp = (signed int) tmp >> 8;		\
-				*dst = MULTI_DIV_24(tmp, vol_scale);	\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
-	}								\
-} while (0)
-		
-#define GET_VOL_SCALE \
-	switch (ch) { \
-	case 0: \
-	case 2: \
-		vol_scale = (channels == ch + 1) ? vol_c : vol[0]; \
-		break; \
-	case 4: \
-	case 5: \
-		vol_scale = vol_c; \
-		break; \
-	default: \
-		vol_scale = vol[ch & 1]; \
-		break; \
+}
+
+SOFTVOL_KERNEL(softvol_short_c, short, 0)
+SOFTVOL_KERNEL(softvol_short_swap_c, short, 1)
+SOFTVOL_KERNEL(softvol_int_c, int, 0)
+SOFTVOL_KERNEL(softvol_int_swap_c, int, 1)
+SOFTVOL_KERNEL(softvol_float_raw_c, float_raw, 0)
+SOFTVOL_KERNEL(softvol_float_raw_swap_c, float_raw, 1)
+
+static void softvol_s24_c(char *dst, unsigned int dst_step,
+			  const char *src, unsigned int src_step,
+			  const unsigned int *gain, unsigned int gain_step,
+			  unsigned int samples)
+{
+	while (samples--) {
+		unsigned int vol_scale = *gain;
+		int v = *(const int *)src;
+		if (! vol_scale)
+			v = 0;
+		else if (vol_scale != 0xffff)
+			v = MULTI_DIV_24(S24_SIGN_EXTEND(v), vol_scale);
+		*(int *)dst = v;
+		src += src_step;
+		dst += dst_step;
+		gain += gain_step;
 	}
+}
 
-#endif /* DOC_HIDDEN */
+static void softvol_s24_3le_c(char *dst, unsigned int dst_step,
+			      const char *src, unsigned int src_step,
+			      const unsigned int *gain, unsigned int gain_step,
+			      unsigned int samples)
+{
+	while (samples--) {
+		const unsigned char *s = (const unsigned char *)src;
+		unsigned char *d = (unsigned char *)dst;
+		unsigned int vol_scale = *gain;
+		int tmp;
+		if (! vol_scale) {
+			d[0] = d[1] = d[2] = 0;
+		} else if (vol_scale == 0xffff) {
+			d[0] = s[0];
+			d[1] = s[1];
+			d[2] = s[2];
+		} else {
+			tmp = s[0] | (s[1] << 8) | (((const signed char *)s)[2] << 16);
+			tmp = MULTI_DIV_24(tmp, vol_scale);
+			d[0] = tmp;
+			d[1] = tmp >> 8;
+			d[2] = tmp >> 16;
+		}
+		src += src_step;
+		dst += dst_step;
+		gain += gain_step;
+	}
+}
 
-/* 2-channel stereo control */
-static void softvol_convert_stereo_vol(snd_pcm_softvol_t *svol,
-				       const snd_pcm_channel_area_t *dst_areas,
-				       snd_pcm_uframes_t dst_offset,
-				       const snd_pcm_channel_area_t *src_areas,
-				       snd_pcm_uframes_t src_offset,
-				       unsigned int channels,
-				       snd_pcm_uframes_t frames)
+#ifdef SND_PCM_SIMD_X86
+/* floor(a * g / 65536) for 0 <= g < 0x10000, as MULTI_DIV_32x16() */
+SND_PCM_SIMD_TARGET("sse2")
+static inline __m128i softvol_mul32_sse2(__m128i a, __m128i g)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale, vol[2], vol_c;
+	__m128i f = _mm_or_si128(g, _mm_slli_epi32(g, 16));
+	__m128i p = _mm_mulhi_epu16(a, f);
+	__m128i l = _mm_mullo_epi16(a, f);
+	__m128i hi;
+
+	/* (a >> 16) * g, corrected for the unsigned high half */
+	hi = _mm_sub_epi32(_mm_srli_epi32(p, 16),
+			   _mm_and_si128(_mm_srai_epi32(a, 31), g));
+	hi = _mm_add_epi32(_mm_slli_epi32(hi, 16), _mm_srli_epi32(l, 16));
+	/* plus ((a & 0xffff) * g) >> 16 */
+	return _mm_add_epi32(hi, _mm_and_si128(p, _mm_set1_epi32(0xffff)));
+}
 
-	if (svol->cur_vol[0] == 0 && svol->cur_vol[1] == 0) {
-		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
-				      svol->sformat);
-		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val &&
-		   svol->cur_vol[1] == svol->zero_dB_val) {
-		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
-				   channels, frames, svol->sformat);
-		return;
+SND_PCM_SIMD_TARGET("sse2")
+static inline __m128i softvol_gain_sse2(const unsigned int *gain,
+					unsigned int gain_step)
+{
+	if (gain_step)
+		return _mm_loadu_si128((const __m128i *)gain);
+	return _mm_set1_epi32(*gain);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void softvol_short_sse2(char *dst, unsigned int dst_step,
+			       const char *src, unsigned int src_step,
+			       const unsigned int *gain, unsigned int gain_step,
+			       unsigned int samples)
+{
+	const __m128i unity = _mm_set1_epi32(0xffff);
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	unsigned int i = 0;
+
+	if (src_step == 2 && dst_step == 2) {
+		for (; i + 8 <= samples; i += 8) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m128i g0 = softvol_gain_sse2(gp, gain_step);
+			__m128i g1 = softvol_gain_sse2(gp + 4 * gain_step, gain_step);
+			__m128i a, b, r, m;
+			if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi32(g0, unity),
+							   _mm_cmpgt_epi32(g1, unity)))) {
+				softvol_short_c(dst + i * 2, 2, src + i * 2, 2,
+						gp, gain_step, 8);
+				continue;
+			}
+			/* 16bit gains, signed: a * g = mulhi(a, g) + a if g >= 0x8000 */
+			b = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(g0, bias),
+							  _mm_sub_epi32(g1, bias)), bias16);
+			a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+			r = _mm_add_epi16(_mm_mulhi_epi16(a, b),
+					  _mm_and_si128(a, _mm_srai_epi16(b, 15)));
+			m = _mm_cmpeq_epi16(b, _mm_set1_epi16(-1));
+			r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, a));
+			_mm_storeu_si128((__m128i *)(dst + i * 2), r);
+		}
 	}
+	softvol_short_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+			gain + i * gain_step, gain_step, samples - i);
+}
 
-	if (svol->max_val == 1) {
-		vol[0] = svol->cur_vol[0] ? 0xffff : 0;
-		vol[1] = svol->cur_vol[1] ? 0xffff : 0;
-		vol_c = vol[0] | vol[1];
-	} else {
-		vol[0] = svol->dB_value[svol->cur_vol[0]];
-		vol[1] = svol->dB_value[svol->cur_vol[1]];
-		vol_c = svol->dB_value[(svol->cur_vol[0] + svol->cur_vol[1]) / 2];
+SND_PCM_SIMD_TARGET("sse2")
+static void softvol_int_sse2(char *dst, unsigned int dst_step,
+			     const char *src, unsigned int src_step,
+			     const unsigned int *gain, unsigned int gain_step,
+			     unsigned int samples)
+{
+	const __m128i unity = _mm_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 4 <= samples; i += 4) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m128i g = softvol_gain_sse2(gp, gain_step);
+			__m128i a, r, m;
+			if (_mm_movemask_epi8(_mm_cmpgt_epi32(g, unity))) {
+				softvol_int_c(dst + i * 4, 4, src + i * 4, 4,
+					      gp, gain_step, 4);
+				continue;
+			}
+			a = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			r = softvol_mul32_sse2(a, g);
+			m = _mm_cmpeq_epi32(g, unity);
+			r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, a));
+			_mm_storeu_si128((__m128i *)(dst + i * 4), r);
+		}
 	}
+	softvol_int_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+		      gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void softvol_s24_sse2(char *dst, unsigned int dst_step,
+			     const char *src, unsigned int src_step,
+			     const unsigned int *gain, unsigned int gain_step,
+			     unsigned int samples)
+{
+	const __m128i unity = _mm_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 4 <= samples; i += 4) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m128i g = softvol_gain_sse2(gp, gain_step);
+			__m128i a, r, m;
+			if (_mm_movemask_epi8(_mm_cmpgt_epi32(g, unity))) {
+				softvol_s24_c(dst + i * 4, 4, src + i * 4, 4,
+					      gp, gain_step, 4);
+				continue;
+			}
+			a = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			r = softvol_mul32_sse2(_mm_srai_epi32(_mm_slli_epi32(a, 8), 8), g);
+			m = _mm_cmpeq_epi32(g, unity);
+			r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, a));
+			_mm_storeu_si128((__m128i *)(dst + i * 4), r);
+		}
+	}
+	softvol_s24_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+		      gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("sse2")
+static void softvol_float_sse2(char *dst, unsigned int dst_step,
+			       const char *src, unsigned int src_step,
+			       const unsigned int *gain, unsigned int gain_step,
+			       unsigned int samples)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / (1 << VOL_SCALE_SHIFT));
+	const __m128i unity = _mm_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 4 <= samples; i += 4) {
+			__m128i g = softvol_gain_sse2(gain + i * gain_step, gain_step);
+			__m128i a = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			__m128 v = _mm_mul_ps(_mm_castsi128_ps(a),
+					      _mm_mul_ps(_mm_cvtepi32_ps(g), scale));
+			__m128i r = _mm_castps_si128(v);
+			__m128i m = _mm_cmpeq_epi32(g, unity);
+			r = _mm_andnot_si128(_mm_cmpeq_epi32(g, _mm_setzero_si128()), r);
+			r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, a));
+			_mm_storeu_si128((__m128i *)(dst + i * 4), r);
+		}
+	}
+	softvol_float_raw_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+			    gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static inline __m256i softvol_gain_avx2(const unsigned int *gain,
+					unsigned int gain_step)
+{
+	if (gain_step)
+		return _mm256_loadu_si256((const __m256i *)gain);
+	return _mm256_set1_epi32(*gain);
+}
+
+/* floor(a * g / 65536) for 0 <= g < 0x10000, as MULTI_DIV_32x16() */
+SND_PCM_SIMD_TARGET("avx2")
+static inline __m256i softvol_mul32_avx2(__m256i a, __m256i g)
+{
+	__m256i hi = _mm256_mullo_epi32(_mm256_srai_epi32(a, 16), g);
+	__m256i lo = _mm256_mullo_epi32(_mm256_and_si256(a, _mm256_set1_epi32(0xffff)), g);
+	return _mm256_add_epi32(hi, _mm256_srli_epi32(lo, 16));
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void softvol_short_avx2(char *dst, unsigned int dst_step,
+			       const char *src, unsigned int src_step,
+			       const unsigned int *gain, unsigned int gain_step,
+			       unsigned int samples)
+{
+	const __m256i unity = _mm256_set1_epi32(0xffff);
+	const __m256i bias = _mm256_set1_epi32(0x8000);
+	const __m256i bias16 = _mm256_set1_epi16((short)0x8000);
+	unsigned int i = 0;
+
+	if (src_step == 2 && dst_step == 2) {
+		for (; i + 16 <= samples; i += 16) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m256i g0 = softvol_gain_avx2(gp, gain_step);
+			__m256i g1 = softvol_gain_avx2(gp + 8 * gain_step, gain_step);
+			__m256i a, b, r, m;
+			if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpgt_epi32(g0, unity),
+								 _mm256_cmpgt_epi32(g1, unity)))) {
+				softvol_short_c(dst + i * 2, 2, src + i * 2, 2,
+						gp, gain_step, 16);
+				continue;
+			}
+			b = _mm256_packs_epi32(_mm256_sub_epi32(g0, bias),
+					       _mm256_sub_epi32(g1, bias));
+			b = _mm256_xor_si256(_mm256_permute4x64_epi64(b, 0xd8), bias16);
+			a = _mm256_loadu_si256((const __m256i *)(src + i * 2));
+			r = _mm256_add_epi16(_mm256_mulhi_epi16(a, b),
+					     _mm256_and_si256(a, _mm256_srai_epi16(b, 15)));
+			m = _mm256_cmpeq_epi16(b, _mm256_set1_epi16(-1));
+			r = _mm256_blendv_epi8(r, a, m);
+			_mm256_storeu_si256((__m256i *)(dst + i * 2), r);
+		}
+	}
+	softvol_short_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+			gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void softvol_int_avx2(char *dst, unsigned int dst_step,
+			     const char *src, unsigned int src_step,
+			     const unsigned int *gain, unsigned int gain_step,
+			     unsigned int samples)
+{
+	const __m256i unity = _mm256_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 8 <= samples; i += 8) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m256i g = softvol_gain_avx2(gp, gain_step);
+			__m256i a, r;
+			if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(g, unity))) {
+				softvol_int_c(dst + i * 4, 4, src + i * 4, 4,
+					      gp, gain_step, 8);
+				continue;
+			}
+			a = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+			r = softvol_mul32_avx2(a, g);
+			r = _mm256_blendv_epi8(r, a, _mm256_cmpeq_epi32(g, unity));
+			_mm256_storeu_si256((__m256i *)(dst + i * 4), r);
+		}
+	}
+	softvol_int_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+		      gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void softvol_s24_avx2(char *dst, unsigned int dst_step,
+			     const char *src, unsigned int src_step,
+			     const unsigned int *gain, unsigned int gain_step,
+			     unsigned int samples)
+{
+	const __m256i unity = _mm256_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 8 <= samples; i += 8) {
+			const unsigned int *gp = gain + i * gain_step;
+			__m256i g = softvol_gain_avx2(gp, gain_step);
+			__m256i a, r;
+			if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(g, unity))) {
+				softvol_s24_c(dst + i * 4, 4, src + i * 4, 4,
+					      gp, gain_step, 8);
+				continue;
+			}
+			a = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+			r = softvol_mul32_avx2(_mm256_srai_epi32(_mm256_slli_epi32(a, 8), 8), g);
+			r = _mm256_blendv_epi8(r, a, _mm256_cmpeq_epi32(g, unity));
+			_mm256_storeu_si256((__m256i *)(dst + i * 4), r);
+		}
+	}
+	softvol_s24_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+		      gain + i * gain_step, gain_step, samples - i);
+}
+
+SND_PCM_SIMD_TARGET("avx2")
+static void softvol_float_avx2(char *dst, unsigned int dst_step,
+			       const char *src, unsigned int src_step,
+			       const unsigned int *gain, unsigned int gain_step,
+			       unsigned int samples)
+{
+	const __m256 scale = _mm256_set1_ps(1.0f / (1 << VOL_SCALE_SHIFT));
+	const __m256i unity = _mm256_set1_epi32(0xffff);
+	unsigned int i = 0;
+
+	if (src_step == 4 && dst_step == 4) {
+		for (; i + 8 <= samples; i += 8) {
+			__m256i g = softvol_gain_avx2(gain + i * gain_step, gain_step);
+			__m256i a = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+			__m256 v = _mm256_mul_ps(_mm256_castsi256_ps(a),
+						 _mm256_mul_ps(_mm256_cvtepi32_ps(g), scale));
+			__m256i r = _mm256_castps_si256(v);
+			r = _mm256_andnot_si256(_mm256_cmpeq_epi32(g, _mm256_setzero_si256()), r);
+			r = _mm256_blendv_epi8(r, a, _mm256_cmpeq_epi32(g, unity));
+			_mm256_storeu_si256((__m256i *)(dst + i * 4), r);
+		}
+	}
+	softvol_float_raw_c(dst + i * dst_step, dst_step, src + i * src_step, src_step,
+			    gain + i * gain_step, gain_step, samples - i);
+}
+#endif /* SND_PCM_SIMD_X86 */
+
+static void softvol_set_kernel(snd_pcm_softvol_t *svol)
+{
+	unsigned int caps = snd_pcm_simd_caps();
+	int swap = !snd_pcm_format_cpu_endian(svol->sformat);
+
 	switch (svol->sformat) {
 	case SND_PCM_FORMAT_S16_LE:
 	case SND_PCM_FORMAT_S16_BE:
-		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		if (swap) {
+			svol->kernel = softvol_short_swap_c;
+			return;
+		}
+		svol->kernel = softvol_short_c;
+#ifdef SND_PCM_SIMD_X86
+		if (caps & SND_PCM_SIMD_AVX2)
+			svol->kernel = softvol_short_avx2;
+		else if (caps & SND_PCM_SIMD_SSE2)
+			svol->kernel = softvol_short_sse2;
+#endif
 		break;
 	case SND_PCM_FORMAT_S32_LE:
 	case SND_PCM_FORMAT_S32_BE:
-		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		if (swap) {
+			svol->kernel = softvol_int_swap_c;
+			return;
+		}
+		svol->kernel = softvol_int_c;
+#ifdef SND_PCM_SIMD_X86
+		if (caps & SND_PCM_SIMD_AVX2)
+			svol->kernel = softvol_int_avx2;
+		else if (caps & SND_PCM_SIMD_SSE2)
+			svol->kernel = softvol_int_sse2;
+#endif
 		break;
 	case SND_PCM_FORMAT_S24_LE:
-		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
+		svol->kernel = softvol_s24_c;
+#ifdef SND_PCM_SIMD_X86
+		if (caps & SND_PCM_SIMD_AVX2)
+			svol->kernel = softvol_s24_avx2;
+		else if (caps & SND_PCM_SIMD_SSE2)
+			svol->kernel = softvol_s24_sse2;
+#endif
 		break;
 	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
+		svol->kernel = softvol_s24_3le_c;
+		break;
+	case SND_PCM_FORMAT_FLOAT_LE:
+	case SND_PCM_FORMAT_FLOAT_BE:
+		/* 32bit float samples, no clipping */
+		if (swap) {
+			svol->kernel = softvol_float_raw_swap_c;
+			return;
+		}
+		svol->kernel = softvol_float_raw_c;
+#ifdef SND_PCM_SIMD_X86
+		if (caps & SND_PCM_SIMD_AVX2)
+			svol->kernel = softvol_float_avx2;
+		else if (caps & SND_PCM_SIMD_SSE2)
+			svol->kernel = softvol_float_sse2;
+#endif
 		break;
 	default:
+		svol->kernel = NULL;
 		break;
 	}
+#ifndef SND_PCM_SIMD_X86
+	(void)caps;
+#endif
+}
+
+/*
+ * The gains are kept per slot: left, right and center.  A stereo control
+ * maps the channels of mono, 2.0, 2.1, 4.0, 4.1, 5.1 and 7.1 onto them,
+ * a mono control drives every channel with the left slot.
+ */
+static unsigned int softvol_channel_slot(unsigned int cchannels,
+					 unsigned int ch, unsigned int channels)
+{
+	if (cchannels == 1)
+		return SOFTVOL_LEFT;
+	switch (ch) {
+	case 0:
+	case 2:
+		return (channels == ch + 1) ? SOFTVOL_CENTER : SOFTVOL_LEFT;
+	case 4:
+	case 5:
+		return SOFTVOL_CENTER;
+	default:
+		return (ch & 1) ? SOFTVOL_RIGHT : SOFTVOL_LEFT;
+	}
+}
+
+static void softvol_set_channel_slots(snd_pcm_softvol_t *svol,
+				      unsigned int channels)
+{
+	unsigned int ch;
+
+	for (ch = 0; ch < channels; ch++)
+		svol->slot[ch] = softvol_channel_slot(svol->cchannels, ch, channels);
+}
+
+static void softvol_target_gains(snd_pcm_softvol_t *svol, unsigned int *gain)
+{
+	unsigned int cur0 = svol->cur_vol[0];
+	unsigned int cur1 = svol->cchannels == 1 ? cur0 : svol->cur_vol[1];
+
+	if (cur0 == 0 && cur1 == 0) {
+		gain[SOFTVOL_LEFT] = gain[SOFTVOL_RIGHT] = gain[SOFTVOL_CENTER] = 0;
+	} else if (svol->max_val == 1) {
+		gain[SOFTVOL_LEFT] = cur0 ? 0xffff : 0;
+		gain[SOFTVOL_RIGHT] = cur1 ? 0xffff : 0;
+		gain[SOFTVOL_CENTER] = gain[SOFTVOL_LEFT] | gain[SOFTVOL_RIGHT];
+	} else {
+		gain[SOFTVOL_LEFT] = svol->dB_value[cur0];
+		gain[SOFTVOL_RIGHT] = svol->dB_value[cur1];
+		gain[SOFTVOL_CENTER] = svol->dB_value[(cur0 + cur1) / 2];
+	}
+}
+
+/*
+ * pick up a changed volume: jump to it, or start a ramp from the gain
+ * currently applied (which may be in the middle of another ramp)
+ */
+static void softvol_update_gains(snd_pcm_softvol_t *svol)
+{
+	unsigned int target[SOFTVOL_SLOTS];
+	unsigned int k;
+
+	softvol_target_gains(svol, target);
+	if (svol->primed &&
+	    !memcmp(target, svol->target, sizeof(target)))
+		return;
+	memcpy(svol->target, target, sizeof(target));
+	svol->pattern_frames = 0;
+	if (!svol->primed || !svol->ramp_frames) {
+		/* start of the stream or no ramp: apply right away */
+		memcpy(svol->gain, target, sizeof(target));
+		svol->ramp_left = 0;
+		svol->primed = 1;
+		return;
+	}
+	for (k = 0; k < SOFTVOL_SLOTS; k++) {
+		double from = svol->ramp_left ? svol->ramp_pos[k] : svol->gain[k];
+		double to = target[k];
+		if (svol->ramp_exp) {
+			/* linear in dB; mute is approached from 1/65536 */
+			if (from < 1)
+				from = 1;
+			if (to < 1)
+				to = 1;
+			svol->ramp_inc[k] = pow(to / from, 1.0 / svol->ramp_frames);
+		} else {
+			svol->ramp_inc[k] = (to - from) / svol->ramp_frames;
+		}
+		svol->ramp_pos[k] = from;
+	}
+	svol->ramp_left = svol->ramp_frames;
+}
+
+/* fill the per-frame gains of the next ramp block */
+static void softvol_ramp_gains(snd_pcm_softvol_t *svol, unsigned int frames)
+{
+	unsigned int k, f;
+
+	for (k = 0; k < SOFTVOL_SLOTS; k++) {
+		double pos = svol->ramp_pos[k];
+		double inc = svol->ramp_inc[k];
+		unsigned int *gain = svol->ramp_gain[k];
+		for (f = 0; f < frames; f++) {
+			if (svol->ramp_exp)
+				pos *= inc;
+			else
+				pos += inc;
+			gain[f] = (unsigned int)(pos + 0.5);
+		}
+		svol->ramp_pos[k] = pos;
+	}
+	svol->ramp_left -= frames;
+	if (!svol->ramp_left) {
+		/* land exactly on the target */
+		for (k = 0; k < SOFTVOL_SLOTS; k++) {
+			svol->ramp_gain[k][frames - 1] = svol->target[k];
+			svol->gain[k] = svol->target[k];
+		}
+	}
+}
+
+static char *softvol_interleaved_addr(const snd_pcm_channel_area_t *areas,
+				      snd_pcm_uframes_t offset,
+				      unsigned int channels, unsigned int width)
+{
+	unsigned int ch;
+
+	if (areas[0].step != channels * width || areas[0].first % 8)
+		return NULL;
+	for (ch = 1; ch < channels; ch++) {
+		if (areas[ch].addr != areas[0].addr ||
+		    areas[ch].first != areas[0].first + ch * width ||
+		    areas[ch].step != areas[0].step)
+			return NULL;
+	}
+	return snd_pcm_channel_area_addr(&areas[0], offset);
+}
+
+/*
+ * apply the gains to a block of frames: the constant gains of the
+ * channel slots (ramp = 0), or the per-frame gains of the ramp block
+ */
+static void softvol_apply(snd_pcm_softvol_t *svol,
+			  const snd_pcm_channel_area_t *dst_areas,
+			  snd_pcm_uframes_t dst_offset,
+			  const snd_pcm_channel_area_t *src_areas,
+			  snd_pcm_uframes_t src_offset,
+			  unsigned int channels,
+			  snd_pcm_uframes_t frames, int ramp)
+{
+	unsigned int width = snd_pcm_format_physical_width(svol->sformat);
+	unsigned int bytes = width / 8;
+	const unsigned int *gain[SOFTVOL_SLOTS];
+	unsigned int k, ch;
+	char *dst, *src;
+
+	for (k = 0; k < SOFTVOL_SLOTS; k++)
+		gain[k] = ramp ? svol->ramp_gain[k] : &svol->gain[k];
+
+	dst = softvol_interleaved_addr(dst_areas, dst_offset, channels, width);
+	src = softvol_interleaved_addr(src_areas, src_offset, channels, width);
+	if (dst && src) {
+		/* frame-major: expand the gains to one per sample */
+		unsigned int *pattern = svol->pattern;
+		int uniform = !ramp;
+
+		for (ch = 1; ch < channels && uniform; ch++)
+			uniform = *gain[svol->slot[ch]] == *gain[svol->slot[0]];
+		if (uniform) {
+			svol->kernel(dst, bytes, src, bytes, gain[svol->slot[0]], 0,
+				     frames * channels);
+			return;
+		}
+		while (frames > 0) {
+			unsigned int f, n = frames;
+			if (n > SOFTVOL_BLOCK)
+				n = SOFTVOL_BLOCK;
+			if (ramp || svol->pattern_frames < n) {
+				unsigned int len = ramp ? n : SOFTVOL_BLOCK;
+				unsigned int *p = pattern;
+				for (f = 0; f < len; f++)
+					for (ch = 0; ch < channels; ch++)
+						*p++ = gain[svol->slot[ch]][ramp ? f : 0];
+				svol->pattern_frames = ramp ? 0 : len;
+			}
+			svol->kernel(dst, bytes, src, bytes, pattern, 1, n * channels);
+			dst += n * channels * bytes;
+			src += n * channels * bytes;
+			frames -= n;
+		}
+		return;
+	}
+
+	for (ch = 0; ch < channels; ch++) {
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[ch];
+		const snd_pcm_channel_area_t *src_area = &src_areas[ch];
+		svol->kernel(snd_pcm_channel_area_addr(dst_area, dst_offset),
+			     snd_pcm_channel_area_step(dst_area),
+			     snd_pcm_channel_area_addr(src_area, src_offset),
+			     snd_pcm_channel_area_step(src_area),
+			     gain[svol->slot[ch]], ramp, frames);
+	}
 }
 
-#undef GET_VOL_SCALE
-#define GET_VOL_SCALE
-
-/* mono control */
-static void softvol_convert_mono_vol(snd_pcm_softvol_t *svol,
-				     const snd_pcm_channel_area_t *dst_areas,
-				     snd_pcm_uframes_t dst_offset,
-				     const snd_pcm_channel_area_t *src_areas,
-				     snd_pcm_uframes_t src_offset,
-				     unsigned int channels,
-				     snd_pcm_uframes_t frames)
+#endif /* DOC_HIDDEN */
+
+static void softvol_convert(snd_pcm_softvol_t *svol,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    unsigned int channels,
+			    snd_pcm_uframes_t frames)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale;
+	unsigned int k, used, silent, unity;
+
+	if (!svol->kernel)
+		return;
+	softvol_update_gains(svol);
+
+	while (svol->ramp_left && frames > 0) {
+		unsigned int n = SOFTVOL_BLOCK;
+		if (n > frames)
+			n = frames;
+		if (n > svol->ramp_left)
+			n = svol->ramp_left;
+		softvol_ramp_gains(svol, n);
+		softvol_apply(svol, dst_areas, dst_offset, src_areas, src_offset,
+			      channels, n, 1);
+		dst_offset += n;
+		src_offset += n;
+		frames -= n;
+	}
+	if (!frames)
+		return;
 
-	if (svol->cur_vol[0] == 0) {
+	used = silent = unity = 0;
+	for (k = 0; k < channels; k++)
+		used |= 1 << svol->slot[k];
+	for (k = 0; k < SOFTVOL_SLOTS; k++) {
+		if (!(used & (1 << k)))
+			continue;
+		if (svol->gain[k] == 0)
+			silent |= 1 << k;
+		else if (svol->gain[k] == 0xffff)
+			unity |= 1 << k;
+	}
+	if (silent == used) {
 		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
 				      svol->sformat);
 		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val) {
+	} else if (unity == used) {
 		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
 				   channels, frames, svol->sformat);
 		return;
 	}
-
-	if (svol->max_val == 1)
-		vol_scale = svol->cur_vol[0] ? 0xffff : 0;
-	else
-		vol_scale = svol->dB_value[svol->cur_vol[0]];
-	switch (svol->sformat) {
-	case SND_PCM_FORMAT_S16_LE:
-	case SND_PCM_FORMAT_S16_BE:
-		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S32_LE:
-	case SND_PCM_FORMAT_S32_BE:
-		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S24_LE:
-		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
-		break;
-	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
-		break;
-	default:
-		break;
-	}
+	softvol_apply(svol, dst_areas, dst_offset, src_areas, src_offset,
+		      channels, frames, 0);
 }
 
 /*
@@ -452,11 +1062,33 @@ static void softvol_free(snd_pcm_softvol_t *svol)
 		snd_pcm_close(svol->plug.gen.slave);
 	if (svol->ctl)
 		snd_ctl_close(svol->ctl);
-	if (svol->dB_value && svol->dB_value != preset_dB_value)
-		free(svol->dB_value);
+	softvol_dB_table_put(svol->dB_table);
+	free(svol->slot);
+	free(svol->pattern);
 	free(svol);
 }
 
+#ifdef BUILD_PCM_PLUGIN_PLUG
+/* the gains of each channel, for the route stage of plug */
+static void softvol_route_gains(snd_pcm_route_volume_t *vol,
+				unsigned int channels, unsigned int *gain)
+{
+	snd_pcm_softvol_t *svol = container_of(vol, snd_pcm_softvol_t, vol);
+	unsigned int target[SOFTVOL_SLOTS];
+	unsigned int ch;
+
+	get_current_volume(svol);
+	softvol_target_gains(svol, target);
+	for (ch = 0; ch < channels; ch++)
+		gain[ch] = target[softvol_channel_slot(svol->cchannels, ch, channels)];
+}
+
+static void softvol_route_free(snd_pcm_route_volume_t *vol)
+{
+	softvol_free(container_of(vol, snd_pcm_softvol_t, vol));
+}
+#endif
+
 static int snd_pcm_softvol_close(snd_pcm_t *pcm)
 {
 	snd_pcm_softvol_t *svol = pcm->private_data;
@@ -476,7 +1108,9 @@ static int snd_pcm_softvol_hw_refine_cprepare(snd_pcm_t *pcm,
 			(1ULL << SND_PCM_FORMAT_S16_BE) |
 			(1ULL << SND_PCM_FORMAT_S24_LE) |
 			(1ULL << SND_PCM_FORMAT_S32_LE) |
- 			(1ULL << SND_PCM_FORMAT_S32_BE),
+ 			(1ULL << SND_PCM_FORMAT_S32_BE) |
+			(1ULL << SND_PCM_FORMAT_FLOAT_LE) |
+			(1ULL << SND_PCM_FORMAT_FLOAT_BE),
 			(1ULL << (SND_PCM_FORMAT_S24_3LE - 32))
 		}
 	};
@@ -632,12 +1266,41 @@ static int snd_pcm_softvol_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * param
 	    slave->format != SND_PCM_FORMAT_S24_3LE && 
 	    slave->format != SND_PCM_FORMAT_S24_LE &&
 	    slave->format != SND_PCM_FORMAT_S32_LE &&
-	    slave->format != SND_PCM_FORMAT_S32_BE) {
+	    slave->format != SND_PCM_FORMAT_S32_BE &&
+	    slave->format != SND_PCM_FORMAT_FLOAT_LE &&
+	    slave->format != SND_PCM_FORMAT_FLOAT_BE) {
 		SNDERR("softvol supports only S16_LE, S16_BE, S24_LE, S24_3LE, "
-		       "S32_LE or S32_BE");
+		       "S32_LE, S32_BE, FLOAT_LE or FLOAT_BE");
 		return -EINVAL;
 	}
 	svol->sformat = slave->format;
+	softvol_set_kernel(svol);
+
+	/* pcm->channels is not set up yet, the slave has the same count */
+	free(svol->slot);
+	free(svol->pattern);
+	svol->pattern_frames = 0;
+	svol->slot = malloc(slave->channels);
+	svol->pattern = malloc(SOFTVOL_BLOCK * slave->channels *
+			       sizeof(*svol->pattern));
+	if (!svol->slot || !svol->pattern) {
+		free(svol->slot);
+		free(svol->pattern);
+		svol->slot = NULL;
+		svol->pattern = NULL;
+		return -ENOMEM;
+	}
+	softvol_set_channel_slots(svol, slave->channels);
+	return 0;
+}
+
+static int snd_pcm_softvol_init(snd_pcm_t *pcm)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+
+	/* no ramp into the first period */
+	svol->primed = 0;
+	svol->ramp_left = 0;
 	return 0;
 }
 
@@ -654,12 +1317,8 @@ snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, slave_areas, slave_offset,
-					 areas, offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, slave_areas, slave_offset,
-					   areas, offset, pcm->channels, size);
+	softvol_convert(svol, slave_areas, slave_offset,
+			areas, offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -677,12 +1336,8 @@ snd_pcm_softvol_read_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, areas, offset, slave_areas,
-					 slave_offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, areas, offset, slave_areas,
-					   slave_offset, pcm->channels, size);
+	softvol_convert(svol, areas, offset, slave_areas,
+			slave_offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -699,6 +1354,9 @@ static void snd_pcm_softvol_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "max_dB: %g\n", svol->max_dB);
 		snd_output_printf(out, "resolution: %d\n", svol->max_val + 1);
 	}
+	if (svol->ramp_frames)
+		snd_output_printf(out, "ramp: %u frames, %s\n", svol->ramp_frames,
+				  svol->ramp_exp ? "exponential" : "linear");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -760,7 +1418,6 @@ static int softvol_load_control(snd_pcm_t *pcm, snd_pcm_softvol_t *svol,
 	snd_pcm_info_t info = {0};
 	snd_ctl_elem_info_t cinfo = {0};
 	int err;
-	unsigned int i;
 
 	if (ctl_card < 0) {
 		err = snd_pcm_info(pcm, &info);
@@ -839,26 +1496,16 @@ static int softvol_load_control(snd_pcm_t *pcm, snd_pcm_softvol_t *svol,
 	/* set up dB table */
 	if (min_dB == PRESET_MIN_DB && max_dB == ZERO_DB &&
 						resolution == PRESET_RESOLUTION)
-		svol->dB_value = (unsigned int*)preset_dB_value;
+		svol->dB_value = preset_dB_value;
 	else {
 #ifndef HAVE_SOFT_FLOAT
-		svol->dB_value = calloc(resolution, sizeof(unsigned int));
-		if (! svol->dB_value) {
+		svol->dB_table = softvol_dB_table_get(min_dB, max_dB, resolution,
+						      svol->zero_dB_val);
+		if (! svol->dB_table) {
 			SNDERR("cannot allocate dB table");
 			return -ENOMEM;
 		}
-		svol->min_dB = min_dB;
-		svol->max_dB = max_dB;
-		for (i = 0; i <= svol->max_val; i++) {
-			double db = svol->min_dB +
-				(i * (svol->max_dB - svol->min_dB)) /
-					svol->max_val;
-			double v = (pow(10.0, db / 20.0) *
-					(double)(1 << VOL_SCALE_SHIFT));
-			svol->dB_value[i] = (unsigned int)v;
-		}
-		if (svol->zero_dB_val)
-			svol->dB_value[svol->zero_dB_val] = 65535;
+		svol->dB_value = svol->dB_table->value;
 #else
 		SNDERR("Cannot handle the given dB range and resolution");
 		return -EINVAL;
@@ -920,7 +1567,9 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	    sformat != SND_PCM_FORMAT_S24_3LE && 
 	    sformat != SND_PCM_FORMAT_S24_LE &&
 	    sformat != SND_PCM_FORMAT_S32_LE &&
-	    sformat != SND_PCM_FORMAT_S32_BE)
+	    sformat != SND_PCM_FORMAT_S32_BE &&
+	    sformat != SND_PCM_FORMAT_FLOAT_LE &&
+	    sformat != SND_PCM_FORMAT_FLOAT_BE)
 		return -EINVAL;
 	svol = calloc(1, sizeof(*svol));
 	if (! svol)
@@ -947,6 +1596,7 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	svol->plug.write = snd_pcm_softvol_write_areas;
 	svol->plug.undo_read = snd_pcm_plugin_undo_read_generic;
 	svol->plug.undo_write = snd_pcm_plugin_undo_write_generic;
+	svol->plug.init = snd_pcm_softvol_init;
 	svol->plug.gen.slave = slave;
 	svol->plug.gen.close_slave = close_slave;
 
@@ -974,6 +1624,47 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+#ifdef BUILD_PCM_PLUGIN_PLUG
+/*
+ * Hand the volume over to a plug slave, whose route stage applies it
+ * while converting, and return the plug itself.  Returns 1 when plug
+ * cannot take it, so that a softvol stage is opened as usual.
+ */
+static int softvol_fold_into_plug(snd_pcm_t **pcmp, const char *name,
+				  int ctl_card, snd_ctl_elem_id_t *ctl_id,
+				  int cchannels, double min_dB, double max_dB,
+				  int resolution, snd_pcm_t *slave)
+{
+	snd_pcm_softvol_t *svol;
+	int err;
+
+	svol = calloc(1, sizeof(*svol));
+	if (! svol)
+		return -ENOMEM;
+	err = softvol_load_control(slave, svol, ctl_card, ctl_id, cchannels,
+				   min_dB, max_dB, resolution);
+	if (err < 0) {
+		softvol_free(svol);
+		return err;
+	}
+	if (err > 0) { /* hardware control - no need for softvol! */
+		softvol_free(svol);
+	} else {
+		svol->cchannels = cchannels;
+		svol->vol.get_gains = softvol_route_gains;
+		svol->vol.free = softvol_route_free;
+		if (snd_pcm_plug_set_volume(slave, &svol->vol) < 0) {
+			softvol_free(svol);
+			return 1;
+		}
+	}
+	*pcmp = slave;
+	if (!slave->name && name)
+		slave->name = strdup(name);
+	return 0;
+}
+#endif
+
 /* in pcm_misc.c */
 int snd_pcm_parse_control_id(snd_config_t *conf, snd_ctl_elem_id_t *ctl_id, int *cardp,
 			     int *cchannelsp, int *hwctlp);
@@ -1016,9 +1707,32 @@ pcm.name {
 	[max_dB REAL]           # maximal dB value (default:   0.0)
 	[resolution INT]        # resolution (default: 256)
 				# resolution = 2 means a mute switch
+	[ramp_frames INT]       # length of the gain ramp in frames
+				# (default: 0, volume changes are a step)
+	[ramp_type STR]         # ramp shape: linear or exponential
+				# (default: linear)
+	[fold_into_plug BOOL]   # let a plug slave apply the volume
+				# (default: no)
 }
 \endcode
 
+With ramp_frames set, a volume change is not applied as a step but the
+gain moves to the new value sample by sample over the given number of
+frames, which avoids zipper noise without the application having to
+write a series of small steps.  A linear ramp interpolates the gain
+factor, an exponential ramp interpolates in dB.  A change arriving in
+the middle of a ramp starts a new ramp from the gain reached so far.
+
+With fold_into_plug set, a slave which is a plug plugin takes over the
+volume and no softvol stage is inserted: the route stage of the plug
+plugin applies the gains in the same block pass as the format and
+channel conversion.  The opened PCM is then the plug plugin itself, so
+snd_pcm_type() reports a plug PCM.  The volume stays a separate stage
+when ramp_frames or a slave format is given, or when the slave is no
+plug plugin.  The fold pays off when the plug plugin converts the
+channels anyway; for a plain format conversion, the separate stages are
+faster.
+
 \subsection pcm_plugins_softvol_funcref Function reference
 
 <UL>
@@ -1056,6 +1770,9 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	double min_dB = PRESET_MIN_DB;
 	double max_dB = ZERO_DB;
 	int card = -1, cchannels = 2;
+	long ramp_frames = 0;
+	int ramp_exp = 0;
+	int fold = 0;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1098,6 +1815,38 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "ramp_frames") == 0) {
+			err = snd_config_get_integer(n, &ramp_frames);
+			if (err < 0 || ramp_frames < 0 || ramp_frames > INT_MAX) {
+				SNDERR("Invalid ramp_frames value");
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "ramp_type") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid ramp_type value");
+				return -EINVAL;
+			}
+			if (strcmp(str, "linear") == 0)
+				ramp_exp = 0;
+			else if (strcmp(str, "exponential") == 0)
+				ramp_exp = 1;
+			else {
+				SNDERR("Unknown ramp_type %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "fold_into_plug") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			fold = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1140,8 +1889,10 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 		    sformat != SND_PCM_FORMAT_S24_3LE && 
 		    sformat != SND_PCM_FORMAT_S24_LE &&
 		    sformat != SND_PCM_FORMAT_S32_LE &&
-		    sformat != SND_PCM_FORMAT_S32_BE) {
-			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE or S32_BE format is supported");
+		    sformat != SND_PCM_FORMAT_S32_BE &&
+		    sformat != SND_PCM_FORMAT_FLOAT_LE &&
+		    sformat != SND_PCM_FORMAT_FLOAT_BE) {
+			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE, S32_BE, FLOAT_LE or FLOAT_BE format is supported");
 			snd_config_delete(sconf);
 			return -EINVAL;
 		}
@@ -1155,11 +1906,29 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			snd_pcm_close(spcm);
 			return err;
 		}
+#ifdef BUILD_PCM_PLUGIN_PLUG
+		/* ramps need the per-sample gains of the softvol stage */
+		if (fold && !ramp_frames && sformat == SND_PCM_FORMAT_UNKNOWN &&
+		    spcm->type == SND_PCM_TYPE_PLUG) {
+			err = softvol_fold_into_plug(pcmp, name, card, &ctl_id,
+						     cchannels, min_dB, max_dB,
+						     resolution, spcm);
+			if (err < 0)
+				snd_pcm_close(spcm);
+			if (err <= 0)
+				return err;
+		}
+#endif
 		err = snd_pcm_softvol_open(pcmp, name, sformat, card, &ctl_id,
 					   cchannels, min_dB, max_dB,
 					   resolution, spcm, 1);
 		if (err < 0)
 			snd_pcm_close(spcm);
+		else if (*pcmp != spcm) {
+			snd_pcm_softvol_t *svol = (*pcmp)->private_data;
+			svol->ramp_frames = ramp_frames;
+			svol->ramp_exp = ramp_exp;
+		}
 	}
 	return err;
 }
@@ -0,0 +1,277 @@
+/*
+ * sync cost benchmark for the direct plugins (dmix, dsnoop, dshare)
+ *
+ * N client processes open the same direct PCM and stream concurrently
+ * for the given time.  Each client measures the time spent in
+ * snd_pcm_avail_update() (the pointer sync against the slave and the
+ * other clients) and in snd_pcm_writei() / snd_pcm_readi() (the mixing
+ * for dmix, under the shared lock given with -l).
+ *
+ * The direct plugins need a hw slave; the default one is the card of
+ * the snd-dummy driver ("modprobe snd-dummy"), which acts as a null
+ * device with a real pointer.  Another card can be given with -c, or a
+ * complete configuration defining pcm.bench with -C.
+ *
+ * The results are printed as CSV to stdout, one line per client:
+ *
+ *   type,ipc_lock,clients,client,syncs,frames,xruns,
+ *   ns_per_sync,ns_per_transfer,ns_per_frame
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include "../include/asoundlib.h"
+
+#define MAX_CLIENTS	64
+
+static const char *pcm_type = "dmix";
+static const char *ipc_lock;
+static const char *card = "Dummy";
+static const char *custom_conf;
+static int num_clients = 4;
+static int period_size = 256;
+static int periods = 4;
+static double bench_seconds = 2.0;
+
+static double timespec_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static int open_bench(snd_pcm_t **pcmp, snd_pcm_stream_t stream)
+{
+	char buf[1024];
+	const char *conf = custom_conf;
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	if (!conf) {
+		/* ipc_lock is a dmix option only, and only the mixing
+		 * under the lock (mix_simd) takes it
+		 */
+		snprintf(buf, sizeof(buf),
+			 "pcm.bench { type %s ipc_key %d %s%s "
+			 "slave { pcm { type hw card \"%s\" } format S16_LE "
+			 "rate 48000 channels 2 period_size %d buffer_size %d } }",
+			 pcm_type, 0x5eed0000 + (getppid() & 0xffff),
+			 ipc_lock ? "mix_simd yes ipc_lock " : "",
+			 ipc_lock ? ipc_lock : "",
+			 card, period_size, period_size * periods);
+		conf = buf;
+	}
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err < 0)
+		goto out;
+	err = snd_config_load(top, input);
+	snd_input_close(input);
+	if (err < 0)
+		goto out;
+	err = snd_pcm_open_lconf(pcmp, "bench", stream, 0, top);
+ out:
+	snd_config_delete(top);
+	return err;
+}
+
+static int run_client(int client, int ready_fd, int start_fd)
+{
+	snd_pcm_stream_t stream;
+	snd_pcm_t *pcm = NULL;
+	struct timespec t0, t1, t2, end;
+	double sync_time = 0, xfer_time = 0;
+	unsigned long syncs = 0, xfers = 0, frames = 0, xruns = 0;
+	short *buf;
+	char c;
+	int err;
+
+	stream = strcmp(pcm_type, "dsnoop") ? SND_PCM_STREAM_PLAYBACK :
+		SND_PCM_STREAM_CAPTURE;
+	err = open_bench(&pcm, stream);
+	if (err >= 0)
+		err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE,
+					 SND_PCM_ACCESS_RW_INTERLEAVED, 2, 48000, 1,
+					 (unsigned int)((long long)period_size * periods * 1000000 / 48000));
+	/* report the end of the setup, failed or not */
+	c = 0;
+	if (write(ready_fd, &c, 1) < 0)
+		perror("write");
+	if (err < 0) {
+		fprintf(stderr, "client %d: cannot open: %s\n", client, snd_strerror(err));
+		if (pcm)
+			snd_pcm_close(pcm);
+		return 1;
+	}
+	buf = calloc(period_size, 2 * sizeof(short));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		return 1;
+	}
+
+	/* wait until all clients are set up */
+	if (read(start_fd, &c, 1) < 0)
+		perror("read");
+	if (stream == SND_PCM_STREAM_CAPTURE)
+		snd_pcm_start(pcm);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += (time_t)bench_seconds;
+	end.tv_nsec += (long)((bench_seconds - (time_t)bench_seconds) * 1e9);
+	if (end.tv_nsec >= 1000000000) {
+		end.tv_sec++;
+		end.tv_nsec -= 1000000000;
+	}
+	for (;;) {
+		snd_pcm_sframes_t avail, n;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (timespec_diff(&t0, &end) <= 0)
+			break;
+		avail = snd_pcm_avail_update(pcm);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		sync_time += timespec_diff(&t0, &t1);
+		syncs++;
+		if (avail < 0) {
+			xruns++;
+			snd_pcm_prepare(pcm);
+			if (stream == SND_PCM_STREAM_CAPTURE)
+				snd_pcm_start(pcm);
+			continue;
+		}
+		if (avail < period_size) {
+			snd_pcm_wait(pcm, 100);
+			continue;
+		}
+		if (stream == SND_PCM_STREAM_PLAYBACK)
+			n = snd_pcm_writei(pcm, buf, period_size);
+		else
+			n = snd_pcm_readi(pcm, buf, period_size);
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		xfer_time += timespec_diff(&t1, &t2);
+		if (n < 0) {
+			xruns++;
+			snd_pcm_recover(pcm, n, 1);
+			continue;
+		}
+		xfers++;
+		frames += n;
+	}
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+
+	printf("%s,%s,%d,%d,%lu,%lu,%lu,%.1f,%.1f,%.2f\n",
+	       custom_conf ? "custom" : pcm_type,
+	       ipc_lock ? ipc_lock : "-",
+	       num_clients, client, syncs, frames, xruns,
+	       syncs ? sync_time * 1e9 / syncs : 0.0,
+	       xfers ? xfer_time * 1e9 / xfers : 0.0,
+	       frames ? (sync_time + xfer_time) * 1e9 / frames : 0.0);
+	fflush(stdout);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dmix-sync-bench [-options]\n");
+	fprintf(stderr, "  -t str  Plugin type: dmix, dsnoop or dshare\n");
+	fprintf(stderr, "  -l str  Mix dmix under a lock (mix_simd): sysv or mutex\n");
+	fprintf(stderr, "  -n val  Number of concurrent clients (max %d)\n", MAX_CLIENTS);
+	fprintf(stderr, "  -c str  Slave card (default Dummy, from snd-dummy)\n");
+	fprintf(stderr, "  -C str  Custom config, it must define pcm.bench\n");
+	fprintf(stderr, "  -p val  Set period size (in frames)\n");
+	fprintf(stderr, "  -P val  Set number of periods\n");
+	fprintf(stderr, "  -s val  Seconds to stream\n");
+}
+
+int main(int argc, char **argv)
+{
+	pid_t pids[MAX_CLIENTS];
+	int ready[2], start[2];
+	int c, i, status, ret = 0;
+
+	while ((c = getopt(argc, argv, "t:l:n:c:C:p:P:s:h")) >= 0) {
+		switch (c) {
+		case 't':
+			pcm_type = optarg;
+			break;
+		case 'l':
+			ipc_lock = optarg;
+			break;
+		case 'n':
+			num_clients = atoi(optarg);
+			break;
+		case 'c':
+			card = optarg;
+			break;
+		case 'C':
+			custom_conf = optarg;
+			break;
+		case 'p':
+			period_size = atoi(optarg);
+			break;
+		case 'P':
+			periods = atoi(optarg);
+			break;
+		case 's':
+			bench_seconds = atof(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (ipc_lock && strcmp(pcm_type, "dmix")) {
+		usage();
+		return 1;
+	}
+	if (num_clients < 1 || num_clients > MAX_CLIENTS ||
+	    period_size < 16 || periods < 2 || bench_seconds <= 0) {
+		usage();
+		return 1;
+	}
+
+	if (pipe(ready) < 0 || pipe(start) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	printf("type,ipc_lock,clients,client,syncs,frames,xruns,"
+	       "ns_per_sync,ns_per_transfer,ns_per_frame\n");
+	fflush(stdout);
+	for (i = 0; i < num_clients; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			num_clients = i;
+			ret = 1;
+			break;
+		}
+		if (!pids[i]) {
+			close(ready[0]);
+			close(start[1]);
+			exit(run_client(i, ready[1], start[0]));
+		}
+	}
+	close(ready[1]);
+	close(start[0]);
+	/* every client reports once, a crashed one ends the read early */
+	for (i = 0; i < num_clients; i++) {
+		char ch;
+		if (read(ready[0], &ch, 1) != 1)
+			break;
+	}
+	/* closing the pipe releases all clients at once */
+	close(start[1]);
+	for (i = 0; i < num_clients; i++) {
+		if (waitpid(pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,155 @@
+/*
+ * A control plugin with the volume controls of the soft volume tests,
+ * so that they run without a sound card.
+ *
+ * It has a stereo and a mono integer element, both marked as user
+ * elements with the range of the softvol defaults, so that the softvol
+ * plugin takes them as its own.  The values live as long as the module
+ * is loaded and are shared by all handles.
+ */
+
+#include <string.h>
+#include <alsa/asoundlib.h>
+#include <alsa/control_external.h>
+
+/* SNDRV_CTL_ELEM_ACCESS_USER */
+#define ACCESS_USER	(1U << 29)
+
+static const struct {
+	const char *name;
+	unsigned int count;
+} elems[] = {
+	{ "LSB Plug Softvol Test Volume", 2 },
+	{ "LSB Plug Softvol Test Mono Volume", 1 },
+};
+
+#define NELEMS		(sizeof(elems) / sizeof(elems[0]))
+
+static long values[NELEMS][2] = { { 255, 255 }, { 255, 255 } };
+
+static void volume_close(snd_ctl_ext_t *ext)
+{
+	free(ext);
+}
+
+static int volume_elem_count(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED)
+{
+	return NELEMS;
+}
+
+static int volume_elem_list(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			    unsigned int offset, snd_ctl_elem_id_t *id)
+{
+	if (offset >= NELEMS)
+		return -EINVAL;
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, elems[offset].name);
+	return 0;
+}
+
+static snd_ctl_ext_key_t volume_find_elem(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+					  const snd_ctl_elem_id_t *id)
+{
+	const char *name = snd_ctl_elem_id_get_name(id);
+	unsigned int i;
+
+	if (snd_ctl_elem_id_get_interface(id) != SND_CTL_ELEM_IFACE_MIXER ||
+	    snd_ctl_elem_id_get_index(id) != 0)
+		return SND_CTL_EXT_KEY_NOT_FOUND;
+	for (i = 0; i < NELEMS; i++)
+		if (!strcmp(name, elems[i].name))
+			return i;
+	return SND_CTL_EXT_KEY_NOT_FOUND;
+}
+
+static int volume_get_attribute(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				snd_ctl_ext_key_t key, int *type,
+				unsigned int *acc, unsigned int *count)
+{
+	*type = SND_CTL_ELEM_TYPE_INTEGER;
+	*acc = SND_CTL_EXT_ACCESS_READWRITE | ACCESS_USER;
+	*count = elems[key].count;
+	return 0;
+}
+
+static int volume_get_integer_info(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				   snd_ctl_ext_key_t key ATTRIBUTE_UNUSED,
+				   long *imin, long *imax, long *istep)
+{
+	*imin = 0;
+	*imax = 255;
+	*istep = 0;
+	return 0;
+}
+
+static int volume_read_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+			       snd_ctl_ext_key_t key, long *value)
+{
+	memcpy(value, values[key], elems[key].count * sizeof(*value));
+	return 0;
+}
+
+static int volume_write_integer(snd_ctl_ext_t *ext ATTRIBUTE_UNUSED,
+				snd_ctl_ext_key_t key, long *value)
+{
+	int changed = memcmp(values[key], value,
+			     elems[key].count * sizeof(*value)) != 0;
+
+	memcpy(values[key], value, elems[key].count * sizeof(*value));
+	return changed;
+}
+
+static const snd_ctl_ext_callback_t volume_ext_callback = {
+	.close = volume_close,
+	.elem_count = volume_elem_count,
+	.elem_list = volume_elem_list,
+	.find_elem = volume_find_elem,
+	.get_attribute = volume_get_attribute,
+	.get_integer_info = volume_get_integer_info,
+	.read_integer = volume_read_integer,
+	.write_integer = volume_write_integer,
+};
+
+SND_CTL_PLUGIN_DEFINE_FUNC(lsb_volume)
+{
+	snd_config_iterator_t i, next;
+	snd_ctl_ext_t *ext;
+	int err;
+
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id;
+
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (!strcmp(id, "comment") || !strcmp(id, "type") ||
+		    !strcmp(id, "hint"))
+			continue;
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+
+	ext = calloc(1, sizeof(*ext));
+	if (!ext)
+		return -ENOMEM;
+	ext->version = SND_CTL_EXT_VERSION;
+	ext->card_idx = 0;
+	strcpy(ext->id, "LSB");
+	strcpy(ext->driver, "LSB volume");
+	strcpy(ext->name, "LSB volume");
+	strcpy(ext->longname, "LSB volume controls");
+	strcpy(ext->mixername, "LSB volume");
+	ext->poll_fd = -1;
+	ext->callback = &volume_ext_callback;
+	ext->private_data = NULL;
+
+	err = snd_ctl_ext_create(ext, name, mode);
+	if (err < 0) {
+		free(ext);
+		return err;
+	}
+	*handlep = ext->handle;
+	return 0;
+}
+
+SND_CTL_PLUGIN_SYMBOL(lsb_volume);
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+
+#define MAX_CHANNELS 8
+
+static void fill_pattern(unsigned char *buf, size_t size, unsigned int seed)
+{
+	size_t i;
+
+	for (i = 0; i < size; ++i)
+		buf[i] = (unsigned char)(seed + i * 7 + (i >> 8));
+}
+
+static void setup_interleaved(snd_pcm_channel_area_t *areas, void *buf,
+			      unsigned int channels, int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; ++c) {
+		areas[c].addr = buf;
+		areas[c].first = c * width;
+		areas[c].step = channels * width;
+	}
+}
+
+static void setup_noninterleaved(snd_pcm_channel_area_t *areas, void **bufs,
+				 unsigned int channels, int width)
+{
+	unsigned int c;
+
+	for (c = 0; c < channels; ++c) {
+		areas[c].addr = bufs[c];
+		areas[c].first = 0;
+		areas[c].step = width;
+	}
+}
+
+static void test_copy(snd_pcm_format_t format, unsigned int channels,
+		      snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+{
+	snd_pcm_channel_area_t iareas[MAX_CHANNELS], nareas[MAX_CHANNELS];
+	int width = snd_pcm_format_physical_width(format);
+	unsigned int bytes = width / 8;
+	size_t size = (offset + frames) * bytes;
+	unsigned char *ibuf, *ibuf2;
+	void *nbufs[MAX_CHANNELS];
+	snd_pcm_uframes_t f;
+	unsigned int c;
+	int ok = 1;
+
+	ibuf = malloc(size * channels);
+	ibuf2 = malloc(size * channels);
+	for (c = 0; c < channels; ++c)
+		nbufs[c] = malloc(size);
+
+	/* interleaved -> non-interleaved */
+	fill_pattern(ibuf, size * channels, channels);
+	for (c = 0; c < channels; ++c)
+		memset(nbufs[c], 0, size);
+	setup_interleaved(iareas, ibuf, channels, width);
+	setup_noninterleaved(nareas, nbufs, channels, width);
+	ALSA_CHECK(snd_pcm_areas_copy(nareas, offset, iareas, offset,
+				      channels, frames, format));
+	for (f = offset; f < offset + frames; ++f)
+		for (c = 0; c < channels; ++c)
+			if (memcmp((char *)nbufs[c] + f * bytes,
+				   ibuf + (f * channels + c) * bytes, bytes))
+				ok = 0;
+	for (c = 0; c < channels; ++c)
+		for (f = 0; f < offset * bytes; ++f)
+			if (((unsigned char *)nbufs[c])[f])
+				ok = 0;
+	TEST_CHECK(ok);
+
+	/* and back again */
+	memset(ibuf2, 0, size * channels);
+	setup_interleaved(iareas, ibuf2, channels, width);
+	ALSA_CHECK(snd_pcm_areas_copy(iareas, offset, nareas, offset,
+				      channels, frames, format));
+	TEST_CHECK(memcmp(ibuf2 + offset * bytes * channels,
+			  ibuf + offset * bytes * channels,
+			  frames * bytes * channels) == 0);
+
+	if (!ok || any_test_failed)
+		fprintf(stderr, "  format %s, channels %u, frames %lu\n",
+			snd_pcm_format_name(format), channels, frames);
+
+	free(ibuf);
+	free(ibuf2);
+	for (c = 0; c < channels; ++c)
+		free(nbufs[c]);
+}
+
+static void test_areas_copy(void)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S32_LE,
+	};
+	static const snd_pcm_uframes_t frames[] = { 1, 7, 16, 37, 1031 };
+	unsigned int f, c, n;
+
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f)
+		for (c = 1; c <= MAX_CHANNELS; ++c)
+			for (n = 0; n < sizeof(frames) / sizeof(frames[0]); ++n) {
+				test_copy(formats[f], c, 0, frames[n]);
+				test_copy(formats[f], c, 3, frames[n]);
+			}
+}
+
+static void test_areas_silence(void)
+{
+	/* big enough to take the non-temporal path */
+	const snd_pcm_uframes_t frames = 128 * 1024 + 3;
+	snd_pcm_channel_area_t areas[2];
+	unsigned char *buf;
+	size_t i, size = frames * 2 * 2;
+	int ok = 1;
+
+	buf = malloc(size + 2);
+	memset(buf, 0x55, size + 2);
+	setup_interleaved(areas, buf, 2, 16);
+	ALSA_CHECK(snd_pcm_areas_silence(areas, 0, 2, frames, SND_PCM_FORMAT_U16_LE));
+	for (i = 0; i < size; i += 2)
+		if (buf[i] != 0x00 || buf[i + 1] != 0x80)
+			ok = 0;
+	TEST_CHECK(ok);
+	TEST_CHECK(buf[size] == 0x55 && buf[size + 1] == 0x55);
+	free(buf);
+}
+
+static void test_area_copy_large(void)
+{
+	const snd_pcm_uframes_t frames = 96 * 1024 + 5;
+	snd_pcm_channel_area_t src[2], dst[2];
+	unsigned char *sbuf, *dbuf;
+	size_t size = frames * 2 * 4;
+
+	sbuf = malloc(size);
+	dbuf = malloc(size + 1);
+	fill_pattern(sbuf, size, 1);
+	dbuf[size] = 0xaa;
+	setup_interleaved(src, sbuf, 2, 32);
+	/* misaligned destination */
+	setup_interleaved(dst, dbuf + 1, 2, 32);
+	ALSA_CHECK(snd_pcm_areas_copy(dst, 0, src, 0, 2, frames - 1,
+				      SND_PCM_FORMAT_S32_LE));
+	TEST_CHECK(memcmp(dbuf + 1, sbuf, size - 8) == 0);
+	TEST_CHECK(dbuf[size] == 0xaa);
+	free(sbuf);
+	free(dbuf);
+}
+
+int main(void)
+{
+	test_areas_copy();
+	test_areas_silence();
+	test_area_copy_large();
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,181 @@
+/*
+ * Checks the conversions of the linear plugin for every pair of the
+ * formats with a specialized loop against a per-sample reference.
+ *
+ * The reference follows the getput path: the sample is left-justified
+ * in 32 bits (the sign of U8 flipped), then the upper bits are stored
+ * in the destination format.  The converted data is taken from a file
+ * plugin below the linear plugin, so nothing but the public API is used.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "test.h"
+
+#define CHANNELS	3
+#define FRAMES		1031
+
+static const snd_pcm_format_t formats[] = {
+	SND_PCM_FORMAT_U8,
+	SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_BE,
+	SND_PCM_FORMAT_S24_LE, SND_PCM_FORMAT_S24_BE,
+	SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S24_3BE,
+	SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S32_BE,
+};
+
+static uint32_t load(const unsigned char *p, unsigned int bytes, int big)
+{
+	uint32_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++)
+		v |= (uint32_t)p[big ? bytes - 1 - i : i] << (8 * i);
+	return v;
+}
+
+static void store(unsigned char *p, uint32_t v, unsigned int bytes, int big)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++)
+		p[big ? bytes - 1 - i : i] = v >> (8 * i);
+}
+
+static uint32_t ref_get(const unsigned char *p, snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int width = snd_pcm_format_width(format);
+	int big = snd_pcm_format_big_endian(format) > 0;
+	uint32_t v = load(p, bytes, big) << (32 - width);
+
+	if (snd_pcm_format_unsigned(format) > 0)
+		v ^= 0x80000000;
+	return v;
+}
+
+static void ref_put(unsigned char *p, uint32_t v, snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int width = snd_pcm_format_width(format);
+	int big = snd_pcm_format_big_endian(format) > 0;
+
+	if (snd_pcm_format_unsigned(format) > 0)
+		v ^= 0x80000000;
+	/* the padding byte of S24_LE/BE gets the sign */
+	store(p, (uint32_t)((int32_t)v >> (32 - width)), bytes, big);
+}
+
+static int open_linear(snd_pcm_t **pcm, snd_pcm_format_t dst, const char *path)
+{
+	char conf[512];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf, sizeof(conf),
+		 "pcm.test { type linear slave { format %s pcm { type file "
+		 "slave.pcm { type null } file \"%s\" format raw } } }",
+		 snd_pcm_format_name(dst), path);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static void test_pair(snd_pcm_format_t src, snd_pcm_format_t dst,
+		      snd_pcm_access_t access)
+{
+	unsigned int sbytes = snd_pcm_format_physical_width(src) / 8;
+	unsigned int dbytes = snd_pcm_format_physical_width(dst) / 8;
+	size_t ssize = (size_t)FRAMES * CHANNELS * sbytes;
+	size_t dsize = (size_t)FRAMES * CHANNELS * dbytes;
+	unsigned char *sbuf, *dbuf, *out;
+	void *bufs[CHANNELS];
+	char path[] = "/tmp/alsa-lsb-linear-XXXXXX";
+	snd_pcm_t *pcm;
+	FILE *fp;
+	size_t i, len;
+	unsigned int f, c;
+	int fd;
+
+	sbuf = malloc(ssize);
+	dbuf = malloc(dsize);
+	out = malloc(dsize + 1);
+	for (i = 0; i < ssize; i++)
+		sbuf[i] = (unsigned char)(i * 151 + (i >> 8) * 7);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		goto _free;
+	}
+	close(fd);
+	if (ALSA_CHECK(open_linear(&pcm, dst, path)) < 0)
+		goto _unlink;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, src, access, CHANNELS,
+					  48000, 0, 100000)) < 0) {
+		snd_pcm_close(pcm);
+		goto _unlink;
+	}
+	if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+		TEST_CHECK(snd_pcm_writei(pcm, sbuf, FRAMES) == FRAMES);
+	} else {
+		/* the same samples, one buffer per channel */
+		for (c = 0; c < CHANNELS; c++)
+			bufs[c] = sbuf + (size_t)c * FRAMES * sbytes;
+		TEST_CHECK(snd_pcm_writen(pcm, bufs, FRAMES) == FRAMES);
+	}
+	snd_pcm_drain(pcm);
+	snd_pcm_close(pcm);
+
+	for (f = 0; f < FRAMES; f++)
+		for (c = 0; c < CHANNELS; c++) {
+			const unsigned char *s;
+
+			if (access == SND_PCM_ACCESS_RW_INTERLEAVED)
+				s = sbuf + ((size_t)f * CHANNELS + c) * sbytes;
+			else
+				s = sbuf + ((size_t)c * FRAMES + f) * sbytes;
+			ref_put(dbuf + ((size_t)f * CHANNELS + c) * dbytes,
+				ref_get(s, src), dst);
+		}
+	len = 0;
+	fp = fopen(path, "rb");
+	if (fp) {
+		len = fread(out, 1, dsize + 1, fp);
+		fclose(fp);
+	}
+	TEST_CHECK(len == dsize);
+	TEST_CHECK(len == dsize && memcmp(out, dbuf, dsize) == 0);
+	if (any_test_failed)
+		fprintf(stderr, "  %s -> %s, %s\n", snd_pcm_format_name(src),
+			snd_pcm_format_name(dst), snd_pcm_access_name(access));
+ _unlink:
+	unlink(path);
+ _free:
+	free(sbuf);
+	free(dbuf);
+	free(out);
+}
+
+int main(void)
+{
+	unsigned int s, d;
+
+	for (s = 0; s < sizeof(formats) / sizeof(formats[0]); s++)
+		for (d = 0; d < sizeof(formats) / sizeof(formats[0]); d++) {
+			test_pair(formats[s], formats[d], SND_PCM_ACCESS_RW_INTERLEAVED);
+			test_pair(formats[s], formats[d], SND_PCM_ACCESS_RW_NONINTERLEAVED);
+		}
+	return TEST_EXIT_CODE();
+}
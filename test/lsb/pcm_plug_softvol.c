@@ -0,0 +1,401 @@
+/*
+ * Checks the soft volume that a softvol plugin hands over to its plug
+ * slave.
+ *
+ * With fold_into_plug and without a ramp or a slave format, the softvol
+ * plugin must not be opened at all: the PCM is the plug plugin, whose
+ * route stage applies the volume.  The data is
+ * taken from a file plugin below the plug plugin.  At 0 dB it must be
+ * identical to the output of the plug plugin alone, at other volumes it
+ * must be the input times the gain of the control, within the rounding
+ * of the formats.  The cases cover format conversions and channel
+ * matrices, with mono and stereo controls and both access types.
+ *
+ * The volume controls come from the control plugin in ctl_volume.c,
+ * which replaces the hw controls, so no card is needed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <math.h>
+#include "test.h"
+
+#define FRAMES		1031
+#define CONTROL		"LSB Plug Softvol Test Volume"
+#define MONO_CONTROL	"LSB Plug Softvol Test Mono Volume"
+
+static const snd_pcm_format_t formats[][2] = {
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S32_LE },
+	{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S16_BE, SND_PCM_FORMAT_S32_LE },
+	{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S24_LE },
+	{ SND_PCM_FORMAT_U8, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_FLOAT_LE },
+};
+
+static const struct {
+	unsigned int channels, schannels, count;
+} setups[] = {
+	{ 2, 2, 2 },
+	{ 2, 4, 1 },
+	{ 4, 2, 2 },
+};
+
+/* control values, left and right */
+static const long volumes[][2] = {
+	{ 255, 255 },
+	{ 0, 0 },
+	{ 128, 200 },
+	{ 200, 37 },
+	{ 254, 1 },
+};
+
+/* the gains of the default dB table at the volumes above */
+static unsigned int preset_gain(long vol)
+{
+	switch (vol) {
+	case 1:
+		return 0xbd;
+	case 37:
+		return 0x1b0;
+	case 128:
+		return 0xdbf;
+	case 200:
+		return 0x4826;
+	case 254:
+		return 0xfa2b;
+	default:
+		return 0xffff;
+	}
+}
+
+#define NFORMATS	(sizeof(formats) / sizeof(formats[0]))
+#define NSETUPS		(sizeof(setups) / sizeof(setups[0]))
+#define NVOLUMES	(sizeof(volumes) / sizeof(volumes[0]))
+
+static const char *control_name(unsigned int count)
+{
+	return count == 1 ? MONO_CONTROL : CONTROL;
+}
+
+static int open_pcm(snd_pcm_t **pcm, int softvol, unsigned int ramp_frames,
+		    const char *options, snd_pcm_format_t format,
+		    unsigned int s, const char *path)
+{
+	char conf[1024], plug[512];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	snprintf(plug, sizeof(plug),
+		 "{ type plug slave { pcm { type file slave.pcm { type null } "
+		 "file \"%s\" format raw } format %s channels %u } }",
+		 path, snd_pcm_format_name(format), setups[s].schannels);
+	if (softvol)
+		snprintf(conf, sizeof(conf),
+			 "pcm.test { type softvol control { name \"%s\" card 0 "
+			 "count %u } ramp_frames %u %s slave.pcm %s }",
+			 control_name(setups[s].count), setups[s].count,
+			 ramp_frames, options, plug);
+	else
+		snprintf(conf, sizeof(conf), "pcm.test %s", plug);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static int set_volume(const long *vol, unsigned int count)
+{
+	snd_ctl_elem_value_t *val;
+	unsigned int i;
+	snd_ctl_t *ctl;
+	int err;
+
+	err = snd_ctl_open(&ctl, "hw:0", 0);
+	if (err < 0)
+		return err;
+	snd_ctl_elem_value_alloca(&val);
+	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_value_set_name(val, control_name(count));
+	for (i = 0; i < count; i++)
+		snd_ctl_elem_value_set_integer(val, i, vol[i]);
+	err = snd_ctl_elem_write(ctl, val);
+	snd_ctl_close(ctl);
+	return err;
+}
+
+/* replace the hw controls by the ones of ctl_volume.c */
+static int fake_controls(void)
+{
+	static const char conf[] =
+		"ctl.!hw { @args [ CARD ] @args.CARD { type string } "
+		"type lsb_volume } "
+		"ctl_type.lsb_volume.lib \"" CTL_VOLUME_MODULE "\"";
+	snd_input_t *input;
+	int err;
+
+	err = snd_config_update();
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err < 0)
+		return err;
+	err = snd_config_load(snd_config, input);
+	snd_input_close(input);
+	return err;
+}
+
+/* full scale samples, valid for every format */
+static void fill(unsigned char *buf, snd_pcm_format_t format, size_t samples)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	int big = snd_pcm_format_big_endian(format) > 0;
+	uint32_t seed = 1;
+	size_t i;
+
+	for (i = 0; i < samples; i++, buf += bytes) {
+		int32_t v;
+		float f;
+		unsigned int b;
+
+		seed = seed * 1103515245 + 12345;
+		v = (int32_t)(seed ^ (seed << 15));
+		if (format == SND_PCM_FORMAT_FLOAT_LE) {
+			f = v / 2147483648.0f;
+			memcpy(buf, &f, sizeof(f));
+			continue;
+		}
+		/* right-justified in the sample width */
+		v >>= 32 - snd_pcm_format_width(format);
+		for (b = 0; b < bytes; b++)
+			buf[big ? bytes - 1 - b : b] = (uint32_t)v >> (8 * b);
+	}
+}
+
+/* one sample, scaled to [-1, 1) */
+static double sample(const unsigned char *p, snd_pcm_format_t format)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	int width = snd_pcm_format_width(format);
+	int big = snd_pcm_format_big_endian(format) > 0;
+	uint32_t v = 0;
+	unsigned int b;
+	float f;
+
+	if (format == SND_PCM_FORMAT_FLOAT_LE) {
+		memcpy(&f, p, sizeof(f));
+		return f;
+	}
+	for (b = 0; b < bytes; b++)
+		v |= (uint32_t)p[big ? bytes - 1 - b : b] << (8 * b);
+	v <<= 32 - width;
+	if (snd_pcm_format_unsigned(format) > 0)
+		v ^= 0x80000000;
+	return (int32_t)v / 2147483648.0;
+}
+
+static size_t read_file(const char *path, unsigned char **data)
+{
+	size_t size = 0, len;
+	FILE *fp;
+
+	*data = NULL;
+	fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+	for (;;) {
+		*data = realloc(*data, size + 65536);
+		len = fread(*data + size, 1, 65536, fp);
+		size += len;
+		if (len < 65536)
+			break;
+	}
+	fclose(fp);
+	return size;
+}
+
+/* play the buffer and return what reached the file */
+static size_t run(int softvol, unsigned int f, unsigned int s, unsigned int v,
+		  snd_pcm_access_t access, const unsigned char *buf,
+		  unsigned char **data)
+{
+	char path[] = "/tmp/alsa-lsb-plug-softvol-XXXXXX";
+	snd_pcm_format_t format = formats[f][0];
+	unsigned int channels = setups[s].channels;
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	const void *bufs[8];
+	snd_pcm_t *pcm;
+	size_t len = 0;
+	unsigned int c;
+	int fd;
+
+	*data = NULL;
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return 0;
+	}
+	close(fd);
+	if (ALSA_CHECK(open_pcm(&pcm, softvol, 0, "fold_into_plug yes",
+				formats[f][1], s, path)) < 0)
+		goto _unlink;
+	/* the volume is folded into the plug plugin */
+	TEST_CHECK(snd_pcm_type(pcm) == SND_PCM_TYPE_PLUG);
+	if (softvol && ALSA_CHECK(set_volume(volumes[v], setups[s].count)) < 0)
+		goto _close;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, format, access, channels,
+					  48000, 0, 100000)) < 0)
+		goto _close;
+	if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+		TEST_CHECK(snd_pcm_writei(pcm, buf, FRAMES) == FRAMES);
+	} else {
+		for (c = 0; c < channels; c++)
+			bufs[c] = buf + (size_t)c * FRAMES * bytes;
+		TEST_CHECK(snd_pcm_writen(pcm, (void **)bufs, FRAMES) == FRAMES);
+	}
+	snd_pcm_drain(pcm);
+ _close:
+	snd_pcm_close(pcm);
+	len = read_file(path, data);
+ _unlink:
+	unlink(path);
+	return len;
+}
+
+/* the gain of a client channel, 0xffff is unity */
+static double channel_gain(unsigned int s, unsigned int v, unsigned int c)
+{
+	const long *vol = volumes[v];
+	unsigned int gain;
+
+	if (vol[0] == 0 && (setups[s].count == 1 || vol[1] == 0))
+		return 0.0;
+	gain = preset_gain(vol[setups[s].count == 1 ? 0 : c & 1]);
+	return gain == 0xffff ? 1.0 : gain / 65536.0;
+}
+
+static void check_gains(unsigned int f, unsigned int s, unsigned int v,
+			snd_pcm_access_t access, const unsigned char *buf,
+			const unsigned char *data, size_t len)
+{
+	snd_pcm_format_t format = formats[f][0], sformat = formats[f][1];
+	unsigned int channels = setups[s].channels;
+	unsigned int schannels = setups[s].schannels;
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned int sbytes = snd_pcm_format_physical_width(sformat) / 8;
+	double lsb = ldexp(1.0, 1 - snd_pcm_format_width(sformat));
+	/* float sums keep 24 bits */
+	double tol = 2 * (lsb > 0x1p-22 ? lsb : 0x1p-22);
+	unsigned int frame, c;
+
+	TEST_CHECK(len == (size_t)FRAMES * schannels * sbytes);
+	if (len != (size_t)FRAMES * schannels * sbytes)
+		return;
+	for (frame = 0; frame < FRAMES; frame++) {
+		for (c = 0; c < schannels; c++) {
+			double in = 0.0, expect = 0.0, out;
+			size_t pos;
+
+			/* the copy policy routes the first channels 1:1 */
+			if (c < channels) {
+				if (access == SND_PCM_ACCESS_RW_INTERLEAVED)
+					pos = (size_t)frame * channels + c;
+				else
+					pos = (size_t)c * FRAMES + frame;
+				in = sample(buf + pos * bytes, format);
+				expect = in * channel_gain(s, v, c);
+			}
+			out = sample(data + ((size_t)frame * schannels + c) * sbytes,
+				     sformat);
+			if (fabs(out - expect) > tol) {
+				TEST_CHECK(fabs(out - expect) <= tol);
+				fprintf(stderr, "  frame %u, channel %u: %g * %g gave %g\n",
+					frame, c, in, channel_gain(s, v, c), out);
+				return;
+			}
+		}
+	}
+}
+
+static void run_case(unsigned int f, unsigned int s, unsigned int v,
+		     snd_pcm_access_t access)
+{
+	snd_pcm_format_t format = formats[f][0];
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	unsigned char *buf, *plain, *data;
+	size_t len, plain_len;
+	int failed = any_test_failed;
+
+	any_test_failed = 0;
+	buf = malloc((size_t)FRAMES * setups[s].channels * bytes);
+	fill(buf, format, (size_t)FRAMES * setups[s].channels);
+	len = run(1, f, s, v, access, buf, &data);
+	/*
+	 * without float mode, plug alone routes float channels in S16,
+	 * while the route stage with the volume keeps them in float
+	 */
+	if (volumes[v][0] == 255 && volumes[v][1] == 255 &&
+	    (format != SND_PCM_FORMAT_FLOAT_LE ||
+	     setups[s].channels == setups[s].schannels)) {
+		plain_len = run(0, f, s, v, access, buf, &plain);
+		TEST_CHECK(plain_len > 0);
+		TEST_CHECK(len == plain_len && memcmp(data, plain, len) == 0);
+		free(plain);
+	} else {
+		check_gains(f, s, v, access, buf, data, len);
+	}
+	if (any_test_failed)
+		fprintf(stderr, "  %s -> %s, setup %u, volumes %u, %sinterleaved\n",
+			snd_pcm_format_name(formats[f][0]),
+			snd_pcm_format_name(formats[f][1]), s, v,
+			access == SND_PCM_ACCESS_RW_INTERLEAVED ? "" : "non-");
+	any_test_failed |= failed;
+	free(data);
+	free(buf);
+}
+
+/* the cases where the softvol plugin stays a stage of its own */
+static void test_no_fold(unsigned int ramp_frames, const char *options)
+{
+	snd_pcm_t *pcm;
+
+	if (ALSA_CHECK(open_pcm(&pcm, 1, ramp_frames, options,
+				SND_PCM_FORMAT_S16_LE, 0, "/dev/null")) < 0)
+		return;
+	TEST_CHECK(snd_pcm_type(pcm) == SND_PCM_TYPE_SOFTVOL);
+	snd_pcm_close(pcm);
+}
+
+int main(void)
+{
+	unsigned int f, s, v;
+
+	if (ALSA_CHECK(fake_controls()) < 0)
+		return TEST_EXIT_CODE();
+	for (f = 0; f < NFORMATS; f++)
+		for (s = 0; s < NSETUPS; s++)
+			for (v = 0; v < NVOLUMES; v++) {
+				run_case(f, s, v, SND_PCM_ACCESS_RW_INTERLEAVED);
+				run_case(f, s, v, SND_PCM_ACCESS_RW_NONINTERLEAVED);
+			}
+	/* not asked for */
+	test_no_fold(0, "");
+	/* the gain ramps need the softvol plugin itself */
+	test_no_fold(100, "fold_into_plug yes");
+	/* the volume is applied in the given format */
+	test_no_fold(0, "fold_into_plug yes slave.format S32_LE");
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,279 @@
+/*
+ * Checks rewind and forward of the rate plugin.
+ *
+ * A stream is rewound over committed periods and the pending fraction
+ * and then written again, or forwarded over frames put in the mmap area.
+ * Both must give the same converted data as a stream which simply wrote
+ * the final frames.  The data is taken from a file plugin below the rate
+ * plugin; the stream is never started, so the null plugin below keeps
+ * everything rewindable.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include "test.h"
+
+#define CHANNELS	2
+#define PERIOD		256
+#define PERIODS		8
+
+static const char *const converters[] = {
+	"linear", "builtin-sinc-fast", "builtin-sinc",
+};
+
+static const unsigned int rates[][2] = {
+	{ 44100, 48000 },
+	{ 48000, 44100 },
+	{ 32000, 48000 },
+};
+
+static int open_rate(snd_pcm_t **pcm, const char *converter,
+		     unsigned int srate, const char *path)
+{
+	char conf[512];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf, sizeof(conf),
+		 "pcm.test { type rate converter \"%s\" slave { rate %u "
+		 "format S16 pcm { type file slave.pcm { type null } "
+		 "file \"%s\" format raw } } }",
+		 converter, srate, path);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static int setup(snd_pcm_t *pcm, unsigned int rate)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_uframes_t size, boundary;
+	int err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_sw_params_alloca(&sw);
+	err = snd_pcm_hw_params_any(pcm, hw);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_channels(pcm, hw, CHANNELS);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_rate(pcm, hw, rate, 0);
+	size = PERIOD;
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &size, 0);
+	size = PERIOD * PERIODS;
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &size);
+	if (err >= 0)
+		err = snd_pcm_hw_params(pcm, hw);
+	if (err < 0)
+		return err;
+	/* put_uncommitted() wraps at this size */
+	if (size != PERIOD * PERIODS)
+		return -EINVAL;
+	/* never started: the null slave keeps everything rewindable */
+	err = snd_pcm_sw_params_current(pcm, sw);
+	if (err >= 0)
+		err = snd_pcm_sw_params_get_boundary(sw, &boundary);
+	if (err >= 0)
+		err = snd_pcm_sw_params_set_start_threshold(pcm, sw, boundary);
+	if (err >= 0)
+		err = snd_pcm_sw_params(pcm, sw);
+	return err;
+}
+
+static void fill(int16_t *buf, snd_pcm_uframes_t frames, unsigned int seed)
+{
+	snd_pcm_uframes_t i;
+
+	for (i = 0; i < frames * CHANNELS; i++)
+		buf[i] = (int16_t)((i + seed) * 2654435761U >> 16);
+}
+
+static void put_mmap(snd_pcm_t *pcm, const int16_t *buf,
+		     snd_pcm_uframes_t frames)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, n;
+
+	while (frames > 0) {
+		n = frames;
+		if (ALSA_CHECK(snd_pcm_mmap_begin(pcm, &areas, &offset, &n)) < 0)
+			return;
+		memcpy((char *)areas[0].addr + offset * CHANNELS * 2, buf,
+		       n * CHANNELS * 2);
+		TEST_CHECK(snd_pcm_mmap_commit(pcm, offset, n) == (snd_pcm_sframes_t)n);
+		buf += n * CHANNELS;
+		frames -= n;
+	}
+}
+
+/* fill the mmap area after appl_ptr without committing it */
+static void put_uncommitted(snd_pcm_t *pcm, const int16_t *buf,
+			    snd_pcm_uframes_t frames)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, pos, n, i;
+	int16_t *dst;
+
+	n = frames;
+	if (ALSA_CHECK(snd_pcm_mmap_begin(pcm, &areas, &offset, &n)) < 0)
+		return;
+	dst = areas[0].addr;
+	pos = offset;
+	for (i = 0; i < frames; i++, pos++) {
+		if (pos == PERIOD * PERIODS)
+			pos = 0;
+		memcpy(dst + pos * CHANNELS, buf + i * CHANNELS, CHANNELS * 2);
+	}
+	TEST_CHECK(snd_pcm_mmap_commit(pcm, offset, 0) == 0);
+}
+
+static size_t read_file(const char *path, unsigned char **data)
+{
+	size_t size = 0, len;
+	FILE *fp;
+
+	*data = NULL;
+	fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+	for (;;) {
+		*data = realloc(*data, size + 65536);
+		len = fread(*data + size, 1, 65536, fp);
+		size += len;
+		if (len < 65536)
+			break;
+	}
+	fclose(fp);
+	return size;
+}
+
+enum { REWIND, FORWARD };
+
+/*
+ * write first frames, then rewind or forward over back frames and write
+ * the rest; the reference run writes the final frames straight away
+ */
+static size_t run(const char *converter, const unsigned int *rate, int mode,
+		  snd_pcm_uframes_t first, snd_pcm_uframes_t back,
+		  snd_pcm_uframes_t last, int ref, unsigned char **data)
+{
+	char path[] = "/tmp/alsa-lsb-rate-XXXXXX";
+	snd_pcm_uframes_t total = first + last;
+	snd_pcm_uframes_t keep = mode == REWIND ? first - back : first;
+	snd_pcm_sframes_t avail;
+	int16_t *a, *b, *silence;
+	snd_pcm_t *pcm;
+	size_t size = 0;
+	int fd;
+
+	*data = NULL;
+	/* a: the frames written first, b: the final frames */
+	a = malloc(total * CHANNELS * 2);
+	b = malloc(total * CHANNELS * 2);
+	fill(a, total, 1);
+	silence = calloc(PERIOD, CHANNELS * 2);
+	fill(b, total, 7);
+	memcpy(b, a, keep * CHANNELS * 2);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		goto _free;
+	}
+	close(fd);
+	if (ALSA_CHECK(open_rate(&pcm, converter, rate[1], path)) < 0)
+		goto _unlink;
+	if (ALSA_CHECK(setup(pcm, rate[0])) < 0)
+		goto _close;
+	if (ref) {
+		put_mmap(pcm, b, total);
+	} else if (mode == REWIND) {
+		put_mmap(pcm, a, first);
+		avail = snd_pcm_avail_update(pcm);
+		TEST_CHECK(snd_pcm_rewindable(pcm) >= (snd_pcm_sframes_t)back);
+		TEST_CHECK(snd_pcm_rewind(pcm, back) == (snd_pcm_sframes_t)back);
+		TEST_CHECK(snd_pcm_avail_update(pcm) == avail + (snd_pcm_sframes_t)back);
+		put_mmap(pcm, b + keep * CHANNELS, total - keep);
+	} else {
+		put_mmap(pcm, a, first);
+		put_uncommitted(pcm, b + first * CHANNELS, back);
+		avail = snd_pcm_avail_update(pcm);
+		TEST_CHECK(snd_pcm_forwardable(pcm) >= (snd_pcm_sframes_t)back);
+		TEST_CHECK(snd_pcm_forward(pcm, back) == (snd_pcm_sframes_t)back);
+		TEST_CHECK(snd_pcm_avail_update(pcm) == avail - (snd_pcm_sframes_t)back);
+		put_mmap(pcm, b + (first + back) * CHANNELS, last - back);
+	}
+	/* drain converts a whole period, do not let it see stale frames */
+	put_uncommitted(pcm, silence, PERIOD);
+	snd_pcm_drain(pcm);
+ _close:
+	snd_pcm_close(pcm);
+	size = read_file(path, data);
+ _unlink:
+	unlink(path);
+ _free:
+	free(a);
+	free(b);
+	free(silence);
+	return size;
+}
+
+static void test_rate(const char *converter, const unsigned int *rate,
+		      int mode, snd_pcm_uframes_t first, snd_pcm_uframes_t back,
+		      snd_pcm_uframes_t last)
+{
+	unsigned char *out, *ref;
+	size_t len, ref_len;
+	int failed = any_test_failed;
+
+	any_test_failed = 0;
+	len = run(converter, rate, mode, first, back, last, 0, &out);
+	ref_len = run(converter, rate, mode, first, back, last, 1, &ref);
+	TEST_CHECK(ref_len > 0);
+	TEST_CHECK(len == ref_len && memcmp(out, ref, len) == 0);
+	if (any_test_failed)
+		fprintf(stderr, "  %s %u -> %u, %s %lu of %lu\n", converter,
+			rate[0], rate[1], mode == REWIND ? "rewind" : "forward",
+			back, first);
+	any_test_failed |= failed;
+	free(out);
+	free(ref);
+}
+
+int main(void)
+{
+	unsigned int c, r;
+
+	for (c = 0; c < sizeof(converters) / sizeof(converters[0]); c++)
+		for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+			/* within the pending fraction */
+			test_rate(converters[c], rates[r], REWIND, 3 * PERIOD + 100, 50, PERIOD);
+			/* over the fraction and committed periods */
+			test_rate(converters[c], rates[r], REWIND, 5 * PERIOD + 100, 3 * PERIOD + 17, PERIOD);
+			/* exactly to a period boundary */
+			test_rate(converters[c], rates[r], REWIND, 4 * PERIOD, 2 * PERIOD, PERIOD);
+			/* forward within and over period boundaries */
+			test_rate(converters[c], rates[r], FORWARD, 2 * PERIOD + 100, 40, PERIOD);
+			test_rate(converters[c], rates[r], FORWARD, 2 * PERIOD + 100, 2 * PERIOD + 5, 3 * PERIOD);
+		}
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,174 @@
+/*
+ * Checks the adaptive mode of the rate plugin.
+ *
+ * The null plugin below consumes everything at once, so the fill level
+ * stays far below the target and the controller keeps trimming the
+ * ratio.  While it does, avail and delay must add up to the buffer
+ * size after every write, and the slave must get more frames than with
+ * the fixed ratio, but not more than max_ppm allows.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "test.h"
+
+#define CHANNELS	2
+#define PERIOD		256
+#define PERIODS		8
+#define MAX_PPM		5000
+#define FRAMES		(400 * PERIOD)
+
+static const char *const converters[] = {
+	"linear", "builtin-sinc-fast",
+};
+
+static const unsigned int rates[][2] = {
+	{ 44100, 48000 },
+	{ 48000, 44100 },
+};
+
+static int open_rate(snd_pcm_t **pcm, const char *converter, int adaptive,
+		     unsigned int srate, const char *path)
+{
+	char conf[512], adapt[64];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	if (adaptive)
+		snprintf(adapt, sizeof(adapt), "{ kp 0.0001 max_ppm %d }", MAX_PPM);
+	else
+		strcpy(adapt, "false");
+	snprintf(conf, sizeof(conf),
+		 "pcm.test { type rate converter \"%s\" adaptive %s "
+		 "slave { rate %u format S16 pcm { type file "
+		 "slave.pcm { type null } file \"%s\" format raw } } }",
+		 converter, adapt, srate, path);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static int setup(snd_pcm_t *pcm, unsigned int rate,
+		 snd_pcm_uframes_t *buffer_size)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_uframes_t size;
+	int err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	err = snd_pcm_hw_params_any(pcm, hw);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_channels(pcm, hw, CHANNELS);
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_rate(pcm, hw, rate, 0);
+	size = PERIOD;
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &size, 0);
+	size = PERIOD * PERIODS;
+	if (err >= 0)
+		err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &size);
+	if (err >= 0)
+		err = snd_pcm_hw_params(pcm, hw);
+	*buffer_size = size;
+	return err;
+}
+
+/* returns the frames the slave got */
+static long run(const char *converter, const unsigned int *rate, int adaptive)
+{
+	char path[] = "/tmp/alsa-lsb-rate-XXXXXX";
+	int16_t buf[(PERIOD + 53) * CHANNELS];
+	snd_pcm_uframes_t buffer_size, written = 0, n;
+	snd_pcm_sframes_t avail, delay, err;
+	snd_pcm_t *pcm;
+	unsigned int seed = 1;
+	long frames = 0;
+	FILE *fp;
+	int fd;
+
+	memset(buf, 0, sizeof(buf));
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		any_test_failed = 1;
+		return 0;
+	}
+	close(fd);
+	if (ALSA_CHECK(open_rate(&pcm, converter, adaptive, rate[1], path)) < 0)
+		goto _unlink;
+	if (ALSA_CHECK(setup(pcm, rate[0], &buffer_size)) < 0)
+		goto _close;
+	while (written < FRAMES) {
+		/* odd chunk sizes, so that the commits fall anywhere */
+		seed = seed * 1103515245 + 12345;
+		n = 1 + (seed >> 16) % (PERIOD + 53);
+		err = snd_pcm_writei(pcm, buf, n);
+		if (ALSA_CHECK(err) < 0)
+			break;
+		written += err;
+		avail = snd_pcm_avail(pcm);
+		TEST_CHECK(snd_pcm_delay(pcm, &delay) == 0);
+		TEST_CHECK(avail >= 0 && (snd_pcm_uframes_t)avail <= buffer_size);
+		TEST_CHECK(delay >= 0 && delay < PERIOD);
+		TEST_CHECK(avail + delay == (snd_pcm_sframes_t)buffer_size);
+		if (any_test_failed)
+			break;
+	}
+	snd_pcm_drain(pcm);
+ _close:
+	snd_pcm_close(pcm);
+	fp = fopen(path, "rb");
+	TEST_CHECK(fp != NULL);
+	if (fp) {
+		fseek(fp, 0, SEEK_END);
+		frames = ftell(fp) / (CHANNELS * 2);
+		fclose(fp);
+	}
+ _unlink:
+	unlink(path);
+	return frames;
+}
+
+static void test_adaptive(const char *converter, const unsigned int *rate)
+{
+	int failed = any_test_failed;
+	long fixed, trimmed;
+
+	any_test_failed = 0;
+	fixed = run(converter, rate, 0);
+	trimmed = run(converter, rate, 1);
+	TEST_CHECK(fixed > 0);
+	/* the ratio is trimmed in whole frames per period */
+	TEST_CHECK(trimmed - fixed > fixed * (MAX_PPM * 0.5e-6));
+	TEST_CHECK(trimmed - fixed < fixed * (MAX_PPM * 1e-6) + PERIOD);
+	if (any_test_failed)
+		fprintf(stderr, "  %s %u -> %u: %ld frames, %ld trimmed\n",
+			converter, rate[0], rate[1], fixed, trimmed);
+	any_test_failed |= failed;
+}
+
+int main(void)
+{
+	unsigned int c, r;
+
+	for (c = 0; c < sizeof(converters) / sizeof(converters[0]); c++)
+		for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+			test_adaptive(converters[c], rates[r]);
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,259 @@
+/*
+ * Checks the vector mixing kernels of the route plugin against the
+ * generic code.
+ *
+ * Every case is run twice: once in a child process with LIBASOUND_SIMD=0,
+ * which selects the C kernels, and once with the kernels the CPU supports.
+ * The routed data is taken from a file plugin below the route plugin and
+ * must be identical.  The cases cover copies, permutations, downmixes,
+ * upmixes and dense matrices with gains below and above unity, for
+ * integer and float formats and both access types.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include "test.h"
+
+#define FRAMES		1031
+
+static const snd_pcm_format_t formats[][2] = {
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S32_LE },
+	{ SND_PCM_FORMAT_S24_LE, SND_PCM_FORMAT_S24_LE },
+	{ SND_PCM_FORMAT_S24_3LE, SND_PCM_FORMAT_S24_3LE },
+	{ SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_FLOAT_LE },
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S32_LE },
+	{ SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE },
+	{ SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_FLOAT_LE },
+	{ SND_PCM_FORMAT_FLOAT_LE, SND_PCM_FORMAT_S32_LE },
+};
+
+static const struct {
+	unsigned int channels, schannels;
+	const char *ttable;
+} tables[] = {
+	/* identity */
+	{ 4, 4, "0.0 1 1.1 1 2.2 1 3.3 1" },
+	/* permutation with a silent channel */
+	{ 4, 5, "0.2 1 1.0 1 2.4 1 3.1 1" },
+	/* 5.1 downmix */
+	{ 6, 2, "0.0 1 1.1 1 2.0 0.707 2.1 0.707 3.0 0.5 3.1 0.5 "
+		"4.0 0.707 5.1 0.707" },
+	/* upmix with gains above unity, which saturate */
+	{ 2, 6, "0.0 1 1.1 1 0.2 1.5 1.2 1.5 0.3 0.25 1.3 0.25 "
+		"0.4 2.0 1.5 0.9" },
+	/* dense matrix */
+	{ 8, 8, NULL },
+};
+
+static void dense_ttable(char *buf, size_t size, unsigned int channels)
+{
+	unsigned int s, d;
+	size_t len = 0;
+
+	buf[0] = 0;
+	for (s = 0; s < channels; s++)
+		for (d = 0; d < channels; d++)
+			len += snprintf(buf + len, size - len, "%u.%u %g ", s, d,
+					((s * 7 + d * 3) % 11) / 8.0);
+}
+
+static int open_route(snd_pcm_t **pcm, snd_pcm_format_t format,
+		      unsigned int schannels, const char *ttable,
+		      const char *path)
+{
+	char conf[2048];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf, sizeof(conf),
+		 "pcm.test { type route ttable { %s } slave { format %s "
+		 "channels %u pcm { type file slave.pcm { type null } "
+		 "file \"%s\" format raw } } }",
+		 ttable, snd_pcm_format_name(format), schannels, path);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+/* full scale samples, valid for every format */
+static void fill(unsigned char *buf, snd_pcm_format_t format, size_t samples)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	uint32_t seed = 1;
+	size_t i;
+
+	for (i = 0; i < samples; i++, buf += bytes) {
+		int32_t v;
+
+		seed = seed * 1103515245 + 12345;
+		v = (int32_t)(seed ^ (seed << 15));
+		switch (format) {
+		case SND_PCM_FORMAT_S16_LE:
+			*(int16_t *)buf = v >> 16;
+			break;
+		case SND_PCM_FORMAT_S24_LE:
+			*(int32_t *)buf = v >> 8;
+			break;
+		case SND_PCM_FORMAT_S24_3LE:
+			buf[0] = v >> 8;
+			buf[1] = v >> 16;
+			buf[2] = v >> 24;
+			break;
+		case SND_PCM_FORMAT_FLOAT_LE:
+			*(float *)buf = v / 2147483648.0f;
+			break;
+		default:
+			*(int32_t *)buf = v;
+			break;
+		}
+	}
+}
+
+static void run_case(unsigned int f, unsigned int t, snd_pcm_access_t access,
+		     const char *path)
+{
+	snd_pcm_format_t src = formats[f][0], dst = formats[f][1];
+	unsigned int channels = tables[t].channels;
+	unsigned int sbytes = snd_pcm_format_physical_width(src) / 8;
+	size_t ssize = (size_t)FRAMES * channels * sbytes;
+	char ttable[1024];
+	void *bufs[8];
+	unsigned char *sbuf;
+	snd_pcm_t *pcm;
+	unsigned int c;
+
+	if (tables[t].ttable)
+		strcpy(ttable, tables[t].ttable);
+	else
+		dense_ttable(ttable, sizeof(ttable), channels);
+	sbuf = malloc(ssize);
+	fill(sbuf, src, (size_t)FRAMES * channels);
+	if (ALSA_CHECK(open_route(&pcm, dst, tables[t].schannels, ttable, path)) < 0)
+		goto _free;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, src, access, channels,
+					  48000, 0, 100000)) < 0)
+		goto _close;
+	if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+		TEST_CHECK(snd_pcm_writei(pcm, sbuf, FRAMES) == FRAMES);
+	} else {
+		for (c = 0; c < channels; c++)
+			bufs[c] = sbuf + (size_t)c * FRAMES * sbytes;
+		TEST_CHECK(snd_pcm_writen(pcm, bufs, FRAMES) == FRAMES);
+	}
+	snd_pcm_drain(pcm);
+ _close:
+	snd_pcm_close(pcm);
+ _free:
+	free(sbuf);
+}
+
+#define NFORMATS	(sizeof(formats) / sizeof(formats[0]))
+#define NTABLES		(sizeof(tables) / sizeof(tables[0]))
+#define NCASES		(NFORMATS * NTABLES * 2)
+
+static void case_path(char *path, size_t size, const char *dir,
+		      const char *kind, unsigned int n)
+{
+	snprintf(path, size, "%s/%s-%u", dir, kind, n);
+}
+
+static void run_all(const char *dir, const char *kind)
+{
+	char path[256];
+	unsigned int f, t, a, n = 0;
+
+	for (f = 0; f < NFORMATS; f++)
+		for (t = 0; t < NTABLES; t++)
+			for (a = 0; a < 2; a++, n++) {
+				case_path(path, sizeof(path), dir, kind, n);
+				run_case(f, t, a ? SND_PCM_ACCESS_RW_NONINTERLEAVED :
+					 SND_PCM_ACCESS_RW_INTERLEAVED, path);
+			}
+}
+
+static size_t read_file(const char *path, unsigned char **data)
+{
+	size_t size = 0, len;
+	FILE *fp;
+
+	*data = NULL;
+	fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+	for (;;) {
+		*data = realloc(*data, size + 65536);
+		len = fread(*data + size, 1, 65536, fp);
+		size += len;
+		if (len < 65536)
+			break;
+	}
+	fclose(fp);
+	return size;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/alsa-lsb-route-XXXXXX";
+	char path[256];
+	unsigned char *simd, *generic;
+	size_t len, generic_len;
+	unsigned int n;
+	int status, failed;
+	pid_t pid;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	/* the kernels are picked once per process */
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (pid == 0) {
+		setenv("LIBASOUND_SIMD", "0", 1);
+		run_all(dir, "generic");
+		_exit(TEST_EXIT_CODE());
+	}
+	TEST_CHECK(waitpid(pid, &status, 0) == pid);
+	TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	run_all(dir, "simd");
+
+	for (n = 0; n < NCASES; n++) {
+		failed = any_test_failed;
+		any_test_failed = 0;
+		case_path(path, sizeof(path), dir, "generic", n);
+		generic_len = read_file(path, &generic);
+		unlink(path);
+		case_path(path, sizeof(path), dir, "simd", n);
+		len = read_file(path, &simd);
+		unlink(path);
+		TEST_CHECK(generic_len > 0);
+		TEST_CHECK(len == generic_len && memcmp(simd, generic, len) == 0);
+		if (any_test_failed)
+			fprintf(stderr, "  %s -> %s, table %u, %sinterleaved\n",
+				snd_pcm_format_name(formats[n / (NTABLES * 2)][0]),
+				snd_pcm_format_name(formats[n / (NTABLES * 2)][1]),
+				(unsigned int)((n / 2) % NTABLES), n % 2 ? "non-" : "");
+		any_test_failed |= failed;
+		free(simd);
+		free(generic);
+	}
+	rmdir(dir);
+	return TEST_EXIT_CODE();
+}
@@ -0,0 +1,289 @@
+/*
+ * Checks the vector volume kernels of the softvol plugin against the
+ * generic code.
+ *
+ * Every case is run twice: once in a child process with LIBASOUND_SIMD=0,
+ * which selects the C kernels, and once with the kernels the CPU supports.
+ * The data is taken from a file plugin below the softvol plugin and must
+ * be identical.  The volume is changed in the middle of each stream, so
+ * both the steps (silence, unity, attenuation and gains above unity) and
+ * the per-sample gain ramps are covered.
+ *
+ * The volume control is a user element on the first card; without a
+ * card the test is skipped.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/wait.h>
+#include "test.h"
+
+#define FRAMES		1031
+#define CONTROL		"LSB Softvol Test Volume"
+
+static const snd_pcm_format_t formats[] = {
+	SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_BE,
+	SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S32_BE,
+	SND_PCM_FORMAT_S24_LE, SND_PCM_FORMAT_S24_3LE,
+	SND_PCM_FORMAT_FLOAT_LE,
+};
+
+static const struct {
+	unsigned int channels, count;
+	const char *max_dB;
+	unsigned int ramp_frames;
+	const char *ramp_type;
+} setups[] = {
+	{ 2, 2, "0.0", 0, "linear" },
+	{ 6, 2, "0.0", 0, "linear" },
+	{ 2, 2, "6.0", 0, "linear" },
+	{ 2, 2, "0.0", 300, "linear" },
+	{ 6, 1, "6.0", 700, "exponential" },
+};
+
+/* the control values before and after the change, left and right */
+static const long volumes[][4] = {
+	{ 255, 255, 0, 0 },
+	{ 0, 255, 255, 128 },
+	{ 128, 37, 200, 255 },
+	{ 1, 254, 60, 61 },
+};
+
+#define NFORMATS	(sizeof(formats) / sizeof(formats[0]))
+#define NSETUPS		(sizeof(setups) / sizeof(setups[0]))
+#define NVOLUMES	(sizeof(volumes) / sizeof(volumes[0]))
+#define NCASES		(NFORMATS * NSETUPS * NVOLUMES * 2)
+
+static int card;
+
+static int open_softvol(snd_pcm_t **pcm, unsigned int s, const char *path)
+{
+	char conf[1024];
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	snprintf(conf, sizeof(conf),
+		 "pcm.test { type softvol control { name \"%s\" card %d "
+		 "count %u } max_dB %s ramp_frames %u ramp_type %s "
+		 "slave.pcm { type file slave.pcm { type null } "
+		 "file \"%s\" format raw } }",
+		 CONTROL, card, setups[s].count, setups[s].max_dB,
+		 setups[s].ramp_frames, setups[s].ramp_type, path);
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, conf, strlen(conf));
+	if (err >= 0) {
+		err = snd_config_load(top, input);
+		snd_input_close(input);
+	}
+	if (err >= 0)
+		err = snd_pcm_open_lconf(pcm, "test", SND_PCM_STREAM_PLAYBACK, 0, top);
+	snd_config_delete(top);
+	return err;
+}
+
+static int set_volume(snd_ctl_t *ctl, const long *vol, unsigned int count)
+{
+	snd_ctl_elem_value_t *val;
+	unsigned int i;
+
+	snd_ctl_elem_value_alloca(&val);
+	snd_ctl_elem_value_set_interface(val, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_value_set_name(val, CONTROL);
+	for (i = 0; i < count; i++)
+		snd_ctl_elem_value_set_integer(val, i, vol[i]);
+	return snd_ctl_elem_write(ctl, val);
+}
+
+/* full scale samples, valid for every format */
+static void fill(unsigned char *buf, snd_pcm_format_t format, size_t samples)
+{
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	int big = snd_pcm_format_big_endian(format) > 0;
+	uint32_t seed = 1;
+	size_t i;
+
+	for (i = 0; i < samples; i++, buf += bytes) {
+		int32_t v;
+		float f;
+		unsigned int b;
+
+		seed = seed * 1103515245 + 12345;
+		v = (int32_t)(seed ^ (seed << 15));
+		if (format == SND_PCM_FORMAT_FLOAT_LE) {
+			f = v / 2147483648.0f;
+			memcpy(buf, &f, sizeof(f));
+			continue;
+		}
+		/* right-justified in the sample width */
+		v >>= 32 - snd_pcm_format_width(format);
+		for (b = 0; b < bytes; b++)
+			buf[big ? bytes - 1 - b : b] = (uint32_t)v >> (8 * b);
+	}
+}
+
+static void run_case(snd_ctl_t *ctl, unsigned int f, unsigned int s,
+		     unsigned int v, snd_pcm_access_t access, const char *path)
+{
+	snd_pcm_format_t format = formats[f];
+	unsigned int channels = setups[s].channels;
+	unsigned int bytes = snd_pcm_format_physical_width(format) / 8;
+	size_t size = (size_t)FRAMES * channels * bytes;
+	void *bufs[8];
+	unsigned char *buf;
+	snd_pcm_t *pcm;
+	unsigned int c, half;
+
+	buf = malloc(2 * size);
+	fill(buf, format, (size_t)2 * FRAMES * channels);
+	if (ALSA_CHECK(open_softvol(&pcm, s, path)) < 0)
+		goto _free;
+	if (ALSA_CHECK(snd_pcm_set_params(pcm, format, access, channels,
+					  48000, 0, 100000)) < 0)
+		goto _close;
+	for (half = 0; half < 2; half++) {
+		unsigned char *p = buf + half * size;
+
+		if (ALSA_CHECK(set_volume(ctl, volumes[v] + 2 * half,
+					  setups[s].count)) < 0)
+			break;
+		if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+			TEST_CHECK(snd_pcm_writei(pcm, p, FRAMES) == FRAMES);
+		} else {
+			for (c = 0; c < channels; c++)
+				bufs[c] = p + (size_t)c * FRAMES * bytes;
+			TEST_CHECK(snd_pcm_writen(pcm, bufs, FRAMES) == FRAMES);
+		}
+	}
+	snd_pcm_drain(pcm);
+ _close:
+	snd_pcm_close(pcm);
+ _free:
+	free(buf);
+}
+
+static void case_path(char *path, size_t size, const char *dir,
+		      const char *kind, unsigned int n)
+{
+	snprintf(path, size, "%s/%s-%u", dir, kind, n);
+}
+
+static void run_all(const char *dir, const char *kind)
+{
+	char path[256], name[16];
+	unsigned int f, s, v, a, n = 0;
+	snd_ctl_t *ctl;
+
+	sprintf(name, "hw:%d", card);
+	if (ALSA_CHECK(snd_ctl_open(&ctl, name, 0)) < 0)
+		return;
+	for (f = 0; f < NFORMATS; f++)
+		for (s = 0; s < NSETUPS; s++)
+			for (v = 0; v < NVOLUMES; v++)
+				for (a = 0; a < 2; a++, n++) {
+					case_path(path, sizeof(path), dir, kind, n);
+					run_case(ctl, f, s, v, a ?
+						 SND_PCM_ACCESS_RW_NONINTERLEAVED :
+						 SND_PCM_ACCESS_RW_INTERLEAVED, path);
+				}
+	snd_ctl_close(ctl);
+}
+
+static void remove_control(void)
+{
+	snd_ctl_elem_id_t *id;
+	char name[16];
+	snd_ctl_t *ctl;
+
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, CONTROL);
+	sprintf(name, "hw:%d", card);
+	if (snd_ctl_open(&ctl, name, 0) < 0)
+		return;
+	snd_ctl_elem_remove(ctl, id);
+	snd_ctl_close(ctl);
+}
+
+static size_t read_file(const char *path, unsigned char **data)
+{
+	size_t size = 0, len;
+	FILE *fp;
+
+	*data = NULL;
+	fp = fopen(path, "rb");
+	if (!fp)
+		return 0;
+	for (;;) {
+		*data = realloc(*data, size + 65536);
+		len = fread(*data + size, 1, 65536, fp);
+		size += len;
+		if (len < 65536)
+			break;
+	}
+	fclose(fp);
+	return size;
+}
+
+int main(void)
+{
+	char dir[] = "/tmp/alsa-lsb-softvol-XXXXXX";
+	char path[256];
+	unsigned char *simd, *generic;
+	size_t len, generic_len;
+	unsigned int n;
+	int status, failed;
+	pid_t pid;
+
+	card = -1;
+	if (snd_card_next(&card) < 0 || card < 0) {
+		fprintf(stderr, "no sound card for the volume control, skipped\n");
+		return 77;
+	}
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	/* the kernels are picked once per process */
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (pid == 0) {
+		setenv("LIBASOUND_SIMD", "0", 1);
+		run_all(dir, "generic");
+		_exit(TEST_EXIT_CODE());
+	}
+	TEST_CHECK(waitpid(pid, &status, 0) == pid);
+	TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	run_all(dir, "simd");
+	remove_control();
+
+	for (n = 0; n < NCASES; n++) {
+		failed = any_test_failed;
+		any_test_failed = 0;
+		case_path(path, sizeof(path), dir, "generic", n);
+		generic_len = read_file(path, &generic);
+		unlink(path);
+		case_path(path, sizeof(path), dir, "simd", n);
+		len = read_file(path, &simd);
+		unlink(path);
+		TEST_CHECK(generic_len > 0);
+		TEST_CHECK(len == generic_len && memcmp(simd, generic, len) == 0);
+		if (any_test_failed)
+			fprintf(stderr, "  %s, setup %u, volumes %u, %sinterleaved\n",
+				snd_pcm_format_name(formats[n / (NSETUPS * NVOLUMES * 2)]),
+				(unsigned int)((n / (NVOLUMES * 2)) % NSETUPS),
+				(unsigned int)((n / 2) % NVOLUMES), n % 2 ? "non-" : "");
+		any_test_failed |= failed;
+		free(simd);
+		free(generic);
+	}
+	rmdir(dir);
+	return TEST_EXIT_CODE();
+}
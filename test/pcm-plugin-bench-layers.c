@@ -0,0 +1,48 @@
+/*
+ * layer count of a PCM chain for pcm-plugin-bench
+ *
+ * This walks the chain through the private data of the plugins, so it
+ * needs the internal PCM header, which does not mix with the public
+ * hw_params prototypes used by the benchmark itself.
+ */
+
+#include "../src/pcm/pcm_local.h"
+#include "../src/pcm/pcm_generic.h"
+
+int bench_count_layers(snd_pcm_t *pcm);
+
+/*
+ * count plugin layers above the terminal PCM; all plugins with a single
+ * slave keep it in a snd_pcm_generic_t at the start of their private data
+ */
+int bench_count_layers(snd_pcm_t *pcm)
+{
+	int layers = 0;
+
+	for (;;) {
+		switch (pcm->type) {
+		case SND_PCM_TYPE_HOOKS:
+		case SND_PCM_TYPE_FILE:
+		case SND_PCM_TYPE_COPY:
+		case SND_PCM_TYPE_LINEAR:
+		case SND_PCM_TYPE_ALAW:
+		case SND_PCM_TYPE_MULAW:
+		case SND_PCM_TYPE_ADPCM:
+		case SND_PCM_TYPE_RATE:
+		case SND_PCM_TYPE_ROUTE:
+		case SND_PCM_TYPE_PLUG:
+		case SND_PCM_TYPE_METER:
+		case SND_PCM_TYPE_LINEAR_FLOAT:
+		case SND_PCM_TYPE_LADSPA:
+		case SND_PCM_TYPE_IEC958:
+		case SND_PCM_TYPE_SOFTVOL:
+		case SND_PCM_TYPE_EXTPLUG:
+		case SND_PCM_TYPE_MMAP_EMUL:
+			break;
+		default:
+			return layers;
+		}
+		layers++;
+		pcm = ((snd_pcm_generic_t *)pcm->private_data)->slave;
+	}
+}
@@ -0,0 +1,504 @@
+/*
+ * throughput benchmark for PCM plugin chains
+ *
+ * Each chain is described by an inline configuration string which ends
+ * in a null (or file to /dev/null) PCM, so no sound card is required.
+ * The chain is opened for every combination of the format/rate/channels
+ * matrix and fed via snd_pcm_writei() or snd_pcm_mmap_begin() +
+ * snd_pcm_mmap_commit() as fast as possible.
+ *
+ * The results are printed as CSV to stdout:
+ *
+ *   chain,access,format,rate,channels,layers,frames,seconds,
+ *   frames_per_sec,ns_per_frame,ns_per_frame_per_plugin,peak_rss_kb
+ *
+ * ns_per_frame_per_plugin is the cost above the bare null PCM with the
+ * same parameters, divided by the number of plugin layers above the
+ * terminal PCM, which are counted by walking the slaves of the opened
+ * chain.
+ *
+ * Every run takes place in a child process of its own, so peak_rss_kb is
+ * the peak resident set of a process which opened only that chain and
+ * setup (it includes the few pages of this program at fork time).
+ *
+ * Combinations which a chain cannot handle (e.g. a float client on the
+ * linear plugin, or softvol without a sound card) are reported on stderr
+ * and skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../include/asoundlib.h"
+
+/* pcm-plugin-bench-layers.c */
+int bench_count_layers(snd_pcm_t *pcm);
+
+#define MAX_ITEMS	32
+
+struct bench_chain {
+	const char *name;
+	const char *conf;
+};
+
+/* the PCM to open must be always called "bench" */
+static const struct bench_chain preset_chains[] = {
+	{ "null",
+	  "pcm.bench { type null }" },
+	{ "file",
+	  "pcm.bench { type file slave.pcm { type null } file \"/dev/null\" format raw }" },
+	{ "plug",
+	  "pcm.bench { type plug slave { pcm { type null } format S32_LE rate 48000 channels 2 } }" },
+	{ "linear",
+	  "pcm.bench { type linear slave { pcm { type null } format S32_LE } }" },
+	{ "lfloat",
+	  "pcm.bench { type lfloat slave { pcm { type null } format FLOAT_LE } }" },
+	{ "rate",
+	  "pcm.bench { type rate slave { pcm { type null } rate 48000 } }" },
+	{ "route",
+	  "pcm.bench { type route slave { pcm { type null } channels 2 } "
+	  "ttable { 0.0 0.5 1.1 0.5 2.0 0.5 3.1 0.5 4.0 0.5 5.1 0.5 6.0 0.5 7.1 0.5 } }" },
+	{ "softvol",
+	  "pcm.bench { type softvol slave.pcm { type null } control { name \"Bench Playback Volume\" card 0 } }" },
+	{ "ladspa",
+	  "pcm.bench { type ladspa slave.pcm { type null } path \"/usr/lib/ladspa\" "
+	  "plugins [ { label delay_5s input.controls [ 0.5 0.5 ] } ] }" },
+	{ "plug-rate-route",
+	  "pcm.bench { type plug slave { pcm { type route slave { pcm { type rate slave { pcm { type null } rate 48000 } } channels 2 } "
+	  "ttable { 0.0 1 1.1 1 } } format S16_LE channels 2 } }" },
+};
+
+static const snd_pcm_format_t default_formats[] = {
+	SND_PCM_FORMAT_S16_LE,
+	SND_PCM_FORMAT_S24_3LE,
+	SND_PCM_FORMAT_S32_LE,
+	SND_PCM_FORMAT_FLOAT_LE,
+};
+
+static const unsigned int default_rates[] = { 44100, 48000 };
+static const unsigned int default_channels[] = { 2, 8 };
+
+static struct bench_chain chains[MAX_ITEMS];
+static int num_chains;
+static snd_pcm_format_t formats[MAX_ITEMS];
+static int num_formats;
+static unsigned int rates[MAX_ITEMS];
+static int num_rates;
+static unsigned int channels[MAX_ITEMS];
+static int num_channels;
+
+static snd_pcm_uframes_t period_size = 1024;
+static unsigned int periods = 4;
+static double bench_seconds = 60.0;	/* amount of audio to push */
+static int use_mmap;
+static int verbose;
+
+/* null baseline (ns/frame) indexed by format/rate/channels */
+static double baseline[MAX_ITEMS][MAX_ITEMS][MAX_ITEMS];
+
+static double timespec_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* what a run in the child process reports back */
+struct bench_result {
+	int err;
+	int layers;
+	snd_pcm_uframes_t done;
+	double secs;
+};
+
+static int open_chain(snd_pcm_t **pcmp, const struct bench_chain *chain)
+{
+	snd_config_t *top;
+	snd_input_t *input;
+	int err;
+
+	err = snd_config_top(&top);
+	if (err < 0)
+		return err;
+	err = snd_input_buffer_open(&input, chain->conf, strlen(chain->conf));
+	if (err < 0)
+		goto out;
+	err = snd_config_load(top, input);
+	snd_input_close(input);
+	if (err < 0)
+		goto out;
+	err = snd_pcm_open_lconf(pcmp, "bench", SND_PCM_STREAM_PLAYBACK, 0, top);
+ out:
+	snd_config_delete(top);
+	return err;
+}
+
+static void dump_chain(snd_pcm_t *pcm)
+{
+	snd_output_t *out;
+
+	if (snd_output_stdio_attach(&out, stderr, 0) < 0)
+		return;
+	snd_pcm_dump(pcm, out);
+	snd_output_close(out);
+}
+
+static int setup_pcm(snd_pcm_t *pcm, snd_pcm_format_t format,
+		     unsigned int rate, unsigned int chs)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_uframes_t psize = period_size;
+	unsigned int nperiods = periods;
+	int err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_sw_params_alloca(&sw);
+	err = snd_pcm_hw_params_any(pcm, hw);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_access(pcm, hw, use_mmap ?
+					   SND_PCM_ACCESS_MMAP_INTERLEAVED :
+					   SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_format(pcm, hw, format);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_channels(pcm, hw, chs);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_rate(pcm, hw, rate, 0);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &psize, NULL);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params_set_periods_near(pcm, hw, &nperiods, NULL);
+	if (err < 0)
+		return err;
+	err = snd_pcm_hw_params(pcm, hw);
+	if (err < 0)
+		return err;
+	err = snd_pcm_sw_params_current(pcm, sw);
+	if (err < 0)
+		return err;
+	err = snd_pcm_sw_params_set_start_threshold(pcm, sw, 1);
+	if (err < 0)
+		return err;
+	return snd_pcm_sw_params(pcm, sw);
+}
+
+static snd_pcm_sframes_t push_rw(snd_pcm_t *pcm, void *buf,
+				 snd_pcm_uframes_t frames)
+{
+	snd_pcm_sframes_t err;
+
+	err = snd_pcm_writei(pcm, buf, frames);
+	if (err == -EPIPE)
+		err = snd_pcm_prepare(pcm);
+	return err;
+}
+
+static snd_pcm_sframes_t push_mmap(snd_pcm_t *pcm, const void *buf,
+				   snd_pcm_uframes_t frames,
+				   snd_pcm_format_t format, unsigned int chs)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_channel_area_t src[chs];
+	snd_pcm_uframes_t offset, size = frames;
+	snd_pcm_sframes_t avail, committed;
+	unsigned int ch, width;
+	int err;
+
+	avail = snd_pcm_avail_update(pcm);
+	if (avail < 0)
+		return snd_pcm_prepare(pcm);
+	err = snd_pcm_mmap_begin(pcm, &areas, &offset, &size);
+	if (err < 0)
+		return err;
+	width = snd_pcm_format_physical_width(format);
+	for (ch = 0; ch < chs; ch++) {
+		src[ch].addr = (void *)buf;
+		src[ch].first = ch * width;
+		src[ch].step = chs * width;
+	}
+	snd_pcm_areas_copy(areas, offset, src, 0, chs, size, format);
+	committed = snd_pcm_mmap_commit(pcm, offset, size);
+	if (committed < 0)
+		return committed;
+	if (snd_pcm_state(pcm) == SND_PCM_STATE_PREPARED) {
+		err = snd_pcm_start(pcm);
+		if (err < 0)
+			return err;
+	}
+	return committed;
+}
+
+/* open the chain and push the frames, in the child process */
+static void bench_one(const struct bench_chain *chain, int fi, int ri, int ci,
+		      struct bench_result *res)
+{
+	snd_pcm_format_t format = formats[fi];
+	unsigned int rate = rates[ri];
+	unsigned int chs = channels[ci];
+	snd_pcm_uframes_t total;
+	struct timespec start, end;
+	snd_pcm_t *pcm;
+	void *buf;
+	int err;
+
+	err = open_chain(&pcm, chain);
+	if (err < 0) {
+		fprintf(stderr, "%s: cannot open: %s\n", chain->name,
+			snd_strerror(err));
+		res->err = err;
+		return;
+	}
+	err = setup_pcm(pcm, format, rate, chs);
+	if (err < 0) {
+		fprintf(stderr, "%s: %s/%u/%u not supported: %s\n",
+			chain->name, snd_pcm_format_name(format), rate, chs,
+			snd_strerror(err));
+		snd_pcm_close(pcm);
+		res->err = err;
+		return;
+	}
+	res->layers = bench_count_layers(pcm);
+	if (verbose)
+		dump_chain(pcm);
+
+	buf = calloc(period_size, snd_pcm_frames_to_bytes(pcm, 1));
+	if (!buf) {
+		snd_pcm_close(pcm);
+		res->err = -ENOMEM;
+		return;
+	}
+	snd_pcm_format_set_silence(format, buf, period_size * chs);
+
+	total = (snd_pcm_uframes_t)(bench_seconds * rate);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (res->done < total) {
+		snd_pcm_sframes_t n;
+		if (use_mmap)
+			n = push_mmap(pcm, buf, period_size, format, chs);
+		else
+			n = push_rw(pcm, buf, period_size);
+		if (n < 0) {
+			fprintf(stderr, "%s: transfer error: %s\n",
+				chain->name, snd_strerror(n));
+			res->err = n;
+			break;
+		}
+		res->done += n;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	snd_pcm_drop(pcm);
+	snd_pcm_close(pcm);
+	free(buf);
+	res->secs = timespec_diff(&start, &end);
+}
+
+static int run_one(const struct bench_chain *chain, int fi, int ri, int ci)
+{
+	struct bench_result res;
+	struct rusage usage;
+	double nsf, nsp;
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return -errno;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -errno;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		memset(&res, 0, sizeof(res));
+		bench_one(chain, fi, ri, ci, &res);
+		if (write(fds[1], &res, sizeof(res)) != sizeof(res))
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	if (read(fds[0], &res, sizeof(res)) != sizeof(res)) {
+		memset(&res, 0, sizeof(res));
+		res.err = -EIO;
+	}
+	close(fds[0]);
+	if (wait4(pid, &status, 0, &usage) < 0) {
+		perror("wait4");
+		return -errno;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "%s: benchmark process failed\n", chain->name);
+		return -EIO;
+	}
+	if (res.err < 0)
+		return res.err;
+
+	nsf = res.done ? res.secs * 1e9 / res.done : 0;
+	if (!strcmp(chain->name, "null"))
+		baseline[fi][ri][ci] = nsf;
+	nsp = 0;
+	if (res.layers > 0)
+		nsp = (nsf - baseline[fi][ri][ci]) / res.layers;
+	printf("%s,%s,%s,%u,%u,%d,%lu,%.6f,%.0f,%.3f,%.3f,%ld\n",
+	       chain->name, use_mmap ? "mmap" : "rw",
+	       snd_pcm_format_name(formats[fi]), rates[ri], channels[ci],
+	       res.layers, (unsigned long)res.done, res.secs,
+	       res.secs > 0 ? res.done / res.secs : 0,
+	       nsf, nsp, usage.ru_maxrss);
+	fflush(stdout);
+	return 0;
+}
+
+static void usage(void)
+{
+	unsigned int i;
+
+	fprintf(stderr, "usage: pcm-plugin-bench [-options]\n");
+	fprintf(stderr, "  -n str  Run the named preset chain (can be repeated)\n");
+	fprintf(stderr, "  -C str  Add a custom chain \"name=config\", the config must define pcm.bench\n");
+	fprintf(stderr, "  -f str  Add a client format (can be repeated)\n");
+	fprintf(stderr, "  -r val  Add a client rate (can be repeated)\n");
+	fprintf(stderr, "  -c val  Add a client channel count (can be repeated)\n");
+	fprintf(stderr, "  -p val  Set period size (in frames)\n");
+	fprintf(stderr, "  -P val  Set number of periods\n");
+	fprintf(stderr, "  -s val  Seconds of audio to push per run\n");
+	fprintf(stderr, "  -m      Use mmap_begin/mmap_commit instead of writei\n");
+	fprintf(stderr, "  -v      Dump each chain to stderr\n");
+	fprintf(stderr, "presets:");
+	for (i = 0; i < sizeof(preset_chains) / sizeof(preset_chains[0]); i++)
+		fprintf(stderr, " %s", preset_chains[i].name);
+	fprintf(stderr, "\n");
+}
+
+static int add_preset(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(preset_chains) / sizeof(preset_chains[0]); i++) {
+		if (!strcmp(preset_chains[i].name, name)) {
+			chains[num_chains++] = preset_chains[i];
+			return 0;
+		}
+	}
+	fprintf(stderr, "unknown preset %s\n", name);
+	return -EINVAL;
+}
+
+static int add_custom(char *arg)
+{
+	char *p = strchr(arg, '=');
+
+	if (!p) {
+		fprintf(stderr, "invalid chain %s\n", arg);
+		return -EINVAL;
+	}
+	*p++ = 0;
+	chains[num_chains].name = arg;
+	chains[num_chains].conf = p;
+	num_chains++;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int c, fi, ri, ci, i;
+
+	while ((c = getopt(argc, argv, "n:C:f:r:c:p:P:s:mvh")) >= 0) {
+		/* one chain slot is kept for the null baseline */
+		if (num_chains >= MAX_ITEMS - 1 || num_formats >= MAX_ITEMS ||
+		    num_rates >= MAX_ITEMS || num_channels >= MAX_ITEMS) {
+			fprintf(stderr, "too many items\n");
+			return 1;
+		}
+		switch (c) {
+		case 'n':
+			if (add_preset(optarg) < 0)
+				return 1;
+			break;
+		case 'C':
+			if (add_custom(optarg) < 0)
+				return 1;
+			break;
+		case 'f':
+			formats[num_formats] = snd_pcm_format_value(optarg);
+			if (formats[num_formats] == SND_PCM_FORMAT_UNKNOWN) {
+				fprintf(stderr, "invalid format %s\n", optarg);
+				return 1;
+			}
+			num_formats++;
+			break;
+		case 'r':
+			rates[num_rates++] = atoi(optarg);
+			break;
+		case 'c':
+			channels[num_channels++] = atoi(optarg);
+			break;
+		case 'p':
+			period_size = atoi(optarg);
+			break;
+		case 'P':
+			periods = atoi(optarg);
+			break;
+		case 's':
+			bench_seconds = atof(optarg);
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (!num_chains) {
+		for (i = 0; i < (int)(sizeof(preset_chains) / sizeof(preset_chains[0])); i++)
+			chains[num_chains++] = preset_chains[i];
+	} else if (strcmp(chains[0].name, "null")) {
+		/* always measure the baseline first */
+		memmove(chains + 1, chains, num_chains * sizeof(chains[0]));
+		chains[0] = preset_chains[0];
+		num_chains++;
+	}
+	if (!num_formats) {
+		for (i = 0; i < (int)(sizeof(default_formats) / sizeof(default_formats[0])); i++)
+			formats[num_formats++] = default_formats[i];
+	}
+	if (!num_rates) {
+		for (i = 0; i < (int)(sizeof(default_rates) / sizeof(default_rates[0])); i++)
+			rates[num_rates++] = default_rates[i];
+	}
+	if (!num_channels) {
+		for (i = 0; i < (int)(sizeof(default_channels) / sizeof(default_channels[0])); i++)
+			channels[num_channels++] = default_channels[i];
+	}
+
+	printf("chain,access,format,rate,channels,layers,frames,seconds,"
+	       "frames_per_sec,ns_per_frame,ns_per_frame_per_plugin,peak_rss_kb\n");
+	for (i = 0; i < num_chains; i++)
+		for (fi = 0; fi < num_formats; fi++)
+			for (ri = 0; ri < num_rates; ri++)
+				for (ci = 0; ci < num_channels; ci++)
+					run_one(&chains[i], fi, ri, ci);
+	snd_config_update_free_global();
+	return 0;
+}